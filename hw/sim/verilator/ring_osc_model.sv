@@ -0,0 +1,36 @@
+`timescale 1ps/1ps
+// Behavioral stand-in for ring_osc.sv in Verilator co-simulation (needs --timing)
+//
+// The LUT chain has no simulation meaning (combinational loop), so each
+// oscillator becomes a toggling reg: half period = STAGES * STAGE_DELAY_PS
+// plus per-edge jitter from $urandom. Seeded from the C++ harness
+// (VerilatedContext::randSeed), so runs are reproducible.
+//
+// Same module name and ports as hw/src/ring_osc.sv - compile one or the other.
+
+module ring_osc #(
+    parameter STAGES = 13,                  // must be odd
+    parameter integer STAGE_DELAY_PS = 45,  // LUT + local route, roughly
+    parameter integer JITTER_PS = 30        // uniform 0..JITTER_PS per edge
+)(
+    input   wire enable,        // enable oscillation
+    output  reg  osc_out        // osc output
+);
+
+    initial begin
+        if (STAGES % 2 == 0) begin
+            $error("STAGES MUST BE ODD FOR A RING OSCILLATOR!!");
+        end
+        osc_out = 1'b0;
+    end
+
+    always begin
+        if (!enable) begin
+            osc_out = 1'b0;         // stage 0 LUT: out = enable & ~in
+            wait (enable);
+        end
+        #(STAGES * STAGE_DELAY_PS + $urandom_range(JITTER_PS, 0));
+        if (enable) osc_out = ~osc_out;
+    end
+
+endmodule
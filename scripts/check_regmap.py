@@ -0,0 +1,151 @@
+#!/usr/bin/env python3
+"""
+check_regmap.py
+
+Checks sw/drivers/hsm_regmap.h against the AXI-Lite wrappers it mirrors:
+every register offset and access (from the ADDR_* localparams and the
+write / read case statements) and every CTRL / STATUS bitfield (from the
+ctrl_* wires and the status assignments). Header entries name their RTL
+counterpart with a `// rtl: <name>` tag.
+
+Usage (from repo root or scripts/):
+    python scripts/check_regmap.py
+
+Exit status 1 on any mismatch, so it can gate a build.
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.abspath(os.path.join(os.path.dirname(__file__), ".."))
+HEADER = os.path.join(ROOT, "sw", "drivers", "hsm_regmap.h")
+
+# header namespace -> RTL wrapper
+MAPS = {
+    "AesMap":  os.path.join(ROOT, "hw", "src", "aes_axi_wrapper.sv"),
+    "TrngMap": os.path.join(ROOT, "hw", "src", "hsm_axi_wrapper.sv"),
+}
+
+# ============================================================
+# RTL side
+# ============================================================
+
+def sv_int(lit):
+    """Verilog literal (5'h04, 3'b010, 12) -> int."""
+    m = re.fullmatch(r"(?:\d+)?'([bBhHdD])([0-9a-fA-F_]+)", lit)
+    if not m:
+        return int(lit)
+    base = {"b": 2, "h": 16, "d": 10}[m.group(1).lower()]
+    return int(m.group(2).replace("_", ""), base)
+
+def case_targets(text, bus):
+    """ADDR_* labels inside the case statement on S_AXI_<bus>ADDR."""
+    m = re.search(r"case\s*\(\s*S_AXI_%sADDR[^)]*\)(.*?)endcase" % bus, text, re.S)
+    return set(re.findall(r"^\s*(ADDR_\w+)\s*:", m.group(1), re.M)) if m else set()
+
+def parse_rtl(path):
+    text = open(path).read()
+    regs = {}
+    for name, lit in re.findall(r"localparam\s+(ADDR_\w+)\s*=\s*([\w']+)\s*;", text):
+        regs[name] = sv_int(lit) * 4
+    written = case_targets(text, "AW")
+    read = case_targets(text, "AR")
+    access = {}
+    for name in regs:
+        w, r = name in written, name in read
+        access[name] = "RW" if w and r else "WO" if w else "RO" if r else "--"
+
+    fields = {}     # signal -> (reg, lsb, width)
+    for sig, bit in re.findall(r"wire\s+(ctrl_\w+)\s*=\s*slv_(?:reg_)?ctrl\[(\d+)\]", text):
+        fields[sig] = ("CTRL", int(bit), 1)
+    m = re.search(r"slv_status\s*=\s*\{\s*\d+'b0\s*,([^}]*)\}", text)
+    if m:
+        for lsb, sig in enumerate(reversed([s.strip() for s in m.group(1).split(",")])):
+            fields[sig] = ("STATUS", lsb, 1)
+    for msb, lsb, sig in re.findall(r"slv_reg_status\[(\d+)(?::(\d+))?\]\s*=\s*(\w+)", text):
+        lo = int(lsb) if lsb else int(msb)
+        fields[sig] = ("STATUS", lo, int(msb) - lo + 1)
+    return regs, access, fields
+
+# ============================================================
+# Header side
+# ============================================================
+
+REG_RE = re.compile(r"using\s+(\w+)\s*=\s*Reg<\s*(0x[0-9A-Fa-f]+)\s*(?:,\s*RegAccess::(\w+))?[^>]*>\s*;\s*//\s*rtl:\s*(\w+)")
+FIELD_RE = re.compile(r"using\s+(\w+)\s*=\s*Field<\s*(\w+)\s*,\s*(\d+)\s*(?:,\s*(\d+))?\s*>\s*;\s*//\s*rtl:\s*(\w+)")
+
+def parse_header(path):
+    maps = {name: {"regs": {}, "fields": {}} for name in MAPS}
+    current = None
+    for line in open(path):
+        m = re.match(r"\s*namespace\s+(\w+)\s*\{", line)
+        if m and m.group(1) in maps:
+            current = m.group(1)
+            continue
+        if line.startswith("}"):
+            current = None
+        if not current:
+            continue
+        m = REG_RE.search(line)
+        if m:
+            name, off, acc, tag = m.groups()
+            maps[current]["regs"][tag] = (name, int(off, 16), acc or "RW")
+            continue
+        m = FIELD_RE.search(line)
+        if m:
+            name, reg, lsb, width, tag = m.groups()
+            maps[current]["fields"][tag] = (name, reg, int(lsb), int(width or 1))
+    return maps
+
+# ============================================================
+# Compare
+# ============================================================
+
+def check():
+    header = parse_header(HEADER)
+    errors = 0
+
+    def fail(msg):
+        nonlocal errors
+        errors += 1
+        print("  ERROR: " + msg)
+
+    for ns, sv in MAPS.items():
+        regs, access, fields = parse_rtl(sv)
+        hdr = header[ns]
+        print(f"{ns} <-> {os.path.relpath(sv, ROOT)}: {len(regs)} registers, {len(fields)} fields")
+        if not regs:
+            fail(f"{ns}: no ADDR_* localparams found in {sv}")
+
+        for tag, off in regs.items():
+            if tag not in hdr["regs"]:
+                fail(f"{ns}: {tag} (0x{off:02X}) missing from hsm_regmap.h")
+                continue
+            name, hoff, hacc = hdr["regs"][tag]
+            if hoff != off:
+                fail(f"{ns}::{name}: offset 0x{hoff:02X}, RTL {tag} is 0x{off:02X}")
+            if hacc != access[tag]:
+                fail(f"{ns}::{name}: access {hacc}, RTL {tag} is {access[tag]}")
+        for tag, (name, _, _) in hdr["regs"].items():
+            if tag not in regs:
+                fail(f"{ns}::{name}: tagged {tag}, not a localparam in the RTL")
+
+        # fields whose registers the RTL assigns (CTRL / STATUS)
+        by_name = {name: tag for tag, (name, _, _) in hdr["regs"].items()}
+        for sig, (reg, lsb, width) in fields.items():
+            if sig not in hdr["fields"]:
+                fail(f"{ns}: {reg} bit {lsb} ({sig}) missing from hsm_regmap.h")
+                continue
+            name, hreg, hlsb, hwidth = hdr["fields"][sig]
+            if by_name.get(hreg) != "ADDR_" + reg or (hlsb, hwidth) != (lsb, width):
+                fail(f"{ns}::{name}: {hreg}[{hlsb}+:{hwidth}], RTL {sig} is {reg}[{lsb}+:{width}]")
+        for sig, (name, _, _, _) in hdr["fields"].items():
+            if sig not in fields:
+                fail(f"{ns}::{name}: tagged {sig}, not found in the RTL")
+
+    print("OK" if not errors else f"{errors} mismatch(es)")
+    return errors == 0
+
+if __name__ == "__main__":
+    sys.exit(0 if check() else 1)
@@ -12,11 +12,24 @@ Generates:
 
     vectors/aes_key_exp.hex  key schedule check --> W[8].. W[11] for vector 0
 
+   Optional, for the driver-side runner (sw/drivers/test_kat.cpp):
+   vectors/aes_kat_random.hex  --random N: N seeded random vectors, same 4-line
+                               format, KEYS distinct keys so runs share a key
+   vectors/ECBVarTxt256.rsp    --aesavs: AESAVS Variable Text / Variable Key KATs,
+   vectors/ECBVarKey256.rsp              NIST response file layout
+   vectors/ECBMCT256.rsp       --mct: AESAVS 6.4.1 Monte Carlo, 100 x 1000 chained
+                               encryptions (pure python, ~10 s)
+
+   The RTL testbench reads aes_kat.hex with a fixed vector count, so it is
+   always just the 3 vectors below.
+
     Ref: FIPS 197 (AES), Appdix A.3 (AES-256 key expansion),
          Appendix C.3 (AES encryption example)
 """
 
+import argparse
 import os
+import random
 import struct
 
 # GF (2^8) aritmetic
@@ -188,6 +201,71 @@ VECTORS = [
     }
 ]
 
+# Corpus generation (driver runner) =================================
+
+def write_hex_vectors(path, vectors):
+    with open(path, "w") as f:
+        for key, pt, ct in vectors:
+            f.write(key[:16].hex() + "\n")
+            f.write(key[16:].hex() + "\n")
+            f.write(pt.hex() + "\n")
+            f.write(ct.hex() + "\n")
+
+def gen_random(vec_dir, n, keys, seed):
+    rng = random.Random(seed)
+    key_list = [bytes(rng.getrandbits(8) for _ in range(32)) for _ in range(max(1, keys))]
+    out = []
+    for i in range(n):
+        key = key_list[rng.randrange(len(key_list))]
+        pt = bytes(rng.getrandbits(8) for _ in range(16))
+        out.append((key, pt, aes256_encrypt(key, pt)[0]))
+    path = os.path.join(vec_dir, "aes_kat_random.hex")
+    write_hex_vectors(path, out)
+    print(f"  Written: {path}  ({n} vectors, {len(key_list)} keys, seed {seed})")
+
+def write_rsp(path, title, records, section="ENCRYPT"):
+    """ NIST response file: header comments, [ENCRYPT], COUNT/KEY/PLAINTEXT/CIPHERTEXT """
+    with open(path, "w") as f:
+        f.write(f"# CAVS 11.1\n# Config info for aes_values\n# AESVS {title} test data for ECB\n"
+                f"# State : Encrypt and Decrypt\n# Key Length : 256\n# Generated by gen_aes_kat.py\n\n")
+        f.write(f"[{section}]\n\n")
+        for count, (key, pt, ct) in enumerate(records):
+            f.write(f"COUNT = {count}\nKEY = {key.hex()}\nPLAINTEXT = {pt.hex()}\nCIPHERTEXT = {ct.hex()}\n\n")
+    print(f"  Written: {path}  ({len(records)} records)")
+
+def leading_ones(i, nbytes):
+    """ i most significant bits set (AESAVS VarTxt / VarKey) """
+    return ((((1 << i) - 1) << (8 * nbytes - i))).to_bytes(nbytes, "big")
+
+def gen_aesavs(vec_dir):
+    key0 = bytes(32)
+    vartxt = [(key0, leading_ones(i, 16), aes256_encrypt(key0, leading_ones(i, 16))[0]) for i in range(1, 129)]
+    write_rsp(os.path.join(vec_dir, "ECBVarTxt256.rsp"), "VarTxt", vartxt)
+    pt0 = bytes(16)
+    varkey = [(leading_ones(i, 32), pt0, aes256_encrypt(leading_ones(i, 32), pt0)[0]) for i in range(1, 257)]
+    write_rsp(os.path.join(vec_dir, "ECBVarKey256.rsp"), "VarKey", varkey)
+
+def gen_mct(vec_dir, seed):
+    """ AESAVS 6.4.1, ECB encrypt, 256-bit: Key ^= CT[998] || CT[999] between outer rounds """
+    rng = random.Random(seed)
+    key = bytes(rng.getrandbits(8) for _ in range(32))
+    pt = bytes(rng.getrandbits(8) for _ in range(16))
+    records = []
+    for i in range(100):
+        W = key_expansion_256(key)
+        rks = [get_round_key(W, r) for r in range(15)]
+        prev, ct = None, pt
+        for j in range(1000):
+            prev = ct
+            state = add_round_key(list(ct), rks[0])
+            for rnd in range(1, 14):
+                state = add_round_key(mix_columns(shift_rows(sub_bytes(state))), rks[rnd])
+            ct = bytes(add_round_key(shift_rows(sub_bytes(state)), rks[14]))
+        records.append((key, pt, ct))
+        key = bytes(a ^ b for a, b in zip(key, prev + ct))
+        pt = ct
+    write_rsp(os.path.join(vec_dir, "ECBMCT256.rsp"), "MCT", records)
+
 # Validation and output =============================================
 
 def bytes_to_hex128(b):
@@ -196,7 +274,7 @@ def bytes_to_hex128(b):
 def word32_to_hex(w):
     return f"{w:08x}"
 
-def validate_and_generate():
+def validate_and_generate(args):
     script_dir = os.path.dirname(os.path.abspath(__file__))
     repo_root = (os.path.dirname(script_dir)
                 if os.path.basename(script_dir) == "scripts" else script_dir)
@@ -255,6 +333,13 @@ def validate_and_generate():
 
     print(f"  Written: {kexp_path}  (W[8]..W[11] for vector 0)")
 
+    if args.random:
+        gen_random(vec_dir, args.random, args.keys, args.seed)
+    if args.aesavs:
+        gen_aesavs(vec_dir)
+    if args.mct:
+        gen_mct(vec_dir, args.seed)
+
     # print key schedule values for ref
     print("")
     print("  Key schedule spot-check (vector 0):")
@@ -265,6 +350,12 @@ def validate_and_generate():
     print("==============================================")
 
 if __name__ == "__main__":
-    validate_and_generate()
+    ap = argparse.ArgumentParser(description="AES-256 golden vectors (FIPS 197) + driver KAT corpora")
+    ap.add_argument("--random", type=int, default=0, metavar="N", help="write N random vectors to aes_kat_random.hex")
+    ap.add_argument("--keys", type=int, default=256, help="distinct keys among the random vectors")
+    ap.add_argument("--seed", type=int, default=1, help="seed for --random / --mct")
+    ap.add_argument("--aesavs", action="store_true", help="write ECBVarTxt256.rsp / ECBVarKey256.rsp")
+    ap.add_argument("--mct", action="store_true", help="write ECBMCT256.rsp (AESAVS Monte Carlo)")
+    validate_and_generate(ap.parse_args())
 
 
@@ -0,0 +1,660 @@
+/**
+* @file     aes_cluster.h
+* @brief    Several aes_bridge instances driven as one AES backend: sharded jobs, key affinity
+* @details  Each instance gets its own MMIO window, AesDriver and AesJob. A worker thread owns
+*           a set of instances and steps their jobs round-robin, one block each per turn, so
+*           core time on one instance overlaps bus traffic to the others; with several workers
+*           (one per CPU by default) the bus traffic itself overlaps too.
+*
+* A job of n blocks under key h is cut into contiguous shards that minimise the predicted
+* finish time, instance i finishing k blocks at
+*
+*     backlog_i + key_i + a_i + b_i * k
+*
+* - backlog_i: predicted ns of shards already queued there
+* - key_i:     0 when h is the last key queued there (it will be resident), one expansion
+*              when the instance is empty, two when it evicts another key - so tenants
+*              settle on their own instances instead of thrashing each other's schedules
+* - a_i, b_i:  LatencyModel fitted per instance over completed shards
+*
+* Blocks are water-filled over the instances in order of start time; shares below
+* min_shard fold back onto fewer instances, so small jobs stay on one warm core and only
+* large ones pay for expansions to spread out.
+*
+* Instances come from addInstance(phys) / addInstance(RegDevice*) (sim_device.h models,
+* optionally on a shared SimBus), or aes_discover() reading every aes_bridge out of the
+* overlay's .hwh or the block design's .bd. Add them all before the first job.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <regex>
+#include <sched.h>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aes_driver.h"
+
+// Discovery =======================================
+struct AesInstanceAddr {
+    std::string name;
+    uint32_t    base;
+    uint32_t    size;
+};
+
+namespace aes_cluster_detail {
+
+inline std::string xml_attr(const std::string& tag, const char* name) {
+    std::string key = std::string(" ") + name + "=\"";
+    size_t p = tag.find(key);
+    if (p == std::string::npos) return "";
+    p += key.size();
+    size_t e = tag.find('"', p);
+    return e == std::string::npos ? "" : tag.substr(p, e - p);
+}
+
+// every <NAME ...> start tag in an XML document
+inline std::vector<std::string> xml_tags(const std::string& doc, const char* name) {
+    std::vector<std::string> out;
+    std::string open = std::string("<") + name + " ";
+    for (size_t p = doc.find(open); p != std::string::npos; p = doc.find(open, p + 1)) {
+        size_t e = doc.find('>', p);
+        if (e == std::string::npos) break;
+        out.push_back(doc.substr(p, e - p));
+    }
+    return out;
+}
+
+// PYNQ hardware handoff: MODULE MODTYPE="aes_bridge", MEMRANGE INSTANCE=... BASEVALUE / HIGHVALUE
+inline void parse_hwh(const std::string& doc, std::vector<AesInstanceAddr>& out) {
+    std::set<std::string> names;
+    for (const std::string& t : xml_tags(doc, "MODULE"))
+        if (xml_attr(t, "MODTYPE") == "aes_bridge") names.insert(xml_attr(t, "INSTANCE"));
+    for (const std::string& t : xml_tags(doc, "MEMRANGE")) {
+        std::string inst = xml_attr(t, "INSTANCE");
+        if (!names.count(inst)) continue;
+        uint32_t base = (uint32_t)strtoul(xml_attr(t, "BASEVALUE").c_str(), nullptr, 0);
+        uint32_t high = (uint32_t)strtoul(xml_attr(t, "HIGHVALUE").c_str(), nullptr, 0);
+        out.push_back({ inst, base, high - base + 1 });
+    }
+}
+
+// Vivado block design: components with a ...:aes_bridge:... vlnv, SEG_* address segments
+inline void parse_bd(const std::string& doc, std::vector<AesInstanceAddr>& out) {
+    std::set<std::string> names;
+    std::regex comp("\"(\\w+)\":\\s*\\{\\s*\"vlnv\":\\s*\"[^\"]*:aes_bridge:");
+    for (std::sregex_iterator it(doc.begin(), doc.end(), comp), end; it != end; ++it) names.insert((*it)[1]);
+    std::regex seg("\"address_block\":\\s*\"/(\\w+)/[^\"]*\",\\s*\"offset\":\\s*\"(0x[0-9A-Fa-f]+)\",\\s*\"range\":\\s*\"(\\d+)([KMG]?)\"");
+    for (std::sregex_iterator it(doc.begin(), doc.end(), seg), end; it != end; ++it) {
+        if (!names.count((*it)[1])) continue;
+        uint64_t size = strtoull((*it)[3].str().c_str(), nullptr, 10);
+        char unit = (*it)[4].length() ? (*it)[4].str()[0] : 0;
+        size <<= unit == 'K' ? 10 : unit == 'M' ? 20 : unit == 'G' ? 30 : 0;
+        out.push_back({ (*it)[1], (uint32_t)strtoul((*it)[2].str().c_str(), nullptr, 16), (uint32_t)size });
+    }
+}
+
+} // namespace aes_cluster_detail
+
+/**
+* @brief Every aes_bridge in an overlay description, sorted by base address
+* @details Reads PYNQ's .hwh (shipped next to the .bit) or Vivado's .bd; empty when the
+*          file is missing or names no aes_bridge.
+*/
+inline std::vector<AesInstanceAddr> aes_discover(const char* path) {
+    std::vector<AesInstanceAddr> out;
+    FILE* f = fopen(path, "rb");
+    if (!f) {
+        perror(path);
+        return out;
+    }
+    std::string doc;
+    char buf[65536];
+    for (size_t n; (n = fread(buf, 1, sizeof(buf), f)) > 0;) doc.append(buf, n);
+    fclose(f);
+
+    if (doc.find("<MODULE ") != std::string::npos) aes_cluster_detail::parse_hwh(doc, out);
+    else aes_cluster_detail::parse_bd(doc, out);
+    std::sort(out.begin(), out.end(), [](const AesInstanceAddr& a, const AesInstanceAddr& b) { return a.base < b.base; });
+    out.erase(std::unique(out.begin(), out.end(), [](const AesInstanceAddr& a, const AesInstanceAddr& b) { return a.base == b.base; }),
+              out.end());
+    return out;
+}
+
+// Config / stats =======================================
+struct AesClusterConfig {
+    size_t   min_shard  = 64;       // blocks; smaller shares fold onto fewer instances
+    uint32_t workers    = 0;        // driver threads, 0 = one per CPU (at most one per instance)
+    uint32_t timeout_us = 100000;   // per key expansion / block
+    uint32_t idle_spins = 256;      // turns with nothing ready before a sched_yield()
+};
+
+struct AesInstanceStats {
+    uint64_t shards    = 0;
+    uint64_t blocks    = 0;
+    uint64_t key_loads = 0;         // shards that had to expand their key
+    uint64_t errors    = 0;         // shards that timed out
+    uint64_t busy_ns   = 0;         // first register write -> last block retired, summed
+};
+
+struct AesClusterStats {
+    std::vector<std::string>      names;
+    std::vector<AesInstanceStats> inst;
+    uint64_t jobs      = 0;
+    uint64_t blocks    = 0;
+    uint64_t active_ns = 0;         // wall time with at least one job in flight
+
+    double mbps() const { return active_ns ? blocks * 16e3 / active_ns : 0.0; }
+
+    void print() const {
+        for (size_t i = 0; i < inst.size(); i++) {
+            const AesInstanceStats& s = inst[i];
+            printf("    %-12s: %8llu blocks %6llu shards %5llu key loads %3llu errors  %8.2f MB/s busy, %5.1f%% of active\n",
+                   names[i].c_str(), (unsigned long long)s.blocks, (unsigned long long)s.shards,
+                   (unsigned long long)s.key_loads, (unsigned long long)s.errors,
+                   s.busy_ns ? s.blocks * 16e3 / s.busy_ns : 0.0, active_ns ? 100.0 * s.busy_ns / active_ns : 0.0);
+        }
+        printf("    Aggregate   : %8llu blocks in %llu jobs, %.2f MB/s over %.3f ms active\n",
+               (unsigned long long)blocks, (unsigned long long)jobs, mbps(), active_ns / 1e6);
+    }
+};
+
+// Cluster =======================================
+class AesCluster {
+private:
+    using clock = std::chrono::steady_clock;
+
+    // caller side of one encryptBulk(): shards count down, the last wakes the caller
+    struct Job {
+        std::mutex              mu;
+        std::condition_variable cv;
+        size_t                  remaining = 0;
+        bool                    ok = true;
+    };
+
+    struct Shard {
+        Job*            job = nullptr;
+        AesKeyHandle    key = AES_NO_KEY;       // cluster handle
+        const uint32_t* pt = nullptr;
+        uint32_t*       ct = nullptr;
+        size_t          n = 0;
+        double          predicted_ns = 0;
+        bool            drop = false;           // unregisterKey(): forget key instead
+    };
+
+    struct Instance {
+        std::string name;
+        MMIO        mmio;
+        AesDriver   drv;
+        AesJob      job;
+        size_t      worker = 0;
+
+        // owner worker only
+        std::vector<AesKeyHandle> local;        // cluster handle - 1 -> driver handle
+        bool              busy = false;         // cur taken off the queue
+        bool              begun = false;        // ... and started on the core
+        Shard             cur;
+        clock::time_point cur_t0;
+        std::deque<Shard> queue;                // under the owner worker's mutex
+        std::atomic<bool> stale{false};         // invalidateKeyCache() pending
+
+        // under _plan_mu
+        LatencyModel     model{2000, 1500};     // ns per shard, key already resident
+        double           key_ns = 3000;         // extra for a shard that expands
+        double           backlog_ns = 0;
+        AesKeyHandle     tail_key = AES_NO_KEY; // key of the last shard queued
+        AesInstanceStats stats;
+
+        Instance(const std::string& n, uint32_t timeout_us) : name(n), drv(mmio), job(&drv, timeout_us) {}
+    };
+
+    struct Worker {
+        std::thread             thread;
+        std::mutex              mu;
+        std::condition_variable cv;
+        std::atomic<bool>       doorbell{false};     // a queue of ours is non-empty
+        bool                    sleeping = false;
+        bool                    quit = false;
+        std::vector<Instance*>  mine;
+    };
+
+    struct KeyEntry {
+        uint32_t key[8];
+        bool     live;
+    };
+
+    AesClusterConfig _cfg;
+    std::vector<std::unique_ptr<Instance>> _inst;
+    std::vector<std::unique_ptr<Worker>>   _workers;
+
+    std::mutex                _plan_mu;         // key table, planning state, stats
+    std::vector<KeyEntry>     _keys;
+    std::vector<AesKeyHandle> _free_keys;
+    uint64_t          _jobs = 0;
+    uint64_t          _blocks = 0;
+    size_t            _in_flight = 0;
+    clock::time_point _active_t0;
+    uint64_t          _active_ns = 0;
+
+    static double since_ns(clock::time_point t0) {
+        return std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+    }
+
+    void startWorkers() {
+        if (!_workers.empty() || _inst.empty()) return;
+        size_t n = _cfg.workers;
+        if (n == 0) n = std::max(1u, std::thread::hardware_concurrency());
+        n = std::min(n, _inst.size());
+        for (size_t w = 0; w < n; w++) _workers.emplace_back(new Worker);
+        for (size_t i = 0; i < _inst.size(); i++) {
+            _inst[i]->worker = i % n;
+            _workers[i % n]->mine.push_back(_inst[i].get());
+        }
+        for (auto& w : _workers) {
+            Worker* wp = w.get();
+            wp->thread = std::thread([this, wp] { workerLoop(*wp); });
+        }
+    }
+
+    // Worker ---------------------------------
+    void finishShard(Instance& in, bool ok) {
+        double ns = since_ns(in.cur_t0);
+        const Shard& s = in.cur;
+        {
+            std::lock_guard<std::mutex> lk(_plan_mu);
+            in.backlog_ns = std::max(0.0, in.backlog_ns - s.predicted_ns);
+            if (!s.drop) {
+                in.stats.shards++;
+                in.stats.busy_ns += (uint64_t)ns;
+                if (ok) in.stats.blocks += s.n;
+                else in.stats.errors++;
+                if (in.job.expandedKey()) {
+                    in.stats.key_loads++;
+                    if (ok) in.key_ns = 0.8 * in.key_ns + 0.2 * std::max(0.0, ns - in.model.predict((double)s.n));
+                } else if (ok) {
+                    in.model.update((double)s.n, ns);
+                }
+                if (!ok) in.tail_key = AES_NO_KEY;      // the driver dropped its key cache
+            }
+        }
+        in.busy = false;
+        std::lock_guard<std::mutex> lk(s.job->mu);
+        s.job->ok &= ok;
+        if (--s.job->remaining == 0) s.job->cv.notify_one();
+    }
+
+    void beginShard(Instance& in) {
+        const Shard& s = in.cur;
+        in.begun = true;
+        in.cur_t0 = clock::now();
+        if (in.stale.exchange(false, std::memory_order_acquire)) in.drv.invalidateKeyCache();
+        if (in.local.size() < s.key) in.local.resize(s.key, AES_NO_KEY);
+        AesKeyHandle& local = in.local[s.key - 1];
+        if (s.drop) {
+            if (local != AES_NO_KEY) in.drv.unregisterKey(local);
+            local = AES_NO_KEY;
+            finishShard(in, true);
+            return;
+        }
+        if (local == AES_NO_KEY) {
+            uint32_t key[8];
+            {
+                std::lock_guard<std::mutex> lk(_plan_mu);
+                memcpy(key, _keys[s.key - 1].key, sizeof(key));
+            }
+            local = in.drv.registerKey(key);
+            volatile uint32_t* wipe = key;
+            for (int i = 0; i < 8; i++) wipe[i] = 0;
+        }
+        in.job.start(local, s.pt, s.ct, s.n);
+    }
+
+    void workerLoop(Worker& w) {
+        // alone on a worker an instance runs long bursts; shared, one block each per turn
+        uint32_t burst = w.mine.size() == 1 ? 64 : 1;
+        uint32_t idle = 0;
+        for (;;) {
+            bool busy = false;
+            for (Instance* in : w.mine) busy |= in->busy;
+            if (!busy || w.doorbell.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lk(w.mu);
+                auto queued = [&] {
+                    for (Instance* in : w.mine) if (!in->queue.empty()) return true;
+                    return false;
+                };
+                if (!busy && !queued() && !w.quit) {
+                    w.sleeping = true;
+                    w.cv.wait(lk, [&] { return w.quit || queued(); });
+                    w.sleeping = false;
+                }
+                if (w.quit) return;
+                bool left = false;
+                for (Instance* in : w.mine) {
+                    if (!in->busy && !in->queue.empty()) {
+                        in->cur = in->queue.front();
+                        in->queue.pop_front();
+                        in->busy = true;
+                        in->begun = false;
+                    }
+                    left |= !in->queue.empty();
+                }
+                w.doorbell.store(left, std::memory_order_relaxed);
+            }
+
+            bool moved = false;
+            for (Instance* in : w.mine) {
+                if (!in->busy) continue;
+                if (!in->begun) {
+                    beginShard(*in);
+                    moved = true;
+                    if (!in->busy) continue;
+                }
+                moved |= in->job.step(burst);
+                if (!in->job.running()) finishShard(*in, in->job.state() == AesJobState::DONE);
+            }
+            if (moved) {
+                idle = 0;
+            } else if (++idle >= _cfg.idle_spins) {
+                sched_yield();
+                idle = 0;
+            }
+        }
+    }
+
+    void enqueue(Instance& in, const Shard& s) {
+        Worker& w = *_workers[in.worker];
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lk(w.mu);
+            in.queue.push_back(s);
+            w.doorbell.store(true, std::memory_order_release);
+            wake = w.sleeping;
+        }
+        if (wake) w.cv.notify_one();
+    }
+
+    // Planning (under _plan_mu) ---------------------------------
+    struct Share {
+        Instance* in;
+        double    start;        // ns until its first block would retire
+        double    b;            // ns per block
+        double    setup;        // start minus the backlog: expansion + fixed cost
+        size_t    blocks;
+        double    cost() const { return setup + blocks * b; }
+    };
+
+    // water-fill n blocks over the m earliest-starting candidates
+    static void fill(std::vector<Share>& c, size_t m, size_t n) {
+        double inv = 0, sb = 0;
+        for (size_t j = 0; j < m; j++) {
+            inv += 1.0 / c[j].b;
+            sb += c[j].start / c[j].b;
+        }
+        double t = (n + sb) / inv;
+        size_t given = 0;
+        for (size_t j = 0; j < m; j++) {
+            double k = (t - c[j].start) / c[j].b;
+            c[j].blocks = k > 0 ? (size_t)k : 0;
+            given += c[j].blocks;
+        }
+        for (size_t j = 0; given < n; j = (j + 1) % m, given++) c[j].blocks++;    // rounding, earliest first
+        for (size_t j = m; given > n; given--) {                                    // float slack, latest first
+            while (c[j - 1].blocks == 0) j--;
+            c[j - 1].blocks--;
+        }
+        for (size_t j = m; j < c.size(); j++) c[j].blocks = 0;
+    }
+
+    std::vector<Share> plan(AesKeyHandle h, size_t n) {
+        std::vector<Share> c;
+        for (auto& p : _inst) {
+            Instance& in = *p;
+            double a, b;
+            in.model.fit(a, b);
+            double key = in.tail_key == h ? 0 : in.tail_key == AES_NO_KEY ? in.key_ns : 2 * in.key_ns;
+            c.push_back({ &in, in.backlog_ns + key + a, b, key + a, 0 });
+        }
+        std::sort(c.begin(), c.end(), [](const Share& x, const Share& y) { return x.start < y.start; });
+
+        // grow while the next instance would start before the current finish time
+        size_t m = 1;
+        for (; m < c.size(); m++) {
+            fill(c, m, n);
+            double finish = c[0].start + c[0].blocks * c[0].b;
+            if (c[m].start >= finish) break;
+        }
+        fill(c, m, n);
+        // fold shares too small to be worth a shard
+        while (m > 1) {
+            size_t smallest = n;
+            for (size_t j = 0; j < m; j++) smallest = std::min(smallest, c[j].blocks);
+            if (smallest >= _cfg.min_shard) break;
+            fill(c, --m, n);
+        }
+        c.resize(m);
+        return c;
+    }
+
+public:
+    explicit AesCluster(const AesClusterConfig& cfg = AesClusterConfig()) : _cfg(cfg) {}
+
+    AesCluster(const AesCluster&) = delete;
+    AesCluster& operator=(const AesCluster&) = delete;
+
+    ~AesCluster() {
+        for (auto& w : _workers) {
+            {
+                std::lock_guard<std::mutex> lk(w->mu);
+                w->quit = true;
+            }
+            w->cv.notify_one();
+            w->thread.join();
+        }
+        for (auto& in : _inst) {
+            for (AesKeyHandle h : in->local) if (h != AES_NO_KEY) in->drv.unregisterKey(h);
+        }
+        for (KeyEntry& e : _keys) {
+            volatile uint32_t* wipe = e.key;
+            for (int i = 0; i < 8; i++) wipe[i] = 0;
+        }
+    }
+
+    // Instances ---------------------------------
+    bool addInstance(uint32_t phys_addr, uint32_t size = AES_SIZE) {
+        char name[32];
+        snprintf(name, sizeof(name), "aes@%08x", phys_addr);
+        std::unique_ptr<Instance> in(new Instance(name, _cfg.timeout_us));
+        if (!in->mmio.open(phys_addr, size)) return false;
+        return add(std::move(in));
+    }
+
+    // a behavioral model (sim_device.h) or any other RegDevice
+    bool addInstance(RegDevice* dev, const char* name = nullptr) {
+        std::string n = name ? name : std::string(dev->name()) + "." + std::to_string(_inst.size());
+        std::unique_ptr<Instance> in(new Instance(n, _cfg.timeout_us));
+        if (!in->mmio.attach(dev)) return false;
+        return add(std::move(in));
+    }
+
+    // every aes_bridge in an overlay description; false when none could be mapped
+    bool addDiscovered(const char* hwh_or_bd) {
+        size_t before = _inst.size();
+        for (const AesInstanceAddr& a : aes_discover(hwh_or_bd)) {
+            if (!addInstance(a.base, a.size)) fprintf(stderr, "    [WARN] %s at 0x%08x not mapped\n", a.name.c_str(), a.base);
+            else _inst.back()->name = a.name;
+        }
+        return _inst.size() > before;
+    }
+
+    size_t size() const { return _inst.size(); }
+    const std::string& name(size_t i) const { return _inst[i]->name; }
+
+    // per-instance register-level knobs, before the first job
+    AesDriver& driver(size_t i) { return _inst[i]->drv; }
+
+    // Keys ---------------------------------
+    // expanded lazily, per instance, the first time a shard under it lands there
+    AesKeyHandle registerKey(const uint32_t key[8]) {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        AesKeyHandle h;
+        if (!_free_keys.empty()) {
+            h = _free_keys.back();
+            _free_keys.pop_back();
+        } else {
+            _keys.push_back(KeyEntry{});
+            h = (AesKeyHandle)_keys.size();
+        }
+        memcpy(_keys[h - 1].key, key, sizeof(_keys[h - 1].key));
+        _keys[h - 1].live = true;
+        return h;
+    }
+
+    // waits until every instance has dropped it
+    void unregisterKey(AesKeyHandle h) {
+        Job job;
+        {
+            std::lock_guard<std::mutex> lk(_plan_mu);
+            if (!validKeyLocked(h)) return;
+            startWorkers();
+            job.remaining = _inst.size();
+            for (auto& in : _inst) if (in->tail_key == h) in->tail_key = AES_NO_KEY;
+        }
+        for (auto& in : _inst) {
+            Shard s;
+            s.job = &job;
+            s.key = h;
+            s.drop = true;
+            enqueue(*in, s);
+        }
+        {
+            std::unique_lock<std::mutex> lk(job.mu);
+            job.cv.wait(lk, [&] { return job.remaining == 0; });
+        }
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        KeyEntry& e = _keys[h - 1];
+        volatile uint32_t* wipe = e.key;
+        for (int i = 0; i < 8; i++) wipe[i] = 0;
+        e.live = false;
+        _free_keys.push_back(h);
+    }
+
+    bool validKey(AesKeyHandle h) {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        return validKeyLocked(h);
+    }
+
+    // Jobs ---------------------------------
+    /**
+    * @brief Encrypt n_blocks under h across the instances, 4 big-endian words per block
+    * @details pt and ct may alias. Thread safe: concurrent jobs queue behind each other per
+    *          instance and the planner sees their backlog. False when a shard timed out
+    *          (the others still finish; that instance's key cache is dropped).
+    */
+    bool encryptBulk(AesKeyHandle h, const uint32_t* pt, uint32_t* ct, size_t n_blocks) {
+        if (n_blocks == 0) return true;
+        Job job;
+        std::vector<Share> shares;
+        {
+            std::lock_guard<std::mutex> lk(_plan_mu);
+            if (!validKeyLocked(h)) {
+                printf("    [ERROR] Invalid AES cluster key handle %u\n", h);
+                return false;
+            }
+            if (_inst.empty()) {
+                printf("    [ERROR] AesCluster has no instances\n");
+                return false;
+            }
+            startWorkers();
+            shares = plan(h, n_blocks);
+            job.remaining = shares.size();
+            for (Share& s : shares) {
+                s.in->backlog_ns += s.cost();
+                s.in->tail_key = h;
+            }
+            _jobs++;
+            _blocks += n_blocks;
+            if (_in_flight++ == 0) _active_t0 = clock::now();
+        }
+
+        size_t off = 0;
+        for (const Share& s : shares) {
+            Shard sh;
+            sh.job = &job;
+            sh.key = h;
+            sh.pt = pt + 4 * off;
+            sh.ct = ct + 4 * off;
+            sh.n = s.blocks;
+            sh.predicted_ns = s.cost();
+            off += s.blocks;
+            enqueue(*s.in, sh);
+        }
+        {
+            std::unique_lock<std::mutex> lk(job.mu);
+            job.cv.wait(lk, [&] { return job.remaining == 0; });
+        }
+
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        if (--_in_flight == 0) _active_ns += (uint64_t)since_ns(_active_t0);
+        return job.ok;
+    }
+
+    bool encrypt(AesKeyHandle h, const uint32_t pt[4], uint32_t ct[4]) { return encryptBulk(h, pt, ct, 1); }
+
+    // forget what every core holds (PL reset, ...); each worker drops it before its next shard
+    void invalidateKeyCache() {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        for (auto& in : _inst) {
+            in->tail_key = AES_NO_KEY;
+            in->stale.store(true, std::memory_order_release);
+        }
+    }
+
+    // Stats ---------------------------------
+    AesClusterStats stats() {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        AesClusterStats s;
+        for (auto& in : _inst) {
+            s.names.push_back(in->name);
+            s.inst.push_back(in->stats);
+        }
+        s.jobs = _jobs;
+        s.blocks = _blocks;
+        s.active_ns = _active_ns + (_in_flight ? (uint64_t)since_ns(_active_t0) : 0);
+        return s;
+    }
+
+    void resetStats() {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        for (auto& in : _inst) in->stats = AesInstanceStats{};
+        _jobs = _blocks = _active_ns = 0;
+        if (_in_flight) _active_t0 = clock::now();
+    }
+
+private:
+    bool add(std::unique_ptr<Instance> in) {
+        std::lock_guard<std::mutex> lk(_plan_mu);
+        if (!_workers.empty()) {
+            printf("    [ERROR] AesCluster: instances must be added before the first job\n");
+            return false;
+        }
+        _inst.push_back(std::move(in));
+        return true;
+    }
+
+    bool validKeyLocked(AesKeyHandle h) const {
+        return h != AES_NO_KEY && h <= _keys.size() && _keys[h - 1].live;
+    }
+};
@@ -0,0 +1,380 @@
+/**
+* @file     aes_dispatch.h
+* @brief    Hybrid AES-256 dispatcher: FPGA core + CPU engine, routed by measured cost
+* @details  Each backend keeps a latency model t(n) = a + b*n (fixed cost + per block),
+*           fitted by exponentially decayed least squares over completed jobs.
+*
+* Per request of n blocks:
+* 1. all CPU:  t_cpu(n)
+* 2. all HW:   t_hw(n)
+* 3. split:    k blocks to the HW worker thread, n-k on the calling thread at the same time;
+*              k solves t_hw(k) + handoff = t_cpu(n-k), cost = max of the two
+* The cheapest plan wins. With MMIO setup in a_hw, 1-block jobs never touch the bus;
+* with the split, the CPU is encrypting whenever the core is. encryptAsync() / wait()
+* runs the same plan but returns while the HW share is in flight (aes_modes.h GHASHes
+* the previous chunk in that window).
+*
+* The HW backend is one AesDriver or an AesCluster (aes_cluster.h); with a cluster the HW
+* share is itself sharded over the instances and the model fits the cluster as a whole.
+*
+* Not thread safe: one caller at a time (the HW worker is internal).
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "aes_cluster.h"
+#include "aes_driver.h"
+#include "soft_aes.h"
+
+enum class AesRoute : uint8_t { CPU, HW, SPLIT };
+
+struct AesDispatchPlan {
+    AesRoute route;
+    size_t   hw_blocks;
+    size_t   cpu_blocks;
+    double   predicted_ns;
+};
+
+struct AesDispatchStats {
+    uint64_t jobs[3]        = {0, 0, 0};       // by AesRoute
+    uint64_t blocks_hw      = 0;
+    uint64_t blocks_cpu     = 0;
+    uint64_t hw_errors      = 0;               // HW share redone on the CPU
+    double   predicted_ns   = 0;               // sum over jobs, vs actual_ns
+    double   actual_ns      = 0;
+
+    void print(FILE* out = stdout) const {
+        fprintf(out, "    Routes      : cpu=%llu hw=%llu split=%llu  blocks hw=%llu cpu=%llu  hw errors=%llu\n",
+               (unsigned long long)jobs[0], (unsigned long long)jobs[1], (unsigned long long)jobs[2],
+               (unsigned long long)blocks_hw, (unsigned long long)blocks_cpu, (unsigned long long)hw_errors);
+        if (actual_ns > 0)
+            fprintf(out, "    Model       : predicted/actual = %.2f\n", predicted_ns / actual_ns);
+    }
+};
+
+// Dispatcher =======================================
+class AesDispatcher {
+private:
+    using clock = std::chrono::steady_clock;
+
+    AesDriver*   _hw = nullptr;                 // both nullptr: CPU only
+    AesCluster*  _cluster = nullptr;
+    SoftAes256   _cpu;
+    AesKeyHandle _hw_key = AES_NO_KEY;
+    bool         _keyed = false;
+
+    // priors: HW ~ key check + 8 MMIO accesses per block, CPU from the engine on first use
+    LatencyModel _hw_model{5000, 2000};
+    LatencyModel _cpu_model{200, 100};
+    LatencyModel _handoff{20000, 0};            // worker wake + completion signal, n ignored
+    AesDispatchStats _stats;
+
+    // HW worker --------------------------------------
+    std::thread             _worker;
+    std::mutex              _mtx;
+    std::condition_variable _cv_job, _cv_done;
+    bool _job_pending = false, _job_done = false, _quit = false;
+    const uint32_t* _job_pt = nullptr;
+    uint32_t*       _job_ct = nullptr;
+    size_t          _job_n = 0;
+    bool            _job_ok = false;
+    double          _job_ns = 0;
+    clock::time_point _job_submit;
+
+    // encryptAsync() job waiting for wait()
+    struct AsyncJob {
+        const uint32_t* pt = nullptr;
+        uint32_t*       ct = nullptr;
+        AesDispatchPlan plan = {};
+        bool            pending = false;
+    } _async;
+
+    static double since_ns(clock::time_point t0) {
+        return std::chrono::duration<double, std::nano>(clock::now() - t0).count();
+    }
+
+    bool runHw(const uint32_t* pt, uint32_t* ct, size_t n, double& ns) {
+        auto t0 = clock::now();
+        bool ok = _cluster ? _cluster->encryptBulk(_hw_key, pt, ct, n)
+                           : n == 1 ? _hw->encrypt(_hw_key, pt, ct) : _hw->encryptBulk(_hw_key, pt, ct, n);
+        ns = since_ns(t0);
+        if (ok) _hw_model.update((double)n, ns);
+        return ok;
+    }
+
+    double runCpu(const uint32_t* pt, uint32_t* ct, size_t n) {
+        auto t0 = clock::now();
+        _cpu.encryptBlocks(pt, ct, n);
+        double ns = since_ns(t0);
+        _cpu_model.update((double)n, ns);
+        return ns;
+    }
+
+    void workerLoop() {
+        std::unique_lock<std::mutex> lk(_mtx);
+        while (true) {
+            _cv_job.wait(lk, [&] { return _job_pending || _quit; });
+            if (_quit) return;
+            _job_pending = false;
+            lk.unlock();
+            double ns = 0;
+            bool ok = runHw(_job_pt, _job_ct, _job_n, ns);
+            lk.lock();
+            _job_ok = ok;
+            _job_ns = ns;
+            _job_done = true;
+            _cv_done.notify_one();
+        }
+    }
+
+    bool hwFallback(const uint32_t* pt, uint32_t* ct, size_t n) {
+        _stats.hw_errors++;
+        if (_cluster) _cluster->invalidateKeyCache();
+        else _hw->invalidateKeyCache();
+        runCpu(pt, ct, n);
+        return true;
+    }
+
+    // hand n blocks to the worker; hwJoin() collects them
+    void hwStart(const uint32_t* pt, uint32_t* ct, size_t n) {
+        _job_submit = clock::now();
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _job_pt = pt;
+            _job_ct = ct;
+            _job_n = n;
+            _job_done = false;
+            _job_pending = true;
+        }
+        _cv_job.notify_one();
+    }
+
+    void hwJoin() {
+        std::unique_lock<std::mutex> lk(_mtx);
+        _cv_done.wait(lk, [&] { return _job_done; });
+        bool ok = _job_ok;
+        double hw_ns = _job_ns;
+        lk.unlock();
+        // handoff = time the HW share took end to end minus its own run time
+        double overhead = since_ns(_job_submit) - hw_ns;
+        if (ok && overhead > 0) _handoff.update(0, overhead);
+        if (!ok) hwFallback(_job_pt, _job_ct, _job_n);
+    }
+
+    void hwUnregister() {
+        if (_hw_key == AES_NO_KEY) return;
+        if (_cluster) _cluster->unregisterKey(_hw_key);
+        else _hw->unregisterKey(_hw_key);
+        _hw_key = AES_NO_KEY;
+    }
+
+public:
+    explicit AesDispatcher(AesDriver* hw, SoftAesKernel kernel = SoftAes256::constantTime()) : _hw(hw), _cpu(kernel) {
+        if (_hw) _worker = std::thread(&AesDispatcher::workerLoop, this);
+    }
+
+    explicit AesDispatcher(std::nullptr_t, SoftAesKernel kernel = SoftAes256::constantTime())
+        : AesDispatcher((AesDriver*)nullptr, kernel) {}
+
+    explicit AesDispatcher(AesCluster* cluster, SoftAesKernel kernel = SoftAes256::constantTime()) : _cluster(cluster), _cpu(kernel) {
+        if (_cluster) _worker = std::thread(&AesDispatcher::workerLoop, this);
+    }
+
+    ~AesDispatcher() {
+        wait();
+        if (_worker.joinable()) {
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                _quit = true;
+            }
+            _cv_job.notify_one();
+            _worker.join();
+        }
+        if (hasHw()) hwUnregister();
+    }
+
+    AesDispatcher(const AesDispatcher&) = delete;
+    AesDispatcher& operator=(const AesDispatcher&) = delete;
+
+    // key goes to the CPU engine now and to the core lazily (key cache handle)
+    void setKey(const uint32_t key[8]) {
+        wait();
+        _cpu.setKey(key);
+        if (hasHw()) {
+            hwUnregister();
+            _hw_key = _cluster ? _cluster->registerKey(key) : _hw->registerKey(key);
+        }
+        _keyed = true;
+    }
+
+    // forget the key: CPU round keys zeroed, core handle released
+    void wipe() {
+        wait();
+        _cpu.wipe();
+        if (hasHw()) hwUnregister();
+        _keyed = false;
+    }
+
+    AesDispatchPlan plan(size_t n) const {
+        AesDispatchPlan cpu_only = { AesRoute::CPU, 0, n, _cpu_model.predict((double)n) };
+        if (!hasHw() || n == 0) return cpu_only;
+
+        AesDispatchPlan best = cpu_only;
+        double t_hw = _hw_model.predict((double)n);
+        if (t_hw < best.predicted_ns) best = { AesRoute::HW, n, 0, t_hw };
+
+        if (n >= 2) {
+            double ah, bh, ac, bc;
+            _hw_model.fit(ah, bh);
+            _cpu_model.fit(ac, bc);
+            double ho = _handoff.predict(0);
+            // ah + ho + bh*k = ac + bc*(n-k)
+            double k = (ac - ah - ho + bc * (double)n) / (bh + bc);
+            if (k >= 1 && k <= (double)n - 1) {
+                size_t hw_n = (size_t)(k + 0.5);
+                if (hw_n < 1) hw_n = 1;
+                if (hw_n > n - 1) hw_n = n - 1;
+                double t = std::max(ah + ho + bh * hw_n, ac + bc * (n - hw_n));
+                if (t < best.predicted_ns) best = { AesRoute::SPLIT, hw_n, n - hw_n, t };
+            }
+        }
+        return best;
+    }
+
+    /**
+    * @brief Encrypt n blocks (4 big endian words each) on whichever backend(s) finish first
+    * @details A failed HW share is redone on the CPU, so output is always produced.
+    */
+    bool encrypt(const uint32_t* pt, uint32_t* ct, size_t n) {
+        if (!_keyed) { printf("[ERROR] AesDispatcher: no key set\n"); return false; }
+        wait();
+        if (n == 0) return true;
+
+        AesDispatchPlan p = plan(n);
+        auto t0 = clock::now();
+        _stats.jobs[(int)p.route]++;
+        _stats.blocks_hw  += p.hw_blocks;
+        _stats.blocks_cpu += p.cpu_blocks;
+
+        if (p.route == AesRoute::CPU) {
+            runCpu(pt, ct, n);
+        } else if (p.route == AesRoute::HW) {
+            double ns;
+            if (!runHw(pt, ct, n, ns)) hwFallback(pt, ct, n);
+        } else {
+            // HW takes the head, this thread the tail
+            hwStart(pt, ct, p.hw_blocks);
+            runCpu(pt + 4 * p.hw_blocks, ct + 4 * p.hw_blocks, p.cpu_blocks);
+            hwJoin();
+        }
+
+        _stats.predicted_ns += p.predicted_ns;
+        _stats.actual_ns    += since_ns(t0);
+        return true;
+    }
+
+    /**
+    * @brief Start encrypting n blocks and return; the HW share runs on the worker meanwhile
+    * @details The CPU share runs in wait(), so work the caller does in between (GHASH,
+    *          XOR of the previous chunk) overlaps the core. One job at a time: a second
+    *          call waits for the first. pt / ct must stay valid until wait().
+    */
+    bool encryptAsync(const uint32_t* pt, uint32_t* ct, size_t n) {
+        if (!_keyed) { printf("[ERROR] AesDispatcher: no key set\n"); return false; }
+        wait();
+        if (n == 0) return true;
+        AesDispatchPlan p = plan(n);
+        _stats.jobs[(int)p.route]++;
+        _stats.blocks_hw  += p.hw_blocks;
+        _stats.blocks_cpu += p.cpu_blocks;
+        _async = { pt, ct, p, true };
+        if (p.hw_blocks) hwStart(pt, ct, p.hw_blocks);
+        return true;
+    }
+
+    // finish the encryptAsync() job (no-op when none is outstanding)
+    void wait() {
+        if (!_async.pending) return;
+        const AesDispatchPlan& p = _async.plan;
+        if (p.cpu_blocks) runCpu(_async.pt + 4 * p.hw_blocks, _async.ct + 4 * p.hw_blocks, p.cpu_blocks);
+        if (p.hw_blocks) hwJoin();
+        _async.pending = false;
+    }
+
+    /**
+    * @brief Measure both backends over 1..max_blocks (powers of 2), refit, print the table
+    * @return crossover job size in blocks (0 = HW never wins a whole job)
+    */
+    size_t calibrate(size_t max_blocks = 4096, int reps = 5, bool verbose = true) {
+        if (!_keyed) { printf("[ERROR] AesDispatcher: set a key before calibrating\n"); return 0; }
+        std::vector<uint32_t> pt(max_blocks * 4), ct(max_blocks * 4);
+        for (size_t i = 0; i < pt.size(); i++) pt[i] = (uint32_t)(i * 0x9E3779B9u);
+
+        _cpu_model.reset();
+        _hw_model.reset();
+        if (verbose) {
+            printf("    %8s %12s %12s %12s\n", "blocks", "cpu us", "hw us", "hw MB/s");
+        }
+        for (size_t n = 1; n <= max_blocks; n *= 2) {
+            double cpu_best = 1e18, hw_best = 1e18;
+            for (int r = 0; r < reps; r++) {
+                cpu_best = std::min(cpu_best, runCpu(pt.data(), ct.data(), n));
+                double ns;
+                if (hasHw() && runHw(pt.data(), ct.data(), n, ns)) hw_best = std::min(hw_best, ns);
+            }
+            if (verbose) {
+                if (hasHw() && hw_best < 1e18)
+                    printf("    %8zu %12.2f %12.2f %12.2f\n", n, cpu_best / 1e3, hw_best / 1e3, n * 16 / hw_best * 1e3);
+                else
+                    printf("    %8zu %12.2f %12s %12s\n", n, cpu_best / 1e3, "-", "-");
+            }
+        }
+
+        size_t cross = crossoverBlocks();
+        if (verbose) {
+            double ah, bh, ac, bc;
+            _hw_model.fit(ah, bh);
+            _cpu_model.fit(ac, bc);
+            printf("    CPU (%s): %.2fus + %.3fus/block\n", SoftAes256::kernelName(_cpu.kernel()), ac / 1e3, bc / 1e3);
+            if (hasHw()) printf("    HW        : %.2fus + %.3fus/block\n", ah / 1e3, bh / 1e3);
+            if (!hasHw())    printf("    Crossover : no HW backend\n");
+            else if (cross)  printf("    Crossover : HW wins whole jobs from %zu blocks (%zu bytes)\n", cross, cross * 16);
+            else             printf("    Crossover : none, CPU faster at every size\n");
+            size_t split_from = 0;
+            for (size_t n = 2; n <= max_blocks && !split_from; n++) {
+                if (plan(n).route != AesRoute::CPU) split_from = n;
+            }
+            if (hasHw() && split_from) printf("    Dispatch  : HW/split used from %zu blocks\n", split_from);
+        }
+        return cross;
+    }
+
+    // smallest n where the core alone beats the CPU alone (0 = never)
+    size_t crossoverBlocks() const {
+        if (!hasHw()) return 0;
+        double ah, bh, ac, bc;
+        _hw_model.fit(ah, bh);
+        _cpu_model.fit(ac, bc);
+        if (bh >= bc) return 0;
+        double n = (ah - ac) / (bc - bh);
+        return n < 1 ? 1 : (size_t)n + 1;
+    }
+
+    bool keyed() const { return _keyed; }
+    bool hasHw() const { return _hw || _cluster; }
+    SoftAesKernel cpuKernel() const { return _cpu.kernel(); }
+    const AesDispatchStats& stats() const { return _stats; }
+    void resetStats() { _stats = AesDispatchStats{}; }
+    LatencyModel& hwModel() { return _hw_model; }
+    LatencyModel& cpuModel() { return _cpu_model; }
+};
@@ -0,0 +1,716 @@
+/**
+* @file aes_driver.h
+* @brief AES-256 AXI-Lite driver for the aes_bridge peripheral on PYNQ-Z2
+* @details Single block and streaming bulk encryption against aes_axi_wrapper.sv.
+*
+* Bulk flow (key already loaded, CTRL=0, core READY):
+* 1. write PTEXT_W for block 0, CTRL=ENCRYPT
+* 2. write PTEXT_W for block i+1 while block i is in the core
+* 3. poll AES_status until done
+* 4. read CTEXT_W for block i
+* 5. CTRL=CLEAR (DONE -> READY, drops encrypt bit), CTRL=ENCRYPT (rising edge starts block i+1)
+*
+* Registers go through hsm_regmap.h's RegShadow: KEY_W / PTEXT_W words the core already
+* holds are not rewritten (CTR counter blocks only change their last word), and a strobe
+* only deasserts its bit first when the shadow says it may still be high. CTRL is left
+* at the last strobe / CLEAR instead of being dropped to 0 after every operation; the
+* core only acts on rising edges and on CLEAR in DONE, so the next strobe does it.
+* setShadowing(false) restores the write-everything sequence (bench_hsm counts both).
+*
+* Batch flow (many small jobs, one key each), encryptBatch():
+* - jobs are stably grouped by key handle, the resident key's group first
+* - the next key's KEY_W go out while the previous job's last block is in the core
+*   (aes_core latches W[0..7] on key_valid; KEY_W is not read again until the next one)
+* - CTRL=CLEAR, CTRL=KEY_LOAD, then during the 52-cycle expansion read the previous
+*   ciphertext (CTEXT only changes at the end of an ENCRYPT) and write the next
+*   plaintext (PTEXT_W is only sampled on encrypt_start); READY -> CTRL=ENCRYPT
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "hsm_regmap.h"
+#include "hsm_wait.h"
+#include "reg_device.h"
+
+// HW Config =======================================
+constexpr uint32_t AES_BASE_ADDR = 0x40001000;
+constexpr uint32_t AES_SIZE = 0x1000;           // 4KB
+
+// core timing - from aes_core.sv
+constexpr double   AES_CLK_HZ         = 100e6;  // S_AXI_ACLK
+constexpr uint32_t AES_KEY_EXP_CYCLES = 52;     // W[8..59], 1 word/cycle
+constexpr uint32_t AES_BLOCK_CYCLES   = 14;     // 1 round/cycle
+
+// Bulk stats =======================================
+struct AesBulkStats {
+    size_t   blocks     = 0;
+    uint64_t elapsed_ns = 0;
+    uint64_t polls      = 0;   // STATUS reads spent waiting for DONE
+
+    double blocks_per_sec() const { return elapsed_ns ? blocks * 1e9 / elapsed_ns : 0.0; }
+    // ceiling if the bus were free: one block every AES_BLOCK_CYCLES
+    static double core_blocks_per_sec() { return AES_CLK_HZ / AES_BLOCK_CYCLES; }
+    double efficiency() const { return blocks_per_sec() / core_blocks_per_sec(); }
+};
+
+inline void print_bulk_stats(const AesBulkStats& s) {
+    printf("    Blocks      : %zu in %.3f ms\n", s.blocks, s.elapsed_ns / 1e6);
+    printf("    Throughput  : %.0f blocks/s (%.2f MB/s)\n", s.blocks_per_sec(), s.blocks_per_sec() * 16 / 1e6);
+    printf("    Core limit  : %.0f blocks/s (%u cycles/block @ %.0f MHz)\n",
+           AesBulkStats::core_blocks_per_sec(), AES_BLOCK_CYCLES, AES_CLK_HZ / 1e6);
+    printf("    Efficiency  : %.2f%% of core rate, %.2f polls/block\n",
+           s.efficiency() * 100.0, s.blocks ? (double)s.polls / s.blocks : 0.0);
+}
+
+// Cost model =======================================
+// decayed least squares fit of ns = a + b * blocks (aes_dispatch.h routing, aes_cluster.h sharding)
+struct LatencyModel {
+    double decay = 0.97;                        // weight of history per sample
+    double a_prior = 0, b_prior = 0;            // used until two distinct sizes are seen
+    double s = 0, sx = 0, sxx = 0, sy = 0, sxy = 0;
+    uint64_t samples = 0;
+
+    LatencyModel() = default;
+    LatencyModel(double a, double b) : a_prior(a), b_prior(b) {}
+
+    void reset() { s = sx = sxx = sy = sxy = 0; samples = 0; }
+
+    void update(double blocks, double ns) {
+        s   = decay * s   + 1;
+        sx  = decay * sx  + blocks;
+        sxx = decay * sxx + blocks * blocks;
+        sy  = decay * sy  + ns;
+        sxy = decay * sxy + blocks * ns;
+        samples++;
+    }
+
+    // fitted (a, b); falls back to the prior slope when sizes don't vary enough
+    void fit(double& a, double& b) const {
+        if (samples == 0) { a = a_prior; b = b_prior; return; }
+        double det = s * sxx - sx * sx;
+        if (det > 1e-9 * s * sxx) {
+            b = (s * sxy - sx * sy) / det;
+            a = (sy - b * sx) / s;
+        } else {
+            a = a_prior;
+            b = sx > 0 ? (sy - a * s) / sx : b_prior;
+        }
+        if (b <= 0) b = b_prior > 0 ? b_prior : 1;
+        if (a < 0) a = 0;
+    }
+
+    double predict(double blocks) const {
+        double a, b;
+        fit(a, b);
+        return a + b * blocks;
+    }
+};
+
+// Key handles =======================================
+// registerKey() returns a handle; encrypt calls name it and the driver skips the
+// KEY_W writes + 52-cycle expansion when that key is already resident in the core.
+using AesKeyHandle = uint32_t;
+constexpr AesKeyHandle AES_NO_KEY = 0;
+
+// aes_core.sv holds one expanded schedule (W[0..59]); a multi-slot core would
+// only need to raise this and pick a slot on miss
+constexpr int AES_HW_KEY_SLOTS = 1;
+
+struct AesKeyCacheStats {
+    uint64_t hits          = 0;   // key already resident, no MMIO
+    uint64_t misses        = 0;   // had to expand
+    uint64_t reloads       = 0;   // misses that evicted another resident key
+    uint64_t words_written = 0;   // KEY_W writes issued
+    uint64_t words_skipped = 0;   // KEY_W writes elided (register already held the word)
+
+    void print() const {
+        uint64_t lookups = hits + misses;
+        printf("    Key cache   : %llu lookups, %llu hits (%.1f%%), %llu misses, %llu reloads\n",
+               (unsigned long long)lookups, (unsigned long long)hits,
+               lookups ? 100.0 * hits / lookups : 0.0,
+               (unsigned long long)misses, (unsigned long long)reloads);
+        printf("    KEY_W words : %llu written, %llu skipped, ~%llu expansion cycles saved\n",
+               (unsigned long long)words_written, (unsigned long long)words_skipped,
+               (unsigned long long)(hits * AES_KEY_EXP_CYCLES));
+    }
+};
+
+// Batch =======================================
+// one tenant job: n_blocks under key, 4 big-endian words per block; pt and ct may alias
+// within a job but jobs must not overlap each other
+struct AesBatchJob {
+    AesKeyHandle    key;
+    const uint32_t* pt;
+    uint32_t*       ct;
+    size_t          n_blocks;
+};
+
+struct AesBatchStats {
+    uint64_t jobs        = 0;
+    uint64_t blocks      = 0;
+    uint64_t key_loads   = 0;   // expansions issued
+    uint64_t key_loads_submitted = 0;   // expansions the submitted order would have needed
+    uint64_t keys_staged = 0;   // key loads whose KEY_W writes went out under a block in flight
+    uint64_t elapsed_ns  = 0;
+
+    double jobs_per_sec() const { return elapsed_ns ? jobs * 1e9 / elapsed_ns : 0.0; }
+
+    void print() const {
+        printf("    Batch       : %llu jobs, %llu blocks in %.3f ms (%.0f jobs/s)\n",
+               (unsigned long long)jobs, (unsigned long long)blocks, elapsed_ns / 1e6, jobs_per_sec());
+        printf("    Key loads   : %llu (submitted order: %llu), %llu staged under a block\n",
+               (unsigned long long)key_loads, (unsigned long long)key_loads_submitted,
+               (unsigned long long)keys_staged);
+    }
+};
+
+enum class AesKeyState : uint8_t {
+    INVALID,        // no such handle
+    RESIDENT,       // already expanded in the core
+    EXPANDING       // KEY_W written and KEY_LOAD strobed, READY still to come
+};
+
+// AES driver =======================================
+class AesDriver {
+private:
+    MMIO& _aes;
+
+    Completion _key_wait;       // KEY_LOAD -> READY (52 cycles)
+    Completion _enc_wait;       // ENCRYPT -> DONE (14 cycles)
+    Completion _bulk_wait;      // per block inside encryptBulk()
+
+    // key handle table, handle = index + 1
+    struct KeyEntry {
+        uint32_t key[8];
+        bool     live;
+    };
+    std::vector<KeyEntry>     _keys;
+    std::vector<AesKeyHandle> _free_keys;
+    AesKeyHandle              _resident[AES_HW_KEY_SLOTS] = {};  // handle expanded in each slot
+    AesKeyCacheStats          _key_stats;
+    RegShadow<AesMap::REGS>   _regs;
+
+    bool pollStatus(uint32_t mask, Completion& c) {
+        return c.wait([&] { return (_aes.read<AesMap::STATUS>() & mask) == mask; });
+    }
+
+    void ctrl(uint32_t v) { _regs.write<AesMap::CTRL>(_aes, v); }
+
+    // rising edge on bit with every other CTRL bit low
+    void strobe(uint32_t bit) {
+        if (!_regs.enabled()) {
+            ctrl(0);
+            ctrl(bit);
+            ctrl(0);
+            return;
+        }
+        if (!_regs.known<AesMap::CTRL>() || (_regs.value<AesMap::CTRL>() & bit)) ctrl(0);
+        ctrl(bit);
+    }
+
+    // DONE -> READY; leaves CLEAR high (harmless outside DONE) unless shadowing is off
+    void clearDone() {
+        ctrl(AES::CTRL_CLEAR);
+        if (!_regs.enabled()) ctrl(0);
+    }
+
+    // write KEY_W0..7 (optionally only the words that differ); safe while the core is
+    // busy, it only reads them on the KEY_LOAD edge
+    void stageKey(const uint32_t key[8], bool skip_unchanged) {
+        for (uint32_t i = 0; i < 8; i++) {
+            if (_regs.writeAt<AesMap::KEY_W0>(_aes, i, key[i], !skip_unchanged)) _key_stats.words_written++;
+            else _key_stats.words_skipped++;
+        }
+    }
+
+    // stageKey() + strobe
+    void writeKey(const uint32_t key[8], bool skip_unchanged) {
+        stageKey(key, skip_unchanged);
+        strobe(AES::CTRL_KEY_LOAD);
+    }
+
+    // writeKey() + wait READY
+    bool expandKey(const uint32_t key[8], bool skip_unchanged) {
+        HsmTelTimer tel(HsmMetric::KEY_LOAD);
+        writeKey(key, skip_unchanged);
+
+        // wait for ready
+        if (!pollStatus(AES::STATUS_READY, _key_wait)) {
+            printf("    [TIMEOUT] Key expansion did not complete\n");
+            invalidateKeyCache();
+            return false;
+        }
+        return true;
+    }
+
+    // hit / miss bookkeeping shared by useKey() and startKey(); no MMIO
+    AesKeyState lookupKey(AesKeyHandle h) {
+        if (!validKey(h)) return AesKeyState::INVALID;
+        for (AesKeyHandle r : _resident) {
+            if (r == h) {
+                _key_stats.hits++;
+                hsm_tel_count(HsmCounter::KEY_HITS);
+                return AesKeyState::RESIDENT;
+            }
+        }
+        _key_stats.misses++;
+        if (_resident[0] != AES_NO_KEY) {
+            _key_stats.reloads++;
+            hsm_tel_count(HsmCounter::KEY_RELOADS);
+        }
+        return AesKeyState::EXPANDING;
+    }
+
+    // PTEXT_W is only sampled on the encrypt strobe, so unchanged words need no write
+    void writeBlock(const uint32_t pt[4]) {
+        _regs.write<AesMap::PTEXT_W0>(_aes, pt[0]);
+        _regs.write<AesMap::PTEXT_W1>(_aes, pt[1]);
+        _regs.write<AesMap::PTEXT_W2>(_aes, pt[2]);
+        _regs.write<AesMap::PTEXT_W3>(_aes, pt[3]);
+    }
+
+    void readBlock(uint32_t ct[4]) {
+        ct[0] = _aes.read<AesMap::CTEXT_W0>();
+        ct[1] = _aes.read<AesMap::CTEXT_W1>();
+        ct[2] = _aes.read<AesMap::CTEXT_W2>();
+        ct[3] = _aes.read<AesMap::CTEXT_W3>();
+    }
+
+public:
+    explicit AesDriver(MMIO& aes) : _aes(aes) {
+        // a block is 140ns of core time: spin hard, never pay for a clock read
+        _bulk_wait.policy.spin_iters = 4096;
+        _bulk_wait.policy.timed = false;
+    }
+
+    // key load + single block waits; bulk keeps its own spin policy
+    void setWaitPolicy(const WaitPolicy& p) { _key_wait.policy = p; _enc_wait.policy = p; }
+    Completion& keyWait()     { return _key_wait; }
+    Completion& encryptWait() { return _enc_wait; }
+    Completion& bulkWait()    { return _bulk_wait; }
+
+    void printWaitStats() const {
+        _key_wait.stats.print("key_load");
+        _enc_wait.stats.print("encrypt");
+        _bulk_wait.stats.print("bulk");
+    }
+
+    uint32_t status() { return _aes.read<AesMap::STATUS>(); }
+
+    // off: every register write reaches the bus and CTRL returns to 0 after each op
+    void setShadowing(bool on) { _regs.setEnabled(on); }
+    const RegShadowStats& shadowStats() const { return _regs.stats(); }
+    void resetShadowStats() { _regs.resetStats(); }
+
+    bool loadKey(const uint32_t key[8]) {
+        // raw key, not tracked by a handle
+        for (AesKeyHandle& h : _resident) h = AES_NO_KEY;
+        return expandKey(key, false);
+    }
+
+    // Key handles ---------------------------------
+    AesKeyHandle registerKey(const uint32_t key[8]) {
+        AesKeyHandle h;
+        if (!_free_keys.empty()) {
+            h = _free_keys.back();
+            _free_keys.pop_back();
+        } else {
+            _keys.push_back(KeyEntry{});
+            h = (AesKeyHandle)_keys.size();
+        }
+        KeyEntry& e = _keys[h - 1];
+        memcpy(e.key, key, sizeof(e.key));
+        e.live = true;
+        return h;
+    }
+
+    void unregisterKey(AesKeyHandle h) {
+        if (!validKey(h)) return;
+        KeyEntry& e = _keys[h - 1];
+        volatile uint32_t* wipe = e.key;
+        for (int i = 0; i < 8; i++) wipe[i] = 0;
+        e.live = false;
+        _free_keys.push_back(h);
+        for (AesKeyHandle& r : _resident) if (r == h) r = AES_NO_KEY;
+    }
+
+    bool validKey(AesKeyHandle h) const {
+        return h != AES_NO_KEY && h <= _keys.size() && _keys[h - 1].live;
+    }
+
+    // make h the expanded key; no MMIO at all when it already is
+    bool useKey(AesKeyHandle h) {
+        switch (lookupKey(h)) {
+            case AesKeyState::INVALID:
+                printf("    [ERROR] Invalid AES key handle %u\n", h);
+                return false;
+            case AesKeyState::RESIDENT:
+                return true;
+            case AesKeyState::EXPANDING:
+                break;
+        }
+        _resident[0] = AES_NO_KEY;
+        if (!expandKey(_keys[h - 1].key, true)) return false;
+        _resident[0] = h;
+        return true;
+    }
+
+    // forget what the core holds (e.g. after a PL reset or another process touched it)
+    void invalidateKeyCache() {
+        for (AesKeyHandle& r : _resident) r = AES_NO_KEY;
+        _regs.invalidate();
+    }
+
+    AesKeyHandle residentKey() const { return _resident[0]; }
+    const AesKeyCacheStats& keyCacheStats() const { return _key_stats; }
+    void resetKeyCacheStats() { _key_stats = AesKeyCacheStats{}; }
+
+    bool encrypt(AesKeyHandle h, const uint32_t pt[4], uint32_t ct_out[4]) {
+        return useKey(h) && encrypt(pt, ct_out);
+    }
+
+    bool encryptBulk(AesKeyHandle h, const uint32_t* pt, uint32_t* ct, size_t n_blocks, AesBulkStats* stats = nullptr) {
+        return useKey(h) && encryptBulk(pt, ct, n_blocks, stats);
+    }
+
+    bool encrypt(const uint32_t pt[4], uint32_t ct_out[4]) {
+        HsmTelTimer tel(HsmMetric::BLOCK_ENCRYPT);
+
+        // write 4 plaintext words
+        writeBlock(pt);
+
+        // strobe encrypt
+        strobe(AES::CTRL_ENCRYPT);
+
+        // wait for done
+        if (!pollStatus(AES::STATUS_DONE, _enc_wait)) {
+            printf("    [TIMEOUT] Encryption did not complete\n");
+            return false;
+        }
+
+        // read ciphertext
+        readBlock(ct_out);
+
+        // clear done latch
+        clearDone();
+
+        hsm_tel_count(HsmCounter::BLOCKS);
+        return true;
+    }
+
+    /**
+    * @brief Encrypt n_blocks under the loaded key, 4 big-endian words per block
+    * @details pt and ct may alias. The core samples PTEXT_W only on the encrypt
+    *          strobe, so block i+1 is written while block i is still in flight.
+    *          Leaves the core READY with the key still expanded (CTRL=CLEAR, or 0
+    *          with shadowing off).
+    */
+    bool encryptBulk(const uint32_t* pt, uint32_t* ct, size_t n_blocks, AesBulkStats* stats = nullptr) {
+        AesBulkStats local;
+        AesBulkStats& st = stats ? *stats : local;
+        st = AesBulkStats{};
+        if (n_blocks == 0) return true;
+
+        auto t0 = std::chrono::steady_clock::now();
+
+        pipeStart(pt);
+        for (size_t i = 0; i < n_blocks; i++) {
+            bool has_next = (i + 1) < n_blocks;
+
+            // overlap: stage next plaintext while the core runs block i
+            if (has_next) pipeStage(pt + 4 * (i + 1));
+
+            uint64_t polls_before = _bulk_wait.stats.polls;
+            bool done = pollStatus(AES::STATUS_DONE, _bulk_wait);
+            st.polls += _bulk_wait.stats.polls - polls_before;
+            if (!done) {
+                printf("    [TIMEOUT] Bulk encryption stalled at block %zu\n", i);
+                pipeAbort();
+                return false;
+            }
+            pipeRetire(ct + 4 * i, has_next);
+        }
+
+        st.blocks = n_blocks;
+        st.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - t0).count();
+        hsm_tel_record(HsmMetric::BULK_ENCRYPT, st.elapsed_ns);
+        hsm_tel_count(HsmCounter::BLOCKS, n_blocks);
+        return true;
+    }
+
+    /**
+    * @brief Run many small jobs, each under its own key, as one block pipeline
+    * @details Jobs are grouped by key (stable, the resident key first) unless
+    *          group_keys is false; results land in each job's ct whatever the order.
+    *          Equal-key neighbours share the bulk pipeline; at a key change the next
+    *          KEY_W are staged under the last block, and the ciphertext read / next
+    *          plaintext write run during the expansion. Invalid handles fail the whole
+    *          batch before any register is touched. Leaves the core READY on the last key.
+    */
+    bool encryptBatch(const AesBatchJob* jobs, size_t n_jobs, AesBatchStats* stats = nullptr, bool group_keys = true) {
+        AesBatchStats local;
+        AesBatchStats& st = stats ? *stats : local;
+        st = AesBatchStats{};
+        auto t0 = std::chrono::steady_clock::now();
+
+        // order -------------------------------------
+        std::vector<size_t> order;
+        order.reserve(n_jobs);
+        AesKeyHandle prev = _resident[0];
+        for (size_t j = 0; j < n_jobs; j++) {
+            if (!validKey(jobs[j].key)) {
+                printf("    [ERROR] Invalid AES key handle %u in batch job %zu\n", jobs[j].key, j);
+                return false;
+            }
+            if (jobs[j].n_blocks == 0) continue;
+            if (jobs[j].key != prev) st.key_loads_submitted++;
+            prev = jobs[j].key;
+            order.push_back(j);
+            st.blocks += jobs[j].n_blocks;
+        }
+        st.jobs = n_jobs;
+        if (order.empty()) return true;
+        if (group_keys) {
+            AesKeyHandle res = _resident[0];
+            std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+                // handles start at 1: rank 0 puts the resident key's group first
+                AesKeyHandle ka = jobs[a].key == res ? 0 : jobs[a].key;
+                AesKeyHandle kb = jobs[b].key == res ? 0 : jobs[b].key;
+                return ka < kb;
+            });
+        }
+
+        // pipeline ----------------------------------
+        const AesBatchJob* cur = &jobs[order[0]];
+        if (_resident[0] != cur->key) st.key_loads++;
+        if (!useKey(cur->key)) return false;
+        pipeStart(cur->pt);
+        size_t k = 0, b = 0;        // in flight: block b of jobs[order[k]]
+        while (true) {
+            // what follows block b
+            const AesBatchJob* nxt = cur;
+            size_t nb = b + 1;
+            if (nb == cur->n_blocks) {
+                nxt = k + 1 < order.size() ? &jobs[order[k + 1]] : nullptr;
+                nb = 0;
+            }
+            bool switch_key = nxt && nxt->key != cur->key;
+
+            // overlap: stage the next plaintext, or the next key, under block b
+            if (switch_key) {
+                lookupKey(nxt->key);
+                stageKey(_keys[nxt->key - 1].key, true);
+                st.keys_staged++;
+                st.key_loads++;
+            } else if (nxt) {
+                pipeStage(nxt->pt + 4 * nb);
+            }
+
+            if (!pollStatus(AES::STATUS_DONE, _bulk_wait)) {
+                printf("    [TIMEOUT] Batch stalled at job %zu block %zu\n", order[k], b);
+                pipeAbort();
+                invalidateKeyCache();
+                return false;
+            }
+
+            if (!switch_key) {
+                pipeRetire(cur->ct + 4 * b, nxt != nullptr);
+                if (!nxt) break;
+            } else {
+                // DONE -> READY, expand the staged key; ciphertext out / plaintext in meanwhile
+                ctrl(AES::CTRL_CLEAR);
+                ctrl(AES::CTRL_KEY_LOAD);
+                _resident[0] = AES_NO_KEY;
+                readBlock(cur->ct + 4 * b);
+                writeBlock(nxt->pt);
+                if (!pollStatus(AES::STATUS_READY, _key_wait)) {
+                    printf("    [TIMEOUT] Key expansion did not complete (batch job %zu)\n", order[k + 1]);
+                    invalidateKeyCache();
+                    return false;
+                }
+                _resident[0] = nxt->key;
+                ctrl(AES::CTRL_ENCRYPT);
+            }
+            if (nxt != cur) k++;
+            cur = nxt;
+            b = nb;
+        }
+
+        st.elapsed_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            std::chrono::steady_clock::now() - t0).count();
+        hsm_tel_count(HsmCounter::BLOCKS, st.blocks);
+        return true;
+    }
+
+    // Split phase ---------------------------------
+    // useKey() / encryptBulk() cut at their waits, for callers that poll STATUS from an
+    // event loop (hsm_async.h) instead of blocking. Same register sequence; no telemetry,
+    // the caller accounts for what it finishes.
+
+    // RESIDENT: nothing written. EXPANDING: poll keyReady(), then finishKey(h);
+    // on giving up call invalidateKeyCache()
+    AesKeyState startKey(AesKeyHandle h) {
+        AesKeyState s = lookupKey(h);
+        if (s == AesKeyState::EXPANDING) {
+            _resident[0] = AES_NO_KEY;
+            writeKey(_keys[h - 1].key, true);
+        }
+        return s;
+    }
+    bool keyReady() { return status() & AES::STATUS_READY; }
+    void finishKey(AesKeyHandle h) { _resident[0] = h; }
+
+    // first block in, rising ENCRYPT (it is low after any other op)
+    void pipeStart(const uint32_t pt[4]) {
+        writeBlock(pt);
+        if (!_regs.known<AesMap::CTRL>() || (_regs.value<AesMap::CTRL>() & AES::CTRL_ENCRYPT)) ctrl(0);
+        ctrl(AES::CTRL_ENCRYPT);
+    }
+    // next plaintext while the current block is in the core
+    void pipeStage(const uint32_t pt[4]) { writeBlock(pt); }
+    bool pipeDone() { return status() & AES::STATUS_DONE; }
+
+    // ciphertext out, DONE -> READY and drop ENCRYPT in one write, start the staged block
+    void pipeRetire(uint32_t ct[4], bool more) {
+        readBlock(ct);
+        ctrl(AES::CTRL_CLEAR);
+        if (more) ctrl(AES::CTRL_ENCRYPT);
+        else if (!_regs.enabled()) ctrl(0);
+    }
+    void pipeAbort() {
+        ctrl(AES::CTRL_CLEAR);
+        ctrl(0);
+    }
+};
+
+// Split-phase job =======================================
+// One encryptBulk(h, ...) as a state machine: step() never waits, it does what the core
+// is ready for and returns, so a loop can interleave it with other work (hsm_async.h)
+// or with jobs on other cores (aes_cluster.h).
+enum class AesJobState : uint8_t { IDLE, RUNNING, DONE, BAD_KEY, TIMEOUT };
+
+class AesJob {
+private:
+    using clock = std::chrono::steady_clock;
+    enum class Phase : uint8_t { START, KEY, BLOCKS };
+
+    AesDriver*      _drv;
+    uint32_t        _timeout_us;
+    AesJobState     _state = AesJobState::IDLE;
+    Phase           _phase = Phase::START;
+    AesKeyHandle    _key = AES_NO_KEY;
+    const uint32_t* _pt = nullptr;
+    uint32_t*       _ct = nullptr;
+    size_t          _n = 0;
+    size_t          _done = 0;
+    bool            _expanded = false;      // this job paid for a key expansion
+    bool            _waiting = false;       // a poll missed, deadline armed
+    clock::time_point _deadline;
+
+    void beginBlocks() {
+        if (_n == 0) {
+            _state = AesJobState::DONE;
+            return;
+        }
+        _drv->pipeStart(_pt);
+        if (_n > 1) _drv->pipeStage(_pt + 4);
+        _phase = Phase::BLOCKS;
+        _waiting = false;
+    }
+
+    // a poll missed: arm the deadline on the first miss, give up once it has passed
+    bool missed(const char* what) {
+        clock::time_point now = clock::now();
+        if (!_waiting) {
+            _waiting = true;
+            _deadline = now + std::chrono::microseconds(_timeout_us);
+            return false;
+        }
+        if (now < _deadline) return false;
+        printf("    [TIMEOUT] %s did not complete\n", what);
+        hsm_tel_count(HsmCounter::WAIT_TIMEOUTS);
+        abort();
+        _state = AesJobState::TIMEOUT;
+        return true;
+    }
+
+public:
+    explicit AesJob(AesDriver* drv, uint32_t timeout_us = 100000) : _drv(drv), _timeout_us(timeout_us) {}
+
+    void start(AesKeyHandle h, const uint32_t* pt, uint32_t* ct, size_t n_blocks) {
+        _state = AesJobState::RUNNING;
+        _phase = Phase::START;
+        _key = h;
+        _pt = pt;
+        _ct = ct;
+        _n = n_blocks;
+        _done = 0;
+        _expanded = false;
+        _waiting = false;
+    }
+
+    /**
+    * @brief Advance without waiting: at most max_blocks blocks retired
+    * @return true when anything moved (register writes issued or a block retired)
+    */
+    bool step(uint32_t max_blocks = 1) {
+        if (_state != AesJobState::RUNNING) return false;
+        switch (_phase) {
+            case Phase::START:
+                switch (_drv->startKey(_key)) {
+                    case AesKeyState::INVALID:   _state = AesJobState::BAD_KEY; break;
+                    case AesKeyState::RESIDENT:  beginBlocks(); break;
+                    case AesKeyState::EXPANDING:
+                        _phase = Phase::KEY;
+                        _expanded = true;
+                        _waiting = false;
+                        break;
+                }
+                return true;
+
+            case Phase::KEY:
+                if (!_drv->keyReady()) return missed("key expansion");
+                _drv->finishKey(_key);
+                beginBlocks();
+                return true;
+
+            case Phase::BLOCKS:
+                for (uint32_t k = 0; k < max_blocks; k++) {
+                    if (!_drv->pipeDone()) return k ? true : missed("encryption");
+                    size_t i = _done++;
+                    bool more = _done < _n;
+                    _drv->pipeRetire(_ct + 4 * i, more);
+                    if (!more) {
+                        hsm_tel_count(HsmCounter::BLOCKS, _n);
+                        _state = AesJobState::DONE;
+                        return true;
+                    }
+                    if (i + 2 < _n) _drv->pipeStage(_pt + 4 * (i + 2));
+                    _waiting = false;
+                }
+                return true;
+        }
+        return false;
+    }
+
+    // leave the core READY and forget its key (timeout, or the owner is shutting down)
+    void abort() {
+        if (_state == AesJobState::RUNNING && _phase == Phase::BLOCKS) _drv->pipeAbort();
+        if (_state == AesJobState::RUNNING && _phase != Phase::START) _drv->invalidateKeyCache();
+        _state = AesJobState::IDLE;
+    }
+
+    AesJobState state() const { return _state; }
+    bool   running() const { return _state == AesJobState::RUNNING; }
+    size_t blocksDone() const { return _done; }
+    bool   expandedKey() const { return _expanded; }
+};
@@ -0,0 +1,512 @@
+/**
+* @file     aes_modes.h
+* @brief    AES-256 modes over AesDispatcher: CTR, CBC encrypt, GCM (streaming init/update/final)
+* @details  Byte-oriented front end to the block primitive (4 big endian words per block).
+*           The core only encrypts, which is all CTR and GCM need in both directions.
+*
+* CTR / GCM keystream is produced AES_MODES_CHUNK blocks at a time, double buffered:
+* 1. counters for chunk k+1 go out with encryptAsync() (core, CPU or split)
+* 2. meanwhile this thread XORs chunk k and, for GCM, GHASHes its ciphertext
+* 3. wait(), swap buffers
+* so GHASH and the XOR run while the core is busy instead of after it.
+*
+* CBC encryption is serial by definition (each block chains on the last), so it is one
+* dispatch per block and the dispatcher keeps it on the CPU; decrypt is not offered
+* (it needs the inverse cipher, which the core does not have).
+*
+* GHASH is table driven (Shoup, 4-bit tables, 256 B + a 16-entry reduction table per key),
+* which suits the Cortex-A9 (no PMULL); it is portable and constant memory per key.
+*
+* The dispatcher holds the key: setKey() on it, then init() the mode. A mode object is
+* not thread safe and uses its dispatcher exclusively while a call runs.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "aes_dispatch.h"
+
+constexpr size_t   AES_MODES_CHUNK = 512;                      // blocks per pipelined dispatch
+constexpr uint64_t AES_GCM_MAX_TEXT = (1ull << 36) - 32;       // bytes, SP 800-38D 5.2.1.1
+
+namespace aes_modes_detail {
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+inline uint64_t load_be64(const uint8_t* p) { return (uint64_t)load_be32(p) << 32 | load_be32(p + 4); }
+
+inline void store_be64(uint8_t* p, uint64_t v) {
+    store_be32(p, (uint32_t)(v >> 32));
+    store_be32(p + 4, (uint32_t)v);
+}
+
+inline void wipe(void* p, size_t n) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    for (size_t i = 0; i < n; i++) v[i] = 0;
+}
+
+// out = in ^ keystream, n_words of keystream (big endian words, little endian host)
+inline void xor_keystream(const uint8_t* in, uint8_t* out, const uint32_t* ks, size_t n_words) {
+    for (size_t i = 0; i < n_words; i++) {
+        uint32_t x;
+        memcpy(&x, in + 4 * i, 4);
+        x ^= __builtin_bswap32(ks[i]);
+        memcpy(out + 4 * i, &x, 4);
+    }
+}
+
+// GHASH =======================================
+// Shoup's 4-bit method: M[i] = i * H for every nibble i, one table lookup + shift per nibble
+class Ghash {
+private:
+    uint64_t _hh[16], _hl[16];      // high / low halves of M[i]
+    uint8_t  _y[16];
+    uint8_t  _buf[16];
+    size_t   _fill = 0;
+
+    // x^4 reduction of the 4 bits shifted out, pre-multiplied by the GCM polynomial
+    static constexpr uint16_t LAST4[16] = {
+        0x0000, 0x1c20, 0x3840, 0x2460, 0x7080, 0x6ca0, 0x48c0, 0x54e0,
+        0xe100, 0xfd20, 0xd940, 0xc560, 0x9180, 0x8da0, 0xa9c0, 0xb5e0,
+    };
+
+    // y = y * H in GF(2^128)
+    void mult() {
+        uint8_t lo = _y[15] & 0xF, hi;
+        uint64_t zh = _hh[lo], zl = _hl[lo];
+        for (int i = 15; i >= 0; i--) {
+            lo = _y[i] & 0xF;
+            hi = _y[i] >> 4;
+            if (i != 15) {
+                uint8_t rem = (uint8_t)(zl & 0xF);
+                zl = (zh << 60) | (zl >> 4);
+                zh = (zh >> 4) ^ ((uint64_t)LAST4[rem] << 48);
+                zh ^= _hh[lo];
+                zl ^= _hl[lo];
+            }
+            uint8_t rem = (uint8_t)(zl & 0xF);
+            zl = (zh << 60) | (zl >> 4);
+            zh = (zh >> 4) ^ ((uint64_t)LAST4[rem] << 48);
+            zh ^= _hh[hi];
+            zl ^= _hl[hi];
+        }
+        store_be64(_y, zh);
+        store_be64(_y + 8, zl);
+    }
+
+    void block(const uint8_t* b) {
+        for (int i = 0; i < 16; i++) _y[i] ^= b[i];
+        mult();
+    }
+
+public:
+    Ghash() { wipeAll(); }
+    ~Ghash() { wipeAll(); }
+
+    void init(const uint8_t h[16]) {
+        uint64_t vh = load_be64(h), vl = load_be64(h + 8);
+        _hh[0] = _hl[0] = 0;
+        _hh[8] = vh;
+        _hl[8] = vl;
+        for (int i = 4; i > 0; i >>= 1) {
+            uint64_t t = (vl & 1) ? 0xE100000000000000ull : 0;
+            vl = (vh << 63) | (vl >> 1);
+            vh = (vh >> 1) ^ t;
+            _hh[i] = vh;
+            _hl[i] = vl;
+        }
+        for (int i = 2; i <= 8; i *= 2) {
+            for (int j = 1; j < i; j++) {
+                _hh[i + j] = _hh[i] ^ _hh[j];
+                _hl[i + j] = _hl[i] ^ _hl[j];
+            }
+        }
+        reset();
+    }
+
+    void reset() {
+        memset(_y, 0, sizeof(_y));
+        _fill = 0;
+    }
+
+    // any length; partial blocks carry over to the next call
+    void update(const uint8_t* p, size_t len) {
+        if (_fill) {
+            size_t n = 16 - _fill < len ? 16 - _fill : len;
+            memcpy(_buf + _fill, p, n);
+            _fill += n;
+            p += n;
+            len -= n;
+            if (_fill < 16) return;
+            block(_buf);
+            _fill = 0;
+        }
+        for (; len >= 16; p += 16, len -= 16) block(p);
+        if (len) {
+            memcpy(_buf, p, len);
+            _fill = len;
+        }
+    }
+
+    // zero-pad the open partial block (end of AAD / end of ciphertext)
+    void pad() {
+        if (!_fill) return;
+        memset(_buf + _fill, 0, 16 - _fill);
+        block(_buf);
+        _fill = 0;
+    }
+
+    const uint8_t* digest() const { return _y; }
+
+    void wipeAll() {
+        wipe(_hh, sizeof(_hh));
+        wipe(_hl, sizeof(_hl));
+        wipe(_y, sizeof(_y));
+        wipe(_buf, sizeof(_buf));
+        _fill = 0;
+    }
+};
+
+// Keystream =======================================
+// counter-mode engine shared by AesCtr and AesGcm
+class CtrKeystream {
+private:
+    AesDispatcher& _aes;
+    uint32_t _ctr[4] = {};
+    bool     _inc32 = false;                // GCM: only the low 32 bits count
+    uint8_t  _ks[16] = {};
+    size_t   _ks_used = 16;                 // bytes of _ks already consumed
+    std::vector<uint32_t> _buf[2];
+    size_t   _buf_used = 0;                 // blocks of _buf to wipe in clear()
+
+    void next(uint32_t* block) {
+        memcpy(block, _ctr, 16);
+        if (_inc32) { _ctr[3]++; return; }
+        for (int i = 3; i >= 0 && ++_ctr[i] == 0; i--) {}
+    }
+
+    void fill(uint32_t* buf, size_t n) {
+        for (size_t i = 0; i < n; i++) next(buf + 4 * i);
+    }
+
+public:
+    explicit CtrKeystream(AesDispatcher& aes) : _aes(aes) {
+        _buf[0].resize(4 * AES_MODES_CHUNK);
+        _buf[1].resize(4 * AES_MODES_CHUNK);
+    }
+    ~CtrKeystream() { clear(); }
+
+    void init(const uint8_t counter[16], bool inc32) {
+        for (int i = 0; i < 4; i++) _ctr[i] = load_be32(counter + 4 * i);
+        _inc32 = inc32;
+        _ks_used = 16;
+    }
+
+    /**
+    * @brief out = in ^ keystream; hash(ciphertext, n) on every byte of ciphertext in order
+    * @details hash_input: the input is the ciphertext (decrypt), hashed before the XOR so
+    *          in == out works; otherwise the output is, hashed after.
+    */
+    template <class Hash>
+    bool crypt(const uint8_t* in, uint8_t* out, size_t len, Hash&& hash, bool hash_input) {
+        // rest of the last partial block
+        if (_ks_used < 16 && len) {
+            size_t n = 16 - _ks_used < len ? 16 - _ks_used : len;
+            if (hash_input) hash(in, n);
+            for (size_t i = 0; i < n; i++) out[i] = in[i] ^ _ks[_ks_used + i];
+            if (!hash_input) hash(out, n);
+            _ks_used += n;
+            in += n;
+            out += n;
+            len -= n;
+        }
+
+        size_t blocks = len / 16;
+        if (blocks) {
+            int cur = 0;
+            size_t first = blocks < AES_MODES_CHUNK ? blocks : AES_MODES_CHUNK;
+            fill(_buf[0].data(), first);
+            if (!_aes.encryptAsync(_buf[0].data(), _buf[0].data(), first)) return false;
+            for (size_t done = 0; done < blocks; cur ^= 1) {
+                size_t n = blocks - done < AES_MODES_CHUNK ? blocks - done : AES_MODES_CHUNK;
+                _aes.wait();
+                size_t rest = blocks - done - n;
+                if (rest) {
+                    size_t nn = rest < AES_MODES_CHUNK ? rest : AES_MODES_CHUNK;
+                    fill(_buf[cur ^ 1].data(), nn);
+                    if (!_aes.encryptAsync(_buf[cur ^ 1].data(), _buf[cur ^ 1].data(), nn)) return false;
+                }
+                // overlaps the chunk just submitted
+                size_t bytes = n * 16;
+                if (hash_input) hash(in, bytes);
+                xor_keystream(in, out, _buf[cur].data(), 4 * n);
+                if (!hash_input) hash(out, bytes);
+                in += bytes;
+                out += bytes;
+                len -= bytes;
+                done += n;
+            }
+            if (first > _buf_used) _buf_used = first;
+        }
+
+        if (len) {
+            uint32_t blk[4];
+            next(blk);
+            if (!_aes.encrypt(blk, blk, 1)) return false;
+            for (int i = 0; i < 4; i++) store_be32(_ks + 4 * i, blk[i]);
+            wipe(blk, sizeof(blk));
+            _ks_used = 0;
+            return crypt(in, out, len, hash, hash_input);
+        }
+        return true;
+    }
+
+    void clear() {
+        wipe(_buf[0].data(), _buf_used * 16);
+        wipe(_buf[1].data(), _buf_used * 16);
+        _buf_used = 0;
+        wipe(_ks, sizeof(_ks));
+        wipe(_ctr, sizeof(_ctr));
+        _ks_used = 16;
+    }
+};
+
+} // namespace aes_modes_detail
+
+// CTR =======================================
+// SP 800-38A CTR, full 128-bit big endian counter; encrypt and decrypt are the same call
+class AesCtr {
+private:
+    aes_modes_detail::CtrKeystream _ks;
+    bool _active = false;
+
+public:
+    explicit AesCtr(AesDispatcher& aes) : _ks(aes) {}
+
+    void init(const uint8_t counter[16]) {
+        _ks.init(counter, false);
+        _active = true;
+    }
+
+    // any length; the keystream position carries across calls
+    bool update(const uint8_t* in, uint8_t* out, size_t len) {
+        if (!_active) { printf("[ERROR] AesCtr: update before init\n"); return false; }
+        return _ks.crypt(in, out, len, [](const uint8_t*, size_t) {}, false);
+    }
+
+    void final() {
+        _ks.clear();
+        _active = false;
+    }
+};
+
+// CBC =======================================
+// SP 800-38A CBC encryption; optional PKCS#7 padding in final()
+class AesCbcEncrypt {
+private:
+    AesDispatcher& _aes;
+    uint32_t _chain[4] = {};
+    uint8_t  _buf[16];
+    size_t   _fill = 0;
+    bool     _active = false;
+
+    bool block(const uint8_t* pt, uint8_t* ct) {
+        for (int i = 0; i < 4; i++) _chain[i] ^= aes_modes_detail::load_be32(pt + 4 * i);
+        if (!_aes.encrypt(_chain, _chain, 1)) return false;
+        for (int i = 0; i < 4; i++) aes_modes_detail::store_be32(ct + 4 * i, _chain[i]);
+        return true;
+    }
+
+public:
+    explicit AesCbcEncrypt(AesDispatcher& aes) : _aes(aes) {}
+    ~AesCbcEncrypt() { aes_modes_detail::wipe(_buf, sizeof(_buf)); }
+
+    void init(const uint8_t iv[16]) {
+        for (int i = 0; i < 4; i++) _chain[i] = aes_modes_detail::load_be32(iv + 4 * i);
+        _fill = 0;
+        _active = true;
+    }
+
+    /**
+    * @brief Encrypt whole blocks as they complete; a partial block waits for more input
+    * @param written bytes put in out (a multiple of 16, at most len + 15)
+    */
+    bool update(const uint8_t* in, size_t len, uint8_t* out, size_t& written) {
+        written = 0;
+        if (!_active) { printf("[ERROR] AesCbcEncrypt: update before init\n"); return false; }
+        if (_fill) {
+            size_t n = 16 - _fill < len ? 16 - _fill : len;
+            memcpy(_buf + _fill, in, n);
+            _fill += n;
+            in += n;
+            len -= n;
+            if (_fill < 16) return true;
+            if (!block(_buf, out)) return false;
+            _fill = 0;
+            written += 16;
+        }
+        for (; len >= 16; in += 16, len -= 16, written += 16) {
+            if (!block(in, out + written)) return false;
+        }
+        memcpy(_buf, in, len);
+        _fill = len;
+        return true;
+    }
+
+    /**
+    * @brief pkcs7: pad and emit the last block (always 16 bytes); otherwise the input
+    *        must have been a whole number of blocks and nothing is written
+    */
+    bool final(uint8_t* out, size_t& written, bool pkcs7 = false) {
+        written = 0;
+        if (!_active) { printf("[ERROR] AesCbcEncrypt: final before init\n"); return false; }
+        _active = false;
+        if (pkcs7) {
+            uint8_t pad = (uint8_t)(16 - _fill);
+            memset(_buf + _fill, pad, pad);
+            if (!block(_buf, out)) return false;
+            written = 16;
+        } else if (_fill) {
+            printf("[ERROR] AesCbcEncrypt: %zu bytes left over without padding\n", _fill);
+            return false;
+        }
+        aes_modes_detail::wipe(_chain, sizeof(_chain));
+        return true;
+    }
+};
+
+// GCM =======================================
+/**
+* SP 800-38D GCM: init(iv) -> aad()* -> encrypt()* or decrypt()* -> final(tag) / verify(tag)
+* decrypt() hands out plaintext before the tag is checked (streaming); callers must
+* discard it unless verify() returns true.
+*/
+class AesGcm {
+private:
+    enum class Phase : uint8_t { IDLE, AAD, ENCRYPT, DECRYPT };
+
+    AesDispatcher& _aes;
+    aes_modes_detail::CtrKeystream _ks;
+    aes_modes_detail::Ghash _ghash;
+    uint8_t  _ek_j0[16];                // E(K, J0), masks the tag
+    uint64_t _aad_len = 0, _text_len = 0;
+    Phase    _phase = Phase::IDLE;
+
+    bool encryptBlock(uint8_t b[16]) {
+        uint32_t w[4];
+        for (int i = 0; i < 4; i++) w[i] = aes_modes_detail::load_be32(b + 4 * i);
+        if (!_aes.encrypt(w, w, 1)) return false;
+        for (int i = 0; i < 4; i++) aes_modes_detail::store_be32(b + 4 * i, w[i]);
+        return true;
+    }
+
+    bool text(const uint8_t* in, uint8_t* out, size_t len, Phase dir) {
+        if (_phase == Phase::AAD) {
+            _ghash.pad();
+            _phase = dir;
+        }
+        if (_phase != dir) {
+            printf("[ERROR] AesGcm: %s\n", _phase == Phase::IDLE ? "not initialized" : "encrypt and decrypt mixed");
+            return false;
+        }
+        if (len > AES_GCM_MAX_TEXT - _text_len) { printf("[ERROR] AesGcm: message too long\n"); return false; }
+        _text_len += len;
+        return _ks.crypt(in, out, len, [this](const uint8_t* c, size_t n) { _ghash.update(c, n); },
+                         dir == Phase::DECRYPT);
+    }
+
+    bool tag(uint8_t t[16]) {
+        if (_phase == Phase::IDLE) { printf("[ERROR] AesGcm: final before init\n"); return false; }
+        _ghash.pad();
+        uint8_t lens[16];
+        aes_modes_detail::store_be64(lens, _aad_len * 8);
+        aes_modes_detail::store_be64(lens + 8, _text_len * 8);
+        _ghash.update(lens, 16);
+        for (int i = 0; i < 16; i++) t[i] = _ghash.digest()[i] ^ _ek_j0[i];
+        _phase = Phase::IDLE;
+        _ks.clear();
+        aes_modes_detail::wipe(_ek_j0, sizeof(_ek_j0));
+        return true;
+    }
+
+public:
+    explicit AesGcm(AesDispatcher& aes) : _aes(aes), _ks(aes) {}
+    ~AesGcm() { aes_modes_detail::wipe(_ek_j0, sizeof(_ek_j0)); }
+
+    // any IV length >= 1 byte; 12 bytes is the fast, recommended case
+    bool init(const uint8_t* iv, size_t iv_len) {
+        if (!_aes.keyed()) { printf("[ERROR] AesGcm: dispatcher has no key\n"); return false; }
+        if (iv_len == 0) { printf("[ERROR] AesGcm: empty IV\n"); return false; }
+        uint8_t h[16] = {};
+        if (!encryptBlock(h)) return false;
+        _ghash.init(h);
+        aes_modes_detail::wipe(h, sizeof(h));
+
+        uint8_t j0[16] = {};
+        if (iv_len == 12) {
+            memcpy(j0, iv, 12);
+            j0[15] = 1;
+        } else {
+            // J0 = GHASH(IV || 0 pad || [0]64 || [len(IV)]64)
+            uint8_t lens[16] = {};
+            aes_modes_detail::store_be64(lens + 8, (uint64_t)iv_len * 8);
+            _ghash.update(iv, iv_len);
+            _ghash.pad();
+            _ghash.update(lens, 16);
+            memcpy(j0, _ghash.digest(), 16);
+            _ghash.reset();
+        }
+        memcpy(_ek_j0, j0, 16);
+        if (!encryptBlock(_ek_j0)) return false;
+        aes_modes_detail::store_be32(j0 + 12, aes_modes_detail::load_be32(j0 + 12) + 1);    // inc32
+        _ks.init(j0, true);
+        _aad_len = _text_len = 0;
+        _phase = Phase::AAD;
+        return true;
+    }
+
+    // additional authenticated data, any number of calls before the first encrypt / decrypt
+    bool aad(const uint8_t* data, size_t len) {
+        if (_phase != Phase::AAD) { printf("[ERROR] AesGcm: AAD after text or before init\n"); return false; }
+        _ghash.update(data, len);
+        _aad_len += len;
+        return true;
+    }
+
+    bool encrypt(const uint8_t* in, uint8_t* out, size_t len) { return text(in, out, len, Phase::ENCRYPT); }
+    bool decrypt(const uint8_t* in, uint8_t* out, size_t len) { return text(in, out, len, Phase::DECRYPT); }
+
+    // SP 800-38D 5.2.1.2: 16, 15, 14, 13, 12 bytes; 8 and 4 only for restricted uses (Appendix C)
+    static bool tagLenOk(size_t tag_len) {
+        return (tag_len >= 12 && tag_len <= 16) || tag_len == 8 || tag_len == 4;
+    }
+
+    // leftmost tag_len bytes of the full tag; tagLenOk() lengths only
+    bool final(uint8_t* tag_out, size_t tag_len = 16) {
+        if (!tagLenOk(tag_len)) { printf("[ERROR] AesGcm: tag length %zu\n", tag_len); return false; }
+        uint8_t t[16];
+        if (!tag(t)) return false;
+        memcpy(tag_out, t, tag_len);
+        return true;
+    }
+
+    // constant-time compare against the expected tag
+    bool verify(const uint8_t* expected, size_t tag_len = 16) {
+        if (!tagLenOk(tag_len)) { printf("[ERROR] AesGcm: tag length %zu\n", tag_len); return false; }
+        uint8_t t[16];
+        if (!tag(t)) return false;
+        uint8_t diff = 0;
+        for (size_t i = 0; i < tag_len; i++) diff |= (uint8_t)(t[i] ^ expected[i]);
+        return diff == 0;
+    }
+};
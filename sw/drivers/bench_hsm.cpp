@@ -0,0 +1,385 @@
+/**
+* @file     bench_hsm.cpp
+* @brief    Latency / throughput benchmarks for the MMIO, AES and TRNG hot paths
+* @details  Every op is timed individually; results are min/mean/p50/p99/p999/max plus
+*           ops/s (and MB/s where the op moves data). --json emits the same numbers
+*           machine-readable so runs on different bitstreams can be diffed.
+*
+* hsm_reg_read / hsm_reg_write   - one AXI-Lite access to the HSM (STATUS / DATA_IN)
+* aes_reg_read / aes_reg_write   - one AXI-Lite access to the AES core (STATUS / PTEXT_W0)
+* aes_key_load                   - AesDriver::loadKey(), alternating two keys
+* aes_block                      - AesDriver::encrypt(), one block
+* aes_bulk                       - AesDriver::encryptBulk(), BULK_BLOCKS per op
+* trng_word                      - PynqHSM::getTrngRandom()
+* trng_sw_health                 - SwHealth::update() over SW_HEALTH_WORDS words (CPU only)
+* drbg_64k                       - CtrDrbg::generate(), one 64 KB request (CPU engine, TRNG seeded)
+*
+* Bus transactions per op (key switch + block, CTR block, CTR bulk block, TRNG word) are counted
+* afterwards on an instant model, with the drivers' shadow registers off and on; the
+* sequence is a property of the driver, so the counts hold for the board too.
+*
+* Usage: bench_hsm [--sim [instant|core|pynq]] [--iters N | --duration SEC] [--warmup N]
+*                  [--filter SUBSTR] [--json [FILE]]
+*   --sim  run against the behavioral models in sim_device.h (any Linux box); instant
+*          measures the driver alone, core adds the fabric latencies (default), pynq
+*          also charges approximate GP0 bus costs per access
+*   --json without FILE writes JSON to stdout and the table to stderr
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "aes_vectors.h"
+#include "ctr_drbg.h"
+#include "hsm_driver.h"
+#include "sim_device.h"
+#include "trng_health_sw.h"
+
+constexpr size_t BULK_BLOCKS    = 256;
+constexpr uint64_t BULK_DIVISOR = 64;   // aes_bulk runs iters / BULK_DIVISOR ops
+constexpr size_t SW_HEALTH_WORDS = 256; // words per trng_sw_health op
+constexpr uint64_t BUS_OPS       = 1024; // ops averaged per bus count
+
+using bench_clock = std::chrono::steady_clock;
+
+// Config / results =======================================
+struct BenchConfig {
+    uint64_t iters      = 10000;
+    uint64_t warmup     = 1000;
+    double   duration_s = 0;        // > 0: run each bench for this long instead of iters
+    std::string filter;
+};
+
+struct BenchResult {
+    std::string name;
+    bool     ok = true;
+    uint64_t samples = 0;
+    double   min_ns = 0, mean_ns = 0, p50_ns = 0, p99_ns = 0, p999_ns = 0, max_ns = 0;
+    double   ops_per_sec = 0;
+    double   mb_per_sec = 0;        // 0 when the op moves no payload
+};
+
+// nearest-rank percentile of a sorted sample set
+static double percentile(const std::vector<double>& sorted, double q) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t)std::ceil(q * sorted.size());
+    return sorted[rank ? rank - 1 : 0];
+}
+
+static double timer_overhead_ns() {
+    double best = 1e9;
+    for (int i = 0; i < 1000; i++) {
+        auto t0 = bench_clock::now();
+        auto t1 = bench_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::nano>(t1 - t0).count());
+    }
+    return best;
+}
+
+template <class Op>
+static BenchResult run_bench(const char* name, const BenchConfig& cfg, uint64_t iters,
+                             size_t bytes_per_op, Op&& op) {
+    BenchResult r;
+    r.name = name;
+
+    for (uint64_t i = 0; i < cfg.warmup && r.ok; i++) r.ok = op(i);
+
+    std::vector<double> ns;
+    ns.reserve(cfg.duration_s > 0 ? 1 << 16 : iters);
+    auto start = bench_clock::now();
+    auto stop_at = start + std::chrono::duration_cast<bench_clock::duration>(std::chrono::duration<double>(cfg.duration_s));
+    double total_ns = 0;
+    for (uint64_t i = 0; r.ok; i++) {
+        if (cfg.duration_s > 0 ? bench_clock::now() >= stop_at : i >= iters) break;
+        auto t0 = bench_clock::now();
+        r.ok = op(i);
+        double d = std::chrono::duration<double, std::nano>(bench_clock::now() - t0).count();
+        ns.push_back(d);
+        total_ns += d;
+    }
+
+    std::sort(ns.begin(), ns.end());
+    r.samples = ns.size();
+    if (!ns.empty()) {
+        r.min_ns  = ns.front();
+        r.max_ns  = ns.back();
+        r.mean_ns = total_ns / ns.size();
+        r.p50_ns  = percentile(ns, 0.50);
+        r.p99_ns  = percentile(ns, 0.99);
+        r.p999_ns = percentile(ns, 0.999);
+        r.ops_per_sec = 1e9 / r.mean_ns;
+        if (bytes_per_op) r.mb_per_sec = bytes_per_op * r.ops_per_sec / 1e6;
+    }
+    return r;
+}
+
+// Bus transactions =======================================
+struct BusResult {
+    std::string name;
+    double reads[2]  = {};      // per op; [0] shadowing off, [1] on
+    double writes[2] = {};
+
+    double cut() const {
+        double off = reads[0] + writes[0];
+        return off > 0 ? 100.0 * (off - reads[1] - writes[1]) / off : 0.0;
+    }
+};
+
+static std::vector<BusResult> count_bus() {
+    std::vector<BusResult> out = { { "aes_key_switch" }, { "aes_block_ctr" }, { "aes_bulk_ctr" }, { "trng_word" } };
+    for (int on = 0; on < 2; on++) {
+        SimAesDevice sim_aes(SimTiming::instant());
+        SimHsmDevice sim_hsm(SimTiming::instant());
+        MMIO aes;
+        aes.attach(&sim_aes);
+        AesDriver drv(aes);
+        PynqHSM hsm(&sim_hsm);
+        drv.setShadowing(on);
+        hsm.setShadowing(on);
+        hsm.writeReg(REG_CTRL, Ctrl::ENABLE);
+
+        // one untimed op first so every count is steady state
+        auto count = [&](BusResult& r, auto& dev, uint64_t ops, uint64_t per_op, auto&& op) {
+            op();
+            uint64_t r0 = dev.reads(), w0 = dev.writes();
+            for (uint64_t i = 0; i < ops; i++) op();
+            r.reads[on]  = (double)(dev.reads() - r0) / (ops * per_op);
+            r.writes[on] = (double)(dev.writes() - w0) / (ops * per_op);
+        };
+
+        AesKeyHandle keys[2] = { drv.registerKey(VECTORS[0].key), drv.registerKey(VECTORS[1].key) };
+        uint32_t ct[4];
+        uint64_t k = 0;
+        count(out[0], sim_aes, BUS_OPS, 1, [&] { drv.encrypt(keys[k++ & 1], VECTORS[0].pt, ct); });
+
+        uint32_t ctr[4] = { 0x01020304, 0x05060708, 0x090A0B0C, 0 };
+        count(out[1], sim_aes, BUS_OPS, 1, [&] { drv.encrypt(ctr, ct); ctr[3]++; });
+
+        std::vector<uint32_t> blocks(BULK_BLOCKS * 4);
+        count(out[2], sim_aes, BUS_OPS / 16, BULK_BLOCKS, [&] {
+            for (size_t b = 0; b < BULK_BLOCKS; b++) {
+                memcpy(&blocks[4 * b], ctr, sizeof(ctr));
+                ctr[3]++;
+            }
+            drv.encryptBulk(blocks.data(), blocks.data(), BULK_BLOCKS);
+        });
+
+        uint32_t word;
+        count(out[3], sim_hsm, BUS_OPS, 1, [&] { hsm.sampleWord(word); });
+    }
+    return out;
+}
+
+static void print_bus(FILE* out, const std::vector<BusResult>& bus) {
+    fprintf(out, "\n  Bus transactions per op (counted on the instant model)\n");
+    fprintf(out, "  %-16s %14s %14s %8s\n", "op", "off rd/wr", "shadow rd/wr", "cut");
+    for (const BusResult& b : bus)
+        fprintf(out, "  %-16s %6.2f /%6.2f %6.2f /%6.2f %7.1f%%\n", b.name.c_str(),
+                b.reads[0], b.writes[0], b.reads[1], b.writes[1], b.cut());
+}
+
+// Output =======================================
+static void print_table(FILE* out, const std::vector<BenchResult>& results) {
+    fprintf(out, "  %-14s %8s %10s %10s %10s %10s %10s %12s %9s\n",
+            "bench", "samples", "min ns", "p50 ns", "p99 ns", "p999 ns", "max ns", "ops/s", "MB/s");
+    for (const BenchResult& r : results) {
+        fprintf(out, "  %-14s %8llu %10.0f %10.0f %10.0f %10.0f %10.0f %12.0f ",
+                r.name.c_str(), (unsigned long long)r.samples, r.min_ns, r.p50_ns, r.p99_ns,
+                r.p999_ns, r.max_ns, r.ops_per_sec);
+        if (r.mb_per_sec > 0) fprintf(out, "%9.2f", r.mb_per_sec);
+        else                  fprintf(out, "%9s", "-");
+        fprintf(out, "%s\n", r.ok ? "" : "  [FAIL]");
+    }
+}
+
+static void write_json(FILE* out, const std::vector<BenchResult>& results, const std::vector<BusResult>& bus,
+                       const BenchConfig& cfg, const char* device, double timer_ns) {
+    char host[64] = "unknown";
+    gethostname(host, sizeof(host) - 1);
+    char stamp[32];
+    time_t now = time(nullptr);
+    strftime(stamp, sizeof(stamp), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+
+    fprintf(out, "{\n");
+    fprintf(out, "  \"schema\": 1,\n");
+    fprintf(out, "  \"timestamp\": \"%s\",\n", stamp);
+    fprintf(out, "  \"host\": \"%s\",\n", host);
+    fprintf(out, "  \"device\": \"%s\",\n", device);
+    fprintf(out, "  \"hsm_base\": \"0x%08X\",\n", HSM_BASE_ADDR);
+    fprintf(out, "  \"aes_base\": \"0x%08X\",\n", AES_BASE_ADDR);
+    fprintf(out, "  \"iters\": %llu,\n", (unsigned long long)cfg.iters);
+    fprintf(out, "  \"warmup\": %llu,\n", (unsigned long long)cfg.warmup);
+    fprintf(out, "  \"duration_s\": %.3f,\n", cfg.duration_s);
+    fprintf(out, "  \"timer_overhead_ns\": %.1f,\n", timer_ns);
+    fprintf(out, "  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        fprintf(out, "    {\"name\": \"%s\", \"ok\": %s, \"samples\": %llu, "
+                     "\"min_ns\": %.1f, \"mean_ns\": %.1f, \"p50_ns\": %.1f, \"p99_ns\": %.1f, "
+                     "\"p999_ns\": %.1f, \"max_ns\": %.1f, \"ops_per_sec\": %.1f, \"mb_per_sec\": %.3f}%s\n",
+                r.name.c_str(), r.ok ? "true" : "false", (unsigned long long)r.samples,
+                r.min_ns, r.mean_ns, r.p50_ns, r.p99_ns, r.p999_ns, r.max_ns,
+                r.ops_per_sec, r.mb_per_sec, i + 1 < results.size() ? "," : "");
+    }
+    fprintf(out, "  ],\n");
+    fprintf(out, "  \"bus\": [\n");
+    for (size_t i = 0; i < bus.size(); i++) {
+        const BusResult& b = bus[i];
+        fprintf(out, "    {\"name\": \"%s\", \"reads_off\": %.3f, \"writes_off\": %.3f, "
+                     "\"reads_shadow\": %.3f, \"writes_shadow\": %.3f}%s\n",
+                b.name.c_str(), b.reads[0], b.writes[0], b.reads[1], b.writes[1], i + 1 < bus.size() ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+// Main =======================================
+int main(int argc, char* argv[]) {
+    BenchConfig cfg;
+    bool sim = false;
+    SimTiming sim_timing;
+    bool json = false;
+    const char* json_path = nullptr;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--iters" && a + 1 < argc)    cfg.iters = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "--warmup" && a + 1 < argc)   cfg.warmup = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "--duration" && a + 1 < argc) cfg.duration_s = atof(argv[++a]);
+        else if (arg == "--filter" && a + 1 < argc)   cfg.filter = argv[++a];
+        else if (arg == "--json") {
+            json = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-') json_path = argv[++a];
+        } else {
+            fprintf(stderr, "Usage: %s [--sim [instant|core|pynq]] [--iters N | --duration SEC] [--warmup N] "
+                            "[--filter SUBSTR] [--json [FILE]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (cfg.iters == 0) cfg.iters = 1;
+    // table goes to stderr when stdout carries the JSON
+    FILE* human = (json && !json_path) ? stderr : stdout;
+
+    // devices -------------------------------------
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or use --sim)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or use --sim)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+    hsm.writeReg(REG_CTRL, Ctrl::ENABLE);
+
+    double timer_ns = timer_overhead_ns();
+    fprintf(human, "================================================\n");
+    fprintf(human, "  HSM Benchmarks (%s)\n", sim ? "behavioral model" : "hardware");
+    if (cfg.duration_s > 0) fprintf(human, "  %.2fs per bench, warmup %llu\n", cfg.duration_s, (unsigned long long)cfg.warmup);
+    else fprintf(human, "  %llu iters per bench (aes_bulk / %llu), warmup %llu\n", (unsigned long long)cfg.iters,
+                 (unsigned long long)BULK_DIVISOR, (unsigned long long)cfg.warmup);
+    fprintf(human, "  timer overhead %.0f ns (included in every sample)\n", timer_ns);
+    fprintf(human, "================================================\n");
+
+    // benches -------------------------------------
+    std::vector<BenchResult> results;
+    auto want = [&](const char* name) { return cfg.filter.empty() || strstr(name, cfg.filter.c_str()); };
+    volatile uint32_t sink = 0;
+
+    if (want("hsm_reg_read"))
+        results.push_back(run_bench("hsm_reg_read", cfg, cfg.iters, 0, [&](uint64_t) {
+            sink = hsm.readReg(REG_STATUS); return true; }));
+    if (want("hsm_reg_write"))
+        results.push_back(run_bench("hsm_reg_write", cfg, cfg.iters, 0, [&](uint64_t i) {
+            hsm.writeReg(REG_DATA_IN, (uint32_t)i); return true; }));
+    if (want("aes_reg_read"))
+        results.push_back(run_bench("aes_reg_read", cfg, cfg.iters, 0, [&](uint64_t) {
+            sink = aes.read(AES::STATUS); return true; }));
+    if (want("aes_reg_write"))
+        results.push_back(run_bench("aes_reg_write", cfg, cfg.iters, 0, [&](uint64_t i) {
+            aes.write(AES::PTEXT_W0, (uint32_t)i); return true; }));       // only sampled at the encrypt strobe
+    if (want("aes_key_load"))
+        results.push_back(run_bench("aes_key_load", cfg, cfg.iters, 0, [&](uint64_t i) {
+            return drv.loadKey(VECTORS[i & 1].key); }));
+
+    uint32_t ct[4];
+    if (want("aes_block")) {
+        drv.loadKey(VECTORS[0].key);
+        results.push_back(run_bench("aes_block", cfg, cfg.iters, 16, [&](uint64_t) {
+            return drv.encrypt(VECTORS[0].pt, ct); }));
+    }
+    if (want("aes_bulk")) {
+        std::vector<uint32_t> buf(BULK_BLOCKS * 4);
+        for (size_t i = 0; i < buf.size(); i++) buf[i] = (uint32_t)i;
+        drv.loadKey(VECTORS[0].key);
+        BenchConfig bulk_cfg = cfg;
+        bulk_cfg.warmup = std::max<uint64_t>(cfg.warmup / BULK_DIVISOR, 1);
+        results.push_back(run_bench("aes_bulk", bulk_cfg, std::max<uint64_t>(cfg.iters / BULK_DIVISOR, 16),
+                                    BULK_BLOCKS * 16, [&](uint64_t) {
+            return drv.encryptBulk(buf.data(), buf.data(), BULK_BLOCKS); }));
+    }
+    if (want("trng_word"))
+        results.push_back(run_bench("trng_word", cfg, cfg.iters, 4, [&](uint64_t) {
+            return hsm.getTrngRandom() != 0xFFFFFFFF; }));
+    if (want("trng_sw_health")) {
+        // CPU only: must stay far above the trng_word rate
+        std::vector<uint32_t> words(SW_HEALTH_WORDS);
+        uint64_t x = 0x9E3779B97F4A7C15ull;
+        for (uint32_t& w : words) { x ^= x << 13; x ^= x >> 7; x ^= x << 17; w = (uint32_t)x; }
+        SwHealth sw_health;
+        results.push_back(run_bench("trng_sw_health", cfg, cfg.iters, SW_HEALTH_WORDS * 4, [&](uint64_t) {
+            sw_health.update(words.data(), words.size()); return true; }));
+    }
+
+    if (want("drbg_64k")) {
+        // bytes per second here vs trng_word is what seeding a DRBG buys
+        CtrDrbg drbg(drbg_entropy(hsm));
+        std::vector<uint8_t> out(DRBG_MAX_REQUEST);
+        bool seeded = drbg.instantiate();
+        BenchConfig drbg_cfg = cfg;
+        drbg_cfg.warmup = std::max<uint64_t>(cfg.warmup / BULK_DIVISOR, 1);
+        results.push_back(run_bench("drbg_64k", drbg_cfg, std::max<uint64_t>(cfg.iters / BULK_DIVISOR, 16),
+                                    out.size(), [&](uint64_t) {
+            return seeded && drbg.generate(out.data(), out.size()); }));
+    }
+
+    print_table(human, results);
+    std::vector<BusResult> bus;
+    if (want("bus")) {
+        bus = count_bus();
+        print_bus(human, bus);
+    }
+
+    if (json) {
+        FILE* out = json_path ? fopen(json_path, "w") : stdout;
+        if (!out) { perror("open json"); return EXIT_FAILURE; }
+        write_json(out, results, bus, cfg, sim ? "sim" : "hw", timer_ns);
+        if (json_path) {
+            fclose(out);
+            fprintf(human, "  JSON written to %s\n", json_path);
+        }
+    }
+
+    bool all_ok = std::all_of(results.begin(), results.end(), [](const BenchResult& r) { return r.ok; });
+    aes.close();
+    return all_ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
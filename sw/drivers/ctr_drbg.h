@@ -0,0 +1,364 @@
+/**
+* @file     ctr_drbg.h
+* @brief    NIST SP 800-90A CTR_DRBG (AES-256, derivation function) seeded from the TRNG
+* @details  The TRNG only supplies seed material (entropy input + nonce, run through
+*           Block_Cipher_df, so the source need not be full entropy); bulk output is
+*           AES-256 in counter mode through AesDispatcher, i.e. on the FPGA core, the CPU
+*           engine or both, whichever its latency model says finishes first. Output rate
+*           follows AES throughput, not the ring oscillators.
+*
+* Generate (per request of at most max_request_bytes):
+* 1. reseed first if prediction_resistance is set or reseed_interval requests have run
+* 2. additional input (if any) -> df -> Update
+* 3. V+1, V+2, ... encrypted under K in bulk -> output
+* 4. Update (backtracking resistance: the K/V that produced this output are gone)
+*
+* Entropy comes from a DrbgEntropySource: drbg_entropy(EntropyPool&) for shared
+* health-tested words, drbg_entropy(PynqHSM&) for direct handshakes.
+*
+* Not thread safe: one instance per thread (ctr_drbg_thread() keeps one per thread on
+* the CPU engine). An instance given an AesDriver must be the only user of that driver.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "aes_dispatch.h"
+#include "hsm_driver.h"
+#include "soft_aes.h"
+#include "trng_pool.h"
+
+// SP 800-90A Table 3, AES-256
+constexpr size_t   DRBG_KEY_BYTES      = 32;
+constexpr size_t   DRBG_BLOCK_BYTES    = 16;
+constexpr size_t   DRBG_SEED_BYTES     = DRBG_KEY_BYTES + DRBG_BLOCK_BYTES;    // seedlen = 384 bits
+constexpr size_t   DRBG_MAX_REQUEST    = 1u << 16;                           // 2^19 bits
+constexpr uint64_t DRBG_MAX_RESEED_INTERVAL = 1ull << 48;
+constexpr size_t   DRBG_MAX_INPUT      = 4096;     // personalization / additional input bytes
+
+// fills buf with len bytes of entropy; false = source failed (health / timeout)
+using DrbgEntropySource = std::function<bool(uint8_t* buf, size_t len)>;
+
+// Config =======================================
+struct CtrDrbgConfig {
+    uint64_t reseed_interval       = 1u << 20;  // generate requests between reseeds
+    size_t   max_request_bytes     = DRBG_MAX_REQUEST;
+    size_t   entropy_bytes         = 64;        // per (re)seed, 2x the 256-bit strength
+    size_t   nonce_bytes           = 16;        // from the same source (8.6.7)
+    bool     prediction_resistance = false;     // fresh entropy before every request
+    SoftAesKernel kernel           = SoftAes256::constantTime();   // secret key: no T-table lookups
+};
+
+struct CtrDrbgStats {
+    uint64_t requests       = 0;    // internal requests (<= max_request_bytes each)
+    uint64_t bytes          = 0;
+    uint64_t reseeds        = 0;    // not counting instantiate
+    uint64_t entropy_bytes  = 0;    // drawn from the source
+    uint64_t entropy_fails  = 0;
+
+    void print() const {
+        printf("    DRBG        : %llu bytes in %llu requests, %llu reseeds, %llu entropy bytes (%.0f out per in), %llu source failures\n",
+               (unsigned long long)bytes, (unsigned long long)requests, (unsigned long long)reseeds,
+               (unsigned long long)entropy_bytes, entropy_bytes ? (double)bytes / entropy_bytes : 0.0,
+               (unsigned long long)entropy_fails);
+    }
+};
+
+// Entropy sources =======================================
+inline DrbgEntropySource drbg_entropy(EntropyPool& pool, uint32_t timeout_us = 1000000) {
+    return [&pool, timeout_us](uint8_t* buf, size_t len) {
+        PoolStatus s = pool.read(buf, len, timeout_us);
+        if (s != PoolStatus::OK) fprintf(stderr, "[ERROR] DRBG entropy: pool %s\n", pool_status_str(s));
+        return s == PoolStatus::OK;
+    };
+}
+
+// getTrngRandom() handshakes straight off the core; STATUS after the run vouches for
+// every word (RCT/APT are sticky), as in EntropyPool's batches
+inline DrbgEntropySource drbg_entropy(PynqHSM& hsm) {
+    return [&hsm](uint8_t* buf, size_t len) {
+        for (size_t off = 0; off < len; off += 4) {
+            uint32_t w;
+            if (!hsm.sampleWord(w)) {
+                fprintf(stderr, "[ERROR] DRBG entropy: TRNG sample timeout\n");
+                return false;
+            }
+            memcpy(buf + off, &w, len - off < 4 ? len - off : 4);
+        }
+        if (!hsm.checkHealth()) {
+            fprintf(stderr, "[ERROR] DRBG entropy: TRNG health test failed\n");
+            return false;
+        }
+        return true;
+    };
+}
+
+namespace drbg_detail {
+
+inline uint32_t load_be32(const uint8_t* p) {
+    return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3];
+}
+
+inline void store_be32(uint8_t* p, uint32_t v) {
+    p[0] = (uint8_t)(v >> 24); p[1] = (uint8_t)(v >> 16); p[2] = (uint8_t)(v >> 8); p[3] = (uint8_t)v;
+}
+
+inline void to_words(const uint8_t* bytes, uint32_t* words, size_t n_words) {
+    for (size_t i = 0; i < n_words; i++) words[i] = load_be32(bytes + 4 * i);
+}
+
+inline void to_bytes(const uint32_t* words, uint8_t* bytes, size_t n_words) {
+    for (size_t i = 0; i < n_words; i++) store_be32(bytes + 4 * i, words[i]);
+}
+
+inline void wipe(void* p, size_t n) {
+    volatile uint8_t* v = static_cast<volatile uint8_t*>(p);
+    for (size_t i = 0; i < n; i++) v[i] = 0;
+}
+
+// V = (V + 1) mod 2^128, V as 4 big endian words
+inline void inc128(uint32_t v[4]) {
+    for (int i = 3; i >= 0 && ++v[i] == 0; i--) {}
+}
+
+/**
+* @brief Block_Cipher_df (10.3.2): any input -> DRBG_SEED_BYTES, via BCC (CBC-MAC) under a fixed key
+* @details Small and rare (only on (re)seed and additional input), so always the CPU engine.
+*/
+inline void block_cipher_df(const uint8_t* const* parts, const size_t* lens, int n_parts,
+                            uint8_t out[DRBG_SEED_BYTES], SoftAesKernel kernel) {
+    size_t in_len = 0;
+    for (int i = 0; i < n_parts; i++) in_len += lens[i];
+
+    // S = L || N || input || 0x80 || 0 pad, prefixed per block-cipher pass by IV = i || 0
+    size_t s_len = (8 + in_len + 1 + DRBG_BLOCK_BYTES - 1) / DRBG_BLOCK_BYTES * DRBG_BLOCK_BYTES;
+    std::vector<uint8_t> s(DRBG_BLOCK_BYTES + s_len, 0);
+    uint8_t* p = s.data() + DRBG_BLOCK_BYTES;
+    store_be32(p, (uint32_t)in_len);
+    store_be32(p + 4, (uint32_t)DRBG_SEED_BYTES);
+    size_t off = 8;
+    for (int i = 0; i < n_parts; i++) {
+        if (lens[i]) memcpy(p + off, parts[i], lens[i]);
+        off += lens[i];
+    }
+    p[off] = 0x80;
+
+    SoftAes256 aes(kernel);
+    uint32_t k[8];
+    for (int i = 0; i < 8; i++) k[i] = 0x00010203u + 0x04040404u * (uint32_t)i;
+    aes.setKey(k);
+
+    uint8_t temp[DRBG_SEED_BYTES];
+    for (uint32_t i = 0; i * DRBG_BLOCK_BYTES < DRBG_SEED_BYTES; i++) {
+        store_be32(s.data(), i);
+        uint32_t chain[4] = {0, 0, 0, 0}, blk[4];
+        for (size_t b = 0; b < s.size(); b += DRBG_BLOCK_BYTES) {
+            to_words(s.data() + b, blk, 4);
+            for (int w = 0; w < 4; w++) chain[w] ^= blk[w];
+            aes.encrypt(chain, chain);
+        }
+        to_bytes(chain, temp + DRBG_BLOCK_BYTES * i, 4);
+    }
+
+    uint32_t x[4];
+    to_words(temp, k, 8);
+    to_words(temp + DRBG_KEY_BYTES, x, 4);
+    aes.setKey(k);
+    for (size_t b = 0; b < DRBG_SEED_BYTES; b += DRBG_BLOCK_BYTES) {
+        aes.encrypt(x, x);
+        to_bytes(x, out + b, 4);
+    }
+    aes.wipe();
+    wipe(k, sizeof(k));
+    wipe(temp, sizeof(temp));
+    wipe(s.data(), s.size());
+}
+
+} // namespace drbg_detail
+
+// DRBG =======================================
+class CtrDrbg {
+private:
+    DrbgEntropySource _entropy;
+    CtrDrbgConfig     _cfg;
+    AesDispatcher     _aes;                 // bulk keystream: core, CPU or split
+    SoftAes256        _cpu;                 // Update's 3 blocks, not worth a dispatch
+
+    uint32_t _key[8] = {};
+    uint32_t _v[4] = {};
+    uint64_t _reseed_counter = 0;           // 0 = not instantiated
+    std::vector<uint32_t> _buf;             // counter blocks, encrypted in place
+    CtrDrbgStats _stats;
+
+    // Update (10.2.1.2): (K, V) = first seedlen bits of E(K, V+1) || E(K, V+2) || E(K, V+3) ^ provided
+    void update(const uint8_t provided[DRBG_SEED_BYTES]) {
+        uint32_t temp[12];
+        _cpu.setKey(_key);
+        for (int b = 0; b < 3; b++) {
+            drbg_detail::inc128(_v);
+            _cpu.encrypt(_v, temp + 4 * b);
+        }
+        if (provided) {
+            uint32_t p[12];
+            drbg_detail::to_words(provided, p, 12);
+            for (int i = 0; i < 12; i++) temp[i] ^= p[i];
+            drbg_detail::wipe(p, sizeof(p));
+        }
+        memcpy(_key, temp, sizeof(_key));
+        memcpy(_v, temp + 8, sizeof(_v));
+        drbg_detail::wipe(temp, sizeof(temp));
+    }
+
+    // entropy || extra0 || extra1 -> df -> Update
+    bool seed(const uint8_t* extra0, size_t len0, const uint8_t* extra1, size_t len1, size_t nonce) {
+        size_t want = _cfg.entropy_bytes + nonce;
+        std::vector<uint8_t> ent(want);
+        if (!_entropy || !_entropy(ent.data(), want)) {
+            _stats.entropy_fails++;
+            return false;
+        }
+        _stats.entropy_bytes += want;
+        const uint8_t* parts[3] = { ent.data(), extra0, extra1 };
+        size_t lens[3] = { want, len0, len1 };
+        uint8_t seed_material[DRBG_SEED_BYTES];
+        drbg_detail::block_cipher_df(parts, lens, 3, seed_material, _cfg.kernel);
+        update(seed_material);
+        drbg_detail::wipe(seed_material, sizeof(seed_material));
+        drbg_detail::wipe(ent.data(), ent.size());
+        _reseed_counter = 1;
+        return true;
+    }
+
+    bool generateRequest(uint8_t* out, size_t len, const uint8_t* add, size_t add_len) {
+        uint8_t add_df[DRBG_SEED_BYTES];
+        bool have_add = add && add_len;
+        if (_cfg.prediction_resistance || _reseed_counter > _cfg.reseed_interval) {
+            if (!seed(add, add_len, nullptr, 0, 0)) return false;
+            _stats.reseeds++;
+            have_add = false;               // consumed by the reseed
+        }
+        if (have_add) {
+            const uint8_t* parts[1] = { add };
+            size_t lens[1] = { add_len };
+            drbg_detail::block_cipher_df(parts, lens, 1, add_df, _cfg.kernel);
+            update(add_df);
+        }
+
+        size_t blocks = (len + DRBG_BLOCK_BYTES - 1) / DRBG_BLOCK_BYTES;
+        for (size_t i = 0; i < blocks; i++) {
+            drbg_detail::inc128(_v);
+            memcpy(&_buf[4 * i], _v, 16);
+        }
+        _aes.setKey(_key);
+        _aes.encrypt(_buf.data(), _buf.data(), blocks);
+        size_t whole = len / 4;
+        drbg_detail::to_bytes(_buf.data(), out, whole);
+        if (len % 4) {
+            uint8_t tail[4];
+            drbg_detail::store_be32(tail, _buf[whole]);
+            memcpy(out + 4 * whole, tail, len % 4);
+        }
+        drbg_detail::wipe(_buf.data(), blocks * 16);
+
+        update(have_add ? add_df : nullptr);
+        drbg_detail::wipe(add_df, sizeof(add_df));
+        _reseed_counter++;
+        _stats.requests++;
+        _stats.bytes += len;
+        return true;
+    }
+
+public:
+    /**
+    * @param hw optional AES core; nullptr keeps everything on the CPU engine
+    */
+    explicit CtrDrbg(DrbgEntropySource entropy, const CtrDrbgConfig& cfg = CtrDrbgConfig{}, AesDriver* hw = nullptr)
+        : _entropy(std::move(entropy)), _cfg(cfg), _aes(hw, cfg.kernel), _cpu(cfg.kernel) {
+        if (_cfg.max_request_bytes == 0 || _cfg.max_request_bytes > DRBG_MAX_REQUEST) _cfg.max_request_bytes = DRBG_MAX_REQUEST;
+        if (_cfg.reseed_interval == 0 || _cfg.reseed_interval > DRBG_MAX_RESEED_INTERVAL) _cfg.reseed_interval = DRBG_MAX_RESEED_INTERVAL;
+        if (_cfg.entropy_bytes < DRBG_KEY_BYTES) _cfg.entropy_bytes = DRBG_KEY_BYTES;
+        if (_cfg.nonce_bytes < DRBG_BLOCK_BYTES / 2) _cfg.nonce_bytes = DRBG_BLOCK_BYTES / 2;
+        _buf.resize((_cfg.max_request_bytes + DRBG_BLOCK_BYTES - 1) / DRBG_BLOCK_BYTES * 4);
+    }
+
+    ~CtrDrbg() { uninstantiate(); }
+
+    CtrDrbg(const CtrDrbg&) = delete;
+    CtrDrbg& operator=(const CtrDrbg&) = delete;
+
+    /**
+    * @brief Instantiate (10.2.1.3.2): entropy input + nonce + personalization -> df -> Update
+    * @details personalization may be null; up to DRBG_MAX_INPUT bytes.
+    */
+    bool instantiate(const void* personalization = nullptr, size_t len = 0) {
+        if (len > DRBG_MAX_INPUT) { printf("[ERROR] DRBG: personalization string too long\n"); return false; }
+        memset(_key, 0, sizeof(_key));
+        memset(_v, 0, sizeof(_v));
+        _reseed_counter = 0;
+        return seed(static_cast<const uint8_t*>(personalization), len, nullptr, 0, _cfg.nonce_bytes);
+    }
+
+    // Reseed (10.2.1.4.2), e.g. after a fork or on demand
+    bool reseed(const void* additional = nullptr, size_t len = 0) {
+        if (!ready()) { printf("[ERROR] DRBG: reseed before instantiate\n"); return false; }
+        if (len > DRBG_MAX_INPUT) { printf("[ERROR] DRBG: additional input too long\n"); return false; }
+        if (!seed(static_cast<const uint8_t*>(additional), len, nullptr, 0, 0)) return false;
+        _stats.reseeds++;
+        return true;
+    }
+
+    /**
+    * @brief len bytes of output, split into max_request_bytes requests
+    * @details additional input goes into every request. false = not instantiated or the
+    *          entropy source failed a needed reseed; buf then holds no usable output.
+    */
+    bool generate(void* buf, size_t len, const void* additional = nullptr, size_t add_len = 0) {
+        if (!ready()) { printf("[ERROR] DRBG: generate before instantiate\n"); return false; }
+        if (add_len > DRBG_MAX_INPUT) { printf("[ERROR] DRBG: additional input too long\n"); return false; }
+        uint8_t* out = static_cast<uint8_t*>(buf);
+        while (len) {
+            size_t n = len < _cfg.max_request_bytes ? len : _cfg.max_request_bytes;
+            if (!generateRequest(out, n, static_cast<const uint8_t*>(additional), add_len)) return false;
+            out += n;
+            len -= n;
+        }
+        return true;
+    }
+
+    void uninstantiate() {
+        drbg_detail::wipe(_key, sizeof(_key));
+        drbg_detail::wipe(_v, sizeof(_v));
+        _cpu.wipe();
+        _aes.wipe();
+        _reseed_counter = 0;
+    }
+
+    bool ready() const { return _reseed_counter != 0; }
+    uint64_t reseedCounter() const { return _reseed_counter; }
+    const CtrDrbgConfig& config() const { return _cfg; }
+    const CtrDrbgStats& stats() const { return _stats; }
+    AesDispatcher& dispatcher() { return _aes; }
+};
+
+/**
+* @brief This thread's CPU-engine DRBG over pool, instantiated on first use
+* @details Personalized with the thread id and its address, so no two instances share
+*          a seed even if the source were to repeat. Check ready() before relying on it.
+*/
+inline CtrDrbg& ctr_drbg_thread(EntropyPool& pool, const CtrDrbgConfig& cfg = CtrDrbgConfig{}) {
+    thread_local std::unique_ptr<CtrDrbg> drbg;
+    if (!drbg) drbg.reset(new CtrDrbg(drbg_entropy(pool), cfg));
+    if (!drbg->ready()) {
+        uint64_t pers[2] = { (uint64_t)std::hash<std::thread::id>{}(std::this_thread::get_id()),
+                             (uint64_t)(uintptr_t)drbg.get() };
+        drbg->instantiate(pers, sizeof(pers));
+    }
+    return *drbg;
+}
@@ -0,0 +1,241 @@
+/**
+* @file     ent_stats.h
+* @brief    Streaming ENT-equivalent statistics: one pass, constant memory, any length
+* @details  Same five numbers as Walker's `ent` in byte mode, so results line up with
+*           the readme table:
+*
+* Entropy / compression / chi-square / mean - from a 256-bin byte histogram
+* Monte Carlo pi     - 6-byte groups -> 24-bit (x, y), hit if x^2 + y^2 <= (2^24 - 1)^2
+* Serial correlation - sum b[i] * b[i+1], wrapping last byte onto the first as ent does
+*
+* Per byte only the histogram and the product sum are touched: four interleaved
+* sub-histograms break the store->load chain on repeated bytes, and the product loop runs
+* on 16K-byte chunks with 32-bit partial sums in fixed 64-product blocks, which GCC 12
+* vectorizes at -O2 (16-byte SSE vectors, checked with -fopt-info-vec; ARM not checked).
+* Everything else comes from the histogram at report time. All accumulators add and
+* subtract, so window() reports the stretch since the previous window() for rolling output.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+constexpr size_t   ENT_CHUNK       = 16384;     // keeps 255 * 255 * chunk inside uint32
+constexpr size_t   ENT_PROD_BLOCK  = 64;        // products per vectorized inner loop
+constexpr uint32_t ENT_MONTE_BYTES = 6;         // ent's MONTEN
+constexpr double   ENT_MONTE_INCIRC = 16777215.0 * 16777215.0;
+
+// Results =======================================
+struct EntResult {
+    uint64_t bytes       = 0;
+    double   entropy     = 0.0;     // bits per byte
+    double   compression = 0.0;     // % optimum compression would save
+    double   chisq       = 0.0;
+    double   chisq_p     = 0.0;     // % of random streams that would exceed chisq
+    double   mean        = 0.0;
+    double   pi          = 0.0;
+    double   pi_error    = 0.0;     // % off M_PI
+    double   serial_corr = 0.0;
+
+    void print(FILE* out = stdout) const {
+        fprintf(out, "Entropy = %f bits per byte.\n\n", entropy);
+        fprintf(out, "Optimum compression would reduce the size\nof this %llu byte file by %d percent.\n\n",
+                (unsigned long long)bytes, (int)compression);
+        fprintf(out, "Chi square distribution for %llu samples is %1.2f, and randomly\n",
+                (unsigned long long)bytes, chisq);
+        if (chisq_p < 0.01)       fprintf(out, "would exceed this value less than 0.01 percent of the times.\n\n");
+        else if (chisq_p > 99.99) fprintf(out, "would exceed this value more than than 99.99 percent of the times.\n\n");
+        else                      fprintf(out, "would exceed this value %1.2f percent of the times.\n\n", chisq_p);
+        fprintf(out, "Arithmetic mean value of data bytes is %1.4f (127.5 = random).\n", mean);
+        fprintf(out, "Monte Carlo value for Pi is %1.9f (error %1.2f percent).\n", pi, pi_error);
+        fprintf(out, "Serial correlation coefficient is ");
+        if (serial_corr >= -99999) fprintf(out, "%1.6f (totally uncorrelated = 0.0).\n", serial_corr);
+        else                       fprintf(out, "undefined (all values equal!).\n");
+    }
+
+    // one line for rolling output
+    void printLine(FILE* out, const char* tag) const {
+        fprintf(out, "[%s] %10.1f MB  H=%.6f  chi2=%9.2f (p %6.2f%%)  mean=%8.4f  pi=%.6f (%5.2f%%)  scc=%+.6f\n",
+                tag, bytes / 1e6, entropy, chisq, chisq_p, mean, pi, pi_error, serial_corr);
+    }
+};
+
+// Q(a, x), regularized upper incomplete gamma (Numerical Recipes gammq): chi-square tail
+inline double ent_gamma_q(double a, double x) {
+    if (x <= 0.0) return 1.0;
+    double gln = std::lgamma(a);
+    if (x < a + 1.0) {
+        double ap = a, sum = 1.0 / a, del = sum;
+        for (int n = 0; n < 1000; n++) {
+            ap += 1.0;
+            del *= x / ap;
+            sum += del;
+            if (std::fabs(del) < std::fabs(sum) * 1e-15) break;
+        }
+        return 1.0 - sum * std::exp(-x + a * std::log(x) - gln);
+    }
+    double b = x + 1.0 - a, c = 1.0 / 1e-300, d = 1.0 / b, h = d;
+    for (int i = 1; i < 1000; i++) {
+        double an = -i * (i - a);
+        b += 2.0;
+        d = an * d + b;
+        if (std::fabs(d) < 1e-300) d = 1e-300;
+        c = b + an / c;
+        if (std::fabs(c) < 1e-300) c = 1e-300;
+        d = 1.0 / d;
+        double del = d * c;
+        h *= del;
+        if (std::fabs(del - 1.0) < 1e-15) break;
+    }
+    return std::exp(-x + a * std::log(x) - gln) * h;
+}
+
+// Accumulators =======================================
+struct EntAccum {
+    uint64_t hist[256] = {};
+    uint64_t bytes     = 0;
+    uint64_t scc_prod  = 0;     // sum b[i] * b[i+1] over adjacent pairs seen
+    uint64_t mc_tries  = 0;
+    uint64_t mc_hits   = 0;
+
+    EntAccum& operator-=(const EntAccum& o) {
+        for (int i = 0; i < 256; i++) hist[i] -= o.hist[i];
+        bytes -= o.bytes;
+        scc_prod -= o.scc_prod;
+        mc_tries -= o.mc_tries;
+        mc_hits -= o.mc_hits;
+        return *this;
+    }
+
+    // first / last close ent's wrap-around pair (last byte * first byte)
+    EntResult result(uint8_t first, uint8_t last) const {
+        EntResult r;
+        r.bytes = bytes;
+        if (!bytes) return r;
+
+        double n = (double)bytes, expected = n / 256.0;
+        double sum = 0.0, sum_sq = 0.0;
+        for (int i = 0; i < 256; i++) {
+            double c = (double)hist[i];
+            if (c > 0) r.entropy -= (c / n) * std::log2(c / n);
+            r.chisq += (c - expected) * (c - expected) / expected;
+            sum += c * i;
+            sum_sq += c * i * i;
+        }
+        r.compression = (8.0 - r.entropy) / 8.0 * 100.0;
+        r.chisq_p = ent_gamma_q(255.0 / 2.0, r.chisq / 2.0) * 100.0;
+        r.mean = sum / n;
+
+        if (mc_tries) {
+            r.pi = 4.0 * mc_hits / mc_tries;
+            r.pi_error = std::fabs(M_PI - r.pi) / M_PI * 100.0;
+        }
+
+        double t1 = (double)scc_prod + (double)last * first;
+        double denom = n * sum_sq - sum * sum;
+        r.serial_corr = denom == 0.0 ? -100000.0 : (n * t1 - sum * sum) / denom;
+        return r;
+    }
+};
+
+// Stream =======================================
+class EntStream {
+private:
+    uint32_t _sub[4][256];          // interleaved histograms, folded into _acc.hist
+    uint64_t _sub_bytes = 0;
+    EntAccum _acc;
+    EntAccum _window_start;
+    uint8_t  _first = 0;
+    uint8_t  _last = 0;
+    uint8_t  _mc[ENT_MONTE_BYTES];
+    uint32_t _mc_fill = 0;
+
+    void fold() {
+        for (int i = 0; i < 256; i++) {
+            _acc.hist[i] += (uint64_t)_sub[0][i] + _sub[1][i] + _sub[2][i] + _sub[3][i];
+        }
+        memset(_sub, 0, sizeof(_sub));
+        _sub_bytes = 0;
+    }
+
+    void monteCarlo(const uint8_t* p, size_t n) {
+        size_t i = 0;
+        while (_mc_fill && _mc_fill < ENT_MONTE_BYTES && i < n) {
+            _mc[_mc_fill++] = p[i++];
+            if (_mc_fill == ENT_MONTE_BYTES) { monteGroup(_mc); _mc_fill = 0; }
+        }
+        for (; i + ENT_MONTE_BYTES <= n; i += ENT_MONTE_BYTES) monteGroup(p + i);
+        if (i < n) {                    // tail < ENT_MONTE_BYTES, and _mc_fill is 0 here
+            memcpy(_mc, p + i, n - i);
+            _mc_fill = (uint32_t)(n - i);
+        }
+    }
+
+    void monteGroup(const uint8_t* g) {
+        double x = (double)(((uint32_t)g[0] << 16) | ((uint32_t)g[1] << 8) | g[2]);
+        double y = (double)(((uint32_t)g[3] << 16) | ((uint32_t)g[4] << 8) | g[5]);
+        _acc.mc_tries++;
+        if (x * x + y * y <= ENT_MONTE_INCIRC) _acc.mc_hits++;
+    }
+
+    void chunk(const uint8_t* p, size_t n) {
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _sub[0][p[i]]++;
+            _sub[1][p[i + 1]]++;
+            _sub[2][p[i + 2]]++;
+            _sub[3][p[i + 3]]++;
+        }
+        for (; i < n; i++) _sub[0][p[i]]++;
+        _sub_bytes += n;
+        if (_sub_bytes >= (1ull << 31)) fold();
+
+        // adjacent products within the chunk (update() adds the pairs across chunk / call
+        // boundaries); the fixed-count inner block is what -O2's cost model will vectorize
+        uint32_t prod = 0;
+        size_t k = 0;
+        for (; k + ENT_PROD_BLOCK < n; k += ENT_PROD_BLOCK)
+            for (size_t j = 0; j < ENT_PROD_BLOCK; j++) prod += (uint32_t)p[k + j] * p[k + j + 1];
+        for (; k + 1 < n; k++) prod += (uint32_t)p[k] * p[k + 1];
+        _acc.scc_prod += prod;
+    }
+
+public:
+    EntStream() { memset(_sub, 0, sizeof(_sub)); }
+
+    void update(const void* data, size_t len) {
+        const uint8_t* p = static_cast<const uint8_t*>(data);
+        if (!len) return;
+        if (_acc.bytes) _acc.scc_prod += (uint64_t)_last * p[0];
+        else _first = p[0];
+        for (size_t off = 0; off < len; off += ENT_CHUNK) {
+            size_t n = len - off < ENT_CHUNK ? len - off : ENT_CHUNK;
+            chunk(p + off, n);
+            if (off + n < len) _acc.scc_prod += (uint64_t)p[off + n - 1] * p[off + n];
+        }
+        monteCarlo(p, len);
+        _acc.bytes += len;
+        _last = p[len - 1];
+    }
+
+    uint64_t bytes() const { return _acc.bytes; }
+
+    // everything so far
+    EntResult result() {
+        fold();
+        return _acc.result(_first, _last);
+    }
+
+    // since the previous window() call (wrap pair approximated by the stream ends)
+    EntResult window() {
+        fold();
+        EntAccum w = _acc;
+        w -= _window_start;
+        _window_start = _acc;
+        return w.result(_first, _last);
+    }
+};
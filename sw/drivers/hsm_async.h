@@ -0,0 +1,524 @@
+/**
+* @file     hsm_async.h
+* @brief    Non-blocking AES / TRNG front end: one reactor thread, coroutine awaitables or futures
+* @details  HsmReactor's thread is the only one that touches the MMIO windows. It keeps one
+*           AES op and one TRNG op in flight and walks each through the drivers' split-phase
+*           calls (AesDriver::startKey / pipe*, PynqHSM::startSample / sampleReady), one
+*           STATUS or SAMP_CNT read per turn, so a ~10us TRNG word never stalls AES blocks
+*           and no caller ever sits in a poll loop.
+*
+* Completion, per op:
+* - co_await encrypt(...) / randomBytes(...) (C++20): the finished op is queued and eventFd()
+*   turns readable; whatever loop owns the coroutines (epoll, poll, asio, hsmd's loop)
+*   calls dispatch(), which resumes them on that thread.
+* - encryptFuture(...) / randomBytesFuture(...) (C++17): a std::future set on the reactor
+*   thread, no loop needed.
+*
+* Buffers must stay valid until the op completes. Once start()ed, the drivers belong to
+* the reactor: register keys and reach anything else through registerKey() / post().
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#include <exception>
+#define HSM_ASYNC_COROUTINES 1
+#else
+#define HSM_ASYNC_COROUTINES 0
+#endif
+
+#include "aes_driver.h"
+#include "hsm_driver.h"
+
+// Config / results =======================================
+struct HsmAsyncConfig {
+    uint32_t timeout_us      = 100000;  // per key expansion, block or TRNG word
+    uint32_t blocks_per_turn = 64;      // AES blocks retired before the TRNG gets its poll
+    uint32_t idle_spins      = 256;     // turns with nothing ready before a sched_yield()
+};
+
+enum class HsmAsyncStatus : uint8_t {
+    OK,
+    BAD_KEY,        // handle not registered
+    TIMEOUT,        // key expansion, block or TRNG word overran timeout_us
+    HEALTH_FAIL,    // RCT / APT latched while sampling; buffer wiped
+    NO_DEVICE,      // reactor built without that driver
+    STOPPED         // submitted after stop(), or still queued when it ran
+};
+
+inline const char* hsm_async_status_name(HsmAsyncStatus s) {
+    static const char* const names[] = { "OK", "BAD_KEY", "TIMEOUT", "HEALTH_FAIL", "NO_DEVICE", "STOPPED" };
+    return names[(int)s];
+}
+
+struct HsmAsyncStats {
+    uint64_t submitted = 0;
+    uint64_t completed = 0;
+    uint64_t turns     = 0;     // reactor loop iterations
+    uint64_t yields    = 0;     // idle_spins exhausted with ops still waiting on hardware
+    uint64_t sleeps    = 0;     // blocked with nothing outstanding
+    uint64_t timeouts  = 0;
+
+    void print() const {
+        printf("    Reactor     : %llu ops submitted, %llu completed, %llu timeouts\n",
+               (unsigned long long)submitted, (unsigned long long)completed, (unsigned long long)timeouts);
+        printf("    Turns       : %llu (%llu yields, %llu sleeps)\n",
+               (unsigned long long)turns, (unsigned long long)yields, (unsigned long long)sleeps);
+    }
+};
+
+// Operation =======================================
+// Lives in the awaitable (coroutine frame) or on the heap (futures) until it completes.
+struct HsmAsyncOp {
+    enum class Kind : uint8_t { ENCRYPT, RANDOM, CALL };
+    Kind kind = Kind::CALL;
+
+    AesKeyHandle    key = AES_NO_KEY;   // ENCRYPT, pt and ct may alias
+    const uint32_t* pt = nullptr;
+    uint32_t*       ct = nullptr;
+    size_t          blocks = 0;
+    uint8_t*        buf = nullptr;      // RANDOM
+    size_t          len = 0;
+    std::function<void()> call;         // CALL, runs on the reactor thread
+
+    HsmAsyncStatus status = HsmAsyncStatus::OK;
+    size_t         done = 0;            // blocks retired / bytes written
+
+    // reactor thread: finish(op) if set (futures), else queued for dispatch() -> resume(waiter)
+    void (*finish)(HsmAsyncOp*) = nullptr;
+    void (*resume)(void*) = nullptr;
+    void*  waiter = nullptr;
+};
+
+#if HSM_ASYNC_COROUTINES
+class HsmAwaitable;
+#endif
+
+// Reactor =======================================
+class HsmReactor {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    AesDriver*     _aes;
+    PynqHSM*       _trng;
+    HsmAsyncConfig _cfg;
+    std::thread    _thread;
+
+    // any thread -> reactor
+    std::mutex               _sub_mu;
+    std::condition_variable  _sub_cv;
+    std::vector<HsmAsyncOp*> _submitted;
+    std::atomic<bool>        _doorbell{false};
+    bool _running  = false;
+    bool _stop     = false;
+    bool _sleeping = false;
+
+    // reactor -> loop
+    std::mutex               _done_mu;
+    std::vector<HsmAsyncOp*> _done;
+    int _event_fd = -1;
+
+    // reactor thread only
+    std::deque<HsmAsyncOp*> _aes_q;
+    std::deque<HsmAsyncOp*> _trng_q;
+    AesJob            _aes_job;                 // front of _aes_q while running
+    bool              _trng_pending = false;    // word requested
+    uint32_t          _trng_base = 0;
+    bool              _trng_waiting = false;
+    Clock::time_point _trng_deadline;
+
+    std::atomic<uint64_t> _submitted_n{0}, _completed_n{0}, _turns{0}, _yields{0}, _sleeps{0}, _timeouts{0};
+
+    // future-backed op
+    struct FutureOp : HsmAsyncOp {
+        std::promise<HsmAsyncStatus> promise;
+        static void fulfil(HsmAsyncOp* op) {
+            FutureOp* f = static_cast<FutureOp*>(op);
+            f->promise.set_value(f->status);
+            delete f;
+        }
+    };
+
+    void complete(HsmAsyncOp* op, HsmAsyncStatus st) {
+        op->status = st;
+        _completed_n.fetch_add(1, std::memory_order_relaxed);
+        if (op->finish) {
+            op->finish(op);
+            return;
+        }
+        bool first;
+        {
+            std::lock_guard<std::mutex> lk(_done_mu);
+            first = _done.empty();
+            _done.push_back(op);
+        }
+        // one wakeup per batch: dispatch() drains everything queued behind it
+        uint64_t one = 1;
+        if (first && ::write(_event_fd, &one, sizeof(one)) < 0) perror("HsmReactor eventfd");
+    }
+
+    // a poll missed: arm the deadline on the first miss, true once it has passed
+    bool overdue(bool& waiting, Clock::time_point& deadline) {
+        Clock::time_point now = Clock::now();
+        if (!waiting) {
+            waiting = true;
+            deadline = now + std::chrono::microseconds(_cfg.timeout_us);
+            return false;
+        }
+        return now >= deadline;
+    }
+
+    // AES ---------------------------------
+    void finishAes(HsmAsyncOp* op, HsmAsyncStatus st) {
+        _aes_q.pop_front();
+        op->done = _aes_job.blocksDone();
+        if (st == HsmAsyncStatus::TIMEOUT) _timeouts.fetch_add(1, std::memory_order_relaxed);
+        complete(op, st);
+    }
+
+    // true when something moved
+    bool stepAes() {
+        if (_aes_q.empty()) return false;
+        HsmAsyncOp* op = _aes_q.front();
+        if (!_aes) {
+            finishAes(op, HsmAsyncStatus::NO_DEVICE);
+            return true;
+        }
+        if (!_aes_job.running()) _aes_job.start(op->key, op->pt, op->ct, op->blocks);
+        bool moved = _aes_job.step(_cfg.blocks_per_turn);
+        switch (_aes_job.state()) {
+            case AesJobState::DONE:    finishAes(op, HsmAsyncStatus::OK); break;
+            case AesJobState::BAD_KEY: finishAes(op, HsmAsyncStatus::BAD_KEY); break;
+            case AesJobState::TIMEOUT: finishAes(op, HsmAsyncStatus::TIMEOUT); break;
+            default: break;
+        }
+        return moved;
+    }
+
+    // TRNG ---------------------------------
+    void finishTrng(HsmAsyncOp* op, HsmAsyncStatus st) {
+        _trng_q.pop_front();
+        _trng_pending = false;
+        _trng_waiting = false;
+        if (st != HsmAsyncStatus::OK && op->buf) {
+            volatile uint8_t* wipe = op->buf;
+            for (size_t i = 0; i < op->len; i++) wipe[i] = 0;
+        }
+        complete(op, st);
+    }
+
+    bool stepTrng() {
+        if (_trng_q.empty()) return false;
+        HsmAsyncOp* op = _trng_q.front();
+        if (!_trng) {
+            finishTrng(op, HsmAsyncStatus::NO_DEVICE);
+            return true;
+        }
+        if (!_trng_pending) {
+            if (op->done == op->len) {
+                finishTrng(op, _trng->checkHealth() ? HsmAsyncStatus::OK : HsmAsyncStatus::HEALTH_FAIL);
+                return true;
+            }
+            _trng_base = _trng->startSample();
+            _trng_pending = true;
+            _trng_waiting = false;
+            return true;
+        }
+        if (!_trng->sampleReady(_trng_base)) {
+            if (!overdue(_trng_waiting, _trng_deadline)) return false;
+            _trng->sampleFailed();
+            _timeouts.fetch_add(1, std::memory_order_relaxed);
+            finishTrng(op, HsmAsyncStatus::TIMEOUT);
+            return true;
+        }
+        uint32_t word = _trng->takeSample();
+        size_t take = op->len - op->done < sizeof(word) ? op->len - op->done : sizeof(word);
+        memcpy(op->buf + op->done, &word, take);
+        op->done += take;
+        _trng_pending = false;
+        _trng_waiting = false;
+        return true;
+    }
+
+    // Loop ---------------------------------
+    void route(HsmAsyncOp* op) {
+        switch (op->kind) {
+            case HsmAsyncOp::Kind::ENCRYPT: _aes_q.push_back(op); break;
+            case HsmAsyncOp::Kind::RANDOM:  _trng_q.push_back(op); break;
+            case HsmAsyncOp::Kind::CALL:
+                op->call();
+                complete(op, HsmAsyncStatus::OK);
+                break;
+        }
+    }
+
+    void run() {
+        std::vector<HsmAsyncOp*> batch;
+        uint32_t idle = 0;
+        for (;;) {
+            bool busy = !_aes_q.empty() || !_trng_q.empty();
+            // mid-operation the lock is only taken when something was submitted
+            if (!busy || _doorbell.load(std::memory_order_acquire)) {
+                std::unique_lock<std::mutex> lk(_sub_mu);
+                if (!busy && _submitted.empty() && !_stop) {
+                    _sleeps.fetch_add(1, std::memory_order_relaxed);
+                    _sleeping = true;
+                    _sub_cv.wait(lk, [&] { return _stop || !_submitted.empty(); });
+                    _sleeping = false;
+                }
+                if (_stop) break;
+                batch.swap(_submitted);
+                _doorbell.store(false, std::memory_order_relaxed);
+            }
+            for (HsmAsyncOp* op : batch) route(op);
+            batch.clear();
+
+            _turns.fetch_add(1, std::memory_order_relaxed);
+            bool moved = stepAes();
+            moved |= stepTrng();
+            if (moved) {
+                idle = 0;
+            } else if (++idle >= _cfg.idle_spins) {
+                _yields.fetch_add(1, std::memory_order_relaxed);
+                sched_yield();
+                idle = 0;
+            }
+        }
+
+        // stop(): leave the core READY and fail whatever is left
+        if (_aes) _aes_job.abort();
+        if (_trng && _trng_pending) _trng->sampleFailed();
+        _trng_pending = false;
+        {
+            std::lock_guard<std::mutex> lk(_sub_mu);
+            batch.swap(_submitted);
+        }
+        for (HsmAsyncOp* op : _aes_q) complete(op, HsmAsyncStatus::STOPPED);
+        for (HsmAsyncOp* op : _trng_q) complete(op, HsmAsyncStatus::STOPPED);
+        for (HsmAsyncOp* op : batch) complete(op, HsmAsyncStatus::STOPPED);
+        _aes_q.clear();
+        _trng_q.clear();
+    }
+
+    template <class Fill>
+    std::future<HsmAsyncStatus> submitFuture(Fill&& fill) {
+        FutureOp* op = new FutureOp;
+        fill(*op);
+        op->finish = FutureOp::fulfil;
+        std::future<HsmAsyncStatus> f = op->promise.get_future();
+        submit(op);
+        return f;
+    }
+
+public:
+    // either driver may be null; ops for it then complete with NO_DEVICE
+    HsmReactor(AesDriver* aes, PynqHSM* trng, const HsmAsyncConfig& cfg = HsmAsyncConfig())
+        : _aes(aes), _trng(trng), _cfg(cfg), _aes_job(aes, cfg.timeout_us) {
+        _event_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_event_fd < 0) perror("eventfd");
+    }
+
+    HsmReactor(const HsmReactor&) = delete;
+    HsmReactor& operator=(const HsmReactor&) = delete;
+
+    ~HsmReactor() {
+        stop();
+        dispatch();
+        if (_event_fd >= 0) ::close(_event_fd);
+    }
+
+    bool start() {
+        if (_event_fd < 0) return false;
+        std::lock_guard<std::mutex> lk(_sub_mu);
+        if (_running) return true;
+        _stop = false;
+        _running = true;
+        _thread = std::thread([this] { run(); });
+        return true;
+    }
+
+    // outstanding ops complete with STOPPED (awaiters still need a dispatch())
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lk(_sub_mu);
+            if (!_running) return;
+            _stop = true;
+        }
+        _sub_cv.notify_one();
+        _thread.join();
+        std::lock_guard<std::mutex> lk(_sub_mu);
+        _running = false;
+    }
+
+    bool running() {
+        std::lock_guard<std::mutex> lk(_sub_mu);
+        return _running;
+    }
+
+    // readable while completed awaiters wait for dispatch(); level-triggered friendly
+    int eventFd() const { return _event_fd; }
+
+    /**
+    * @brief Resume every coroutine whose op has completed, on the calling thread
+    * @details Call from the loop that owns the awaiting coroutines when eventFd() is
+    *          readable. Resumed coroutines may submit again; they must not call dispatch().
+    */
+    size_t dispatch() {
+        uint64_t n;
+        if (_event_fd >= 0 && ::read(_event_fd, &n, sizeof(n)) < 0 && errno != EAGAIN) perror("HsmReactor eventfd");
+        std::vector<HsmAsyncOp*> ready;
+        {
+            std::lock_guard<std::mutex> lk(_done_mu);
+            ready.swap(_done);
+        }
+        for (HsmAsyncOp* op : ready) op->resume(op->waiter);
+        return ready.size();
+    }
+
+    // hand an op to the reactor; it is completed exactly once
+    void submit(HsmAsyncOp* op) {
+        bool wake;
+        {
+            std::lock_guard<std::mutex> lk(_sub_mu);
+            if (!_running || _stop) {
+                wake = false;
+            } else {
+                _submitted.push_back(op);
+                _doorbell.store(true, std::memory_order_release);
+                _submitted_n.fetch_add(1, std::memory_order_relaxed);
+                wake = _sleeping;
+                op = nullptr;
+            }
+        }
+        if (op) {
+            // not running: calls run inline (the drivers are still the caller's), the rest fail
+            if (op->kind == HsmAsyncOp::Kind::CALL) op->call();
+            complete(op, op->kind == HsmAsyncOp::Kind::CALL ? HsmAsyncStatus::OK : HsmAsyncStatus::STOPPED);
+        } else if (wake) {
+            _sub_cv.notify_one();
+        }
+    }
+
+    // Futures ---------------------------------
+    std::future<HsmAsyncStatus> encryptFuture(AesKeyHandle key, const uint32_t* pt, uint32_t* ct, size_t n_blocks) {
+        return submitFuture([&](HsmAsyncOp& op) {
+            op.kind = HsmAsyncOp::Kind::ENCRYPT;
+            op.key = key;
+            op.pt = pt;
+            op.ct = ct;
+            op.blocks = n_blocks;
+        });
+    }
+
+    std::future<HsmAsyncStatus> randomBytesFuture(uint8_t* buf, size_t len) {
+        return submitFuture([&](HsmAsyncOp& op) {
+            op.kind = HsmAsyncOp::Kind::RANDOM;
+            op.buf = buf;
+            op.len = len;
+        });
+    }
+
+    // fn runs on the reactor thread between operations (or inline when not started)
+    std::future<HsmAsyncStatus> post(std::function<void()> fn) {
+        return submitFuture([&](HsmAsyncOp& op) { op.call = std::move(fn); });
+    }
+
+    // Keys ---------------------------------
+    // the handle table is the reactor's once it runs; these hop onto its thread and wait
+    AesKeyHandle registerKey(const uint32_t key[8]) {
+        AesKeyHandle h = AES_NO_KEY;
+        if (_aes) post([&] { h = _aes->registerKey(key); }).wait();
+        return h;
+    }
+
+    void unregisterKey(AesKeyHandle h) {
+        if (_aes) post([&] { _aes->unregisterKey(h); }).wait();
+    }
+
+    // Awaitables (C++20) ---------------------------------
+#if HSM_ASYNC_COROUTINES
+    HsmAwaitable encrypt(AesKeyHandle key, const uint32_t* pt, uint32_t* ct, size_t n_blocks);
+    HsmAwaitable randomBytes(uint8_t* buf, size_t len);
+#endif
+
+    HsmAsyncStats stats() const {
+        HsmAsyncStats s;
+        s.submitted = _submitted_n.load(std::memory_order_relaxed);
+        s.completed = _completed_n.load(std::memory_order_relaxed);
+        s.turns     = _turns.load(std::memory_order_relaxed);
+        s.yields    = _yields.load(std::memory_order_relaxed);
+        s.sleeps    = _sleeps.load(std::memory_order_relaxed);
+        s.timeouts  = _timeouts.load(std::memory_order_relaxed);
+        return s;
+    }
+};
+
+#if HSM_ASYNC_COROUTINES
+// Coroutines =======================================
+// co_await reactor.encrypt(...) -> HsmAsyncStatus; the op lives in the coroutine frame
+class HsmAwaitable {
+private:
+    HsmReactor& _r;
+    HsmAsyncOp  _op;
+
+public:
+    HsmAwaitable(HsmReactor& r, const HsmAsyncOp& op) : _r(r), _op(op) {}
+    HsmAwaitable(const HsmAwaitable&) = delete;
+    HsmAwaitable& operator=(const HsmAwaitable&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+    void await_suspend(std::coroutine_handle<> h) {
+        _op.waiter = h.address();
+        _op.resume = [](void* w) { std::coroutine_handle<>::from_address(w).resume(); };
+        _r.submit(&_op);
+    }
+    HsmAsyncStatus await_resume() const noexcept { return _op.status; }
+};
+
+inline HsmAwaitable HsmReactor::encrypt(AesKeyHandle key, const uint32_t* pt, uint32_t* ct, size_t n_blocks) {
+    HsmAsyncOp op;
+    op.kind = HsmAsyncOp::Kind::ENCRYPT;
+    op.key = key;
+    op.pt = pt;
+    op.ct = ct;
+    op.blocks = n_blocks;
+    return HsmAwaitable(*this, op);
+}
+
+inline HsmAwaitable HsmReactor::randomBytes(uint8_t* buf, size_t len) {
+    HsmAsyncOp op;
+    op.kind = HsmAsyncOp::Kind::RANDOM;
+    op.buf = buf;
+    op.len = len;
+    return HsmAwaitable(*this, op);
+}
+
+// fire-and-forget coroutine for loops that don't bring their own task type
+struct HsmTask {
+    struct promise_type {
+        HsmTask get_return_object() noexcept { return {}; }
+        std::suspend_never initial_suspend() noexcept { return {}; }
+        std::suspend_never final_suspend() noexcept { return {}; }
+        void return_void() noexcept {}
+        void unhandled_exception() noexcept { std::terminate(); }
+    };
+};
+#endif
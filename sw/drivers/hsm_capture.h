@@ -0,0 +1,234 @@
+/**
+* @file     hsm_capture.h
+* @brief    Buffered binary capture: page-aligned buffer ring + writer thread
+* @details  The sampler fills one buffer while a writer thread drains the others,
+*           so harvesting never blocks on the file / pipe unless every buffer is full.
+*
+* 1. put() appends a word to the current buffer (no syscall); bulk producers write into
+*    space() directly and commit() it
+* 2. a full buffer is handed to the writer; all queued buffers go out in one writev()
+* 3. pipes get F_SETPIPE_SZ raised to the buffer size so a writev moves a whole buffer
+*
+* vmsplice() is not used: gifted pages are only safe if the buffer is never rewritten,
+* and the ring reuses them immediately.
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// Config =======================================
+struct CaptureConfig {
+    size_t   buffer_bytes = 1 << 20;   // per buffer, rounded up to a page
+    uint32_t buffers      = 4;         // >= 2; one filling, the rest queued / writing
+};
+
+struct CaptureStats {
+    uint64_t bytes_written   = 0;
+    uint64_t syscalls        = 0;      // writev calls
+    uint64_t buffers_written = 0;
+    uint64_t producer_stalls = 0;      // sampler waited for a free buffer (I/O bound)
+    double   elapsed_s       = 0;
+
+    double mb_per_sec() const { return elapsed_s > 0 ? bytes_written / elapsed_s / 1e6 : 0; }
+
+    void print(FILE* out = stderr) const {
+        fprintf(out, "    Captured    : %llu bytes in %.2fs (%.2f MB/s)\n",
+                (unsigned long long)bytes_written, elapsed_s, mb_per_sec());
+        fprintf(out, "    Writer      : %llu buffers in %llu writev calls, %llu producer stalls\n",
+                (unsigned long long)buffers_written, (unsigned long long)syscalls,
+                (unsigned long long)producer_stalls);
+    }
+};
+
+// Writer =======================================
+class CaptureWriter {
+private:
+    int      _fd = -1;
+    bool     _own_fd = false;
+    size_t   _buf_bytes = 0;
+    uint32_t _nbuf = 0;
+    std::vector<uint8_t*> _bufs;
+    std::vector<size_t>   _lens;
+
+    // ring of buffer indices: [_write_idx, _fill_idx) queued, _fill_idx filling
+    std::mutex              _mtx;
+    std::condition_variable _cv_writer, _cv_producer;
+    uint32_t _fill_idx  = 0;
+    uint32_t _write_idx = 0;
+    uint32_t _queued    = 0;
+    bool     _closing   = false;
+    bool     _failed    = false;
+
+    uint8_t* _cur = nullptr;        // producer's view of the filling buffer
+    size_t   _cur_len = 0;
+
+    std::thread _thread;
+    CaptureStats _stats;
+    std::chrono::steady_clock::time_point _t0;
+
+    bool writeAll(struct iovec* iov, int cnt) {
+        while (cnt > 0) {
+            ssize_t n = ::writev(_fd, iov, cnt);
+            _stats.syscalls++;
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                if (errno != EPIPE) perror("capture writev");   // EPIPE: reader went away (dd done)
+                return false;
+            }
+            _stats.bytes_written += n;
+            // advance past what went out (short writes on pipes are normal)
+            while (cnt > 0 && (size_t)n >= iov->iov_len) { n -= iov->iov_len; iov++; cnt--; }
+            if (cnt > 0) { iov->iov_base = (uint8_t*)iov->iov_base + n; iov->iov_len -= n; }
+        }
+        return true;
+    }
+
+    void writerLoop() {
+        std::vector<struct iovec> iov(_nbuf);
+        std::unique_lock<std::mutex> lk(_mtx);
+        while (true) {
+            _cv_writer.wait(lk, [&] { return _queued > 0 || _closing; });
+            if (_queued == 0) break;
+
+            uint32_t cnt = _queued;
+            for (uint32_t i = 0; i < cnt; i++) {
+                uint32_t b = (_write_idx + i) % _nbuf;
+                iov[i].iov_base = _bufs[b];
+                iov[i].iov_len  = _lens[b];
+            }
+            lk.unlock();
+            bool ok = writeAll(iov.data(), (int)cnt);
+            lk.lock();
+
+            _stats.buffers_written += cnt;
+            _write_idx = (_write_idx + cnt) % _nbuf;
+            _queued -= cnt;
+            if (!ok) _failed = true;
+            _cv_producer.notify_one();
+            if (_failed) break;
+        }
+    }
+
+    // hand the filling buffer to the writer and take the next free one
+    bool rotate() {
+        std::unique_lock<std::mutex> lk(_mtx);
+        _lens[_fill_idx] = _cur_len;
+        _queued++;
+        _fill_idx = (_fill_idx + 1) % _nbuf;
+        _cv_writer.notify_one();
+        if (_queued >= _nbuf) {
+            _stats.producer_stalls++;
+            _cv_producer.wait(lk, [&] { return _queued < _nbuf || _failed; });
+        }
+        _cur = _bufs[_fill_idx];
+        _cur_len = 0;
+        return !_failed;
+    }
+
+public:
+    CaptureWriter() = default;
+    CaptureWriter(const CaptureWriter&) = delete;
+    CaptureWriter& operator=(const CaptureWriter&) = delete;
+
+    ~CaptureWriter() {
+        finish();
+        for (uint8_t* b : _bufs) free(b);
+        if (_own_fd && _fd >= 0) ::close(_fd);
+    }
+
+    /**
+    * @brief Open the sink and start the writer thread
+    * @param path  file to create/truncate, or nullptr / "-" for stdout
+    */
+    bool open(const char* path, const CaptureConfig& cfg = CaptureConfig{}) {
+        long page = sysconf(_SC_PAGESIZE);
+        if (page <= 0) page = 4096;
+        _buf_bytes = (cfg.buffer_bytes + page - 1) / page * page;
+        _nbuf = cfg.buffers < 2 ? 2 : cfg.buffers;
+
+        if (!path || strcmp(path, "-") == 0) {
+            _fd = STDOUT_FILENO;
+        } else {
+            _fd = ::open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (_fd < 0) { perror("capture open"); return false; }
+            _own_fd = true;
+        }
+
+        struct stat st;
+        if (fstat(_fd, &st) == 0 && S_ISFIFO(st.st_mode)) {
+#ifdef F_SETPIPE_SZ
+            // best effort: capped by /proc/sys/fs/pipe-max-size for non-root
+            if (fcntl(_fd, F_SETPIPE_SZ, (int)_buf_bytes) < 0) perror("F_SETPIPE_SZ (continuing)");
+#endif
+        }
+
+        for (uint32_t i = 0; i < _nbuf; i++) {
+            void* p = nullptr;
+            if (posix_memalign(&p, page, _buf_bytes) != 0) { perror("posix_memalign"); return false; }
+            memset(p, 0, _buf_bytes);   // prefault now, not mid-capture
+            _bufs.push_back(static_cast<uint8_t*>(p));
+        }
+        _lens.assign(_nbuf, 0);
+
+        _cur = _bufs[0];
+        _cur_len = 0;
+        _t0 = std::chrono::steady_clock::now();
+        _thread = std::thread(&CaptureWriter::writerLoop, this);
+        return true;
+    }
+
+    // append one word (or its first `bytes` bytes); false once the sink has failed (e.g. EPIPE)
+    bool put(uint32_t word, size_t bytes = sizeof(uint32_t)) {
+        memcpy(_cur + _cur_len, &word, bytes);
+        _cur_len += bytes;
+        if (_cur_len + sizeof(word) > _buf_bytes) return rotate();
+        return true;
+    }
+
+    // bulk producers: fill up to `room` bytes at the returned pointer, then commit() them
+    uint8_t* space(size_t& room) {
+        room = _buf_bytes - _cur_len;
+        return _cur + _cur_len;
+    }
+
+    bool commit(size_t bytes) {
+        _cur_len += bytes;
+        if (_cur_len == _buf_bytes) return rotate();
+        return true;
+    }
+
+    // flush the partial buffer, drain the queue, stop the writer; false if any write failed
+    bool finish() {
+        if (!_thread.joinable()) return !_failed;
+        if (_cur_len > 0 && !_failed) rotate();
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _closing = true;
+        }
+        _cv_writer.notify_one();
+        _thread.join();
+        _stats.elapsed_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - _t0).count();
+        return !_failed;
+    }
+
+    bool failed() {
+        std::lock_guard<std::mutex> lk(_mtx);
+        return _failed;
+    }
+
+    const CaptureStats& stats() const { return _stats; }
+};
@@ -0,0 +1,192 @@
+/**
+* @file     hsm_client.h
+* @brief    Client for hsmd: AES-256 and TRNG bytes through the shared daemon
+* @details  Blocking, one connection per HsmClient (not thread safe; one per thread).
+*           Large encrypts are split into HSMD_MAX_BLOCKS requests and pipelined up to
+*           HSMD_CLIENT_WINDOW deep, so the daemon can batch them with other clients'
+*           work under the same key instead of seeing one request at a time.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "hsm_proto.h"
+
+constexpr uint32_t HSMD_CLIENT_WINDOW = 4;     // ENCRYPT requests in flight per call
+
+class HsmClient {
+private:
+    int _fd = -1;
+    uint32_t _next_id = 1;
+
+    bool send(HsmOp op, uint32_t id, uint32_t key, const void* payload, uint32_t len) {
+        HsmMsgHeader h = { HSMD_MAGIC, (uint16_t)op, 0, id, key, len };
+        return hsm_write_all(_fd, &h, sizeof(h)) && (!len || hsm_write_all(_fd, payload, len));
+    }
+
+    // next response header; payload left on the socket for the caller
+    bool recvHeader(HsmMsgHeader& h) {
+        return hsm_read_all(_fd, &h, sizeof(h)) && h.magic == HSMD_MAGIC;
+    }
+
+    bool discard(uint32_t len) {
+        uint8_t sink[256];
+        while (len) {
+            uint32_t n = len < sizeof(sink) ? len : (uint32_t)sizeof(sink);
+            if (!hsm_read_all(_fd, sink, n)) return false;
+            len -= n;
+        }
+        return true;
+    }
+
+    // one request, one response, payload into out (up to out_len bytes)
+    HsmStatus call(HsmOp op, uint32_t key, const void* payload, uint32_t len,
+                   void* out = nullptr, uint32_t out_len = 0, uint32_t* key_out = nullptr) {
+        if (_fd < 0) return HsmStatus::DISCONNECTED;
+        uint32_t id = _next_id++;
+        HsmMsgHeader h;
+        if (!send(op, id, key, payload, len) || !recvHeader(h) || h.id != id) return fail();
+        uint32_t take = h.len < out_len ? h.len : out_len;
+        if (take && !hsm_read_all(_fd, out, take)) return fail();
+        if (!discard(h.len - take)) return fail();
+        if (key_out) *key_out = h.key;
+        return (HsmStatus)h.status;
+    }
+
+    HsmStatus fail() {
+        close();
+        return HsmStatus::DISCONNECTED;
+    }
+
+public:
+    HsmClient() = default;
+    ~HsmClient() { close(); }
+    HsmClient(const HsmClient&) = delete;
+    HsmClient& operator=(const HsmClient&) = delete;
+
+    bool connect(const char* path = HSMD_SOCKET) {
+        close();
+        _fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (_fd < 0) { perror("socket"); return false; }
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+        if (::connect(_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+            perror("connect hsmd");
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (_fd >= 0) ::close(_fd);
+        _fd = -1;
+    }
+
+    bool isOpen() const { return _fd >= 0; }
+
+    HsmStatus loadKey(const uint32_t key[8], AesKeyHandle& h) {
+        h = AES_NO_KEY;
+        return call(HsmOp::KEY_LOAD, 0, key, 32, nullptr, 0, &h);
+    }
+
+    HsmStatus dropKey(AesKeyHandle h) { return call(HsmOp::KEY_DROP, h, nullptr, 0); }
+
+    /**
+    * @brief Encrypt n_blocks under h (4 words per block, AesDriver layout); pt and ct may alias
+    * @details Pipelined in HSMD_MAX_BLOCKS pieces; the first non-OK status is returned
+    *          after every outstanding response has been drained.
+    */
+    HsmStatus encrypt(AesKeyHandle h, const uint32_t* pt, uint32_t* ct, size_t n_blocks) {
+        if (_fd < 0) return HsmStatus::DISCONNECTED;
+        size_t chunks = (n_blocks + HSMD_MAX_BLOCKS - 1) / HSMD_MAX_BLOCKS;
+        uint32_t base = _next_id;
+        _next_id += (uint32_t)chunks;
+        size_t sent = 0, done = 0;
+        HsmStatus result = HsmStatus::OK;
+
+        while (done < chunks) {
+            while (sent < chunks && sent - done < HSMD_CLIENT_WINDOW) {
+                size_t off = sent * HSMD_MAX_BLOCKS;
+                size_t n = n_blocks - off < HSMD_MAX_BLOCKS ? n_blocks - off : HSMD_MAX_BLOCKS;
+                if (!send(HsmOp::ENCRYPT, base + (uint32_t)sent, h, pt + 4 * off, (uint32_t)(n * 16))) return fail();
+                sent++;
+            }
+            HsmMsgHeader r;
+            if (!recvHeader(r) || r.id - base >= chunks) return fail();
+            size_t off = (size_t)(r.id - base) * HSMD_MAX_BLOCKS;
+            size_t n = n_blocks - off < HSMD_MAX_BLOCKS ? n_blocks - off : HSMD_MAX_BLOCKS;
+            if (r.status == (uint16_t)HsmStatus::OK && r.len == n * 16) {
+                if (!hsm_read_all(_fd, ct + 4 * off, r.len)) return fail();
+            } else {
+                if (!discard(r.len)) return fail();
+                if (result == HsmStatus::OK) result = r.status ? (HsmStatus)r.status : HsmStatus::BAD_REQUEST;
+            }
+            done++;
+        }
+        return result;
+    }
+
+    HsmStatus random(void* buf, size_t len) {
+        uint8_t* out = static_cast<uint8_t*>(buf);
+        while (len) {
+            uint32_t n = len < HSMD_MAX_RANDOM ? (uint32_t)len : HSMD_MAX_RANDOM;
+            HsmStatus s = call(HsmOp::RANDOM, 0, &n, sizeof(n), out, n);
+            if (s != HsmStatus::OK) return s;
+            out += n;
+            len -= n;
+        }
+        return HsmStatus::OK;
+    }
+
+    // pass a ring's memfd + doorbells to hsmd (SCM_RIGHTS), see hsm_shm_ring.h
+    HsmStatus attachRing(int mem_fd, int sq_fd, int cq_fd) {
+        if (_fd < 0) return HsmStatus::DISCONNECTED;
+        uint32_t id = _next_id++;
+        HsmMsgHeader h = { HSMD_MAGIC, (uint16_t)HsmOp::RING_ATTACH, 0, id, 0, 0 };
+        int fds[3] = { mem_fd, sq_fd, cq_fd };
+        union {
+            char buf[CMSG_SPACE(sizeof(fds))];
+            struct cmsghdr align;
+        } ctl = {};
+        struct iovec iov = { &h, sizeof(h) };
+        struct msghdr msg = {};
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = sizeof(ctl.buf);
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+        ssize_t n;
+        do { n = ::sendmsg(_fd, &msg, MSG_NOSIGNAL); } while (n < 0 && errno == EINTR);
+        if (n != (ssize_t)sizeof(h)) return fail();
+        HsmMsgHeader r;
+        if (!recvHeader(r) || r.id != id || !discard(r.len)) return fail();
+        return (HsmStatus)r.status;
+    }
+
+    HsmStatus stats(std::string& text) {
+        std::vector<char> buf(16384);
+        uint32_t id = _next_id++;
+        HsmMsgHeader h;
+        if (_fd < 0) return HsmStatus::DISCONNECTED;
+        if (!send(HsmOp::STATS, id, 0, nullptr, 0) || !recvHeader(h) || h.id != id) return fail();
+        buf.resize(h.len);
+        if (h.len && !hsm_read_all(_fd, buf.data(), h.len)) return fail();
+        text.assign(buf.begin(), buf.end());
+        return (HsmStatus)h.status;
+    }
+};
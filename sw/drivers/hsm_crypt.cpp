@@ -0,0 +1,361 @@
+/**
+* @file     hsm_crypt.cpp
+* @brief    hsm-crypt: AES-256-CTR over files and pipes through AesDispatcher (core, CPU or split)
+* @details  Encrypt = decrypt in CTR; -d only changes where the IV comes from.
+*
+* 1. input: a regular file is mmap()ed (MADV_SEQUENTIAL, consumed ranges dropped behind
+*    the cursor); a pipe / socket / tty is read() in CRYPT_CHUNK pieces straight into the
+*    output buffer and encrypted in place
+* 2. AesCtr keystream is itself double buffered against the core (aes_modes.h)
+* 3. output goes through CaptureWriter (hsm_capture.h): a writer thread drains full
+*    buffers while the next one is encrypted, so the write() of chunk k overlaps chunk k+1
+* Any length works; a partial last block uses the leading bytes of its keystream block.
+*
+* Format: 16-byte initial counter block, then the ciphertext. The IV is drawn from the
+* TRNG (getrandom() with --cpu) unless --iv gives it; --raw drops the header on output
+* (and expects none on input), so the IV must then be passed both ways.
+*
+* The dispatcher is calibrated on the live key first, so each chunk is routed to the
+* core, the CPU kernel or split between them by measured cost, never slower than the
+* CPU alone. MB/s and CPU use (user + sys over wall, in cores) go to stderr.
+*
+* Usage: hsm_crypt (--key-file FILE | --key-fd N) [-d] [-i IN] [-o OUT] [--iv HEX] [--raw]
+*                  [--cpu | --sim [instant|core|pynq]] [--kernel NAME] [--chunk BYTES] [-q]
+*        hsm_crypt -k HEX --sim ...
+*   IN / OUT default to stdin / stdout; FILE / fd N hold 32 raw bytes or 64 hex digits
+*   (--key-fd 0 with -i: key piped on stdin). -k puts the key in argv, where ps and
+*   /proc/<pid>/cmdline show it to every local user, so it is accepted with --sim only.
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "aes_modes.h"
+#include "hsm_capture.h"
+#include "hsm_driver.h"
+#include "sim_device.h"
+
+constexpr size_t CRYPT_CHUNK      = 1 << 20;    // bytes per output buffer / read
+constexpr size_t CRYPT_DROP_EVERY = 8 << 20;    // mmap bytes consumed between MADV_DONTNEED
+
+// Input =======================================
+class CryptInput {
+private:
+    int            _fd = -1;
+    bool           _own_fd = false;
+    const uint8_t* _map = nullptr;
+    size_t         _map_len = 0;
+    size_t         _pos = 0;
+    size_t         _dropped = 0;            // map bytes already handed back to the kernel
+
+public:
+    CryptInput() = default;
+    CryptInput(const CryptInput&) = delete;
+    CryptInput& operator=(const CryptInput&) = delete;
+
+    ~CryptInput() {
+        if (_map) munmap((void*)_map, _map_len);
+        if (_own_fd) ::close(_fd);
+    }
+
+    // path nullptr / "-": stdin; regular non-empty files are mapped
+    bool open(const char* path) {
+        if (!path || strcmp(path, "-") == 0) {
+            _fd = STDIN_FILENO;
+        } else {
+            _fd = ::open(path, O_RDONLY);
+            if (_fd < 0) { perror(path); return false; }
+            _own_fd = true;
+        }
+        struct stat st;
+        if (fstat(_fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+            void* p = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, _fd, 0);
+            if (p != MAP_FAILED) {
+                _map = (const uint8_t*)p;
+                _map_len = (size_t)st.st_size;
+                madvise(p, _map_len, MADV_SEQUENTIAL);
+            }
+        }
+        return true;
+    }
+
+    bool mapped() const { return _map != nullptr; }
+
+    /**
+    * @brief Next run of input, at most max bytes; 0 at end of input, -1 on error
+    * @details Mapped: data points into the mapping and dst is untouched. Otherwise read()
+    *          fills dst (short reads retried up to max or EOF) and data = dst.
+    */
+    ssize_t next(uint8_t* dst, size_t max, const uint8_t*& data) {
+        if (_map) {
+            if (_pos - _dropped >= CRYPT_DROP_EVERY) {
+                size_t page = (size_t)sysconf(_SC_PAGESIZE);
+                size_t upto = _pos / page * page;
+                madvise((void*)(_map + _dropped), upto - _dropped, MADV_DONTNEED);
+                _dropped = upto;
+            }
+            size_t n = std::min(max, _map_len - _pos);
+            data = _map + _pos;
+            _pos += n;
+            return (ssize_t)n;
+        }
+        size_t got = 0;
+        while (got < max) {
+            ssize_t n = ::read(_fd, dst + got, max - got);
+            if (n < 0) {
+                if (errno == EINTR) continue;
+                perror("read");
+                return -1;
+            }
+            if (n == 0) break;
+            got += (size_t)n;
+        }
+        data = dst;
+        return (ssize_t)got;
+    }
+};
+
+// Helpers =======================================
+static bool parse_hex(const char* s, uint8_t* out, size_t len) {
+    if (strlen(s) != 2 * len) return false;
+    for (size_t i = 0; i < len; i++) {
+        unsigned v;
+        if (sscanf(s + 2 * i, "%2x", &v) != 1 || !isxdigit((unsigned char)s[2 * i]) || !isxdigit((unsigned char)s[2 * i + 1]))
+            return false;
+        out[i] = (uint8_t)v;
+    }
+    return true;
+}
+
+// 32 raw bytes or 64 hex digits (trailing newline allowed)
+// 32 raw bytes or 64 hex digits, up to EOF
+static bool load_key_fd(int fd, const char* what, uint8_t key[32]) {
+    char buf[80];
+    size_t n = 0;
+    while (n < sizeof(buf) - 1) {
+        ssize_t r = ::read(fd, buf + n, sizeof(buf) - 1 - n);
+        if (r < 0 && errno == EINTR) continue;
+        if (r < 0) { perror(what); return false; }
+        if (r == 0) break;
+        n += (size_t)r;
+    }
+    bool ok = false;
+    if (n == 32) {
+        memcpy(key, buf, 32);
+        ok = true;
+    } else {
+        while (n && (buf[n - 1] == '\n' || buf[n - 1] == '\r')) n--;
+        buf[n] = 0;
+        ok = parse_hex(buf, key, 32);
+    }
+    volatile char* wipe = buf;
+    for (size_t i = 0; i < sizeof(buf); i++) wipe[i] = 0;
+    if (!ok) fprintf(stderr, "[ERROR] %s: expected 32 raw bytes or 64 hex digits\n", what);
+    return ok;
+}
+
+static bool load_key_file(const char* path, uint8_t key[32]) {
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { perror(path); return false; }
+    bool ok = load_key_fd(fd, path, key);
+    ::close(fd);
+    return ok;
+}
+
+// health-checked TRNG words, or the kernel CSPRNG when no HSM is in play
+static bool random_iv(PynqHSM* hsm, uint8_t iv[16]) {
+    if (!hsm) return getrandom(iv, 16, 0) == 16;
+    for (int i = 0; i < 4; i++) {
+        uint32_t w;
+        if (!hsm->sampleWord(w)) return false;
+        memcpy(iv + 4 * i, &w, 4);
+    }
+    return hsm->checkHealth();
+}
+
+static double cpu_seconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_stime.tv_sec + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) / 1e6;
+}
+
+static int usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s (--key-file FILE | --key-fd N) [-d] [-i IN] [-o OUT] [--iv HEX] [--raw]\n"
+                    "       %*s [--cpu | --sim [instant|core|pynq]] [--kernel NAME] [--chunk BYTES] [-q]\n"
+                    "       %s -k HEX --sim ...   (key on the command line: simulation only)\n",
+            argv0, (int)strlen(argv0), "", argv0);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    const char* in_path = nullptr;
+    const char* out_path = nullptr;
+    const char* key_file = nullptr;
+    const char* key_hex = nullptr;
+    int key_fd = -1;
+    const char* iv_hex = nullptr;
+    bool decrypt = false, raw = false, cpu_only = false, sim = false, quiet = false;
+    size_t chunk = CRYPT_CHUNK;
+    SimTiming sim_timing;
+    SoftAesKernel kernel = SoftAes256::constantTime();    // --kernel opts out
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "-k" && a + 1 < argc)                 key_hex = argv[++a];
+        else if (arg == "--key-file" && a + 1 < argc)    key_file = argv[++a];
+        else if (arg == "--key-fd" && a + 1 < argc)      key_fd = atoi(argv[++a]);
+        else if (arg == "-i" && a + 1 < argc)            in_path = argv[++a];
+        else if (arg == "-o" && a + 1 < argc)            out_path = argv[++a];
+        else if (arg == "--iv" && a + 1 < argc)          iv_hex = argv[++a];
+        else if (arg == "--chunk" && a + 1 < argc)       chunk = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "-d")                            decrypt = true;
+        else if (arg == "--raw")                         raw = true;
+        else if (arg == "--cpu")                         cpu_only = true;
+        else if (arg == "-q")                            quiet = true;
+        else if (arg == "--kernel" && a + 1 < argc) {
+            if (!SoftAes256::parseKernel(argv[++a], kernel) || !SoftAes256::available(kernel)) {
+                fprintf(stderr, "[FATAL] Unknown or unsupported kernel '%s'\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    int key_sources = !!key_hex + !!key_file + (key_fd >= 0);
+    if (key_sources != 1 || (raw && !iv_hex) || (cpu_only && sim) || chunk < 16) return usage(argv[0]);
+    if (key_hex && !sim) {
+        fprintf(stderr, "[FATAL] -k is for --sim only: argv is world-readable, use --key-file or --key-fd\n");
+        return EXIT_FAILURE;
+    }
+    if (key_fd == 0 && !in_path) {
+        fprintf(stderr, "[FATAL] --key-fd 0 takes stdin, give the input with -i\n");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t key_bytes[32], iv[16];
+    bool key_ok = key_file ? load_key_file(key_file, key_bytes)
+                : key_fd >= 0 ? load_key_fd(key_fd, "--key-fd", key_bytes)
+                : parse_hex(key_hex, key_bytes, 32);
+    if (key_fd > 0) ::close(key_fd);
+    if (!key_ok) {
+        if (key_hex) fprintf(stderr, "[FATAL] -k wants 64 hex digits\n");
+        return EXIT_FAILURE;
+    }
+    if (iv_hex && !parse_hex(iv_hex, iv, 16)) {
+        fprintf(stderr, "[FATAL] --iv wants 32 hex digits\n");
+        return EXIT_FAILURE;
+    }
+
+    // devices -------------------------------------
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    std::unique_ptr<PynqHSM> hsm;
+    if (!cpu_only) {
+        if (sim) {
+            aes.attach(&sim_aes);
+        } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+            fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or use --cpu / --sim)\n");
+            return EXIT_FAILURE;
+        }
+        hsm.reset(sim ? new PynqHSM(&sim_hsm) : new PynqHSM(HSM_BASE_ADDR, HSM_SIZE));
+        if (!hsm->isOpen()) {
+            fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or use --cpu / --sim)\n");
+            return EXIT_FAILURE;
+        }
+        hsm->clearHealth();
+    }
+    AesDriver drv(aes);
+    AesDispatcher disp(cpu_only ? nullptr : &drv, kernel);
+
+    uint32_t key[8];
+    for (int i = 0; i < 8; i++) key[i] = aes_modes_detail::load_be32(key_bytes + 4 * i);
+    disp.setKey(key);
+    aes_modes_detail::wipe(key, sizeof(key));
+    aes_modes_detail::wipe(key_bytes, sizeof(key_bytes));
+    size_t crossover = disp.hasHw() ? disp.calibrate(4096, 3, false) : 0;
+
+    // streams -------------------------------------
+    CryptInput in;
+    if (!in.open(in_path)) return EXIT_FAILURE;
+    CaptureConfig wcfg;
+    wcfg.buffer_bytes = chunk;
+    CaptureWriter out;
+    if (!out.open(out_path, wcfg)) return EXIT_FAILURE;
+
+    const uint8_t* data;
+    if (decrypt && !raw) {
+        uint8_t head[16];
+        ssize_t n = in.next(head, sizeof(head), data);
+        if (n != (ssize_t)sizeof(head)) {
+            fprintf(stderr, "[FATAL] Input shorter than the 16-byte IV header\n");
+            return EXIT_FAILURE;
+        }
+        if (!iv_hex) memcpy(iv, data, 16);
+        else if (memcmp(iv, data, 16) != 0) fprintf(stderr, "[WARN] --iv differs from the header, using --iv\n");
+    } else if (!iv_hex && !random_iv(hsm.get(), iv)) {
+        fprintf(stderr, "[FATAL] No IV: random source failed (TRNG health?)\n");
+        return EXIT_FAILURE;
+    }
+
+    auto t0 = std::chrono::steady_clock::now();
+    double cpu0 = cpu_seconds();
+    uint64_t bytes = 0;
+    bool ok = true;
+    if (!decrypt && !raw) {
+        size_t room;
+        memcpy(out.space(room), iv, 16);
+        ok = out.commit(16);
+    }
+
+    AesCtr ctr(disp);
+    ctr.init(iv);
+    while (ok) {
+        size_t room;
+        uint8_t* dst = out.space(room);
+        ssize_t n = in.next(dst, std::min(room, chunk), data);
+        if (n < 0) { ok = false; break; }
+        if (n == 0) break;
+        ok = ctr.update(data, dst, (size_t)n) && out.commit((size_t)n);
+        bytes += (size_t)n;
+    }
+    ctr.final();
+    ok = out.finish() && ok;
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    double cpu = cpu_seconds() - cpu0;
+    if (!quiet) {
+        const AesDispatchStats& ds = disp.stats();
+        const CaptureStats& ws = out.stats();
+        fprintf(stderr, "hsm_crypt: %s %llu bytes in %.3fs, %.2f MB/s, CPU %.2fs (%.0f%% of one core, %ld online)\n",
+                decrypt ? "decrypted" : "encrypted", (unsigned long long)bytes, wall, wall > 0 ? bytes / wall / 1e6 : 0.0,
+                cpu, wall > 0 ? 100.0 * cpu / wall : 0.0, sysconf(_SC_NPROCESSORS_ONLN));
+        fprintf(stderr, "    Backend     : %s, CPU kernel %s, HW crossover %zu blocks\n",
+                cpu_only ? "CPU only" : sim ? aes.backend() : "core + CPU", SoftAes256::kernelName(disp.cpuKernel()), crossover);
+        fprintf(stderr, "    Input       : %s\n", in.mapped() ? "mmap" : "read()");
+        ds.print(stderr);
+        fprintf(stderr, "    Writer      : %llu buffers in %llu writev calls, %llu encrypt stalls on output\n",
+                (unsigned long long)ws.buffers_written, (unsigned long long)ws.syscalls, (unsigned long long)ws.producer_stalls);
+    }
+    if (!ok) fprintf(stderr, "[ERROR] hsm_crypt failed; output is incomplete\n");
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,170 @@
+/**
+* @file     hsm_driver.h
+* @brief    PYNQ HSM (TRNG) driver for the my_hsm peripheral on PYNQ-Z2
+* @details  Register map from hsm_axi_wrapper.sv, sample handshake w/ safety timeouts
+*
+* CTRL goes through a RegShadow and the last SAMP_CNT seen is remembered, so a steady
+* stream of samples costs two CTRL writes + the poll + one RAND_OUT read per word; any
+* writeReg() from outside forgets both (it may have changed CTRL or cleared the count).
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <iostream>
+
+#include "hsm_regmap.h"
+#include "hsm_wait.h"
+#include "reg_device.h"
+
+// --- CONFIG ---
+constexpr uint32_t HSM_BASE_ADDR = 0x40000000;
+constexpr uint32_t HSM_SIZE = 0x1000; // 4KB
+
+// --- REG MAP --- (hsm_regmap.h: TrngMap, REG_*, Ctrl::, Status::)
+
+/* ===== SAFE DRIVER CLASS ===== */
+class PynqHSM {
+private:
+    MMIO _mmio;                 // /dev/mem mapping, or an attached device (sim_device.h)
+    Completion _sample_wait;    // SAMPLE rising edge -> SAMPLE_CNT increments (~32 VN bits)
+    RegShadow<TrngMap::REGS> _regs;
+    uint32_t _count = 0;        // SAMP_CNT after our last completed sample
+    bool     _count_known = false;
+
+    void ctrl(uint32_t v) { _regs.write<TrngMap::CTRL>(_mmio, v); }
+
+    void forget() {
+        _regs.invalidate();
+        _count_known = false;
+    }
+
+    void initWait() {
+        // a word takes ~10us of VN output: spin through the typical case, then yield
+        _sample_wait.policy.spin_iters = 256;
+        _sample_wait.policy.timeout_us = 100000;
+    }
+
+public:
+    PynqHSM(uint32_t phys_addr, uint32_t size) {
+        initWait();
+        _mmio.open(phys_addr, size);    // reports its own errors; check isOpen()
+    }
+
+    // drive an attached device instead of the FPGA
+    explicit PynqHSM(RegDevice* dev) {
+        initWait();
+        _mmio.attach(dev);
+    }
+
+    ~PynqHSM() {
+        if (isOpen()) writeReg(REG_CTRL, 0);
+    }
+
+    bool isOpen() const { return _mmio.isOpen(); }
+    const char* backend() const { return _mmio.backend(); }
+
+    void writeReg(RegOffset offset, uint32_t value) {
+        _mmio.write(offset, value);
+        forget();
+    }
+    uint32_t readReg(RegOffset offset) { return _mmio.read(offset); }
+
+    // --- Health status check ---
+    bool checkHealth(bool verbose = false) {
+        uint32_t status = readReg(REG_STATUS);
+        if (verbose) {
+            bool osc_ok = status & Status::OSC_RUNNING;
+            bool rct_ok = !(status & Status::RCT_FAIL);
+            bool apt_ok = !(status & Status::APT_FAIL);
+            std::cout << "  OSC Running : " << (osc_ok  ? "[OK]" : "[FAIL]") << std::endl;
+            std::cout << "  RCT Test    : " << (rct_ok  ? "[OK]" : "[FAIL] - Oscillator may be locked") << std::endl;
+            std::cout << "  APT Test    : " << (apt_ok  ? "[OK]" : "[FAIL] - Bit distribution skewed") << std::endl;
+        }
+        if (status & Status::HEALTH_FAIL) {
+            hsm_tel_count(HsmCounter::HEALTH_FAILS);
+            return false;
+        }
+        return true;
+    }
+
+    // --- Timeout implementation ---
+    bool waitForSampleDone(uint32_t old_count) {
+        return _sample_wait.wait([&] { return sampleReady(old_count); });
+    }
+
+    Completion& sampleWait() { return _sample_wait; }
+
+    // off: CTRL rewritten and SAMP_CNT re-read for every word (the pre-shadow sequence)
+    void setShadowing(bool on) {
+        _regs.setEnabled(on);
+        _count_known = false;
+    }
+    const RegShadowStats& shadowStats() const { return _regs.stats(); }
+    void resetShadowStats() { _regs.resetStats(); }
+    
+    // --- COMMANDS ---
+    // one handshake; false on timeout so callers don't have to trust 0xFFFFFFFF
+    bool sampleWord(uint32_t& out) {
+        HsmTelTimer tel(HsmMetric::TRNG_WORD);
+
+        uint32_t current_cnt = startSample();
+
+        // 4. Wait until count increases (Hardware Handshake)
+        //    (I also increased the timeout here just to be safe)
+        if (!waitForSampleDone(current_cnt)) {
+            sampleFailed();
+            return false;
+        }
+
+        // 5. Read result
+        out = takeSample();
+        return true;
+    }
+
+    // --- SPLIT PHASE ---
+    // sampleWord() without the wait, for event loops (hsm_async.h):
+    // base = startSample(); poll sampleReady(base); takeSample() or sampleFailed()
+    uint32_t startSample() {
+        // 1. Current count (the previous word's handshake already read it)
+        uint32_t current_cnt = _count_known && _regs.enabled() ? _count : _mmio.read<TrngMap::SAMP_CNT>();
+
+        // 2. PREPARE TRIGGER: Pull Sample Bit LOW (keep Enable High)
+        //    This resets the pin to 0 so we can create a rising edge.
+        ctrl(Ctrl::ENABLE);
+
+        // 3. TRIGGER: Pull Sample Bit HIGH
+        //    This creates the 0->1 transition the hardware is waiting for!
+        ctrl(Ctrl::ENABLE | Ctrl::SAMPLE);
+        return current_cnt;
+    }
+
+    bool sampleReady(uint32_t base) {
+        _count = _mmio.read<TrngMap::SAMP_CNT>();
+        return _count > base;
+    }
+
+    uint32_t takeSample() {
+        _count_known = true;
+        hsm_tel_count(HsmCounter::TRNG_WORDS);
+        return _mmio.read<TrngMap::RAND_OUT>();
+    }
+
+    void sampleFailed() {
+        _count_known = false;
+        hsm_tel_count(HsmCounter::TRNG_TIMEOUTS);
+    }
+
+    uint32_t getTrngRandom() {
+        uint32_t value;
+        return sampleWord(value) ? value : 0xFFFFFFFF;
+    }
+
+    // drop latched RCT/APT fails (also resets SAMPLE_CNT and the accumulator)
+    void clearHealth() {
+        ctrl(Ctrl::ENABLE | Ctrl::CLEAR);
+        ctrl(Ctrl::ENABLE);
+        _count_known = false;
+    }
+};
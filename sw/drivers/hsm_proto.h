@@ -0,0 +1,87 @@
+/**
+* @file     hsm_proto.h
+* @brief    hsmd wire protocol: framed requests / responses over a Unix stream socket
+* @details  Every message is an HsmMsgHeader followed by len payload bytes, host byte
+*           order (both ends are on the board). Responses echo id, so a client may keep
+*           several requests in flight and match them up; the daemon answers a client's
+*           requests in order per key but may interleave keys and ops.
+*
+* KEY_LOAD  payload key[8]               -> key = handle (per connection, refcounted)
+* KEY_DROP  key = handle                 -> -
+* ENCRYPT   key = handle, payload n*4 words -> n*4 words ciphertext (same layout as AesDriver)
+* RANDOM    payload uint32 length        -> length bytes from the entropy pool
+* STATS     -                            -> text report (same as SIGUSR1 on the daemon)
+* RING_ATTACH SCM_RIGHTS memfd, SQ eventfd, CQ eventfd -> key = ring id (hsm_shm_ring.h)
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <unistd.h>
+
+constexpr uint32_t    HSMD_MAGIC       = 0x31534D48;        // "HMS1" little-endian
+constexpr const char* HSMD_SOCKET      = "/run/hsmd.sock";
+constexpr uint32_t    HSMD_MAX_BLOCKS  = 4096;              // per ENCRYPT request (64 KB)
+constexpr uint32_t    HSMD_MAX_RANDOM  = 65536;             // per RANDOM request
+constexpr uint32_t    HSMD_MAX_PAYLOAD = HSMD_MAX_BLOCKS * 16;
+
+enum class HsmOp : uint16_t { KEY_LOAD = 1, KEY_DROP = 2, ENCRYPT = 3, RANDOM = 4, STATS = 5, RING_ATTACH = 6 };
+
+enum class HsmStatus : uint16_t {
+    OK = 0,
+    BAD_REQUEST,        // malformed frame or size out of range
+    BAD_KEY,            // handle not loaded on this connection
+    HEALTH_FAIL,        // entropy pool hit a failed batch
+    DEVICE_ERROR,       // AES core timed out
+    DISCONNECTED,       // client side: socket closed or I/O error
+    KEY_LIMIT,          // KEY_LOAD past HsmServiceConfig::max_keys_per_client
+};
+
+inline const char* hsm_status_str(HsmStatus s) {
+    switch (s) {
+        case HsmStatus::OK:           return "OK";
+        case HsmStatus::BAD_REQUEST:  return "BAD_REQUEST";
+        case HsmStatus::BAD_KEY:      return "BAD_KEY";
+        case HsmStatus::HEALTH_FAIL:  return "HEALTH_FAIL";
+        case HsmStatus::DEVICE_ERROR: return "DEVICE_ERROR";
+        case HsmStatus::KEY_LIMIT:    return "KEY_LIMIT";
+        default:                      return "DISCONNECTED";
+    }
+}
+
+struct HsmMsgHeader {
+    uint32_t magic;
+    uint16_t op;
+    uint16_t status;    // responses only
+    uint32_t id;        // chosen by the client, echoed back
+    uint32_t key;       // AES key handle where the op takes one
+    uint32_t len;       // payload bytes that follow
+};
+static_assert(sizeof(HsmMsgHeader) == 20, "wire header layout");
+
+// blocking helpers for the client side (the daemon is non-blocking and buffers itself)
+inline bool hsm_write_all(int fd, const void* buf, size_t len) {
+    const uint8_t* p = static_cast<const uint8_t*>(buf);
+    while (len) {
+        ssize_t n = ::write(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
+
+inline bool hsm_read_all(int fd, void* buf, size_t len) {
+    uint8_t* p = static_cast<uint8_t*>(buf);
+    while (len) {
+        ssize_t n = ::read(fd, p, len);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) return false;
+        p += n;
+        len -= (size_t)n;
+    }
+    return true;
+}
@@ -0,0 +1,228 @@
+/**
+* @file     hsm_regmap.h
+* @brief    Typed register maps for aes_axi_wrapper.sv and hsm_axi_wrapper.sv, plus shadow registers
+* @details  Every register is a Reg<offset, access> type and every bitfield a Field<Reg, lsb,
+*           width>, so MMIO::read<R>() / write<R>() fold the word index at compile time and
+*           writing a read-only register (or reading a write-only one) does not compile.
+*           The `// rtl:` tags name the RTL localparam / signal each entry mirrors;
+*           scripts/check_regmap.py compares them against hw/src and fails on any drift.
+*
+* RegShadow caches what was last written to the plain storage registers (CTRL, KEY_W,
+* PTEXT_W, DATA_*) so a write of the value already there is skipped. The RTL never
+* changes those on its own - CTRL strobes are edge detected, not self clearing - so the
+* cache only goes stale when someone else writes the peripheral: invalidate() then.
+*
+* The untyped names the rest of the tree uses (AES::CTRL, REG_STATUS, Ctrl::ENABLE, ...)
+* are defined from these maps at the bottom, not written out a second time.
+*/
+
+#pragma once
+
+#include <cstdint>
+
+#include "reg_device.h"
+
+// Register / field types =======================================
+enum class RegAccess : uint8_t { RO, WO, RW };
+
+template <uint32_t Offset, RegAccess Access = RegAccess::RW, bool Storage = true>
+struct Reg {
+    static_assert(Offset % 4 == 0, "AXI-Lite registers are 32-bit aligned");
+    static constexpr uint32_t  offset   = Offset;
+    static constexpr uint32_t  index    = Offset / 4;
+    static constexpr RegAccess access   = Access;
+    static constexpr bool      readable = Access != RegAccess::WO;
+    static constexpr bool      writable = Access != RegAccess::RO;
+    // reads back exactly what was last written (safe to shadow)
+    static constexpr bool      shadowable = writable && Storage;
+};
+
+template <class R, unsigned Lsb, unsigned Width = 1>
+struct Field {
+    static_assert(Lsb + Width <= 32, "field past bit 31");
+    using reg = R;
+    static constexpr uint32_t shift = Lsb;
+    static constexpr uint32_t mask  = (Width == 32 ? 0xFFFFFFFFu : ((1u << Width) - 1)) << Lsb;
+
+    static constexpr uint32_t get(uint32_t v) { return (v & mask) >> shift; }
+    static constexpr uint32_t make(uint32_t x) { return (x << shift) & mask; }
+    static constexpr bool     test(uint32_t v) { return (v & mask) != 0; }
+};
+
+// AES (aes_axi_wrapper.sv) =======================================
+namespace AesMap {
+    using CTRL     = Reg<0x00>;                  // rtl: ADDR_CTRL
+    using STATUS   = Reg<0x04, RegAccess::RO>;   // rtl: ADDR_STATUS
+    using KEY_W0   = Reg<0x10>;                  // rtl: ADDR_KEY_W0    key[255:224]
+    using KEY_W1   = Reg<0x14>;                  // rtl: ADDR_KEY_W1
+    using KEY_W2   = Reg<0x18>;                  // rtl: ADDR_KEY_W2
+    using KEY_W3   = Reg<0x1C>;                  // rtl: ADDR_KEY_W3
+    using KEY_W4   = Reg<0x20>;                  // rtl: ADDR_KEY_W4
+    using KEY_W5   = Reg<0x24>;                  // rtl: ADDR_KEY_W5
+    using KEY_W6   = Reg<0x28>;                  // rtl: ADDR_KEY_W6
+    using KEY_W7   = Reg<0x2C>;                  // rtl: ADDR_KEY_W7    key[31:0]
+    using PTEXT_W0 = Reg<0x30>;                  // rtl: ADDR_PTEXT_W0  plaintext[127:96]
+    using PTEXT_W1 = Reg<0x34>;                  // rtl: ADDR_PTEXT_W1
+    using PTEXT_W2 = Reg<0x38>;                  // rtl: ADDR_PTEXT_W2
+    using PTEXT_W3 = Reg<0x3C>;                  // rtl: ADDR_PTEXT_W3  plaintext[31:0]
+    using CTEXT_W0 = Reg<0x40, RegAccess::RO>;   // rtl: ADDR_CTEXT_W0  ciphertext[127:96]
+    using CTEXT_W1 = Reg<0x44, RegAccess::RO>;   // rtl: ADDR_CTEXT_W1
+    using CTEXT_W2 = Reg<0x48, RegAccess::RO>;   // rtl: ADDR_CTEXT_W2
+    using CTEXT_W3 = Reg<0x4C, RegAccess::RO>;   // rtl: ADDR_CTEXT_W3  ciphertext[31:0]
+    constexpr uint32_t REGS = 0x50 / 4;
+
+    namespace Ctrl {
+        using KEY_LOAD = Field<CTRL, 0>;         // rtl: ctrl_key_load  rising edge starts expansion
+        using ENCRYPT  = Field<CTRL, 1>;         // rtl: ctrl_encrypt   rising edge starts a block
+        using CLEAR    = Field<CTRL, 2>;         // rtl: ctrl_clear     level: DONE -> READY, drops the latch
+    }
+    namespace Status {
+        using READY = Field<STATUS, 0>;          // rtl: aes_ready
+        using BUSY  = Field<STATUS, 1>;          // rtl: aes_busy
+        using DONE  = Field<STATUS, 2>;          // rtl: done_latched
+    }
+}
+
+// TRNG (hsm_axi_wrapper.sv) =======================================
+namespace TrngMap {
+    using CTRL     = Reg<0x00>;                          // rtl: ADDR_CTRL
+    using STATUS   = Reg<0x04, RegAccess::RO>;           // rtl: ADDR_STATUS
+    using DATA_IN  = Reg<0x08>;                          // rtl: ADDR_DATA_IN   scratch
+    using DATA_OUT = Reg<0x0C>;                          // rtl: ADDR_DATA_OUT  scratch
+    using RAW_OSC  = Reg<0x10, RegAccess::RO>;           // rtl: ADDR_RAW_OSC   [3:0] live ring outputs
+    using COUNTER  = Reg<0x14, RegAccess::RO>;           // rtl: ADDR_COUNTER   free-running S_AXI_ACLK
+    using RAND_OUT = Reg<0x18, RegAccess::RO>;           // rtl: ADDR_RAND_OUT  last 32-bit word
+    using SAMP_CNT = Reg<0x1C, RegAccess::RO>;           // rtl: ADDR_SAMP_CNT  words since CLEAR
+    constexpr uint32_t REGS = 0x20 / 4;
+
+    namespace Ctrl {
+        using ENABLE = Field<CTRL, 0>;                   // rtl: ctrl_enable  oscillators on
+        using SAMPLE = Field<CTRL, 1>;                   // rtl: ctrl_sample  rising edge collects one word
+        using CLEAR  = Field<CTRL, 2>;                   // rtl: ctrl_clear   level: zeroes SAMP_CNT + health
+    }
+    namespace Status {
+        using OSC_RUNNING = Field<STATUS, 0>;            // rtl: trng_osc_running
+        using RAW_OSC     = Field<STATUS, 4, 4>;         // rtl: trng_raw_osc
+        using HEALTH_FAIL = Field<STATUS, 8>;            // rtl: trng_health_fail      sticky
+        using RCT_FAIL    = Field<STATUS, 9>;            // rtl: trng_health_rct_fail  sticky
+        using APT_FAIL    = Field<STATUS, 10>;           // rtl: trng_health_apt_fail  sticky
+    }
+}
+
+// Shadow registers =======================================
+struct RegShadowStats {
+    uint64_t writes  = 0;   // reached the bus
+    uint64_t skipped = 0;   // same value as the shadow, dropped
+};
+
+template <uint32_t N>
+class RegShadow {
+    static_assert(N <= 64, "one known bit per register");
+
+private:
+    uint32_t _val[N] = {};
+    uint64_t _known = 0;
+    bool     _enabled = true;
+    RegShadowStats _stats;
+
+public:
+    // off: every write reaches the bus (values are still tracked)
+    void setEnabled(bool on) { _enabled = on; }
+    bool enabled() const { return _enabled; }
+
+    // someone else may have written the peripheral
+    void invalidate() { _known = 0; }
+
+    template <class R> bool known() const { return (_known >> R::index) & 1; }
+    template <class R> uint32_t value() const { return _val[R::index]; }
+
+    // true when the write reached the bus
+    template <class R>
+    bool write(MMIO& m, uint32_t v, bool force = false) {
+        static_assert(R::shadowable, "only plain storage registers can be shadowed");
+        static_assert(R::index < N, "register outside this map");
+        if (skip(R::index, v, force)) return false;
+        m.write<R>(v);
+        return true;
+    }
+
+    // runtime index for register arrays (KEY_W0 + i); First names the base
+    template <class First>
+    bool writeAt(MMIO& m, uint32_t i, uint32_t v, bool force = false) {
+        static_assert(First::shadowable, "only plain storage registers can be shadowed");
+        uint32_t idx = First::index + i;
+        if (skip(idx, v, force)) return false;
+        m.write(First::offset + 4 * i, v);
+        return true;
+    }
+
+    const RegShadowStats& stats() const { return _stats; }
+    void resetStats() { _stats = RegShadowStats{}; }
+
+private:
+    bool skip(uint32_t idx, uint32_t v, bool force) {
+        uint64_t bit = 1ull << idx;
+        if (_enabled && !force && (_known & bit) && _val[idx] == v) {
+            _stats.skipped++;
+            return true;
+        }
+        _val[idx] = v;
+        _known |= bit;
+        _stats.writes++;
+        return false;
+    }
+};
+
+// Untyped names =======================================
+namespace AES {
+    constexpr uint32_t CTRL     = AesMap::CTRL::offset;
+    constexpr uint32_t STATUS   = AesMap::STATUS::offset;
+    constexpr uint32_t KEY_W0   = AesMap::KEY_W0::offset;
+    constexpr uint32_t KEY_W1   = AesMap::KEY_W1::offset;
+    constexpr uint32_t KEY_W2   = AesMap::KEY_W2::offset;
+    constexpr uint32_t KEY_W3   = AesMap::KEY_W3::offset;
+    constexpr uint32_t KEY_W4   = AesMap::KEY_W4::offset;
+    constexpr uint32_t KEY_W5   = AesMap::KEY_W5::offset;
+    constexpr uint32_t KEY_W6   = AesMap::KEY_W6::offset;
+    constexpr uint32_t KEY_W7   = AesMap::KEY_W7::offset;
+    constexpr uint32_t PTEXT_W0 = AesMap::PTEXT_W0::offset;
+    constexpr uint32_t PTEXT_W1 = AesMap::PTEXT_W1::offset;
+    constexpr uint32_t PTEXT_W2 = AesMap::PTEXT_W2::offset;
+    constexpr uint32_t PTEXT_W3 = AesMap::PTEXT_W3::offset;
+    constexpr uint32_t CTEXT_W0 = AesMap::CTEXT_W0::offset;
+    constexpr uint32_t CTEXT_W1 = AesMap::CTEXT_W1::offset;
+    constexpr uint32_t CTEXT_W2 = AesMap::CTEXT_W2::offset;
+    constexpr uint32_t CTEXT_W3 = AesMap::CTEXT_W3::offset;
+
+    constexpr uint32_t CTRL_KEY_LOAD = AesMap::Ctrl::KEY_LOAD::mask;
+    constexpr uint32_t CTRL_ENCRYPT  = AesMap::Ctrl::ENCRYPT::mask;
+    constexpr uint32_t CTRL_CLEAR    = AesMap::Ctrl::CLEAR::mask;
+
+    constexpr uint32_t STATUS_READY = AesMap::Status::READY::mask;
+    constexpr uint32_t STATUS_BUSY  = AesMap::Status::BUSY::mask;
+    constexpr uint32_t STATUS_DONE  = AesMap::Status::DONE::mask;
+}
+
+enum RegOffset : uint32_t {
+    REG_CTRL       = TrngMap::CTRL::offset,
+    REG_STATUS     = TrngMap::STATUS::offset,
+    REG_DATA_IN    = TrngMap::DATA_IN::offset,
+    REG_DATA_OUT   = TrngMap::DATA_OUT::offset,
+    REG_TRNG_OSC   = TrngMap::RAW_OSC::offset,
+    REG_COUNTER    = TrngMap::COUNTER::offset,
+    REG_TRNG_OUT   = TrngMap::RAND_OUT::offset,
+    REG_SAMPLE_CNT = TrngMap::SAMP_CNT::offset,
+};
+
+namespace Ctrl {
+    constexpr uint32_t ENABLE = TrngMap::Ctrl::ENABLE::mask;
+    constexpr uint32_t SAMPLE = TrngMap::Ctrl::SAMPLE::mask;
+    constexpr uint32_t CLEAR  = TrngMap::Ctrl::CLEAR::mask;
+}
+
+namespace Status {
+    constexpr uint32_t OSC_RUNNING = TrngMap::Status::OSC_RUNNING::mask;
+    constexpr uint32_t HEALTH_FAIL = TrngMap::Status::HEALTH_FAIL::mask;   // combined health failure
+    constexpr uint32_t RCT_FAIL    = TrngMap::Status::RCT_FAIL::mask;      // repetition count test
+    constexpr uint32_t APT_FAIL    = TrngMap::Status::APT_FAIL::mask;
+}
@@ -0,0 +1,291 @@
+/**
+* @file     hsm_rt.h
+* @brief    Low-latency runtime mode for the thread that owns the MMIO mapping
+* @details  On the dual-core Zynq a spinning poll loses the core to kworkers, RCU and
+*           IRQ threads; p99 then measures the scheduler, not the AES core / sampler.
+*
+* 1. RtRuntime::enter() on the polling thread: pin it to RtConfig::cpu, optionally
+*    SCHED_FIFO at RtConfig::fifo_priority, mlockall() (current + future pages),
+*    pre-fault RT_STACK_PREFAULT of stack. lock() pins single working buffers when
+*    mlockall() is off or not allowed; prefault() touches a side-effect-free register
+*    so the first iteration does not pay the TLB miss (/dev/mem mmap already installs
+*    the PTEs, remap_pfn_range, so no page faults are left to take)
+* 2. RtLoop drives a periodic (or back-to-back) control loop: each iteration is
+*    released at an absolute time (clock_nanosleep TIMER_ABSTIME, or a spin for short
+*    periods), and its wake-up lateness and release -> done response time go into
+*    always-on RtJitter histograms
+* 3. a response time past RtConfig::deadline_ns is an overrun: counted and logged
+*    (iteration, ns) in a fixed ring, nothing allocated or printed inside the loop
+*
+* Every step reports its own failure (perror) and the rest still run: without
+* CAP_SYS_NICE / RLIMIT_MEMLOCK the loop runs unpinned from the scheduler but is still
+* measured. leave() (and the destructor) restores the previous affinity and policy of the
+* thread that called enter(), from whichever thread runs it; that thread must still be
+* alive, so destroy the RtRuntime (or leave()) before it exits.
+* Pair it with WaitPolicy::lowLatency() so completion waits never yield the pinned core,
+* and keep the chosen CPU out of the general scheduler (isolcpus= / nohz_full=).
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hsm_telemetry.h"
+#include "reg_device.h"
+
+constexpr size_t   RT_STACK_PREFAULT = 256 << 10;
+constexpr int      RT_OVERRUN_LOG    = 64;                      // most recent overruns kept
+constexpr int      RT_BUCKETS        = 38 * HsmHist::SUB;       // as hsm_telemetry: up to 2^40 ns
+
+// Config =======================================
+struct RtConfig {
+    int      cpu           = -1;    // pin to this CPU; -1 keeps the current mask
+    int      fifo_priority = 0;     // SCHED_FIFO 1..99; 0 keeps SCHED_OTHER
+    bool     lock_memory   = false; // mlockall(MCL_CURRENT | MCL_FUTURE)
+    uint64_t deadline_ns   = 0;     // release -> done budget per iteration; 0 = none
+};
+
+// Jitter =======================================
+struct RtOverrun {
+    uint64_t iter;
+    uint64_t ns;
+};
+
+class RtJitter {
+private:
+    HsmHistogram<RT_BUCKETS> _hist;
+    uint64_t  _max_iter = 0;
+    uint64_t  _deadline = 0;
+    uint64_t  _overruns = 0;
+    RtOverrun _log[RT_OVERRUN_LOG] = {};
+
+public:
+    explicit RtJitter(uint64_t deadline_ns = 0) : _deadline(deadline_ns) {}
+
+    void setDeadline(uint64_t ns) { _deadline = ns; }
+    uint64_t deadline() const { return _deadline; }
+
+    // true if it overran
+    bool record(uint64_t iter, uint64_t ns) {
+        if (ns > _hist.max) _max_iter = iter;
+        _hist.record(ns);
+        if (!_deadline || ns <= _deadline) return false;
+        _log[_overruns % RT_OVERRUN_LOG] = { iter, ns };
+        _overruns++;
+        return true;
+    }
+
+    void reset() { *this = RtJitter(_deadline); }
+
+    const HsmHistogram<RT_BUCKETS>& hist() const { return _hist; }
+    uint64_t count() const { return _hist.count; }
+    uint64_t max() const { return _hist.max; }
+    uint64_t maxIter() const { return _max_iter; }
+    uint64_t overruns() const { return _overruns; }
+    double   mean() const { return _hist.mean(); }
+    uint64_t percentile(double q) const { return _hist.percentile(q); }
+
+    // i-th logged overrun, oldest first (only the last RT_OVERRUN_LOG are kept)
+    int logged() const { return (int)std::min<uint64_t>(_overruns, RT_OVERRUN_LOG); }
+    const RtOverrun& overrun(int i) const {
+        uint64_t first = _overruns > RT_OVERRUN_LOG ? _overruns - RT_OVERRUN_LOG : 0;
+        return _log[(first + i) % RT_OVERRUN_LOG];
+    }
+
+    void print(const char* what, FILE* out = stdout) const {
+        fprintf(out, "    %-10s n=%llu mean=%.2fus p50=%.2fus p99=%.2fus p99.9=%.2fus max=%.2fus (iter %llu)\n",
+                what, (unsigned long long)count(), mean() / 1e3, percentile(0.50) / 1e3, percentile(0.99) / 1e3,
+                percentile(0.999) / 1e3, max() / 1e3, (unsigned long long)_max_iter);
+        if (!_deadline) return;
+        fprintf(out, "    %-10s deadline %.2fus: %llu overrun(s)\n", "", _deadline / 1e3,
+                (unsigned long long)_overruns);
+        for (int i = 0; i < logged(); i++)
+            fprintf(out, "    %-10s   iter %llu: %.2fus\n", "", (unsigned long long)overrun(i).iter,
+                    overrun(i).ns / 1e3);
+        if (_overruns > RT_OVERRUN_LOG)
+            fprintf(out, "    %-10s   (%llu earlier not kept)\n", "",
+                    (unsigned long long)(_overruns - RT_OVERRUN_LOG));
+    }
+};
+
+// Runtime =======================================
+class RtRuntime {
+private:
+    bool        _entered = false;
+    pthread_t   _thread = {};   // the caller of enter(); leave() may run elsewhere
+    bool        _pinned = false;
+    bool        _fifo = false;
+    bool        _locked = false;
+    cpu_set_t   _old_mask;
+    int         _old_policy = SCHED_OTHER;
+    sched_param _old_param = {};
+
+    static void touchStack() {
+        volatile uint8_t stack[RT_STACK_PREFAULT];
+        for (size_t i = 0; i < sizeof(stack); i += 4096) stack[i] = 0;
+    }
+
+public:
+    RtRuntime() = default;
+    RtRuntime(const RtRuntime&) = delete;
+    RtRuntime& operator=(const RtRuntime&) = delete;
+    ~RtRuntime() { leave(); }
+
+    /**
+    * @brief Apply cfg to the calling thread (the one that will poll)
+    * @return false if any requested step failed; the others are still applied
+    */
+    bool enter(const RtConfig& cfg) {
+        leave();
+        bool ok = true;
+        pthread_t self = _thread = pthread_self();
+        pthread_getaffinity_np(self, sizeof(_old_mask), &_old_mask);
+        pthread_getschedparam(self, &_old_policy, &_old_param);
+        _entered = true;
+
+        // pin -------------------------------------
+        if (cfg.cpu >= 0) {
+            cpu_set_t set;
+            CPU_ZERO(&set);
+            CPU_SET(cfg.cpu, &set);
+            int rc = pthread_setaffinity_np(self, sizeof(set), &set);
+            if (rc != 0) {
+                fprintf(stderr, "rt: pin to CPU %d: %s\n", cfg.cpu, strerror(rc));
+                ok = false;
+            } else {
+                _pinned = true;
+            }
+        }
+
+        // memory -------------------------------------
+        // before SCHED_FIFO: faulting in the whole image can take a while
+        if (cfg.lock_memory) {
+            if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+                perror("rt: mlockall (RLIMIT_MEMLOCK?)");
+                ok = false;
+            } else {
+                _locked = true;
+            }
+        }
+        touchStack();
+
+        // scheduler -------------------------------------
+        if (cfg.fifo_priority > 0) {
+            sched_param p = {};
+            p.sched_priority = std::min(cfg.fifo_priority, sched_get_priority_max(SCHED_FIFO));
+            int rc = pthread_setschedparam(self, SCHED_FIFO, &p);
+            if (rc != 0) {
+                fprintf(stderr, "rt: SCHED_FIFO %d: %s (needs CAP_SYS_NICE / RLIMIT_RTPRIO)\n",
+                        p.sched_priority, strerror(rc));
+                ok = false;
+            } else {
+                _fifo = true;
+            }
+        }
+        return ok;
+    }
+
+    // the entered thread back to the affinity / policy enter() found; memory stays locked
+    // only if it was
+    void leave() {
+        if (!_entered) return;
+        if (_fifo) pthread_setschedparam(_thread, _old_policy, &_old_param);
+        if (_pinned) pthread_setaffinity_np(_thread, sizeof(_old_mask), &_old_mask);
+        if (_locked) munlockall();
+        _entered = _pinned = _fifo = _locked = false;
+    }
+
+    // one working buffer, when mlockall() is off or refused
+    static bool lock(const void* p, size_t len) {
+        if (mlock(p, len) != 0) { perror("rt: mlock"); return false; }
+        return true;
+    }
+
+    // a read of `offset` must have no side effects (AES STATUS, HSM COUNTER)
+    static void prefault(MMIO& mmio, uint32_t offset) { (void)mmio.read(offset); }
+
+    bool pinned() const { return _pinned; }
+    bool fifo() const { return _fifo; }
+    bool locked() const { return _locked; }
+
+    void print(const RtConfig& cfg, FILE* out = stdout) const {
+        char cpu[32], sched[48];
+        if (cfg.cpu < 0)  snprintf(cpu, sizeof(cpu), "any");
+        else if (_pinned) snprintf(cpu, sizeof(cpu), "%d", cfg.cpu);
+        else              snprintf(cpu, sizeof(cpu), "any (pin to %d failed)", cfg.cpu);
+        if (_fifo)                       snprintf(sched, sizeof(sched), "SCHED_FIFO %d", cfg.fifo_priority);
+        else if (cfg.fifo_priority > 0)  snprintf(sched, sizeof(sched), "SCHED_OTHER (FIFO refused)");
+        else                             snprintf(sched, sizeof(sched), "SCHED_OTHER");
+        fprintf(out, "    Runtime     : CPU %s, %s, memory %s\n", cpu, sched,
+                _locked ? "locked" : cfg.lock_memory ? "unlocked (mlockall refused)" : "unlocked");
+    }
+};
+
+// Loop =======================================
+// released every period_ns (0: back to back, released as soon as the previous one is done)
+class RtLoop {
+private:
+    uint64_t _period_ns;
+    bool     _spin;
+    uint64_t _iter = 0;
+    uint64_t _release = 0;
+
+    static uint64_t now() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+    }
+
+public:
+    RtJitter wake;          // release -> running (scheduler + timer latency)
+    RtJitter response;      // release -> done, against the deadline
+
+    // spin: busy-wait to the release instead of sleeping (periods below the wake-up latency)
+    RtLoop(uint64_t period_ns, uint64_t deadline_ns, bool spin = false)
+        : _period_ns(period_ns), _spin(spin), response(deadline_ns) {}
+
+    void start() {
+        _iter = 0;
+        _release = now();
+    }
+
+    // block until this iteration's release; returns its index. After an overrun the
+    // missed releases follow at once (no skipping), so the period holds on average
+    uint64_t next() {
+        if (_period_ns && _iter) _release += _period_ns;
+        else if (!_period_ns) _release = now();
+        if (_period_ns) {
+            if (_spin) {
+                while (now() < _release) {}
+            } else {
+                struct timespec ts = { (time_t)(_release / 1000000000ull), (long)(_release % 1000000000ull) };
+                while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) == EINTR) {}
+            }
+        }
+        uint64_t t = now();
+        wake.record(_iter, t > _release ? t - _release : 0);
+        return _iter;
+    }
+
+    // this iteration's work is finished; true if it overran the deadline
+    bool done() {
+        uint64_t t = now();
+        return response.record(_iter++, t > _release ? t - _release : 0);
+    }
+
+    uint64_t iterations() const { return _iter; }
+
+    void print(FILE* out = stdout) const {
+        wake.print("wake-up", out);
+        response.print("response", out);
+    }
+};
@@ -0,0 +1,938 @@
+/**
+* @file     hsm_service.h
+* @brief    hsmd core: one process owns both peripherals, clients share them over a socket
+* @details  Single-threaded epoll loop; the AES core is only touched from this thread and
+*           the TRNG only from the EntropyPool harvester, so no two users ever interleave
+*           KEY_W / PTEXT_W writes.
+*
+* Per loop iteration:
+* 1. read every ready socket, parse frames into per-client queues (KEY_* / STATS answered inline)
+* 2. pick a key: stay on the resident key while anyone has work for it (no KEY_W writes, no
+*    52-cycle expansion), but at most max_key_run batches in a row while another key's
+*    request is older; otherwise switch to the key of the oldest queued request
+* 3. fill one encryptBulk() run of up to max_batch_blocks with that key's requests, deficit
+*    round robin over clients (quantum_blocks per round) so one bulk client cannot starve
+*    a small one; scatter ciphertext back into responses
+* 4. serve RANDOM requests round robin from whatever the pool holds, never blocking on it
+* 5. flush responses; a client with max_inflight queued requests or max_out_bytes unsent
+*    stops being read (kernel socket buffers then block it) until it drains to half
+*
+* Shared-memory rings (hsm_shm_ring.h) skip the socket for payload, not the scheduler:
+* each loop iteration pulls SQEs (up to max_batch_blocks queued per ring, one CQ slot
+* reserved each) into the owning client's queue, where they batch and take DRR turns
+* like socket requests; the batch gathers from and scatters back into the client's
+* arena and posts CQEs. hsmd sleeps only after flagging RING_SQ_WAKEUP on every ring.
+*
+* Key handles are refcounted by key value: clients loading the same key share one
+* AesDriver handle, so their requests batch together. A client can only use handles it
+* loaded itself; everything it holds is released when it disconnects. A client holds at
+* most max_keys_per_client loads (KEY_LIMIT past that), so the key table and its linear
+* lookup stay bounded by max_clients x max_keys_per_client.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "hsm_proto.h"
+#include "hsm_shm_ring.h"
+#include "hsm_telemetry.h"
+#include "trng_pool.h"
+
+// Config =======================================
+struct HsmServiceConfig {
+    std::string socket_path   = HSMD_SOCKET;
+    uint32_t max_batch_blocks = 4096;       // per encryptBulk run; bounds how long sockets wait
+    uint32_t quantum_blocks   = 512;        // per client per round inside a batch
+    uint32_t max_key_run      = 2;          // resident-key batches in a row while an older key waits
+    uint32_t max_inflight     = 32;         // queued requests per client before it stops being read
+    size_t   max_out_bytes    = 1 << 20;    // unsent response bytes per client before the same
+    uint32_t max_clients      = 64;
+    uint32_t max_keys_per_client = 32;      // KEY_LOADs held; bounds the key table at max_clients x this
+    uint32_t ring_idle_loops  = 2000;       // passes polling idle rings before sleeping on doorbells
+};
+
+// Latency =======================================
+// HsmHistogram (hsm_telemetry.h) over ns, 8 buckets per power of two (~12% resolution)
+struct HsmLatency : HsmHistogram<62 * HsmHist::SUB> {
+    void print(FILE* out, const char* name) const {
+        fprintf(out, "    %-10s n=%-8llu mean=%8.1fus p50=%8.1fus p99=%8.1fus max=%8.1fus\n",
+                name, (unsigned long long)count, mean() / 1e3,
+                percentile(0.50) / 1e3, percentile(0.99) / 1e3, max / 1e3);
+    }
+};
+
+// Stats =======================================
+struct HsmServiceStats {
+    uint64_t connections    = 0;
+    uint64_t rejected       = 0;    // over max_clients
+    uint64_t key_limited    = 0;    // KEY_LOADs refused, over max_keys_per_client
+    uint64_t clients        = 0;
+    uint64_t clients_peak   = 0;
+    uint64_t requests[7]    = {};   // by HsmOp
+    uint64_t errors         = 0;    // non-OK responses
+    uint64_t batches        = 0;
+    uint64_t batch_blocks   = 0;
+    uint64_t batch_requests = 0;
+    uint64_t key_switches   = 0;    // batches that changed key
+    uint64_t queue_depth    = 0;    // queued requests right now
+    uint64_t queue_peak     = 0;
+    uint64_t queue_sum      = 0;    // depth sampled at each batch, for the mean
+    uint64_t pauses         = 0;    // backpressure: client socket reads suspended
+    uint64_t random_bytes   = 0;
+    uint64_t rings          = 0;    // attached now
+    uint64_t ring_sqes      = 0;
+    uint64_t ring_blocks    = 0;
+    uint64_t ring_wakeups   = 0;    // SQ doorbells received
+    uint64_t ring_signals   = 0;    // CQ eventfd writes
+    HsmLatency encrypt_lat;         // frame parsed -> response queued
+    HsmLatency random_lat;
+
+    void print(FILE* out) const {
+        fprintf(out, "    Clients     : %llu now, %llu peak, %llu connections, %llu rejected\n",
+                (unsigned long long)clients, (unsigned long long)clients_peak,
+                (unsigned long long)connections, (unsigned long long)rejected);
+        fprintf(out, "    Requests    : key_load=%llu key_drop=%llu encrypt=%llu random=%llu stats=%llu "
+                     "ring_attach=%llu errors=%llu key_limit=%llu\n",
+                (unsigned long long)requests[1], (unsigned long long)requests[2],
+                (unsigned long long)requests[3], (unsigned long long)requests[4],
+                (unsigned long long)requests[5], (unsigned long long)requests[6],
+                (unsigned long long)errors, (unsigned long long)key_limited);
+        fprintf(out, "    Batches     : %llu, %.1f requests / %.1f blocks per batch, %llu key switches\n",
+                (unsigned long long)batches,
+                batches ? (double)batch_requests / batches : 0.0,
+                batches ? (double)batch_blocks / batches : 0.0, (unsigned long long)key_switches);
+        fprintf(out, "    Queue depth : %llu now, %llu peak, %.1f mean at batch, %llu backpressure pauses\n",
+                (unsigned long long)queue_depth, (unsigned long long)queue_peak,
+                batches ? (double)queue_sum / batches : 0.0, (unsigned long long)pauses);
+        fprintf(out, "    Random      : %llu bytes served\n", (unsigned long long)random_bytes);
+        fprintf(out, "    Rings       : %llu attached, %llu SQEs / %llu blocks in place, %llu doorbells, %llu CQ signals\n",
+                (unsigned long long)rings, (unsigned long long)ring_sqes, (unsigned long long)ring_blocks,
+                (unsigned long long)ring_wakeups, (unsigned long long)ring_signals);
+        encrypt_lat.print(out, "encrypt");
+        random_lat.print(out, "random");
+    }
+};
+
+// Service =======================================
+class HsmService {
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Ring;
+
+    struct Request {
+        uint32_t     id = 0;
+        HsmOp        op = HsmOp::ENCRYPT;
+        AesKeyHandle key = AES_NO_KEY;
+        uint32_t     blocks = 0;
+        uint32_t     random_len = 0;
+        uint32_t     random_done = 0;
+        std::vector<uint32_t> data;     // ENCRYPT: pt, ct in place; RANDOM: output
+        Clock::time_point t_enq;
+        Ring*        ring = nullptr;    // ring SQE: payload stays in ring->arena
+        uint64_t     user_data = 0;
+        uint64_t     src = 0, dst = 0;  // arena offsets, checked when pulled
+    };
+
+    // epoll data.ptr targets
+    struct Pollable {
+        enum Kind { CLIENT, RING } kind;
+    };
+
+    struct Client;
+
+    // one attached hsm_shm_ring.h ring, mapped from the client's memfd
+    struct Ring : Pollable {
+        Client*  owner = nullptr;
+        uint8_t* base = nullptr;
+        size_t   size = 0;
+        HsmRingHeader* hdr = nullptr;
+        HsmSqe*  sq = nullptr;
+        HsmCqe*  cq = nullptr;
+        uint8_t* arena = nullptr;
+        uint64_t arena_bytes = 0;       // daemon's copy; the header is client-writable
+        uint32_t sq_mask = 0, cq_mask = 0;
+        uint32_t cq_tail = 0;           // daemon's copy, published by postCqes()
+        uint32_t inflight = 0;          // pulled SQEs whose CQE is not written yet
+        uint64_t queued_blocks = 0;     // their blocks
+        bool     cq_dirty = false;
+        int      sq_fd = -1, cq_fd = -1;
+
+        Ring() : Pollable{RING} {}
+        ~Ring() {
+            if (base) munmap(base, size);
+            if (sq_fd >= 0) ::close(sq_fd);
+            if (cq_fd >= 0) ::close(cq_fd);
+        }
+        bool pending() const {
+            return hdr->sq_tail.load(std::memory_order_acquire) != hdr->sq_head.load(std::memory_order_relaxed);
+        }
+    };
+
+    struct Client : Pollable {
+        int fd = -1;
+        std::vector<uint8_t> in;
+        std::vector<uint8_t> out;
+        size_t   out_off = 0;
+        std::deque<Request> aes;        // ENCRYPT + KEY_DROP, arrival order
+        std::deque<Request> rnd;
+        std::vector<AesKeyHandle> keys; // one entry per KEY_LOAD still held
+        std::vector<int> fds;           // SCM_RIGHTS received, consumed by RING_ATTACH
+        std::vector<std::unique_ptr<Ring>> rings;
+        uint32_t deficit = 0;
+        uint32_t events  = 0;           // current epoll interest
+        bool     paused  = false;
+        bool     closing = false;
+
+        Client() : Pollable{CLIENT} {}
+        ~Client() { for (int f : fds) ::close(f); }
+
+        size_t queued() const { return aes.size() + rnd.size(); }
+        size_t unsent() const { return out.size() - out_off; }
+        bool holds(AesKeyHandle h) const { return std::find(keys.begin(), keys.end(), h) != keys.end(); }
+    };
+
+    struct KeyRef {
+        uint32_t     key[8];
+        AesKeyHandle handle;
+        uint32_t     refs;
+    };
+
+    AesDriver&   _aes;
+    EntropyPool& _pool;
+    HsmServiceConfig _cfg;
+    int _listen_fd = -1;
+    int _epoll_fd  = -1;
+    int _wake_fd   = -1;
+    std::vector<std::unique_ptr<Client>> _clients;
+    std::vector<KeyRef> _keyrefs;
+    size_t       _rr = 0;
+    size_t       _rr_random = 0;
+    AesKeyHandle _run_key = AES_NO_KEY;
+    uint32_t     _run_batches = 0;
+    std::vector<uint32_t> _batch;
+    HsmServiceStats _stats;
+    std::atomic<bool> _stop{false};
+    std::atomic<bool> _dump{false};
+
+    // Keys ----------------------------------------
+    AesKeyHandle acquireKey(const uint32_t key[8]) {
+        for (KeyRef& r : _keyrefs) {
+            if (memcmp(r.key, key, sizeof(r.key)) == 0) { r.refs++; return r.handle; }
+        }
+        KeyRef r;
+        memcpy(r.key, key, sizeof(r.key));
+        r.handle = _aes.registerKey(key);
+        r.refs = 1;
+        _keyrefs.push_back(r);
+        return r.handle;
+    }
+
+    void releaseKey(AesKeyHandle h) {
+        for (size_t i = 0; i < _keyrefs.size(); i++) {
+            KeyRef& r = _keyrefs[i];
+            if (r.handle != h || --r.refs) continue;
+            _aes.unregisterKey(h);
+            volatile uint32_t* wipe = r.key;
+            for (int k = 0; k < 8; k++) wipe[k] = 0;
+            _keyrefs.erase(_keyrefs.begin() + i);
+            return;
+        }
+    }
+
+    // Responses -----------------------------------
+    void respond(Client& c, uint32_t id, HsmOp op, HsmStatus st, uint32_t key = 0,
+                 const void* payload = nullptr, uint32_t len = 0) {
+        HsmMsgHeader h = { HSMD_MAGIC, (uint16_t)op, (uint16_t)st, id, key, len };
+        const uint8_t* hp = reinterpret_cast<const uint8_t*>(&h);
+        c.out.insert(c.out.end(), hp, hp + sizeof(h));
+        if (len) c.out.insert(c.out.end(), static_cast<const uint8_t*>(payload),
+                              static_cast<const uint8_t*>(payload) + len);
+        if (st != HsmStatus::OK) _stats.errors++;
+    }
+
+    void flush(Client& c) {
+        while (c.unsent() && !c.closing) {
+            ssize_t n = ::send(c.fd, c.out.data() + c.out_off, c.unsent(), MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) { c.closing = true; break; }
+            c.out_off += (size_t)n;
+        }
+        if (!c.unsent()) { c.out.clear(); c.out_off = 0; }
+        else if (c.out_off > (1u << 16)) {
+            c.out.erase(c.out.begin(), c.out.begin() + c.out_off);
+            c.out_off = 0;
+        }
+    }
+
+    // backpressure + EPOLLOUT; only touches epoll when the interest set changes
+    void updateInterest(Client& c) {
+        if (!c.paused && (c.queued() >= _cfg.max_inflight || c.unsent() >= _cfg.max_out_bytes)) {
+            c.paused = true;
+            _stats.pauses++;
+        } else if (c.paused && c.queued() <= _cfg.max_inflight / 2 && c.unsent() <= _cfg.max_out_bytes / 2) {
+            c.paused = false;
+        }
+        uint32_t ev = (uint32_t)EPOLLRDHUP | (c.paused ? 0u : (uint32_t)EPOLLIN) | (c.unsent() ? (uint32_t)EPOLLOUT : 0u);
+        if (ev == c.events || c.closing) return;
+        struct epoll_event e = {};
+        e.events = ev;
+        e.data.ptr = static_cast<Pollable*>(&c);
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_MOD, c.fd, &e) < 0) perror("epoll_ctl mod");
+        c.events = ev;
+    }
+
+    // Requests ------------------------------------
+    // KEY_DROP runs once no earlier ENCRYPT of this client still needs the handle
+    void settleDrops(Client& c) {
+        for (size_t i = 0; i < c.aes.size(); ) {
+            Request& r = c.aes[i];
+            bool blocked = false;
+            for (size_t j = 0; j < i && !blocked; j++) blocked = c.aes[j].key == r.key;
+            if (r.op != HsmOp::KEY_DROP || blocked) { i++; continue; }
+            auto it = std::find(c.keys.begin(), c.keys.end(), r.key);
+            if (it != c.keys.end()) {
+                c.keys.erase(it);
+                releaseKey(r.key);
+                respond(c, r.id, HsmOp::KEY_DROP, HsmStatus::OK, r.key);
+            } else {
+                respond(c, r.id, HsmOp::KEY_DROP, HsmStatus::BAD_KEY, r.key);
+            }
+            c.aes.erase(c.aes.begin() + i);
+        }
+    }
+
+    void handle(Client& c, const HsmMsgHeader& h, const uint8_t* payload) {
+        HsmOp op = (HsmOp)h.op;
+        if (h.op >= 1 && h.op <= 6) _stats.requests[h.op]++;
+        Request r;
+        r.id = h.id;
+        r.op = op;
+        r.key = h.key;
+        r.t_enq = Clock::now();
+
+        switch (op) {
+        case HsmOp::KEY_LOAD: {
+            if (h.len != 32) { respond(c, h.id, op, HsmStatus::BAD_REQUEST); return; }
+            if (c.keys.size() >= _cfg.max_keys_per_client) {
+                _stats.key_limited++;
+                respond(c, h.id, op, HsmStatus::KEY_LIMIT);
+                return;
+            }
+            uint32_t key[8];
+            memcpy(key, payload, sizeof(key));
+            AesKeyHandle kh = acquireKey(key);
+            volatile uint32_t* wipe = key;
+            for (int k = 0; k < 8; k++) wipe[k] = 0;
+            c.keys.push_back(kh);
+            respond(c, h.id, op, HsmStatus::OK, kh);
+            return;
+        }
+        case HsmOp::KEY_DROP:
+            if (!c.holds(h.key)) { respond(c, h.id, op, HsmStatus::BAD_KEY, h.key); return; }
+            c.aes.push_back(std::move(r));
+            settleDrops(c);
+            return;
+        case HsmOp::ENCRYPT:
+            if (!h.len || h.len % 16 || h.len > HSMD_MAX_PAYLOAD) { respond(c, h.id, op, HsmStatus::BAD_REQUEST); return; }
+            if (!c.holds(h.key)) { respond(c, h.id, op, HsmStatus::BAD_KEY, h.key); return; }
+            r.blocks = h.len / 16;
+            r.data.resize(h.len / 4);
+            memcpy(r.data.data(), payload, h.len);
+            c.aes.push_back(std::move(r));
+            return;
+        case HsmOp::RANDOM: {
+            uint32_t n = 0;
+            if (h.len == sizeof(n)) memcpy(&n, payload, sizeof(n));
+            if (!n || n > HSMD_MAX_RANDOM) { respond(c, h.id, op, HsmStatus::BAD_REQUEST); return; }
+            r.random_len = n;
+            r.data.resize((n + 3) / 4);
+            c.rnd.push_back(std::move(r));
+            return;
+        }
+        case HsmOp::RING_ATTACH: {
+            HsmStatus st = attachRing(c);
+            respond(c, h.id, op, st, st == HsmStatus::OK ? (uint32_t)c.rings.size() : 0);
+            return;
+        }
+        case HsmOp::STATS: {
+            std::string text = report();
+            respond(c, h.id, op, HsmStatus::OK, 0, text.data(), (uint32_t)text.size());
+            return;
+        }
+        default:
+            respond(c, h.id, op, HsmStatus::BAD_REQUEST);
+        }
+    }
+
+    void readClient(Client& c) {
+        uint8_t buf[65536];
+        union {
+            char buf[CMSG_SPACE(8 * sizeof(int))];
+            struct cmsghdr align;
+        } ctl;
+        while (!c.paused && !c.closing) {
+            struct iovec iov = { buf, sizeof(buf) };
+            struct msghdr msg = {};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            msg.msg_control = ctl.buf;
+            msg.msg_controllen = sizeof(ctl.buf);
+            ssize_t n = ::recvmsg(c.fd, &msg, MSG_CMSG_CLOEXEC);
+            if (n < 0 && errno == EINTR) continue;
+            if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) break;
+            if (n <= 0) { c.closing = true; break; }
+            for (struct cmsghdr* cm = CMSG_FIRSTHDR(&msg); cm; cm = CMSG_NXTHDR(&msg, cm)) {
+                if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) continue;
+                size_t nfd = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for (size_t k = 0; k < nfd; k++) {
+                    int f;
+                    memcpy(&f, CMSG_DATA(cm) + k * sizeof(int), sizeof(int));
+                    c.fds.push_back(f);
+                }
+            }
+            if (c.fds.size() > 8) { c.closing = true; break; }     // nobody needs more than one attach pending
+            c.in.insert(c.in.end(), buf, buf + n);
+
+            size_t off = 0;
+            while (c.in.size() - off >= sizeof(HsmMsgHeader)) {
+                HsmMsgHeader h;
+                memcpy(&h, c.in.data() + off, sizeof(h));
+                if (h.magic != HSMD_MAGIC || h.len > HSMD_MAX_PAYLOAD) {
+                    fprintf(stderr, "[hsmd] fd %d: bad frame, dropping client\n", c.fd);
+                    c.closing = true;
+                    return;
+                }
+                if (c.in.size() - off - sizeof(h) < h.len) break;
+                handle(c, h, c.in.data() + off + sizeof(h));
+                off += sizeof(h) + h.len;
+            }
+            c.in.erase(c.in.begin(), c.in.begin() + off);
+            updateInterest(c);
+        }
+    }
+
+    // Rings ---------------------------------------
+    // validate and map the memfd from the client's SCM_RIGHTS; header values read once
+    HsmStatus attachRing(Client& c) {
+        if (c.fds.size() < 3) return HsmStatus::BAD_REQUEST;
+        int mem_fd = c.fds[0];
+        std::unique_ptr<Ring> r(new Ring);
+        r->owner = &c;
+        r->sq_fd = c.fds[1];
+        r->cq_fd = c.fds[2];
+        c.fds.erase(c.fds.begin(), c.fds.begin() + 3);
+
+        struct stat st;
+        int seals = fcntl(mem_fd, F_GET_SEALS);
+        bool ok = fstat(mem_fd, &st) == 0 && seals >= 0 &&
+                  (seals & (F_SEAL_SHRINK | F_SEAL_GROW)) == (F_SEAL_SHRINK | F_SEAL_GROW);
+        HsmRingHeader hdr_copy;
+        ok = ok && (size_t)st.st_size >= sizeof(HsmRingHeader) &&
+             pread(mem_fd, &hdr_copy, offsetof(HsmRingHeader, sq_head), 0) == (ssize_t)offsetof(HsmRingHeader, sq_head);
+        HsmRingLayout l;
+        ok = ok && hdr_copy.magic == HSM_RING_MAGIC &&
+             HsmRingLayout::compute(hdr_copy.sq_entries, hdr_copy.cq_entries, hdr_copy.arena_bytes, l) &&
+             hdr_copy.arena_off == l.arena_off && (uint64_t)st.st_size >= l.total;
+        if (ok) {
+            void* p = mmap(nullptr, l.total, PROT_READ | PROT_WRITE, MAP_SHARED, mem_fd, 0);
+            if (p == MAP_FAILED) { perror("mmap ring"); ok = false; }
+            else {
+                r->base = static_cast<uint8_t*>(p);
+                r->size = l.total;
+            }
+        }
+        ::close(mem_fd);
+        if (!ok) {
+            fprintf(stderr, "[hsmd] fd %d: ring rejected (seals / geometry)\n", c.fd);
+            return HsmStatus::BAD_REQUEST;
+        }
+        r->hdr = reinterpret_cast<HsmRingHeader*>(r->base);
+        r->sq = reinterpret_cast<HsmSqe*>(r->base + l.sq_off);
+        r->cq = reinterpret_cast<HsmCqe*>(r->base + l.cq_off);
+        r->arena = r->base + l.arena_off;
+        r->arena_bytes = hdr_copy.arena_bytes;
+        r->sq_mask = hdr_copy.sq_entries - 1;
+        r->cq_mask = hdr_copy.cq_entries - 1;
+        r->cq_tail = r->hdr->cq_tail.load(std::memory_order_relaxed);
+
+        struct epoll_event e = {};
+        e.events = EPOLLIN;
+        e.data.ptr = static_cast<Pollable*>(r.get());
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, r->sq_fd, &e) < 0) {
+            perror("epoll_ctl ring");
+            return HsmStatus::BAD_REQUEST;
+        }
+        c.rings.push_back(std::move(r));
+        _stats.rings++;
+        return HsmStatus::OK;
+    }
+
+    void detachRing(Ring& r) {
+        epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, r.sq_fd, nullptr);
+        _stats.rings--;
+    }
+
+    bool checkSqe(const Ring& r, const HsmSqe& e) const {
+        uint64_t bytes = (uint64_t)e.blocks * 16;
+        return e.blocks && e.blocks <= HSMD_MAX_BLOCKS && !(e.src % 4) && !(e.dst % 4) &&
+               e.src <= r.arena_bytes && bytes <= r.arena_bytes - e.src &&
+               e.dst <= r.arena_bytes && bytes <= r.arena_bytes - e.dst &&
+               r.owner->holds(e.key);
+    }
+
+    void writeCqe(Ring& r, uint64_t user_data, HsmStatus st, uint32_t blocks) {
+        HsmCqe& q = r.cq[r.cq_tail++ & r.cq_mask];
+        q.user_data = user_data;
+        q.status = (uint32_t)st;
+        q.blocks = blocks;
+        r.cq_dirty = true;
+        if (st != HsmStatus::OK) _stats.errors++;
+    }
+
+    // publish written CQEs, one CQ doorbell per ring
+    void postCqes(Ring& r) {
+        if (!r.cq_dirty) return;
+        r.cq_dirty = false;
+        r.hdr->cq_tail.store(r.cq_tail, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (r.hdr->flags.load(std::memory_order_relaxed) & RING_CQ_WAIT) {
+            uint64_t one = 1;
+            if (::write(r.cq_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("ring cq signal");
+            _stats.ring_signals++;
+        }
+    }
+
+    // move SQEs into the owner's queue while their CQEs are sure to fit; bad ones are
+    // answered at once. true if any were consumed
+    bool pullRing(Ring& r) {
+        HsmRingHeader& h = *r.hdr;
+        Client& c = *r.owner;
+        uint32_t sq_head = h.sq_head.load(std::memory_order_relaxed);
+        uint32_t sq_tail = h.sq_tail.load(std::memory_order_acquire);
+        uint32_t cq_head = h.cq_head.load(std::memory_order_acquire);
+        if (sq_tail - sq_head > r.sq_mask + 1) sq_tail = sq_head + r.sq_mask + 1;     // client garbage
+        uint32_t pulled = 0;
+        auto now = Clock::now();
+
+        while (sq_head != sq_tail && r.queued_blocks < _cfg.max_batch_blocks) {
+            if (r.cq_tail + r.inflight - cq_head > r.cq_mask) {
+                cq_head = h.cq_head.load(std::memory_order_acquire);
+                if (r.cq_tail + r.inflight - cq_head > r.cq_mask) break;
+            }
+            HsmSqe e = r.sq[sq_head & r.sq_mask];        // copy: the client can rewrite the slot
+            sq_head++;
+            pulled++;
+            if (!checkSqe(r, e)) {
+                writeCqe(r, e.user_data, c.holds(e.key) ? HsmStatus::BAD_REQUEST : HsmStatus::BAD_KEY, e.blocks);
+                continue;
+            }
+            Request q;
+            q.key = e.key;
+            q.blocks = e.blocks;
+            q.t_enq = now;
+            q.ring = &r;
+            q.user_data = e.user_data;
+            q.src = e.src;
+            q.dst = e.dst;
+            c.aes.push_back(std::move(q));
+            r.inflight++;
+            r.queued_blocks += e.blocks;
+        }
+        if (!pulled) return false;
+
+        h.sq_head.store(sq_head, std::memory_order_release);
+        _stats.ring_sqes += pulled;
+        postCqes(r);
+        return true;
+    }
+
+    // true if any ring had work this pass
+    bool serveRings() {
+        bool worked = false;
+        for (auto& c : _clients) {
+            if (c->closing) continue;
+            for (auto& r : c->rings) worked |= pullRing(*r);
+        }
+        return worked;
+    }
+
+    // about to block: ask for doorbells, then make sure nothing slipped in meanwhile
+    bool ringsIdle() {
+        bool idle = true;
+        for (auto& c : _clients) {
+            for (auto& r : c->rings) r->hdr->flags.fetch_or(RING_SQ_WAKEUP, std::memory_order_seq_cst);
+        }
+        for (auto& c : _clients) {
+            for (auto& r : c->rings) if (r->pending()) idle = false;
+        }
+        if (!idle) ringsAwake();
+        return idle;
+    }
+
+    void ringsAwake() {
+        for (auto& c : _clients) {
+            for (auto& r : c->rings) r->hdr->flags.fetch_and(~RING_SQ_WAKEUP, std::memory_order_relaxed);
+        }
+    }
+
+    void accept() {
+        while (true) {
+            int fd = ::accept4(_listen_fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) perror("accept");
+                return;
+            }
+            if (_clients.size() >= _cfg.max_clients) {
+                _stats.rejected++;
+                ::close(fd);
+                continue;
+            }
+            std::unique_ptr<Client> c(new Client);
+            c->fd = fd;
+            c->events = EPOLLIN | EPOLLRDHUP;
+            struct epoll_event e = {};
+            e.events = c->events;
+            e.data.ptr = static_cast<Pollable*>(c.get());
+            if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, fd, &e) < 0) {
+                perror("epoll_ctl add");
+                ::close(fd);
+                continue;
+            }
+            _clients.push_back(std::move(c));
+            _stats.connections++;
+            _stats.clients = _clients.size();
+            _stats.clients_peak = std::max<uint64_t>(_stats.clients_peak, _stats.clients);
+        }
+    }
+
+    void reap() {
+        for (size_t i = 0; i < _clients.size(); ) {
+            Client& c = *_clients[i];
+            if (!c.closing) { i++; continue; }
+            epoll_ctl(_epoll_fd, EPOLL_CTL_DEL, c.fd, nullptr);
+            for (auto& r : c.rings) detachRing(*r);
+            ::close(c.fd);
+            for (AesKeyHandle h : c.keys) releaseKey(h);
+            _clients.erase(_clients.begin() + i);
+            _stats.clients = _clients.size();
+        }
+    }
+
+    // Scheduling ----------------------------------
+    // request i of c is schedulable for key k: ENCRYPT under k, no KEY_DROP of k before it
+    static bool runnable(const Client& c, size_t i, AesKeyHandle k) {
+        if (c.aes[i].op != HsmOp::ENCRYPT || c.aes[i].key != k) return false;
+        for (size_t j = 0; j < i; j++) {
+            if (c.aes[j].op == HsmOp::KEY_DROP && c.aes[j].key == k) return false;
+        }
+        return true;
+    }
+
+    AesKeyHandle pickKey() {
+        AesKeyHandle resident = _aes.residentKey();
+        bool resident_work = false;
+        const Request* oldest = nullptr;
+        for (auto& cp : _clients) {
+            for (size_t i = 0; i < cp->aes.size(); i++) {
+                const Request& r = cp->aes[i];
+                if (r.op != HsmOp::ENCRYPT) continue;
+                if (!oldest || r.t_enq < oldest->t_enq) oldest = &r;
+                if (r.key == resident && runnable(*cp, i, resident)) resident_work = true;
+            }
+        }
+        if (!oldest) return AES_NO_KEY;
+        if (resident_work && (oldest->key == resident || _run_batches < _cfg.max_key_run)) return resident;
+        return oldest->key;
+    }
+
+    bool runBatch() {
+        AesKeyHandle k = pickKey();
+        if (k == AES_NO_KEY) return false;
+        if (k == _run_key) {
+            _run_batches++;
+        } else {
+            if (_run_key != AES_NO_KEY) _stats.key_switches++;
+            _run_key = k;
+            _run_batches = 1;
+        }
+
+        // deficit round robin over clients, whole requests only
+        struct Taken { Client* c; Request r; };
+        std::vector<Taken> taken;
+        size_t total = 0, n = _clients.size();
+        bool full = false, more = true;
+        while (!full && more) {
+            more = false;
+            for (size_t s = 0; s < n && !full; s++) {
+                Client& c = *_clients[(_rr + s) % n];
+                if (c.closing) continue;
+                bool has = false;
+                c.deficit += _cfg.quantum_blocks;
+                for (size_t i = 0; i < c.aes.size(); ) {
+                    if (!runnable(c, i, k)) { i++; continue; }
+                    Request& r = c.aes[i];
+                    if (total && total + r.blocks > _cfg.max_batch_blocks) { full = true; has = true; break; }
+                    if (r.blocks > c.deficit) { has = true; break; }
+                    c.deficit -= r.blocks;
+                    total += r.blocks;
+                    taken.push_back(Taken{ &c, std::move(r) });
+                    c.aes.erase(c.aes.begin() + i);
+                }
+                if (has) more = true;
+                else c.deficit = 0;         // nothing left under this key: no credit banked
+            }
+        }
+        if (n) _rr = (_rr + 1) % n;
+        if (taken.empty()) return false;
+
+        _stats.queue_sum += _stats.queue_depth;
+        _batch.resize(total * 4);
+        size_t off = 0;
+        for (Taken& t : taken) {
+            const void* pt = t.r.ring ? t.r.ring->arena + t.r.src : (const void*)t.r.data.data();
+            memcpy(_batch.data() + off, pt, t.r.blocks * 16);
+            off += t.r.blocks * 4;
+        }
+        bool ok = _aes.encryptBulk(k, _batch.data(), _batch.data(), total);
+        if (!ok) _aes.invalidateKeyCache();
+
+        _stats.batches++;
+        _stats.batch_blocks += total;
+        _stats.batch_requests += taken.size();
+        auto now = Clock::now();
+        off = 0;
+        for (Taken& t : taken) {
+            if (Ring* r = t.r.ring) {
+                if (ok) memcpy(r->arena + t.r.dst, _batch.data() + off, t.r.blocks * 16);
+                writeCqe(*r, t.r.user_data, ok ? HsmStatus::OK : HsmStatus::DEVICE_ERROR, t.r.blocks);
+                r->inflight--;
+                r->queued_blocks -= t.r.blocks;
+                if (ok) _stats.ring_blocks += t.r.blocks;
+            } else if (ok) {
+                respond(*t.c, t.r.id, HsmOp::ENCRYPT, HsmStatus::OK, k, _batch.data() + off, t.r.blocks * 16);
+            } else {
+                respond(*t.c, t.r.id, HsmOp::ENCRYPT, HsmStatus::DEVICE_ERROR, k);
+            }
+            off += t.r.blocks * 4;
+            _stats.encrypt_lat.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(now - t.r.t_enq).count());
+        }
+        for (Taken& t : taken) {
+            if (t.r.ring) postCqes(*t.r.ring);
+            settleDrops(*t.c);
+        }
+        return true;
+    }
+
+    // hand out what the pool already holds; never waits on the harvester
+    bool serveRandom() {
+        bool pending = false;
+        size_t n = _clients.size();
+        for (size_t s = 0; s < n; s++) {
+            Client& c = *_clients[(_rr_random + s) % n];
+            if (c.rnd.empty() || c.closing) continue;
+            Request& r = c.rnd.front();
+            uint32_t avail = _pool.fill() * 4;
+            uint32_t need = r.random_len - r.random_done;
+            uint32_t take = need < avail ? need : avail;
+            HsmStatus st = HsmStatus::OK;
+            if (!_pool.running()) st = HsmStatus::DEVICE_ERROR;
+            else if (take) {
+                PoolStatus ps = _pool.read(reinterpret_cast<uint8_t*>(r.data.data()) + r.random_done, take, 0);
+                if (ps == PoolStatus::HEALTH_FAIL) st = HsmStatus::HEALTH_FAIL;
+                else if (ps == PoolStatus::OK) r.random_done += take;
+            }
+            if (st == HsmStatus::OK && r.random_done < r.random_len) { pending = true; continue; }
+
+            if (st == HsmStatus::OK) {
+                respond(c, r.id, HsmOp::RANDOM, st, 0, r.data.data(), r.random_len);
+                _stats.random_bytes += r.random_len;
+            } else {
+                respond(c, r.id, HsmOp::RANDOM, st);
+            }
+            _stats.random_lat.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - r.t_enq).count());
+            memset(r.data.data(), 0, r.data.size() * 4);
+            c.rnd.pop_front();
+            if (!c.rnd.empty()) pending = true;
+        }
+        if (n) _rr_random = (_rr_random + 1) % n;
+        return pending;
+    }
+
+    void updateDepth() {
+        uint64_t depth = 0;
+        for (auto& c : _clients) depth += c->queued();
+        _stats.queue_depth = depth;
+        _stats.queue_peak = std::max(_stats.queue_peak, depth);
+    }
+
+    bool encryptPending() const {
+        for (auto& c : _clients) {
+            for (const Request& r : c->aes) if (r.op == HsmOp::ENCRYPT) return true;
+        }
+        return false;
+    }
+
+public:
+    HsmService(AesDriver& aes, EntropyPool& pool, const HsmServiceConfig& cfg = HsmServiceConfig{})
+        : _aes(aes), _pool(pool), _cfg(cfg) {
+        if (_cfg.max_batch_blocks < HSMD_MAX_BLOCKS) _cfg.max_batch_blocks = HSMD_MAX_BLOCKS;
+        if (_cfg.quantum_blocks == 0) _cfg.quantum_blocks = 1;
+        if (_cfg.max_inflight == 0) _cfg.max_inflight = 1;
+        if (_cfg.max_keys_per_client == 0) _cfg.max_keys_per_client = 1;
+    }
+
+    ~HsmService() { close(); }
+
+    HsmService(const HsmService&) = delete;
+    HsmService& operator=(const HsmService&) = delete;
+
+    /**
+    * @brief Bind the socket (replacing a stale one) and set up epoll
+    * @return false with perror output on any failure
+    */
+    bool open() {
+        _listen_fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+        if (_listen_fd < 0) { perror("socket"); return false; }
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        if (_cfg.socket_path.size() >= sizeof(addr.sun_path)) {
+            fprintf(stderr, "[hsmd] socket path too long: %s\n", _cfg.socket_path.c_str());
+            return false;
+        }
+        strncpy(addr.sun_path, _cfg.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        ::unlink(_cfg.socket_path.c_str());
+        if (::bind(_listen_fd, (struct sockaddr*)&addr, sizeof(addr)) < 0) { perror("bind"); return false; }
+        ::chmod(_cfg.socket_path.c_str(), 0660);     // owner + group (e.g. an "hsm" group)
+        if (::listen(_listen_fd, 128) < 0) { perror("listen"); return false; }
+
+        _epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+        _wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (_epoll_fd < 0 || _wake_fd < 0) { perror("epoll/eventfd"); return false; }
+        struct epoll_event e = {};
+        e.events = EPOLLIN;
+        e.data.ptr = &_listen_fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _listen_fd, &e) < 0) { perror("epoll_ctl"); return false; }
+        e.data.ptr = &_wake_fd;
+        if (epoll_ctl(_epoll_fd, EPOLL_CTL_ADD, _wake_fd, &e) < 0) { perror("epoll_ctl"); return false; }
+        return true;
+    }
+
+    void close() {
+        for (auto& c : _clients) c->closing = true;
+        if (_epoll_fd >= 0) reap();
+        if (_listen_fd >= 0) {
+            ::close(_listen_fd);
+            ::unlink(_cfg.socket_path.c_str());
+        }
+        if (_epoll_fd >= 0) ::close(_epoll_fd);
+        if (_wake_fd >= 0) ::close(_wake_fd);
+        _listen_fd = _epoll_fd = _wake_fd = -1;
+    }
+
+    // async-signal-safe: flag + eventfd write
+    void requestStop() {
+        _stop.store(true);
+        uint64_t one = 1;
+        if (_wake_fd >= 0 && ::write(_wake_fd, &one, sizeof(one)) < 0) {}
+    }
+
+    // async-signal-safe: report on stderr from the loop (SIGUSR1)
+    void requestReport() {
+        _dump.store(true);
+        uint64_t one = 1;
+        if (_wake_fd >= 0 && ::write(_wake_fd, &one, sizeof(one)) < 0) {}
+    }
+
+    /**
+    * @brief Serve until requestStop()
+    */
+    void run() {
+        struct epoll_event events[64];
+        bool random_waiting = false;
+        uint32_t ring_idle = _cfg.ring_idle_loops;
+        while (!_stop.load()) {
+            // busy while encrypt work is queued or a ring was active in the last ring_idle_loops
+            // passes; poll the pool at 1 ms while RANDOM waits on it; otherwise sleep
+            int timeout = encryptPending() || ring_idle < _cfg.ring_idle_loops ? 0 : random_waiting ? 1 : -1;
+            bool asleep = timeout != 0 && ringsIdle();
+            if (timeout != 0 && !asleep) timeout = 0;
+            int n = epoll_wait(_epoll_fd, events, 64, timeout);
+            if (asleep) ringsAwake();
+            if (n < 0 && errno != EINTR) { perror("epoll_wait"); break; }
+            for (int i = 0; i < n; i++) {
+                void* p = events[i].data.ptr;
+                if (p == &_listen_fd) { accept(); continue; }
+                if (p == &_wake_fd) {
+                    uint64_t v;
+                    if (::read(_wake_fd, &v, sizeof(v)) < 0) {}
+                    if (_dump.exchange(false)) fprintf(stderr, "%s", report().c_str());
+                    continue;
+                }
+                Pollable* t = static_cast<Pollable*>(p);
+                if (t->kind == Pollable::RING) {
+                    uint64_t v;
+                    if (::read(static_cast<Ring*>(t)->sq_fd, &v, sizeof(v)) > 0) _stats.ring_wakeups++;
+                    ring_idle = 0;
+                    continue;
+                }
+                Client& c = *static_cast<Client*>(t);
+                if (events[i].events & EPOLLOUT) flush(c);
+                if (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) readClient(c);
+            }
+
+            if (serveRings()) ring_idle = 0;
+            else if (ring_idle < _cfg.ring_idle_loops) ring_idle++;
+            updateDepth();
+            runBatch();
+            random_waiting = serveRandom();
+            for (auto& c : _clients) {
+                flush(*c);
+                updateInterest(*c);
+            }
+            reap();
+            updateDepth();
+        }
+    }
+
+    const HsmServiceStats& stats() const { return _stats; }
+
+    std::string report() const {
+        char* text = nullptr;
+        size_t size = 0;
+        FILE* f = open_memstream(&text, &size);
+        if (!f) return std::string();
+        const AesKeyCacheStats& k = _aes.keyCacheStats();
+        fprintf(f, "--- hsmd (%s) ---\n", _cfg.socket_path.c_str());
+        _stats.print(f);
+        fprintf(f, "    Key cache   : %zu keys loaded, %llu hits, %llu misses, %llu reloads\n",
+                _keyrefs.size(), (unsigned long long)k.hits, (unsigned long long)k.misses,
+                (unsigned long long)k.reloads);
+        fprintf(f, "    Pool        : %u words buffered\n", _pool.fill());
+        fclose(f);
+        std::string s(text, size);
+        free(text);
+        return s;
+    }
+};
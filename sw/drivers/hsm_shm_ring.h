@@ -0,0 +1,241 @@
+/**
+* @file     hsm_shm_ring.h
+* @brief    Zero-copy submission / completion rings between hsmd clients and the AES owner
+* @details  io_uring-style SPSC rings in a sealed memfd shared with hsmd: the client puts
+*           plaintext in the arena, queues descriptors (key, src, dst, blocks) on the SQ,
+*           hsmd feeds the arena straight into encryptBulk() and writes ciphertext back in
+*           place, then posts a CQE. Payload bytes never cross the socket or the kernel.
+*
+* Layout (one memfd, sealed against shrink/grow so the daemon's mapping cannot SIGBUS):
+*   [HsmRingHeader][sq_entries x HsmSqe][cq_entries x HsmCqe][pad to 4K][arena]
+*
+* Doorbells (eventfds passed with the memfd via SCM_RIGHTS, RING_ATTACH):
+* - SQ: hsmd sets RING_SQ_WAKEUP before it sleeps; flush() only writes the eventfd then,
+*   so a busy daemon costs the client no syscalls
+* - CQ: wait() spins, then sets RING_CQ_WAIT and blocks on the eventfd; hsmd only
+*   signals while that flag is set. poll mode (reap() alone) never touches the kernel
+*
+* hsmd copies each SQE before validating it and bounds-checks every range against the
+* arena, so a misbehaving client can only corrupt its own buffers.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "hsm_client.h"
+#include "hsm_proto.h"
+
+constexpr uint32_t HSM_RING_MAGIC       = 0x474E5248;   // "HRNG"
+constexpr uint32_t HSM_RING_MAX_ENTRIES = 4096;
+constexpr size_t   HSM_RING_MAX_ARENA   = 64u << 20;
+constexpr uint32_t HSM_RING_SPIN        = 2048;         // CQ polls before wait() sleeps
+
+// flags
+constexpr uint32_t RING_SQ_WAKEUP = 0x1;    // hsmd is asleep: ring the SQ eventfd
+constexpr uint32_t RING_CQ_WAIT   = 0x2;    // client is asleep: signal the CQ eventfd
+
+// Layout =======================================
+struct HsmRingHeader {
+    uint32_t magic;
+    uint32_t sq_entries;            // power of 2
+    uint32_t cq_entries;            // power of 2, >= sq_entries
+    uint32_t reserved;
+    uint64_t arena_off;
+    uint64_t arena_bytes;
+    alignas(64) std::atomic<uint32_t> sq_head;      // hsmd
+    alignas(64) std::atomic<uint32_t> sq_tail;      // client
+    alignas(64) std::atomic<uint32_t> cq_head;      // client
+    alignas(64) std::atomic<uint32_t> cq_tail;      // hsmd
+    alignas(64) std::atomic<uint32_t> flags;
+};
+static_assert(std::atomic<uint32_t>::is_always_lock_free, "ring indices must be lock free across processes");
+
+struct HsmSqe {
+    uint64_t user_data;             // echoed in the CQE
+    uint32_t key;                   // handle from KEY_LOAD on the same connection
+    uint32_t blocks;
+    uint64_t src;                   // arena offsets, 4-byte aligned; may be equal (in place)
+    uint64_t dst;
+};
+
+struct HsmCqe {
+    uint64_t user_data;
+    uint32_t status;                // HsmStatus
+    uint32_t blocks;
+};
+
+struct HsmRingLayout {
+    uint64_t sq_off, cq_off, arena_off, total;
+
+    static bool compute(uint32_t sq, uint32_t cq, uint64_t arena, HsmRingLayout& l) {
+        auto pow2 = [](uint32_t v) { return v && !(v & (v - 1)); };
+        if (!pow2(sq) || !pow2(cq) || sq > HSM_RING_MAX_ENTRIES || cq > HSM_RING_MAX_ENTRIES || cq < sq) return false;
+        if (!arena || arena > HSM_RING_MAX_ARENA || arena % 16) return false;
+        l.sq_off = (sizeof(HsmRingHeader) + 63) & ~63ull;
+        l.cq_off = l.sq_off + (uint64_t)sq * sizeof(HsmSqe);
+        l.arena_off = (l.cq_off + (uint64_t)cq * sizeof(HsmCqe) + 4095) & ~4095ull;
+        l.total = l.arena_off + arena;
+        return true;
+    }
+};
+
+// Client =======================================
+class HsmRingClient {
+private:
+    int _mem_fd = -1, _sq_fd = -1, _cq_fd = -1;
+    uint8_t* _base = nullptr;
+    HsmRingLayout _layout = {};
+    HsmRingHeader* _hdr = nullptr;
+    HsmSqe* _sq = nullptr;
+    HsmCqe* _cq = nullptr;
+    uint32_t _sq_mask = 0, _cq_mask = 0;
+    uint32_t _sq_local = 0;         // tail including unflushed submissions
+    uint64_t _doorbells = 0, _sleeps = 0;
+
+public:
+    HsmRingClient() = default;
+    ~HsmRingClient() { close(); }
+    HsmRingClient(const HsmRingClient&) = delete;
+    HsmRingClient& operator=(const HsmRingClient&) = delete;
+
+    /**
+    * @brief Create the memfd + eventfds and hand them to hsmd over conn
+    * @details The ring lives as long as conn stays connected; keys come from conn.loadKey().
+    */
+    bool attach(HsmClient& conn, uint32_t entries = 256, size_t arena_bytes = 1u << 20) {
+        close();
+        if (!HsmRingLayout::compute(entries, entries, arena_bytes, _layout)) {
+            fprintf(stderr, "[ERROR] ring geometry %u entries / %zu bytes out of range\n", entries, arena_bytes);
+            return false;
+        }
+        _mem_fd = memfd_create("hsm_ring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (_mem_fd < 0) { perror("memfd_create"); return false; }
+        if (ftruncate(_mem_fd, (off_t)_layout.total) < 0) { perror("ftruncate"); close(); return false; }
+        if (fcntl(_mem_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) < 0) {
+            perror("F_ADD_SEALS");
+            close();
+            return false;
+        }
+        void* p = mmap(nullptr, _layout.total, PROT_READ | PROT_WRITE, MAP_SHARED, _mem_fd, 0);
+        if (p == MAP_FAILED) { perror("mmap ring"); close(); return false; }
+        _base = static_cast<uint8_t*>(p);
+        _hdr = new (_base) HsmRingHeader();
+        _hdr->magic = HSM_RING_MAGIC;
+        _hdr->sq_entries = entries;
+        _hdr->cq_entries = entries;
+        _hdr->arena_off = _layout.arena_off;
+        _hdr->arena_bytes = arena_bytes;
+        _sq = reinterpret_cast<HsmSqe*>(_base + _layout.sq_off);
+        _cq = reinterpret_cast<HsmCqe*>(_base + _layout.cq_off);
+        _sq_mask = _cq_mask = entries - 1;
+
+        _sq_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+        _cq_fd = eventfd(0, EFD_CLOEXEC);
+        if (_sq_fd < 0 || _cq_fd < 0) { perror("eventfd"); close(); return false; }
+        HsmStatus st = conn.attachRing(_mem_fd, _sq_fd, _cq_fd);
+        if (st != HsmStatus::OK) {
+            fprintf(stderr, "[ERROR] RING_ATTACH: %s\n", hsm_status_str(st));
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+        if (_base) munmap(_base, _layout.total);
+        if (_mem_fd >= 0) ::close(_mem_fd);
+        if (_sq_fd >= 0) ::close(_sq_fd);
+        if (_cq_fd >= 0) ::close(_cq_fd);
+        _base = nullptr;
+        _hdr = nullptr;
+        _mem_fd = _sq_fd = _cq_fd = -1;
+        _sq_local = 0;
+    }
+
+    bool isOpen() const { return _base != nullptr; }
+    uint8_t* arena() { return _base + _layout.arena_off; }
+    size_t arenaBytes() const { return _hdr ? (size_t)_hdr->arena_bytes : 0; }
+    uint32_t entries() const { return _sq_mask + 1; }
+    uint64_t doorbells() const { return _doorbells; }
+    uint64_t sleeps() const { return _sleeps; }
+
+    // free SQ slots, counting unflushed submissions
+    uint32_t sqSpace() const {
+        return entries() - (_sq_local - _hdr->sq_head.load(std::memory_order_acquire));
+    }
+
+    /**
+    * @brief Queue one descriptor (not visible to hsmd until flush())
+    * @return false when the SQ is full
+    */
+    bool submit(uint64_t user_data, AesKeyHandle key, size_t src, size_t dst, uint32_t blocks) {
+        if (!sqSpace()) return false;
+        HsmSqe& e = _sq[_sq_local & _sq_mask];
+        e.user_data = user_data;
+        e.key = key;
+        e.blocks = blocks;
+        e.src = src;
+        e.dst = dst;
+        _sq_local++;
+        return true;
+    }
+
+    // publish everything submitted; doorbell only if hsmd is asleep
+    void flush() {
+        _hdr->sq_tail.store(_sq_local, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (_hdr->flags.load(std::memory_order_relaxed) & RING_SQ_WAKEUP) {
+            uint64_t one = 1;
+            if (::write(_sq_fd, &one, sizeof(one)) < 0 && errno != EAGAIN) perror("ring doorbell");
+            _doorbells++;
+        }
+    }
+
+    // completions available now, no syscalls
+    uint32_t reap(HsmCqe* out, uint32_t max) {
+        uint32_t head = _hdr->cq_head.load(std::memory_order_relaxed);
+        uint32_t tail = _hdr->cq_tail.load(std::memory_order_acquire);
+        uint32_t n = 0;
+        while (head != tail && n < max) out[n++] = _cq[head++ & _cq_mask];
+        _hdr->cq_head.store(head, std::memory_order_release);
+        return n;
+    }
+
+    /**
+    * @brief At least one completion: spin HSM_RING_SPIN polls, then sleep on the CQ eventfd
+    * @return completions copied to out, 0 on timeout
+    */
+    uint32_t wait(HsmCqe* out, uint32_t max, int timeout_ms = 1000) {
+        for (uint32_t i = 0; i < HSM_RING_SPIN; i++) {
+            if (uint32_t n = reap(out, max)) return n;
+        }
+        while (true) {
+            _hdr->flags.fetch_or(RING_CQ_WAIT, std::memory_order_seq_cst);
+            if (uint32_t n = reap(out, max)) {
+                _hdr->flags.fetch_and(~RING_CQ_WAIT, std::memory_order_relaxed);
+                return n;
+            }
+            _sleeps++;
+            struct pollfd pfd = { _cq_fd, POLLIN, 0 };
+            int r = ::poll(&pfd, 1, timeout_ms);
+            _hdr->flags.fetch_and(~RING_CQ_WAIT, std::memory_order_relaxed);
+            if (r < 0 && errno == EINTR) continue;
+            if (r <= 0) return reap(out, max);
+            uint64_t v;
+            if (::read(_cq_fd, &v, sizeof(v)) < 0) perror("ring cq read");
+            if (uint32_t n = reap(out, max)) return n;
+        }
+    }
+};
@@ -0,0 +1,346 @@
+/**
+* @file     hsm_stat.cpp
+* @brief    Reads the hsm_telemetry.h segments of running driver processes
+* @details  Maps every /dev/shm/hsm_tel.<pid> read-only and sums its thread slots; the
+*           writers are never signalled, locked or otherwise disturbed. Percentiles come
+*           from the log-linear buckets (<= 12.5% high), mean and max are exact.
+*
+* --watch prints per-interval deltas and rates instead of totals since process start.
+* --prom writes Prometheus text exposition (node_exporter textfile collector): one
+* histogram per metric with power-of-two `le` bounds, one counter per event, labelled by
+* pid and comm; rewritten every interval with --watch, atomically via rename.
+*
+* Usage: hsm_stat [--pid N] [--threads] [--watch SEC] [--prom FILE] [--clean]
+*   --clean  unlink segments left behind by processes that died without exiting
+*/
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hsm_telemetry.h"
+
+constexpr const char* SHM_DIR      = "/dev/shm";
+constexpr int         PROM_MIN_LG  = 6;     // le = 64ns ...
+constexpr int         PROM_MAX_LG  = 34;    // ... 17s, then +Inf
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_stop(int) { g_stop = 1; }
+
+// Snapshot =======================================
+struct Hist : HsmHistogram<HSM_TEL_BUCKETS> {
+    void add(const HsmTelHist& h) {
+        count += h.count.load(std::memory_order_relaxed);
+        sum   += h.sum_ns.load(std::memory_order_relaxed);
+        max    = std::max(max, h.max_ns.load(std::memory_order_relaxed));
+        for (int i = 0; i < HSM_TEL_BUCKETS; i++) buckets[i] += h.buckets[i].load(std::memory_order_relaxed);
+    }
+
+    // this minus an earlier snapshot; max stays the all-time max
+    Hist since(const Hist& prev) const {
+        Hist d = *this;
+        d.count -= prev.count;
+        d.sum -= prev.sum;
+        for (int i = 0; i < HSM_TEL_BUCKETS; i++) d.buckets[i] -= prev.buckets[i];
+        return d;
+    }
+
+    // samples <= 2^lg - 1 ns; exact, bucket edges fall on powers of two
+    uint64_t below_pow2(int lg) const {
+        uint64_t n = 0;
+        for (int i = 0; i < HSM_TEL_BUCKETS && HsmHist::upper(i) < (1ull << lg); i++) n += buckets[i];
+        return n;
+    }
+};
+
+struct Snapshot {
+    Hist     hist[HSM_TEL_METRICS];
+    uint64_t counters[HSM_TEL_COUNTERS] = {};
+
+    void add(const HsmTelSlot& s) {
+        for (int m = 0; m < HSM_TEL_METRICS; m++) hist[m].add(s.hist[m]);
+        for (int c = 0; c < HSM_TEL_COUNTERS; c++) counters[c] += s.counters[c].load(std::memory_order_relaxed);
+    }
+};
+
+struct ThreadSnap {
+    int         slot;
+    uint32_t    tid;
+    uint32_t    state;
+    std::string name;
+    Snapshot    snap;
+};
+
+struct Process {
+    int   pid = 0;
+    bool  alive = false;
+    std::string comm, shm_name;
+    const HsmTelSegment* seg = nullptr;
+    Snapshot total, prev;
+    std::vector<ThreadSnap> threads;
+
+    void sample() {
+        total = Snapshot{};
+        threads.clear();
+        for (uint32_t i = 0; i < std::min<uint32_t>(seg->slots, HSM_TEL_SLOTS); i++) {
+            const HsmTelSlot& s = seg->slot[i];
+            uint32_t state = s.state.load(std::memory_order_acquire);
+            if (state == TEL_FREE) continue;
+            ThreadSnap t{ (int)i, s.tid, state, std::string(s.name, strnlen(s.name, sizeof(s.name))), {} };
+            t.snap.add(s);
+            total.add(s);
+            threads.push_back(std::move(t));
+        }
+        alive = kill(pid, 0) == 0 || errno == EPERM;
+    }
+};
+
+// Segments =======================================
+static const HsmTelSegment* map_segment(const std::string& name) {
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    void* p = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size == sizeof(HsmTelSegment))
+        p = mmap(nullptr, sizeof(HsmTelSegment), PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return nullptr;
+    auto* seg = static_cast<const HsmTelSegment*>(p);
+    if (seg->magic != HSM_TEL_MAGIC || seg->version != HSM_TEL_VERSION) {
+        munmap(p, sizeof(HsmTelSegment));
+        return nullptr;
+    }
+    return seg;
+}
+
+// every segment in SHM_DIR (or only pid's), oldest pid first
+static std::vector<Process> find_segments(int only_pid) {
+    std::vector<Process> out;
+    DIR* d = opendir(SHM_DIR);
+    if (!d) {
+        perror("[ERROR] opendir /dev/shm");
+        return out;
+    }
+    const char* prefix = HSM_TEL_PREFIX + 1;
+    while (struct dirent* e = readdir(d)) {
+        if (strncmp(e->d_name, prefix, strlen(prefix)) != 0) continue;
+        int pid = atoi(e->d_name + strlen(prefix));
+        if (pid <= 0 || (only_pid && pid != only_pid)) continue;
+        Process p;
+        p.pid = pid;
+        p.shm_name = std::string("/") + e->d_name;
+        errno = 0;
+        p.seg = map_segment(p.shm_name);
+        if (!p.seg && errno == EACCES) {
+            fprintf(stderr, "    [WARN] %s: segment is 0600, run hsm_stat as its owner (sudo)\n", e->d_name);
+            continue;
+        }
+        if (!p.seg) {
+            fprintf(stderr, "    [WARN] %s: not a version %u telemetry segment, skipped\n", e->d_name, HSM_TEL_VERSION);
+            continue;
+        }
+        p.comm = std::string(p.seg->comm, strnlen(p.seg->comm, sizeof(p.seg->comm)));
+        out.push_back(std::move(p));
+    }
+    closedir(d);
+    std::sort(out.begin(), out.end(), [](const Process& a, const Process& b) { return a.pid < b.pid; });
+    return out;
+}
+
+// Text report =======================================
+static void print_hist_header() {
+    printf("    %-14s %12s %10s %10s %10s %10s %10s\n", "metric", "count", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+}
+
+static void print_hists(const Snapshot& s, double secs) {
+    for (int m = 0; m < HSM_TEL_METRICS; m++) {
+        const Hist& h = s.hist[m];
+        if (!h.count) continue;
+        printf("    %-14s %12llu %10.2f %10.2f %10.2f %10.2f %10.2f", hsm_metric_name(m), (unsigned long long)h.count,
+               h.mean() / 1e3, h.percentile(0.50) / 1e3, h.percentile(0.99) / 1e3,
+               h.percentile(0.999) / 1e3, h.max / 1e3);
+        if (secs > 0) printf("  %10.0f/s", h.count / secs);
+        printf("\n");
+    }
+}
+
+static void print_counters(const Snapshot& s, double secs) {
+    for (int c = 0; c < HSM_TEL_COUNTERS; c++) {
+        if (!s.counters[c]) continue;
+        printf("    %-14s %12llu", hsm_counter_name(c), (unsigned long long)s.counters[c]);
+        if (secs > 0) printf("  %10.0f/s", s.counters[c] / secs);
+        printf("\n");
+    }
+}
+
+static Snapshot delta(const Snapshot& now, const Snapshot& prev) {
+    Snapshot d;
+    for (int m = 0; m < HSM_TEL_METRICS; m++) d.hist[m] = now.hist[m].since(prev.hist[m]);
+    for (int c = 0; c < HSM_TEL_COUNTERS; c++) d.counters[c] = now.counters[c] - prev.counters[c];
+    return d;
+}
+
+static void print_process(const Process& p, bool per_thread, double interval) {
+    size_t live = std::count_if(p.threads.begin(), p.threads.end(), [](const ThreadSnap& t) { return t.state == TEL_LIVE; });
+    printf("\n[%d] %s%s  %zu thread slot(s), %zu live\n", p.pid, p.comm.c_str(), p.alive ? "" : " (dead)",
+           p.threads.size(), live);
+    Snapshot shown = interval > 0 ? delta(p.total, p.prev) : p.total;
+    print_hist_header();
+    print_hists(shown, interval);
+    print_counters(shown, interval);
+    if (!per_thread || interval > 0) return;
+    for (const ThreadSnap& t : p.threads) {
+        printf("  -- slot %d tid %u %s%s\n", t.slot, t.tid, t.name.c_str(), t.state == TEL_EXITED ? " (exited)" : "");
+        print_hists(t.snap, 0);
+        print_counters(t.snap, 0);
+    }
+}
+
+// Prometheus =======================================
+static void prom_escape(FILE* f, const std::string& s) {
+    for (char c : s) {
+        if (c == '\\' || c == '"') fputc('\\', f);
+        if (c == '\n') { fputs("\\n", f); continue; }
+        fputc(c, f);
+    }
+}
+
+static bool write_prom(const std::string& path, const std::vector<Process>& procs) {
+    std::string tmp = path + ".tmp";
+    FILE* f = fopen(tmp.c_str(), "w");
+    if (!f) {
+        perror("[ERROR] open prom file");
+        return false;
+    }
+    auto labels = [f](const Process& p) {
+        fprintf(f, "pid=\"%d\",comm=\"", p.pid);
+        prom_escape(f, p.comm);
+        fputc('"', f);
+    };
+    for (int m = 0; m < HSM_TEL_METRICS; m++) {
+        fprintf(f, "# HELP hsm_%s_seconds %s latency from hsm_telemetry.h\n", hsm_metric_name(m), hsm_metric_name(m));
+        fprintf(f, "# TYPE hsm_%s_seconds histogram\n", hsm_metric_name(m));
+        for (const Process& p : procs) {
+            const Hist& h = p.total.hist[m];
+            for (int lg = PROM_MIN_LG; lg <= PROM_MAX_LG; lg++) {
+                fprintf(f, "hsm_%s_seconds_bucket{", hsm_metric_name(m));
+                labels(p);
+                fprintf(f, ",le=\"%.9g\"} %llu\n", (double)(1ull << lg) / 1e9, (unsigned long long)h.below_pow2(lg));
+            }
+            fprintf(f, "hsm_%s_seconds_bucket{", hsm_metric_name(m));
+            labels(p);
+            fprintf(f, ",le=\"+Inf\"} %llu\n", (unsigned long long)h.count);
+            fprintf(f, "hsm_%s_seconds_sum{", hsm_metric_name(m));
+            labels(p);
+            fprintf(f, "} %.9f\n", h.sum / 1e9);
+            fprintf(f, "hsm_%s_seconds_count{", hsm_metric_name(m));
+            labels(p);
+            fprintf(f, "} %llu\n", (unsigned long long)h.count);
+        }
+    }
+    for (int c = 0; c < HSM_TEL_COUNTERS; c++) {
+        fprintf(f, "# TYPE hsm_%s_total counter\n", hsm_counter_name(c));
+        for (const Process& p : procs) {
+            fprintf(f, "hsm_%s_total{", hsm_counter_name(c));
+            labels(p);
+            fprintf(f, "} %llu\n", (unsigned long long)p.total.counters[c]);
+        }
+    }
+    bool ok = fflush(f) == 0 && fsync(fileno(f)) == 0;
+    ok = fclose(f) == 0 && ok;
+    if (!ok || rename(tmp.c_str(), path.c_str()) != 0) {
+        perror("[ERROR] write prom file");
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    int only_pid = 0;
+    bool per_thread = false, clean = false;
+    double watch = 0;
+    std::string prom;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--pid" && a + 1 < argc)        only_pid = atoi(argv[++a]);
+        else if (arg == "--threads")               per_thread = true;
+        else if (arg == "--watch" && a + 1 < argc) watch = atof(argv[++a]);
+        else if (arg == "--prom" && a + 1 < argc)  prom = argv[++a];
+        else if (arg == "--clean")                 clean = true;
+        else {
+            fprintf(stderr, "Usage: %s [--pid N] [--threads] [--watch SEC] [--prom FILE] [--clean]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Process> procs = find_segments(only_pid);
+
+    if (clean) {
+        int removed = 0;
+        for (Process& p : procs) {
+            p.sample();
+            if (p.alive) continue;
+            if (shm_unlink(p.shm_name.c_str()) == 0) removed++;
+            else perror("[ERROR] shm_unlink");
+        }
+        printf("Removed %d stale segment(s)\n", removed);
+        return EXIT_SUCCESS;
+    }
+
+    if (procs.empty()) {
+        fprintf(stderr, "No telemetry segments in %s%s\n", SHM_DIR,
+                only_pid ? (" for pid " + std::to_string(only_pid)).c_str() : "");
+        return EXIT_FAILURE;
+    }
+
+    if (watch <= 0) {
+        for (Process& p : procs) {
+            p.sample();
+            print_process(p, per_thread, 0);
+        }
+        return prom.empty() || write_prom(prom, procs) ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // --watch: rescan each interval so processes started later show up
+    signal(SIGINT, on_stop);
+    signal(SIGTERM, on_stop);
+    for (Process& p : procs) p.sample();
+    auto period = std::chrono::microseconds((int64_t)(watch * 1e6));
+    auto last = std::chrono::steady_clock::now();
+    while (!g_stop) {
+        std::this_thread::sleep_for(period);
+        if (g_stop) break;
+        auto now = std::chrono::steady_clock::now();
+        double secs = std::chrono::duration<double>(now - last).count();
+        last = now;
+
+        std::vector<Process> next = find_segments(only_pid);
+        for (Process& n : next) {
+            auto old = std::find_if(procs.begin(), procs.end(), [&](const Process& p) { return p.pid == n.pid; });
+            if (old != procs.end()) n.prev = old->total;
+            n.sample();
+        }
+        for (Process& p : procs) munmap((void*)p.seg, sizeof(HsmTelSegment));
+        procs = std::move(next);
+
+        printf("\n==== %.1fs interval ====", secs);
+        if (procs.empty()) printf("\n    no telemetry segments\n");
+        for (const Process& p : procs) print_process(p, per_thread, secs);
+        fflush(stdout);
+        if (!prom.empty()) write_prom(prom, procs);
+    }
+    return EXIT_SUCCESS;
+}
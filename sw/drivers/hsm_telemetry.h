@@ -0,0 +1,307 @@
+/**
+* @file     hsm_telemetry.h
+* @brief    Hot-path telemetry: per-thread lock-free latency histograms + counters in shared memory
+* @details  Every process that records gets one POSIX shm segment, /hsm_tel.<pid>, holding
+*           HSM_TEL_SLOTS thread slots. A thread claims a slot on its first record and is
+*           then its only writer (relaxed atomics on its own cache lines, no locks, no
+*           syscalls); hsm_stat maps the segment read-only and sums the slots, so reading
+*           never touches the writers. The segment is unlinked at exit.
+*
+* The segment is created 0600: slot names and latency timing are per-operation side
+* information, so only the driver's own user (root for the hw drivers) and hsm_stat run
+* as that user can map it.
+*
+* Histograms are log-linear (HDR style): exact below HsmHist::SUB ns, then HsmHist::SUB
+* sub-buckets per power of two (<= 12.5% error), same bucketing as hsmd's HsmLatency.
+*
+* Build with -DHSM_TELEMETRY=0 to compile every hook out.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef HSM_TELEMETRY
+#define HSM_TELEMETRY 1
+#endif
+
+// Log-linear buckets =======================================
+namespace HsmHist {
+    constexpr int SUB = 8;
+
+    inline int bucket(uint64_t ns) {
+        if (ns < (uint64_t)SUB) return (int)ns;
+        int lg = 63 - __builtin_clzll(ns);
+        return (lg - 2) * SUB + (int)((ns >> (lg - 3)) & (SUB - 1));
+    }
+
+    // largest value that lands in bucket i
+    inline uint64_t upper(int i) {
+        if (i < SUB) return (uint64_t)i;
+        int lg = i / SUB + 2;
+        return ((uint64_t)(SUB + i % SUB) << (lg - 3)) + ((1ull << (lg - 3)) - 1);
+    }
+}
+
+// N HsmHist buckets + count / sum / exact max, single writer; values past the last bucket
+// land in it. Unit-free: ns for latencies, fabric cycles in trng_profile.h.
+template <int N>
+struct HsmHistogram {
+    static constexpr int BUCKETS = N;
+    uint64_t count = 0;
+    uint64_t sum   = 0;
+    uint64_t max   = 0;
+    uint64_t buckets[N] = {};
+
+    void record(uint64_t v) {
+        int b = HsmHist::bucket(v);
+        buckets[b < N ? b : N - 1]++;
+        count++;
+        sum += v;
+        if (v > max) max = v;
+    }
+
+    double mean() const { return count ? (double)sum / count : 0; }
+
+    // q in [0, 1]; bucket upper bound (<= 12.5% high), capped by the exact max
+    uint64_t percentile(double q) const {
+        if (!count) return 0;
+        uint64_t rank = (uint64_t)std::ceil(q * count), seen = 0;
+        if (rank == 0) rank = 1;
+        for (int i = 0; i < N; i++) {
+            seen += buckets[i];
+            if (seen >= rank) return std::min(HsmHist::upper(i), max);
+        }
+        return max;
+    }
+};
+
+// Metrics =======================================
+enum class HsmMetric : uint8_t {
+    KEY_LOAD,           // AesDriver KEY_W writes + expansion wait
+    BLOCK_ENCRYPT,      // AesDriver::encrypt(), one block
+    BULK_ENCRYPT,       // AesDriver::encryptBulk(), whole call
+    TRNG_WORD,          // PynqHSM::sampleWord() handshake
+    STATUS_POLL,        // Completion::wait() when the policy is timed
+    COUNT
+};
+
+enum class HsmCounter : uint8_t {
+    POLL_ITERS,         // STATUS / SAMPLE_CNT reads inside waits
+    WAIT_TIMEOUTS,      // any Completion timeout
+    TRNG_TIMEOUTS,      // sampleWord() failures (getTrngRandom() -> 0xFFFFFFFF)
+    HEALTH_FAILS,       // checkHealth() false, or an entropy pool batch rejected
+    KEY_RELOADS,        // key cache misses that evicted another key
+    KEY_HITS,           // key already resident, expansion skipped
+    BLOCKS,             // blocks through the AES core
+    TRNG_WORDS,         // words sampled
+    COUNT
+};
+
+constexpr int HSM_TEL_METRICS  = (int)HsmMetric::COUNT;
+constexpr int HSM_TEL_COUNTERS = (int)HsmCounter::COUNT;
+
+inline const char* hsm_metric_name(int m) {
+    static const char* const names[HSM_TEL_METRICS] = { "key_load", "block_encrypt", "bulk_encrypt", "trng_word", "status_poll" };
+    return m >= 0 && m < HSM_TEL_METRICS ? names[m] : "?";
+}
+
+inline const char* hsm_counter_name(int c) {
+    static const char* const names[HSM_TEL_COUNTERS] = { "poll_iters", "wait_timeouts", "trng_timeouts", "health_fails",
+                                                         "key_reloads", "key_hits", "aes_blocks", "trng_words" };
+    return c >= 0 && c < HSM_TEL_COUNTERS ? names[c] : "?";
+}
+
+// Segment layout =======================================
+constexpr uint32_t    HSM_TEL_MAGIC   = 0x4C455448;    // "HTEL"
+constexpr uint32_t    HSM_TEL_VERSION = 1;
+constexpr int         HSM_TEL_SLOTS   = 32;            // the last one is shared once the rest are taken
+constexpr int         HSM_TEL_BUCKETS = 38 * HsmHist::SUB;     // up to 2^40 ns (~18 min), larger clamps
+constexpr const char* HSM_TEL_PREFIX  = "/hsm_tel.";
+
+enum HsmTelSlotState : uint32_t { TEL_FREE = 0, TEL_LIVE = 1, TEL_EXITED = 2 };
+
+struct HsmTelHist {
+    std::atomic<uint64_t> count;
+    std::atomic<uint64_t> sum_ns;
+    std::atomic<uint64_t> max_ns;
+    std::atomic<uint64_t> buckets[HSM_TEL_BUCKETS];
+};
+
+struct alignas(64) HsmTelSlot {
+    std::atomic<uint32_t> state;
+    uint32_t tid;
+    char     name[16];              // thread name at claim time
+    alignas(64) std::atomic<uint64_t> counters[HSM_TEL_COUNTERS];
+    HsmTelHist hist[HSM_TEL_METRICS];
+};
+
+struct HsmTelSegment {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t pid;
+    uint32_t slots;
+    uint64_t start_unix_ns;
+    char     comm[32];
+    HsmTelSlot slot[HSM_TEL_SLOTS];
+};
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "telemetry counters must be lock free in shared memory");
+
+// Writer =======================================
+namespace hsm_tel_detail {
+
+// process-wide segment, created on first use and unlinked at exit (never unmapped:
+// late-exiting threads may still record)
+class Segment {
+private:
+    HsmTelSegment* _seg = nullptr;
+    char _name[40] = {};
+    bool _shared = false;
+
+public:
+    Segment() {
+        snprintf(_name, sizeof(_name), "%s%d", HSM_TEL_PREFIX, (int)getpid());
+        void* p = MAP_FAILED;
+        int fd = shm_open(_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+        if (fd < 0 && errno == EEXIST) {
+            // stale segment from a dead process that had our pid
+            shm_unlink(_name);
+            fd = shm_open(_name, O_CREAT | O_EXCL | O_RDWR | O_CLOEXEC, 0600);
+        }
+        if (fd >= 0) {
+            if (ftruncate(fd, sizeof(HsmTelSegment)) == 0)
+                p = mmap(nullptr, sizeof(HsmTelSegment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+            close(fd);
+            if (p == MAP_FAILED) shm_unlink(_name);
+            else _shared = true;
+        }
+        // no /dev/shm: keep recording in private memory, just nothing for hsm_stat to read
+        if (p == MAP_FAILED) p = mmap(nullptr, sizeof(HsmTelSegment), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) return;
+
+        _seg = static_cast<HsmTelSegment*>(p);      // zero filled by ftruncate / MAP_ANONYMOUS
+        _seg->version = HSM_TEL_VERSION;
+        _seg->pid = (uint32_t)getpid();
+        _seg->slots = HSM_TEL_SLOTS;
+        _seg->start_unix_ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::system_clock::now().time_since_epoch()).count();
+        FILE* f = fopen("/proc/self/comm", "r");
+        if (f) {
+            if (fgets(_seg->comm, sizeof(_seg->comm), f)) _seg->comm[strcspn(_seg->comm, "\n")] = 0;
+            fclose(f);
+        }
+        std::atomic_thread_fence(std::memory_order_release);
+        _seg->magic = HSM_TEL_MAGIC;                // readers check this last
+    }
+
+    ~Segment() {
+        if (_shared) shm_unlink(_name);
+    }
+
+    HsmTelSegment* get() const { return _seg; }
+    const char* name() const { return _shared ? _name : nullptr; }
+};
+
+inline Segment& segment() {
+    static Segment s;
+    return s;
+}
+
+// claim a free slot, else one whose thread exited, else share the last one
+inline HsmTelSlot* claim() {
+    HsmTelSegment* seg = segment().get();
+    if (!seg) return nullptr;
+    const uint32_t from[2] = { TEL_FREE, TEL_EXITED };
+    for (uint32_t f : from) {
+        for (int i = 0; i < HSM_TEL_SLOTS - 1; i++) {
+            uint32_t expect = f;
+            HsmTelSlot& s = seg->slot[i];
+            if (s.state.compare_exchange_strong(expect, TEL_LIVE, std::memory_order_acq_rel)) {
+                s.tid = (uint32_t)syscall(SYS_gettid);
+                memset(s.name, 0, sizeof(s.name));
+                pthread_getname_np(pthread_self(), s.name, sizeof(s.name));
+                return &s;
+            }
+        }
+    }
+    HsmTelSlot& shared = seg->slot[HSM_TEL_SLOTS - 1];
+    uint32_t expect = TEL_FREE;
+    if (shared.state.compare_exchange_strong(expect, TEL_LIVE, std::memory_order_acq_rel)) strcpy(shared.name, "(shared)");
+    return &shared;
+}
+
+struct ThreadSlot {
+    HsmTelSlot* slot = claim();
+    ~ThreadSlot() {
+        if (slot && slot != &segment().get()->slot[HSM_TEL_SLOTS - 1])
+            slot->state.store(TEL_EXITED, std::memory_order_release);
+    }
+};
+
+inline HsmTelSlot* this_thread() {
+    thread_local ThreadSlot ts;
+    return ts.slot;
+}
+
+} // namespace hsm_tel_detail
+
+#if HSM_TELEMETRY
+
+inline void hsm_tel_count(HsmCounter c, uint64_t n = 1) {
+    if (HsmTelSlot* s = hsm_tel_detail::this_thread()) s->counters[(int)c].fetch_add(n, std::memory_order_relaxed);
+}
+
+inline void hsm_tel_record(HsmMetric m, uint64_t ns) {
+    HsmTelSlot* s = hsm_tel_detail::this_thread();
+    if (!s) return;
+    HsmTelHist& h = s->hist[(int)m];
+    int b = HsmHist::bucket(ns);
+    h.buckets[b < HSM_TEL_BUCKETS ? b : HSM_TEL_BUCKETS - 1].fetch_add(1, std::memory_order_relaxed);
+    h.count.fetch_add(1, std::memory_order_relaxed);
+    h.sum_ns.fetch_add(ns, std::memory_order_relaxed);
+    uint64_t mx = h.max_ns.load(std::memory_order_relaxed);
+    while (ns > mx && !h.max_ns.compare_exchange_weak(mx, ns, std::memory_order_relaxed)) {}
+}
+
+// times a scope into one histogram
+class HsmTelTimer {
+private:
+    HsmMetric _m;
+    std::chrono::steady_clock::time_point _t0;
+
+public:
+    explicit HsmTelTimer(HsmMetric m) : _m(m), _t0(std::chrono::steady_clock::now()) {}
+    ~HsmTelTimer() {
+        hsm_tel_record(_m, (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                               std::chrono::steady_clock::now() - _t0).count());
+    }
+};
+
+// shm name hsm_stat will find, nullptr when only private memory was available
+inline const char* hsm_tel_segment_name() { return hsm_tel_detail::segment().name(); }
+
+#else
+
+inline void hsm_tel_count(HsmCounter, uint64_t = 1) {}
+inline void hsm_tel_record(HsmMetric, uint64_t) {}
+class HsmTelTimer {
+public:
+    explicit HsmTelTimer(HsmMetric) {}
+};
+inline const char* hsm_tel_segment_name() { return nullptr; }
+
+#endif
@@ -0,0 +1,219 @@
+/**
+* @file     hsm_wait.h
+* @brief    Completion waiting shared by the AES and TRNG drivers
+* @details  One wait = spin -> back off -> (optional) block on interrupt.
+*
+* 1. spin:    poll the predicate up to spin_iters times (lowest latency)
+* 2. backoff: sched_yield() or nanosleep(sleep_ns) between polls (frees the core)
+* 3. irq:     if irq_fd >= 0, block in poll() on a UIO fd instead of backing off
+*
+* UIO protocol: write uint32 1 to unmask, poll for POLLIN, read uint32 event count.
+* SoftIrq speaks the same protocol over a socketpair so policies can be exercised
+* off-board (the current bitstream has no interrupt lines wired to the PS).
+*/
+
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#include "hsm_telemetry.h"
+
+enum class Backoff : uint8_t { YIELD, SLEEP };
+
+// Policy =======================================
+struct WaitPolicy {
+    uint32_t spin_iters = 64;        // predicate polls before backing off
+    Backoff  backoff    = Backoff::YIELD;
+    uint32_t sleep_ns   = 2000;      // per backoff step when backoff == SLEEP
+    int      irq_fd     = -1;        // UIO (or SoftIrq) fd, used after the spin phase
+    uint32_t timeout_us = 1000000;
+    bool     timed      = true;      // record latency (two clock reads per wait)
+
+    // poll hard, never give up the core
+    static WaitPolicy lowLatency() {
+        WaitPolicy p;
+        p.spin_iters = 1u << 20;
+        return p;
+    }
+    // short spin covers the common case, then yield
+    static WaitPolicy balanced() { return WaitPolicy{}; }
+
+    // a few polls then sleep (or interrupt if one is given)
+    static WaitPolicy lowCpu(int irq_fd = -1) {
+        WaitPolicy p;
+        p.spin_iters = 4;
+        p.backoff    = Backoff::SLEEP;
+        p.sleep_ns   = 20000;
+        p.irq_fd     = irq_fd;
+        return p;
+    }
+
+    static bool parse(const char* name, WaitPolicy& out) {
+        std::string n = name;
+        if (n == "latency")  { out = lowLatency(); return true; }
+        if (n == "balanced") { out = balanced();   return true; }
+        if (n == "cpu")      { out = lowCpu();     return true; }
+        return false;
+    }
+};
+
+// Stats =======================================
+struct WaitStats {
+    uint64_t waits        = 0;
+    uint64_t spin_done    = 0;   // completed inside the spin budget
+    uint64_t backoff_done = 0;   // completed after yield/sleep
+    uint64_t irq_done     = 0;   // completed after an interrupt wakeup
+    uint64_t timeouts     = 0;
+    uint64_t polls        = 0;   // predicate evaluations (= STATUS / SAMPLE_CNT reads)
+    uint64_t backoffs     = 0;   // sched_yield / nanosleep calls
+    uint64_t irqs         = 0;   // interrupt events read from irq_fd
+    uint64_t total_ns     = 0;   // timed waits only
+    uint64_t max_ns       = 0;
+
+    void reset() { *this = WaitStats{}; }
+
+    void print(const char* op) const {
+        printf("    %-10s waits=%llu spin=%llu backoff=%llu irq=%llu timeout=%llu "
+               "polls/wait=%.1f avg=%.2fus max=%.2fus\n",
+               op, (unsigned long long)waits, (unsigned long long)spin_done,
+               (unsigned long long)backoff_done, (unsigned long long)irq_done,
+               (unsigned long long)timeouts, waits ? (double)polls / waits : 0.0,
+               waits ? total_ns / 1e3 / waits : 0.0, max_ns / 1e3);
+    }
+};
+
+// Completion =======================================
+// one per operation type (key load, encrypt, TRNG sample), so stats stay separate
+class Completion {
+public:
+    WaitPolicy policy;
+    WaitStats  stats;
+
+    Completion() = default;
+    explicit Completion(const WaitPolicy& p) : policy(p) {}
+
+    template <class Pred>
+    bool wait(Pred&& done) {
+        using clock = std::chrono::steady_clock;
+        stats.waits++;
+        _polls0 = stats.polls;
+        clock::time_point t0;
+        if (policy.timed) t0 = clock::now();
+
+        // 1. spin
+        for (uint32_t i = 0; i < policy.spin_iters; i++) {
+            stats.polls++;
+            if (done()) { stats.spin_done++; return finish(t0, true); }
+        }
+
+        if (!policy.timed) t0 = clock::now();
+        auto deadline = t0 + std::chrono::microseconds(policy.timeout_us);
+
+        // 3. interrupt
+        if (policy.irq_fd >= 0) {
+            while (true) {
+                uint32_t unmask = 1;
+                if (::write(policy.irq_fd, &unmask, sizeof(unmask)) < 0 && errno != EAGAIN) break;
+                // re-check after unmask so an edge between spin and arm is not lost
+                stats.polls++;
+                if (done()) { stats.irq_done++; return finish(t0, true); }
+
+                auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now()).count();
+                if (left < 0) return timeout(t0);
+                struct pollfd pfd = { policy.irq_fd, POLLIN, 0 };
+                int rc = ::poll(&pfd, 1, (int)left + 1);
+                if (rc < 0 && errno != EINTR) break;
+                if (rc > 0) {
+                    uint32_t count;
+                    if (::read(policy.irq_fd, &count, sizeof(count)) == sizeof(count)) stats.irqs++;
+                }
+                stats.polls++;
+                if (done()) { stats.irq_done++; return finish(t0, true); }
+                if (clock::now() >= deadline) return timeout(t0);
+            }
+            // fd broken - fall through to backoff
+        }
+
+        // 2. backoff
+        struct timespec ts = { 0, (long)policy.sleep_ns };
+        while (true) {
+            stats.polls++;
+            if (done()) { stats.backoff_done++; return finish(t0, true); }
+            if (clock::now() >= deadline) return timeout(t0);
+            stats.backoffs++;
+            if (policy.backoff == Backoff::YIELD) sched_yield();
+            else nanosleep(&ts, nullptr);
+        }
+    }
+
+private:
+    uint64_t _polls0 = 0;
+
+    // telemetry gets one counter add per wait, not per poll
+    bool finish(std::chrono::steady_clock::time_point t0, bool ok) {
+        hsm_tel_count(HsmCounter::POLL_ITERS, stats.polls - _polls0);
+        if (policy.timed) {
+            uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              std::chrono::steady_clock::now() - t0).count();
+            stats.total_ns += ns;
+            if (ns > stats.max_ns) stats.max_ns = ns;
+            hsm_tel_record(HsmMetric::STATUS_POLL, ns);
+        }
+        return ok;
+    }
+
+    bool timeout(std::chrono::steady_clock::time_point t0) {
+        stats.timeouts++;
+        hsm_tel_count(HsmCounter::WAIT_TIMEOUTS);
+        finish(t0, false);
+        return false;
+    }
+};
+
+// SoftIrq =======================================
+// software stand-in for /dev/uioN: fd() goes in WaitPolicy::irq_fd, fire() plays the device
+class SoftIrq {
+private:
+    int _fds[2] = { -1, -1 };   // [0] waiter side, [1] device side
+    uint32_t _count = 0;
+    uint64_t _unmasks = 0;
+
+public:
+    ~SoftIrq() { close(); }
+
+    bool open() {
+        // seqpacket keeps the 4-byte UIO message boundaries
+        if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, _fds) < 0) { perror("socketpair"); return false; }
+        fcntl(_fds[0], F_SETFL, O_NONBLOCK);
+        fcntl(_fds[1], F_SETFL, O_NONBLOCK);
+        return true;
+    }
+
+    void close() {
+        for (int& fd : _fds) { if (fd >= 0) ::close(fd); fd = -1; }
+    }
+
+    int fd() const { return _fds[0]; }
+
+    // raise the interrupt: drain unmask writes, post the running event count
+    void fire() {
+        uint32_t buf[64];
+        ssize_t n;
+        while ((n = ::read(_fds[1], buf, sizeof(buf))) > 0) _unmasks += n / sizeof(uint32_t);
+        _count++;
+        if (::write(_fds[1], &_count, sizeof(_count)) < 0) perror("SoftIrq write");
+    }
+
+    uint32_t count() const { return _count; }
+    uint64_t unmasks() const { return _unmasks; }
+};
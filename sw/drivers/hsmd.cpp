@@ -0,0 +1,110 @@
+/**
+* @file     hsmd.cpp
+* @brief    HSM service daemon: sole owner of the AES core and TRNG, shared over a Unix socket
+* @details  See hsm_service.h for scheduling, hsm_proto.h for the wire format and
+*           hsm_client.h for the client side (hsm_shm_ring.h for zero-copy shared-memory
+*           rings). SIGINT / SIGTERM stop, SIGUSR1 prints the
+*           queue depth / batching / latency report to stderr.
+*
+* Usage: hsmd [--socket PATH] [--sim [instant|core|pynq]] [--batch BLOCKS] [--quantum BLOCKS]
+*             [--key-run N] [--inflight N] [--clients N] [--keys N]
+*        hsmd --stats [--socket PATH]     print a running daemon's report
+*/
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "aes_driver.h"
+#include "hsm_client.h"
+#include "hsm_driver.h"
+#include "hsm_service.h"
+#include "sim_device.h"
+#include "trng_pool.h"
+
+static HsmService* g_service = nullptr;
+
+static void on_stop(int) { if (g_service) g_service->requestStop(); }
+static void on_report(int) { if (g_service) g_service->requestReport(); }
+
+int main(int argc, char* argv[]) {
+    HsmServiceConfig cfg;
+    bool sim = false, query = false;
+    SimTiming sim_timing;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--socket" && a + 1 < argc)        cfg.socket_path = argv[++a];
+        else if (arg == "--batch" && a + 1 < argc)    cfg.max_batch_blocks = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--quantum" && a + 1 < argc)  cfg.quantum_blocks = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--key-run" && a + 1 < argc)  cfg.max_key_run = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--inflight" && a + 1 < argc) cfg.max_inflight = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--clients" && a + 1 < argc)  cfg.max_clients = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--keys" && a + 1 < argc)     cfg.max_keys_per_client = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--stats") query = true;
+        else if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            fprintf(stderr, "Usage: %s [--socket PATH] [--sim [instant|core|pynq]] [--batch BLOCKS] "
+                            "[--quantum BLOCKS] [--key-run N] [--inflight N] [--clients N] [--keys N]\n"
+                            "       %s --stats [--socket PATH]\n", argv[0], argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (query) {
+        HsmClient client;
+        std::string text;
+        if (!client.connect(cfg.socket_path.c_str())) return EXIT_FAILURE;
+        HsmStatus st = client.stats(text);
+        if (st != HsmStatus::OK) {
+            fprintf(stderr, "[ERROR] stats: %s\n", hsm_status_str(st));
+            return EXIT_FAILURE;
+        }
+        fputs(text.c_str(), stdout);
+        return EXIT_SUCCESS;
+    }
+
+    // devices -------------------------------------
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or use --sim)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or use --sim)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+    EntropyPool pool(hsm);
+    if (!pool.start()) return EXIT_FAILURE;
+
+    HsmService service(drv, pool, cfg);
+    if (!service.open()) return EXIT_FAILURE;
+    g_service = &service;
+    signal(SIGINT, on_stop);
+    signal(SIGTERM, on_stop);
+    signal(SIGUSR1, on_report);
+    signal(SIGPIPE, SIG_IGN);
+
+    fprintf(stderr, "[hsmd] serving on %s (%s), batch %u blocks, quantum %u, %u in flight per client\n",
+            cfg.socket_path.c_str(), sim ? aes.backend() : "hardware", cfg.max_batch_blocks,
+            cfg.quantum_blocks, cfg.max_inflight);
+    service.run();
+
+    g_service = nullptr;
+    fprintf(stderr, "%s", service.report().c_str());
+    service.close();
+    pool.stop();
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+/**
+* @file     reg_device.h
+* @brief    Register backends shared by every driver: /dev/mem or an in-process device
+* @details  MMIO is the one wrapper the drivers talk through. open() maps the peripheral
+*           via DevMemDevice and accesses go straight to the mapping; attach() hands it a
+*           RegDevice instead (the behavioral model in sim_device.h), so tests and
+*           benchmarks build and run on any Linux box.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+class RegDevice {
+public:
+    virtual ~RegDevice() = default;
+    virtual uint32_t read(uint32_t offset) = 0;                 // byte offset, 32-bit aligned
+    virtual void     write(uint32_t offset, uint32_t value) = 0;
+    virtual const char* name() const = 0;
+};
+
+// /dev/mem =======================================
+class DevMemDevice : public RegDevice {
+private:
+    volatile uint32_t* _base = nullptr;
+    int      _fd = -1;
+    uint32_t _size = 0;
+
+public:
+    DevMemDevice() = default;
+    DevMemDevice(const DevMemDevice&) = delete;
+    DevMemDevice& operator=(const DevMemDevice&) = delete;
+    ~DevMemDevice() override { close(); }
+
+    bool open(uint32_t phys_addr, uint32_t size) {
+        close();
+        _fd = ::open("/dev/mem", O_RDWR | O_SYNC);
+        if (_fd < 0) { perror("open /dev/mem"); return false; }
+        void* p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, phys_addr);
+        if (p == MAP_FAILED) {
+            perror("mmap");
+            ::close(_fd);
+            _fd = -1;
+            return false;
+        }
+        _base = (volatile uint32_t*)p;
+        _size = size;
+        return true;
+    }
+
+    void close() {
+        if (_base) munmap((void*)_base, _size);
+        if (_fd >= 0) ::close(_fd);
+        _base = nullptr;
+        _fd = -1;
+    }
+
+    bool isOpen() const { return _base != nullptr; }
+    volatile uint32_t* base() const { return _base; }
+
+    const char* name() const override { return "devmem"; }
+    uint32_t read(uint32_t offset) override { return _base[offset / 4]; }
+    void write(uint32_t offset, uint32_t value) override { _base[offset / 4] = value; }
+};
+
+// MMIO helper =======================================
+class MMIO {
+public:
+    volatile uint32_t* base_ptr = nullptr;  // /dev/mem fast path, no virtual call
+    RegDevice* dev = nullptr;               // attached device instead of /dev/mem
+
+    bool attach(RegDevice* d) {
+        dev = d;
+        return d != nullptr;
+    }
+
+    bool open(uint32_t base, uint32_t size) {
+        if (!_mem.open(base, size)) return false;
+        base_ptr = _mem.base();
+        return true;
+    }
+
+    void close() {
+        _mem.close();
+        base_ptr = nullptr;
+        dev = nullptr;
+    }
+
+    bool isOpen() const { return base_ptr || dev; }
+    const char* backend() const { return dev ? dev->name() : _mem.name(); }
+
+    void write(uint32_t offset, uint32_t value) {
+        if (__builtin_expect(dev != nullptr, 0)) dev->write(offset, value);
+        else base_ptr[offset / 4] = value;
+    }
+    uint32_t read(uint32_t offset) {
+        if (__builtin_expect(dev != nullptr, 0)) return dev->read(offset);
+        return base_ptr[offset / 4];
+    }
+
+    // typed registers (hsm_regmap.h): word index is a constant, access checked at compile time
+    template <class R>
+    void write(uint32_t value) {
+        static_assert(R::writable, "register is read-only");
+        if (__builtin_expect(dev != nullptr, 0)) dev->write(R::offset, value);
+        else base_ptr[R::index] = value;
+    }
+    template <class R>
+    uint32_t read() {
+        static_assert(R::readable, "register is write-only");
+        if (__builtin_expect(dev != nullptr, 0)) return dev->read(R::offset);
+        return base_ptr[R::index];
+    }
+
+private:
+    DevMemDevice _mem;
+};
@@ -0,0 +1,195 @@
+/**
+* @file     rtl_device.h
+* @brief    Verilated RTL as a register backend: AXI-Lite master + cycle accounting
+* @details  Wraps a Verilator model of aes_axi_wrapper / hsm_axi_wrapper (same S_AXI_*
+*           port names, so one template) and turns every RegDevice read / write into an
+*           AXI-Lite transaction clocked through the real handshake logic. Time only
+*           moves with bus activity; gap_cycles models the PS / interconnect time between
+*           accesses. Only built with -DHSM_VERILATOR=ON (CMake), see test_rtl.cpp.
+*
+* Cycle accounting: cycles() is S_AXI_ACLK since reset, bus_cycles() the subset with a
+* transaction in flight. Snapshot both around a driver call (RtlOpStats) to get cycles
+* and bus utilization per operation.
+*/
+
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+
+#include <verilated.h>
+
+#include "reg_device.h"
+
+constexpr uint64_t RTL_HALF_PERIOD_PS = 5000;   // 100 MHz S_AXI_ACLK
+constexpr uint32_t RTL_AXI_TIMEOUT    = 64;     // cycles before a handshake is declared hung
+
+// Per-operation cycles ==============================
+struct RtlOpStats {
+    uint64_t ops        = 0;
+    uint64_t cycles     = 0;
+    uint64_t bus_cycles = 0;
+    uint64_t reads      = 0;
+    uint64_t writes     = 0;
+
+    double cycles_per_op() const { return ops ? (double)cycles / ops : 0.0; }
+    double utilization() const { return cycles ? (double)bus_cycles / cycles : 0.0; }
+
+    void print(const char* name) const {
+        printf("    %-14s ops=%-6llu cycles/op=%8.1f  reads/op=%5.1f writes/op=%5.1f  bus=%5.1f%%\n",
+               name, (unsigned long long)ops, cycles_per_op(),
+               ops ? (double)reads / ops : 0.0, ops ? (double)writes / ops : 0.0,
+               utilization() * 100.0);
+    }
+};
+
+// AXI-Lite master =======================================
+template <class Top>
+class RtlDevice : public RegDevice {
+private:
+    std::unique_ptr<VerilatedContext> _ctx;
+    std::unique_ptr<Top> _top;
+    const char* _name;
+    uint32_t _gap_cycles = 0;
+    uint64_t _cycles = 0;
+    uint64_t _bus_cycles = 0;
+    uint64_t _reads = 0;
+    uint64_t _writes = 0;
+    uint64_t _timeouts = 0;
+
+    // settle timed processes (ring_osc_model.sv) up to t, then eval at t
+    void runTo(uint64_t t) {
+        while (_top->eventsPending() && _top->nextTimeSlot() <= t) {
+            _ctx->time(_top->nextTimeSlot());
+            _top->eval();
+        }
+        _ctx->time(t);
+        _top->eval();
+    }
+
+    // one full clock: rising edge, then falling edge; inputs change while the clock is low
+    void tick() {
+        _top->S_AXI_ACLK = 1;
+        runTo(_ctx->time() + RTL_HALF_PERIOD_PS);
+        _top->S_AXI_ACLK = 0;
+        runTo(_ctx->time() + RTL_HALF_PERIOD_PS);
+        _cycles++;
+    }
+
+    void idle() {
+        for (uint32_t i = 0; i < _gap_cycles; i++) tick();
+    }
+
+public:
+    explicit RtlDevice(const char* name, uint32_t seed = 1) : _ctx(new VerilatedContext), _name(name) {
+        _ctx->randSeed(seed);
+        _ctx->randReset(2);         // randomize uninitialized state, as on power-up
+        _top.reset(new Top(_ctx.get(), name));
+
+        _top->S_AXI_AWVALID = 0;
+        _top->S_AXI_WVALID  = 0;
+        _top->S_AXI_BREADY  = 0;
+        _top->S_AXI_ARVALID = 0;
+        _top->S_AXI_RREADY  = 0;
+        _top->S_AXI_WSTRB   = 0xF;
+        _top->S_AXI_AWPROT  = 0;
+        _top->S_AXI_ARPROT  = 0;
+        _top->S_AXI_ACLK    = 0;
+        _top->S_AXI_ARESETN = 0;
+        runTo(0);
+        for (int i = 0; i < 4; i++) tick();
+        _top->S_AXI_ARESETN = 1;
+        tick();
+        _cycles = 0;
+    }
+
+    ~RtlDevice() override { _top->final(); }
+
+    const char* name() const override { return _name; }
+
+    // PS-side cycles between transactions (0 = back to back)
+    void setGapCycles(uint32_t n) { _gap_cycles = n; }
+
+    uint64_t cycles() const { return _cycles; }
+    uint64_t bus_cycles() const { return _bus_cycles; }
+    uint64_t reads() const { return _reads; }
+    uint64_t writes() const { return _writes; }
+    uint64_t timeouts() const { return _timeouts; }
+
+    // let the fabric run with the bus idle (e.g. wait out a known latency)
+    void run(uint64_t cycles) {
+        for (uint64_t i = 0; i < cycles; i++) tick();
+    }
+
+    uint32_t read(uint32_t offset) override {
+        idle();
+        _reads++;
+        _top->S_AXI_ARADDR  = offset;
+        _top->S_AXI_ARVALID = 1;
+        _top->S_AXI_RREADY  = 1;
+        uint32_t data = 0xFFFFFFFF;
+        for (uint32_t n = 0; ; n++) {
+            bool ar_hs = _top->S_AXI_ARVALID && _top->S_AXI_ARREADY;
+            bool r_hs  = _top->S_AXI_RVALID && _top->S_AXI_RREADY;
+            if (r_hs) data = _top->S_AXI_RDATA;
+            tick();
+            _bus_cycles++;
+            if (ar_hs) _top->S_AXI_ARVALID = 0;
+            if (r_hs) break;
+            if (n == RTL_AXI_TIMEOUT) {
+                printf("    [TIMEOUT] %s: AXI read @0x%02X hung\n", _name, offset);
+                _timeouts++;
+                break;
+            }
+        }
+        _top->S_AXI_ARVALID = 0;
+        _top->S_AXI_RREADY  = 0;
+        return data;
+    }
+
+    void write(uint32_t offset, uint32_t value) override {
+        idle();
+        _writes++;
+        _top->S_AXI_AWADDR  = offset;
+        _top->S_AXI_WDATA   = value;
+        _top->S_AXI_AWVALID = 1;
+        _top->S_AXI_WVALID  = 1;
+        _top->S_AXI_BREADY  = 1;
+        for (uint32_t n = 0; ; n++) {
+            bool aw_hs = _top->S_AXI_AWVALID && _top->S_AXI_AWREADY;
+            bool w_hs  = _top->S_AXI_WVALID && _top->S_AXI_WREADY;
+            bool b_hs  = _top->S_AXI_BVALID && _top->S_AXI_BREADY;
+            tick();
+            _bus_cycles++;
+            if (aw_hs) _top->S_AXI_AWVALID = 0;
+            if (w_hs)  _top->S_AXI_WVALID = 0;
+            if (b_hs) break;
+            if (n == RTL_AXI_TIMEOUT) {
+                printf("    [TIMEOUT] %s: AXI write @0x%02X hung\n", _name, offset);
+                _timeouts++;
+                break;
+            }
+        }
+        _top->S_AXI_AWVALID = 0;
+        _top->S_AXI_WVALID  = 0;
+        _top->S_AXI_BREADY  = 0;
+    }
+
+    // accumulate one driver operation: snapshot before, call, add the deltas
+    template <class F>
+    auto measure(RtlOpStats& s, F&& op) -> decltype(op()) {
+        uint64_t c0 = _cycles, b0 = _bus_cycles, r0 = _reads, w0 = _writes;
+        struct Commit {
+            RtlDevice* d; RtlOpStats& s; uint64_t c0, b0, r0, w0;
+            ~Commit() {
+                s.ops++;
+                s.cycles += d->_cycles - c0;
+                s.bus_cycles += d->_bus_cycles - b0;
+                s.reads += d->_reads - r0;
+                s.writes += d->_writes - w0;
+            }
+        } commit{this, s, c0, b0, r0, w0};
+        return op();
+    }
+};
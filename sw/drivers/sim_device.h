@@ -0,0 +1,465 @@
+/**
+* @file     sim_device.h
+* @brief    Behavioral models of the AES and HSM peripherals (no FPGA needed)
+* @details  Cycle-level where the drivers can see it, evaluated lazily: every register
+*           access first brings the model up to the current S_AXI_ACLK cycle, then applies
+*           the access. Time comes from SimClock - wall clock (so spin/poll loops see the
+*           same latencies as on the board) or a virtual clock that only moves with
+*           accesses (deterministic). Not thread safe, same as the bus wrappers.
+*
+* SimAesDevice - aes_axi_wrapper.sv + aes_core.sv: edge-triggered key_load / encrypt,
+*                KEY_EXPAND (52 cycles) and ENCRYPT (14 cycles) busy windows, level
+*                clear, done latch, 0xDEADBEEF on unmapped reads; AES from SoftAes256
+* SimHsmDevice - hsm_axi_wrapper.sv + trng_sampler.sv + trng_health.sv: decimator,
+*                Von Neumann corrector, 32-bit accumulator / SAMPLE_CNT handshake,
+*                RCT / APT health bits, free-running COUNTER; raw bits from a PRNG
+*                with optional fault injection
+* SimBus       - the GP0 interconnect shared by several device models (one per aes_bridge
+*                instance, aes_cluster.h): an access holds it for bus_ns, accesses from
+*                other threads queue behind
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#include "aes_driver.h"
+#include "hsm_driver.h"
+#include "reg_device.h"
+#include "soft_aes.h"
+
+// Timing =======================================
+struct SimTiming {
+    double   clk_hz         = AES_CLK_HZ;           // both peripherals sit on S_AXI_ACLK
+    uint32_t key_exp_cycles = AES_KEY_EXP_CYCLES;
+    uint32_t block_cycles   = AES_BLOCK_CYCLES;
+    uint32_t read_ns        = 0;        // injected per register read (bus round trip)
+    uint32_t write_ns       = 0;        // injected per register write
+    uint32_t bus_ns         = 0;        // interconnect occupancy per access (SimBus only)
+    bool     virtual_clock  = false;    // time advances per access instead of with the wall clock
+    bool     instant_trng   = false;    // a SAMPLE edge fills the word at once (bits still simulated)
+
+    // every operation completes at the access that starts it
+    static SimTiming instant() {
+        SimTiming t;
+        t.key_exp_cycles = 0;
+        t.block_cycles = 0;
+        t.virtual_clock = true;
+        t.instant_trng = true;
+        return t;
+    }
+    // core latencies only, bus is free
+    static SimTiming core() { return SimTiming(); }
+    // core latencies + rough Zynq GP0 AXI-Lite costs (uncached read stalls, posted write)
+    static SimTiming pynq() {
+        SimTiming t;
+        t.read_ns = 200;
+        t.write_ns = 80;
+        t.bus_ns = 60;          // ~6 ACLK per AXI-Lite transfer through the interconnect
+        return t;
+    }
+
+    static bool parse(const std::string& s, SimTiming& out) {
+        if (s == "instant")     out = instant();
+        else if (s == "core")   out = core();
+        else if (s == "pynq")   out = pynq();
+        else return false;
+        return true;
+    }
+};
+
+// Interconnect =======================================
+// Devices attached to one SimBus share its slots: an access reserves the earliest free
+// bus_ns window and then pays its own latency. Only matters with several threads
+// driving several devices (wall clock); a single driver thread never queues.
+class SimBus {
+private:
+    using clock = std::chrono::steady_clock;
+
+    clock::time_point _t0 = clock::now();
+    std::atomic<int64_t>  _free_at{0};      // ns since _t0
+    std::atomic<uint64_t> _accesses{0};
+    std::atomic<uint64_t> _stall_ns{0};
+
+public:
+    // ns this access waits for the bus
+    uint64_t reserve(uint32_t hold_ns) {
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - _t0).count();
+        int64_t free_at = _free_at.load(std::memory_order_relaxed);
+        int64_t start;
+        do {
+            start = free_at > now ? free_at : now;
+        } while (!_free_at.compare_exchange_weak(free_at, start + hold_ns, std::memory_order_relaxed));
+        _accesses.fetch_add(1, std::memory_order_relaxed);
+        if (start > now) _stall_ns.fetch_add((uint64_t)(start - now), std::memory_order_relaxed);
+        return (uint64_t)(start - now);
+    }
+
+    uint64_t accesses() const { return _accesses.load(std::memory_order_relaxed); }
+    uint64_t stallNs() const { return _stall_ns.load(std::memory_order_relaxed); }
+};
+
+class SimClock {
+private:
+    using clock = std::chrono::steady_clock;
+
+    SimTiming _t;
+    clock::time_point _t0 = clock::now();
+    double   _cycles_per_ns;
+    uint64_t _virt = 0;
+    SimBus*  _bus = nullptr;
+
+public:
+    explicit SimClock(const SimTiming& t) : _t(t), _cycles_per_ns(t.clk_hz / 1e9) {}
+
+    const SimTiming& timing() const { return _t; }
+    void attachBus(SimBus* bus) { _bus = bus; }
+
+    // current S_AXI_ACLK cycle
+    uint64_t now() const {
+        if (_t.virtual_clock) return _virt;
+        return (uint64_t)(std::chrono::duration<double, std::nano>(clock::now() - _t0).count() * _cycles_per_ns);
+    }
+
+    // charge one bus access: spin out the injected latency, or step the virtual clock
+    void access(bool is_write) {
+        uint32_t ns = is_write ? _t.write_ns : _t.read_ns;
+        if (_t.virtual_clock) {
+            uint64_t cycles = (uint64_t)(ns * _cycles_per_ns);
+            _virt += cycles ? cycles : 1;
+        } else {
+            if (_bus && _t.bus_ns) ns += (uint32_t)_bus->reserve(_t.bus_ns);
+            if (!ns) return;
+            clock::time_point end = clock::now() + std::chrono::nanoseconds(ns);
+            while (clock::now() < end) {}
+        }
+    }
+};
+
+// AES =======================================
+class SimAesDevice : public RegDevice {
+private:
+    enum class State : uint8_t { IDLE, KEY_EXPAND, READY, ENCRYPT, DONE };
+
+    SimClock _clock;
+    uint32_t _ctrl = 0;
+    uint32_t _key[8] = {};
+    uint32_t _pt[4] = {};
+    uint32_t _ct[4] = {};
+    uint32_t _result[4] = {};   // ciphertext register only updates when ENCRYPT finishes
+    bool     _done_latched = false;
+    State    _state = State::IDLE;
+    uint64_t _busy_until = 0;   // cycle the current KEY_EXPAND / ENCRYPT completes
+    uint64_t _reads = 0;
+    uint64_t _writes = 0;
+    SoftAes256 _engine;
+
+    void advance(uint64_t now) {
+        if (now < _busy_until) return;
+        if (_state == State::KEY_EXPAND) {
+            _state = State::READY;
+        } else if (_state == State::ENCRYPT) {
+            memcpy(_ct, _result, sizeof(_ct));
+            _state = State::DONE;
+            _done_latched = true;       // done pulse wins over clear in its own cycle
+            if (_ctrl & AES::CTRL_CLEAR) {
+                _state = State::READY;  // clear held: DONE -> READY one cycle later
+                _done_latched = false;
+            }
+        }
+    }
+
+    void onCtrl(uint32_t v, uint64_t now) {
+        bool key_edge = (v & AES::CTRL_KEY_LOAD) && !(_ctrl & AES::CTRL_KEY_LOAD);
+        bool enc_edge = (v & AES::CTRL_ENCRYPT)  && !(_ctrl & AES::CTRL_ENCRYPT);
+        _ctrl = v;
+
+        // aes_core: key_valid is only seen in IDLE / READY and wins over encrypt_start
+        if (key_edge && (_state == State::IDLE || _state == State::READY)) {
+            _engine.setKey(_key);
+            _state = State::KEY_EXPAND;
+            _busy_until = now + _clock.timing().key_exp_cycles;
+        } else if (enc_edge && _state == State::READY) {
+            _engine.encrypt(_pt, _result);
+            _state = State::ENCRYPT;
+            _busy_until = now + _clock.timing().block_cycles;
+        } else if ((v & AES::CTRL_CLEAR) && _state == State::DONE) {
+            _state = State::READY;
+        }
+        if (v & AES::CTRL_CLEAR) _done_latched = false;
+        advance(now);           // zero-cycle timings complete in the same access
+    }
+
+public:
+    explicit SimAesDevice(const SimTiming& timing = SimTiming()) : _clock(timing) {}
+
+    const char* name() const override { return "sim-aes"; }
+    const SimTiming& timing() const { return _clock.timing(); }
+    void attachBus(SimBus* bus) { _clock.attachBus(bus); }
+    uint64_t reads() const { return _reads; }
+    uint64_t writes() const { return _writes; }
+
+    uint32_t read(uint32_t offset) override {
+        _reads++;
+        _clock.access(false);
+        advance(_clock.now());
+        uint32_t idx = (offset & 0x7F) >> 2;
+        switch (idx) {
+            case AES::CTRL   >> 2: return _ctrl;
+            case AES::STATUS >> 2: return (_done_latched ? AES::STATUS_DONE : 0) |
+                                          (_state == State::KEY_EXPAND || _state == State::ENCRYPT ? AES::STATUS_BUSY : 0) |
+                                          (_state == State::READY ? AES::STATUS_READY : 0);
+            default: break;
+        }
+        if (idx >= (AES::KEY_W0 >> 2)   && idx <= (AES::KEY_W7 >> 2))   return _key[idx - (AES::KEY_W0 >> 2)];
+        if (idx >= (AES::PTEXT_W0 >> 2) && idx <= (AES::PTEXT_W3 >> 2)) return _pt[idx - (AES::PTEXT_W0 >> 2)];
+        if (idx >= (AES::CTEXT_W0 >> 2) && idx <= (AES::CTEXT_W3 >> 2)) return _ct[idx - (AES::CTEXT_W0 >> 2)];
+        return 0xDEADBEEF;
+    }
+
+    void write(uint32_t offset, uint32_t value) override {
+        _writes++;
+        _clock.access(true);
+        uint64_t now = _clock.now();
+        advance(now);
+        uint32_t idx = (offset & 0x7F) >> 2;
+        if (idx == (AES::CTRL >> 2)) { onCtrl(value, now); return; }
+        if (idx >= (AES::KEY_W0 >> 2)   && idx <= (AES::KEY_W7 >> 2))   _key[idx - (AES::KEY_W0 >> 2)] = value;
+        if (idx >= (AES::PTEXT_W0 >> 2) && idx <= (AES::PTEXT_W3 >> 2)) _pt[idx - (AES::PTEXT_W0 >> 2)] = value;
+    }
+};
+
+// HSM / TRNG =======================================
+enum class TrngFault : uint8_t {
+    NONE,
+    LOCKED,     // oscillators locked to the clock: raw bits alternate, VN emits a constant -> RCT
+    BIASED,     // VN output skewed to P(1) = bias -> APT
+    DEAD        // raw bit stuck: VN never emits, SAMPLE_CNT stalls -> driver timeout
+};
+
+class SimHsmDevice : public RegDevice {
+private:
+    // longest idle stretch replayed bit by bit; older samples are skipped, the state
+    // they would have produced (accumulator full, health verdict) is reached well within it
+    static constexpr uint64_t MAX_CATCHUP_CYCLES = 1 << 16;
+    // trng_health.sv parameters
+    static constexpr uint32_t RCT_CUTOFF = 32;
+    static constexpr uint32_t APT_WINDOW = 512;
+    static constexpr uint32_t APT_LOW    = 166;
+    static constexpr uint32_t APT_HIGH   = 346;
+
+    SimClock _clock;
+    uint32_t _ctrl = 0;
+    uint32_t _data_in = 0;
+    uint32_t _data_out = 0;
+    uint64_t _reads = 0;
+    uint64_t _writes = 0;
+
+    // raw source
+    uint64_t _rng;
+    uint64_t _rng_bits = 0;
+    uint32_t _rng_left = 0;
+    TrngFault _fault = TrngFault::NONE;
+    double   _bias = 0.5;
+    bool     _lock_phase = false;
+
+    // trng_sampler: decimator, VN, accumulator
+    uint64_t _next_pulse = 0;       // cycle of the next decimator sample_pulse
+    uint32_t _threshold = 7;        // DECIMATION_WAIT after reset
+    bool     _vn_state = false;
+    bool     _vn_first = false;
+    uint32_t _random = 0;
+    uint32_t _sample_cnt = 0;
+    uint32_t _bit_count = 0;
+    bool     _valid = false;
+
+    // trng_health
+    bool     _rct_prev = false;
+    uint32_t _rct_count = 0;
+    bool     _rct_fail = false;
+    bool     _apt_last = false;     // apt_buffer[0]
+    uint32_t _apt_ones = 0;
+    uint32_t _apt_fill = 0;
+    bool     _apt_full = false;
+    bool     _apt_fail = false;
+
+    uint64_t nextRand() {
+        _rng ^= _rng >> 12; _rng ^= _rng << 25; _rng ^= _rng >> 27;    // xorshift64*
+        return _rng * 0x2545F4914F6CDD1Dull;
+    }
+
+    bool randBit() {
+        if (_rng_left == 0) { _rng_bits = nextRand(); _rng_left = 64; }
+        bool b = _rng_bits & 1;
+        _rng_bits >>= 1;
+        _rng_left--;
+        return b;
+    }
+
+    bool rawBit() {
+        switch (_fault) {
+            case TrngFault::LOCKED: return _lock_phase = !_lock_phase;
+            case TrngFault::DEAD:   return false;
+            default:                return randBit();
+        }
+    }
+
+    void healthBit(bool bit) {
+        if (bit == _rct_prev) {
+            if (_rct_count >= RCT_CUTOFF) _rct_fail = true;
+            else _rct_count++;
+        } else {
+            _rct_count = 0;
+            _rct_prev = bit;
+        }
+
+        // as in trng_health.sv: the "leaving" bit is apt_buffer[0], i.e. the previous
+        // bit rather than the one 512 back, so once full the count only moves by +-1
+        uint32_t nxt = _apt_ones + bit - (_apt_full ? _apt_last : 0);
+        if (_apt_full && (nxt < APT_LOW || nxt > APT_HIGH)) _apt_fail = true;
+        if (!_apt_full) {
+            if (_apt_fill == APT_WINDOW - 1) _apt_full = true;
+            else _apt_fill++;
+        }
+        _apt_ones = nxt;
+        _apt_last = bit;
+    }
+
+    void vnBit(bool bit) {
+        if (_ctrl & Ctrl::CLEAR) return;    // accumulator and health held in clear
+        if (_fault == TrngFault::BIASED) bit = (nextRand() >> 11) * 0x1.0p-53 < _bias;
+        healthBit(bit);
+        if (!_valid) {
+            _random = (_random << 1) | bit;
+            if (++_bit_count == 32) {
+                _valid = true;
+                _sample_cnt++;
+            }
+        }
+    }
+
+    // one decimator sample_pulse: raw bit into the VN pair
+    void pulse() {
+        bool raw = rawBit();
+        if (!_vn_state) {
+            _vn_first = raw;
+        } else if (_vn_first != raw) {
+            vnBit(_vn_first);       // 10 -> 1, 01 -> 0
+        }
+        _vn_state = !_vn_state;
+        // {3'd6, raw_bit} + 4'd6 truncates to 2 or 3: a pulse every 3-4 cycles
+        _next_pulse += _threshold + 1;
+        _threshold = ((12u | raw) + 6u) & 0xF;
+    }
+
+    // replay decimator pulses up to cycle `now`
+    void advance(uint64_t now) {
+        if (!(_ctrl & Ctrl::ENABLE)) return;
+        if (now > _next_pulse + MAX_CATCHUP_CYCLES) _next_pulse = now - MAX_CATCHUP_CYCLES;
+        while (_next_pulse <= now) pulse();
+    }
+
+    void clearState() {
+        _random = 0;
+        _sample_cnt = 0;
+        _bit_count = 0;
+        _valid = false;
+        _rct_prev = false;
+        _rct_count = 0;
+        _rct_fail = false;
+        _apt_last = false;
+        _apt_ones = 0;
+        _apt_fill = 0;
+        _apt_full = false;
+        _apt_fail = false;
+    }
+
+    void onCtrl(uint32_t v, uint64_t now) {
+        bool sample_edge = (v & Ctrl::SAMPLE) && !(_ctrl & Ctrl::SAMPLE);
+        if ((v & Ctrl::ENABLE) && !(_ctrl & Ctrl::ENABLE)) _next_pulse = now + _threshold + 1;
+        _ctrl = v;
+        if (v & Ctrl::CLEAR) {
+            clearState();       // level: held in clear, collects as soon as it drops
+        } else if (sample_edge) {
+            _valid = false;
+            _bit_count = 0;
+            if (_clock.timing().instant_trng && (v & Ctrl::ENABLE)) {
+                // run the sampler ahead until the word is in (bounded: a dead source never fills it)
+                for (uint64_t n = 0; !_valid && n < MAX_CATCHUP_CYCLES; n++) pulse();
+                _next_pulse = now + _threshold + 1;
+            }
+        }
+    }
+
+    uint32_t status() const {
+        uint32_t s = 0;
+        if (_ctrl & Ctrl::ENABLE) s |= Status::OSC_RUNNING | (rawOsc() << 4);
+        if (_rct_fail || _apt_fail) s |= Status::HEALTH_FAIL;
+        if (_rct_fail) s |= Status::RCT_FAIL;
+        if (_apt_fail) s |= Status::APT_FAIL;
+        return s;
+    }
+
+    uint32_t rawOsc() const {
+        if (!(_ctrl & Ctrl::ENABLE) || _fault == TrngFault::DEAD) return 0;
+        return (uint32_t)(_rng >> 60);
+    }
+
+public:
+    explicit SimHsmDevice(const SimTiming& timing = SimTiming(), uint64_t seed = 0x853C49E6748FEA9Bull)
+        : _clock(timing), _rng(seed ? seed : 1) {}
+
+    const char* name() const override { return "sim-hsm"; }
+    const SimTiming& timing() const { return _clock.timing(); }
+    void attachBus(SimBus* bus) { _clock.attachBus(bus); }
+    uint64_t reads() const { return _reads; }
+    uint64_t writes() const { return _writes; }
+
+    void injectFault(TrngFault fault, double bias = 0.8) {
+        _fault = fault;
+        _bias = bias;
+    }
+
+    static bool parseFault(const std::string& s, TrngFault& out) {
+        if (s == "none")        out = TrngFault::NONE;
+        else if (s == "locked") out = TrngFault::LOCKED;
+        else if (s == "biased") out = TrngFault::BIASED;
+        else if (s == "dead")   out = TrngFault::DEAD;
+        else return false;
+        return true;
+    }
+
+    uint32_t read(uint32_t offset) override {
+        _reads++;
+        _clock.access(false);
+        uint64_t now = _clock.now();
+        advance(now);
+        switch (offset & 0x1C) {
+            case REG_CTRL:       return _ctrl;
+            case REG_STATUS:     return status();
+            case REG_DATA_IN:    return _data_in;
+            case REG_DATA_OUT:   return _data_out;
+            case REG_TRNG_OSC:   return rawOsc();
+            case REG_COUNTER:    return (uint32_t)now;
+            case REG_TRNG_OUT:   return _random;
+            default:             return _sample_cnt;    // REG_SAMPLE_CNT
+        }
+    }
+
+    void write(uint32_t offset, uint32_t value) override {
+        _writes++;
+        _clock.access(true);
+        uint64_t now = _clock.now();
+        advance(now);
+        switch (offset & 0x1C) {
+            case REG_CTRL:     onCtrl(value, now); break;
+            case REG_DATA_IN:  _data_in = value; break;
+            case REG_DATA_OUT: _data_out = value; break;
+            default: break;     // RAW_OSC / COUNTER / RAND_OUT / SAMP_CNT are read-only
+        }
+    }
+};
@@ -0,0 +1,524 @@
+/**
+* @file     soft_aes.h
+* @brief    Software AES-256 encryption engine with runtime kernel selection
+* @details  CPU reference for checking the FPGA core at line rate and for comparing
+*           throughput. Same big endian word layout as AESTestVector / the AES registers:
+*           block = 4 words, key = 8 words, byte 0 in bits [31:24] of word 0.
+*
+* Kernels:
+* - TTABLE   : 4 x 1KB lookup tables, portable (tables built from GF(2^8) math at first use)
+* - BITSLICE : constant time, 8 blocks per pass in 128-bit lanes (NEON on the Cortex-A9,
+*              SSE2 on x86); layout follows BearSSL's aes_ct64
+* - AESNI    : x86 AES-NI, 4 blocks interleaved
+* - ARMV8_CE : AArch64 crypto extensions (not on the Zynq-7000, kept for newer boards)
+*
+* SoftAes256::constantTime() is hardware AES if present, else BITSLICE: no key- or
+* data-dependent table lookups. It is the default wherever a secret key meets the CPU
+* (CtrDrbgConfig::kernel, AesDispatcher, hsm_crypt).
+* SoftAes256::best() picks the fastest kernel the CPU supports: hardware AES if present,
+* else T-tables or bitsliced, whichever measures faster here (timed once per process).
+* Benchmarks and an explicit --kernel use it; TTABLE leaks key bits through the cache.
+*/
+
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <initializer_list>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SOFT_AES_X86 1
+#endif
+
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#include <sys/auxv.h>
+#include <asm/hwcap.h>
+#define SOFT_AES_ARMV8 1
+#endif
+
+static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "soft_aes.h: SIMD kernels assume a little endian host");
+
+enum class SoftAesKernel : uint8_t { TTABLE, BITSLICE, AESNI, ARMV8_CE };
+
+constexpr int AES256_ROUNDS      = 14;
+constexpr int AES256_RK_WORDS    = 4 * (AES256_ROUNDS + 1);   // 60
+constexpr int SOFT_AES_TIME_RUNS = 3;                          // best(): timing passes per software kernel
+
+namespace soft_aes_detail {
+
+// Tables =======================================
+inline uint8_t xtime(uint8_t x) { return (uint8_t)((x << 1) ^ ((x & 0x80) ? 0x1B : 0)); }
+inline uint8_t rotl8(uint8_t x, int n) { return (uint8_t)((x << n) | (x >> (8 - n))); }
+inline uint32_t rotr32(uint32_t x, int n) { return (x >> n) | (x << (32 - n)); }
+
+struct Tables {
+    uint8_t  sbox[256];
+    uint32_t te[4][256];    // te[0][x] = {2.S(x), S(x), S(x), 3.S(x)}, te[k] = te[0] >>> 8k
+
+    Tables() {
+        // log/antilog over generator 3 -> inverse -> affine transform (FIPS 197 5.1.1)
+        uint8_t exp[255], log[256] = {0};
+        uint8_t x = 1;
+        for (int i = 0; i < 255; i++) {
+            exp[i] = x;
+            log[x] = (uint8_t)i;
+            x ^= xtime(x);
+        }
+        for (int i = 0; i < 256; i++) {
+            uint8_t inv = i ? exp[(255 - log[i]) % 255] : 0;
+            uint8_t s = inv ^ rotl8(inv, 1) ^ rotl8(inv, 2) ^ rotl8(inv, 3) ^ rotl8(inv, 4) ^ 0x63;
+            sbox[i] = s;
+            uint32_t s2 = xtime(s), s3 = s2 ^ s;
+            te[0][i] = (s2 << 24) | ((uint32_t)s << 16) | ((uint32_t)s << 8) | s3;
+            for (int k = 1; k < 4; k++) te[k][i] = rotr32(te[0][i], 8 * k);
+        }
+    }
+};
+
+inline const Tables& tables() {
+    static const Tables t;
+    return t;
+}
+
+inline uint32_t sub_word(uint32_t w) {
+    const uint8_t* s = tables().sbox;
+    return ((uint32_t)s[w >> 24] << 24) | ((uint32_t)s[(w >> 16) & 0xFF] << 16) |
+           ((uint32_t)s[(w >> 8) & 0xFF] << 8) | s[w & 0xFF];
+}
+
+// FIPS 197 5.2, Nk = 8
+inline void expand_key_256(const uint32_t key[8], uint32_t rk[AES256_RK_WORDS]) {
+    uint32_t rcon = 0x01000000;
+    for (int i = 0; i < 8; i++) rk[i] = key[i];
+    for (int i = 8; i < AES256_RK_WORDS; i++) {
+        uint32_t t = rk[i - 1];
+        if (i % 8 == 0) {
+            t = sub_word((t << 8) | (t >> 24)) ^ rcon;
+            rcon = (uint32_t)xtime((uint8_t)(rcon >> 24)) << 24;
+        } else if (i % 8 == 4) {
+            t = sub_word(t);
+        }
+        rk[i] = rk[i - 8] ^ t;
+    }
+}
+
+// T-table kernel =======================================
+inline void ttable_encrypt(const uint32_t rk[AES256_RK_WORDS], const uint32_t in[4], uint32_t out[4]) {
+    const Tables& T = tables();
+    const uint32_t (&te)[4][256] = T.te;
+    uint32_t s0 = in[0] ^ rk[0], s1 = in[1] ^ rk[1], s2 = in[2] ^ rk[2], s3 = in[3] ^ rk[3];
+
+    for (int r = 1; r < AES256_ROUNDS; r++) {
+        const uint32_t* k = rk + 4 * r;
+        uint32_t t0 = te[0][s0 >> 24] ^ te[1][(s1 >> 16) & 0xFF] ^ te[2][(s2 >> 8) & 0xFF] ^ te[3][s3 & 0xFF] ^ k[0];
+        uint32_t t1 = te[0][s1 >> 24] ^ te[1][(s2 >> 16) & 0xFF] ^ te[2][(s3 >> 8) & 0xFF] ^ te[3][s0 & 0xFF] ^ k[1];
+        uint32_t t2 = te[0][s2 >> 24] ^ te[1][(s3 >> 16) & 0xFF] ^ te[2][(s0 >> 8) & 0xFF] ^ te[3][s1 & 0xFF] ^ k[2];
+        uint32_t t3 = te[0][s3 >> 24] ^ te[1][(s0 >> 16) & 0xFF] ^ te[2][(s1 >> 8) & 0xFF] ^ te[3][s2 & 0xFF] ^ k[3];
+        s0 = t0; s1 = t1; s2 = t2; s3 = t3;
+    }
+
+    // last round: SubBytes + ShiftRows + AddRoundKey, no MixColumns
+    const uint8_t* S = T.sbox;
+    const uint32_t* k = rk + 4 * AES256_ROUNDS;
+    out[0] = (((uint32_t)S[s0 >> 24] << 24) | ((uint32_t)S[(s1 >> 16) & 0xFF] << 16) |
+              ((uint32_t)S[(s2 >> 8) & 0xFF] << 8) | S[s3 & 0xFF]) ^ k[0];
+    out[1] = (((uint32_t)S[s1 >> 24] << 24) | ((uint32_t)S[(s2 >> 16) & 0xFF] << 16) |
+              ((uint32_t)S[(s3 >> 8) & 0xFF] << 8) | S[s0 & 0xFF]) ^ k[1];
+    out[2] = (((uint32_t)S[s2 >> 24] << 24) | ((uint32_t)S[(s3 >> 16) & 0xFF] << 16) |
+              ((uint32_t)S[(s0 >> 8) & 0xFF] << 8) | S[s1 & 0xFF]) ^ k[2];
+    out[3] = (((uint32_t)S[s3 >> 24] << 24) | ((uint32_t)S[(s0 >> 16) & 0xFF] << 16) |
+              ((uint32_t)S[(s1 >> 8) & 0xFF] << 8) | S[s2 & 0xFF]) ^ k[3];
+}
+
+// Bitsliced kernel =======================================
+// Each lane is a uint64_t holding 4 blocks (BearSSL ct64 layout); BsWord has 2 lanes
+// so one pass is 8 blocks. GCC lowers the vector ops to NEON / SSE2.
+#if defined(__GNUC__)
+typedef uint64_t BsWord __attribute__((vector_size(16)));
+constexpr int BS_LANES = 2;
+inline uint64_t bs_get(const BsWord& w, int l) { return w[l]; }
+inline void bs_set(BsWord& w, int l, uint64_t v) { w[l] = v; }
+#else
+typedef uint64_t BsWord;
+constexpr int BS_LANES = 1;
+inline uint64_t bs_get(const BsWord& w, int) { return w; }
+inline void bs_set(BsWord& w, int, uint64_t v) { w = v; }
+#endif
+constexpr int BS_BLOCKS = 4 * BS_LANES;
+
+inline void bs_interleave_in(uint64_t& q0, uint64_t& q1, const uint32_t w[4]) {
+    uint64_t x0 = w[0], x1 = w[1], x2 = w[2], x3 = w[3];
+    x0 |= (x0 << 16); x1 |= (x1 << 16); x2 |= (x2 << 16); x3 |= (x3 << 16);
+    x0 &= 0x0000FFFF0000FFFFull; x1 &= 0x0000FFFF0000FFFFull;
+    x2 &= 0x0000FFFF0000FFFFull; x3 &= 0x0000FFFF0000FFFFull;
+    x0 |= (x0 << 8); x1 |= (x1 << 8); x2 |= (x2 << 8); x3 |= (x3 << 8);
+    x0 &= 0x00FF00FF00FF00FFull; x1 &= 0x00FF00FF00FF00FFull;
+    x2 &= 0x00FF00FF00FF00FFull; x3 &= 0x00FF00FF00FF00FFull;
+    q0 = x0 | (x2 << 8);
+    q1 = x1 | (x3 << 8);
+}
+
+inline void bs_interleave_out(uint32_t w[4], uint64_t q0, uint64_t q1) {
+    uint64_t x0 = q0 & 0x00FF00FF00FF00FFull;
+    uint64_t x1 = q1 & 0x00FF00FF00FF00FFull;
+    uint64_t x2 = (q0 >> 8) & 0x00FF00FF00FF00FFull;
+    uint64_t x3 = (q1 >> 8) & 0x00FF00FF00FF00FFull;
+    x0 |= (x0 >> 8); x1 |= (x1 >> 8); x2 |= (x2 >> 8); x3 |= (x3 >> 8);
+    x0 &= 0x0000FFFF0000FFFFull; x1 &= 0x0000FFFF0000FFFFull;
+    x2 &= 0x0000FFFF0000FFFFull; x3 &= 0x0000FFFF0000FFFFull;
+    w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16);
+    w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+    w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16);
+    w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+inline void bs_swap(BsWord& x, BsWord& y, uint64_t cl, uint64_t ch, int s) {
+    BsWord a = x, b = y;
+    x = (a & cl) | ((b & cl) << s);
+    y = ((a & ch) >> s) | (b & ch);
+}
+
+// transpose between byte-per-word and bit-per-word form (its own inverse)
+inline void bs_ortho(BsWord q[8]) {
+    for (int i = 0; i < 8; i += 2) bs_swap(q[i], q[i + 1], 0x5555555555555555ull, 0xAAAAAAAAAAAAAAAAull, 1);
+    for (int i : {0, 1, 4, 5})     bs_swap(q[i], q[i + 2], 0x3333333333333333ull, 0xCCCCCCCCCCCCCCCCull, 2);
+    for (int i = 0; i < 4; i++)    bs_swap(q[i], q[i + 4], 0x0F0F0F0F0F0F0F0Full, 0xF0F0F0F0F0F0F0F0ull, 4);
+}
+
+// Boyar-Peralta S-box circuit (113 gates)
+inline void bs_sbox(BsWord q[8]) {
+    BsWord x0 = q[7], x1 = q[6], x2 = q[5], x3 = q[4], x4 = q[3], x5 = q[2], x6 = q[1], x7 = q[0];
+
+    // top linear transformation
+    BsWord y14 = x3 ^ x5,   y13 = x0 ^ x6,   y9  = x0 ^ x3,   y8  = x0 ^ x5;
+    BsWord t0  = x1 ^ x2,   y1  = t0 ^ x7,   y4  = y1 ^ x3,   y12 = y13 ^ y14;
+    BsWord y2  = y1 ^ x0,   y5  = y1 ^ x6,   y3  = y5 ^ y8,   t1  = x4 ^ y12;
+    BsWord y15 = t1 ^ x5,   y20 = t1 ^ x1,   y6  = y15 ^ x7,  y10 = y15 ^ t0;
+    BsWord y11 = y20 ^ y9,  y7  = x7 ^ y11,  y17 = y10 ^ y11, y19 = y10 ^ y8;
+    BsWord y16 = t0 ^ y11,  y21 = y13 ^ y16, y18 = x0 ^ y16;
+
+    // non-linear section
+    BsWord t2  = y12 & y15, t3  = y3 & y6,   t4  = t3 ^ t2,   t5  = y4 & x7;
+    BsWord t6  = t5 ^ t2,   t7  = y13 & y16, t8  = y5 & y1,   t9  = t8 ^ t7;
+    BsWord t10 = y2 & y7,   t11 = t10 ^ t7,  t12 = y9 & y11,  t13 = y14 & y17;
+    BsWord t14 = t13 ^ t12, t15 = y8 & y10,  t16 = t15 ^ t12, t17 = t4 ^ t14;
+    BsWord t18 = t6 ^ t16,  t19 = t9 ^ t14,  t20 = t11 ^ t16, t21 = t17 ^ y20;
+    BsWord t22 = t18 ^ y19, t23 = t19 ^ y21, t24 = t20 ^ y18;
+
+    BsWord t25 = t21 ^ t22, t26 = t21 & t23, t27 = t24 ^ t26, t28 = t25 & t27;
+    BsWord t29 = t28 ^ t22, t30 = t23 ^ t24, t31 = t22 ^ t26, t32 = t31 & t30;
+    BsWord t33 = t32 ^ t24, t34 = t23 ^ t33, t35 = t27 ^ t33, t36 = t24 & t35;
+    BsWord t37 = t36 ^ t34, t38 = t27 ^ t36, t39 = t29 & t38, t40 = t25 ^ t39;
+
+    BsWord t41 = t40 ^ t37, t42 = t29 ^ t33, t43 = t29 ^ t40, t44 = t33 ^ t37;
+    BsWord t45 = t42 ^ t41;
+    BsWord z0  = t44 & y15, z1  = t37 & y6,  z2  = t33 & x7,  z3  = t43 & y16;
+    BsWord z4  = t40 & y1,  z5  = t29 & y7,  z6  = t42 & y11, z7  = t45 & y17;
+    BsWord z8  = t41 & y10, z9  = t44 & y12, z10 = t37 & y3,  z11 = t33 & y4;
+    BsWord z12 = t43 & y13, z13 = t40 & y5,  z14 = t29 & y2,  z15 = t42 & y9;
+    BsWord z16 = t45 & y14, z17 = t41 & y8;
+
+    // bottom linear transformation
+    BsWord t46 = z15 ^ z16, t47 = z10 ^ z11, t48 = z5 ^ z13,  t49 = z9 ^ z10;
+    BsWord t50 = z2 ^ z12,  t51 = z2 ^ z5,   t52 = z7 ^ z8,   t53 = z0 ^ z3;
+    BsWord t54 = z6 ^ z7,   t55 = z16 ^ z17, t56 = z12 ^ t48, t57 = t50 ^ t53;
+    BsWord t58 = z4 ^ t46,  t59 = z3 ^ t54,  t60 = t46 ^ t57, t61 = z14 ^ t57;
+    BsWord t62 = t52 ^ t58, t63 = t49 ^ t58, t64 = z4 ^ t59,  t65 = t61 ^ t62;
+    BsWord t66 = z1 ^ t63;
+    BsWord s0  = t59 ^ t63, s6  = t56 ^ ~t62, s7 = t48 ^ ~t60;
+    BsWord t67 = t64 ^ t65;
+    BsWord s3  = t53 ^ t66, s4  = t51 ^ t66,  s5 = t47 ^ t65;
+    BsWord s1  = t64 ^ ~s3, s2  = t55 ^ ~t67;
+
+    q[7] = s0; q[6] = s1; q[5] = s2; q[4] = s3;
+    q[3] = s4; q[2] = s5; q[1] = s6; q[0] = s7;
+}
+
+inline void bs_shift_rows(BsWord q[8]) {
+    for (int i = 0; i < 8; i++) {
+        BsWord x = q[i];
+        q[i] = (x & 0x000000000000FFFFull)
+             | ((x & 0x00000000FFF00000ull) >> 4)
+             | ((x & 0x00000000000F0000ull) << 12)
+             | ((x & 0x0000FF0000000000ull) >> 8)
+             | ((x & 0x000000FF00000000ull) << 8)
+             | ((x & 0xF000000000000000ull) >> 12)
+             | ((x & 0x0FFF000000000000ull) << 4);
+    }
+}
+
+inline BsWord bs_rotr32(BsWord x) { return (x << 32) | (x >> 32); }
+
+inline void bs_mix_columns(BsWord q[8]) {
+    BsWord r[8];
+    for (int i = 0; i < 8; i++) r[i] = (q[i] >> 16) | (q[i] << 48);
+    BsWord q0 = q[0], q1 = q[1], q2 = q[2], q3 = q[3], q4 = q[4], q5 = q[5], q6 = q[6], q7 = q[7];
+    q[0] = q7 ^ r[7] ^ r[0] ^ bs_rotr32(q0 ^ r[0]);
+    q[1] = q0 ^ r[0] ^ q7 ^ r[7] ^ r[1] ^ bs_rotr32(q1 ^ r[1]);
+    q[2] = q1 ^ r[1] ^ r[2] ^ bs_rotr32(q2 ^ r[2]);
+    q[3] = q2 ^ r[2] ^ q7 ^ r[7] ^ r[3] ^ bs_rotr32(q3 ^ r[3]);
+    q[4] = q3 ^ r[3] ^ q7 ^ r[7] ^ r[4] ^ bs_rotr32(q4 ^ r[4]);
+    q[5] = q4 ^ r[4] ^ r[5] ^ bs_rotr32(q5 ^ r[5]);
+    q[6] = q5 ^ r[5] ^ r[6] ^ bs_rotr32(q6 ^ r[6]);
+    q[7] = q6 ^ r[6] ^ r[7] ^ bs_rotr32(q7 ^ r[7]);
+}
+
+// BS_BLOCKS big endian blocks -> bitsliced state
+inline void bs_load(BsWord q[8], const uint32_t* blocks) {
+    for (int l = 0; l < BS_LANES; l++) {
+        for (int i = 0; i < 4; i++) {
+            const uint32_t* b = blocks + 4 * (4 * l + i);
+            uint32_t w[4] = { __builtin_bswap32(b[0]), __builtin_bswap32(b[1]),
+                              __builtin_bswap32(b[2]), __builtin_bswap32(b[3]) };
+            uint64_t lo, hi;
+            bs_interleave_in(lo, hi, w);
+            bs_set(q[i], l, lo);
+            bs_set(q[i + 4], l, hi);
+        }
+    }
+    bs_ortho(q);
+}
+
+inline void bs_store(uint32_t* blocks, BsWord q[8]) {
+    bs_ortho(q);
+    for (int l = 0; l < BS_LANES; l++) {
+        for (int i = 0; i < 4; i++) {
+            uint32_t w[4];
+            bs_interleave_out(w, bs_get(q[i], l), bs_get(q[i + 4], l));
+            uint32_t* b = blocks + 4 * (4 * l + i);
+            for (int j = 0; j < 4; j++) b[j] = __builtin_bswap32(w[j]);
+        }
+    }
+}
+
+// round keys in bitsliced form: the same round key in every block slot
+inline void bs_expand_key(const uint32_t rk[AES256_RK_WORDS], BsWord sk[AES256_ROUNDS + 1][8]) {
+    uint32_t rep[4 * BS_BLOCKS];
+    for (int r = 0; r <= AES256_ROUNDS; r++) {
+        for (int b = 0; b < BS_BLOCKS; b++) memcpy(rep + 4 * b, rk + 4 * r, 16);
+        bs_load(sk[r], rep);
+    }
+}
+
+inline void bs_encrypt(const BsWord sk[AES256_ROUNDS + 1][8], const uint32_t* in, uint32_t* out) {
+    BsWord q[8];
+    bs_load(q, in);
+    for (int i = 0; i < 8; i++) q[i] ^= sk[0][i];
+    for (int r = 1; r < AES256_ROUNDS; r++) {
+        bs_sbox(q);
+        bs_shift_rows(q);
+        bs_mix_columns(q);
+        for (int i = 0; i < 8; i++) q[i] ^= sk[r][i];
+    }
+    bs_sbox(q);
+    bs_shift_rows(q);
+    for (int i = 0; i < 8; i++) q[i] ^= sk[AES256_ROUNDS][i];
+    bs_store(out, q);
+}
+
+// AES-NI kernel =======================================
+#ifdef SOFT_AES_X86
+__attribute__((target("aes,ssse3")))
+inline void aesni_encrypt(const uint8_t rkb[AES256_ROUNDS + 1][16], const uint32_t* in, uint32_t* out, size_t n) {
+    // big endian words <-> AES byte order
+    const __m128i bswap = _mm_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m128i k[AES256_ROUNDS + 1];
+    for (int r = 0; r <= AES256_ROUNDS; r++) k[r] = _mm_loadu_si128((const __m128i*)rkb[r]);
+
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i* src = (const __m128i*)(in + 4 * i);
+        __m128i b0 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(src + 0), bswap), k[0]);
+        __m128i b1 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(src + 1), bswap), k[0]);
+        __m128i b2 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(src + 2), bswap), k[0]);
+        __m128i b3 = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128(src + 3), bswap), k[0]);
+        for (int r = 1; r < AES256_ROUNDS; r++) {
+            b0 = _mm_aesenc_si128(b0, k[r]);
+            b1 = _mm_aesenc_si128(b1, k[r]);
+            b2 = _mm_aesenc_si128(b2, k[r]);
+            b3 = _mm_aesenc_si128(b3, k[r]);
+        }
+        __m128i* dst = (__m128i*)(out + 4 * i);
+        _mm_storeu_si128(dst + 0, _mm_shuffle_epi8(_mm_aesenclast_si128(b0, k[AES256_ROUNDS]), bswap));
+        _mm_storeu_si128(dst + 1, _mm_shuffle_epi8(_mm_aesenclast_si128(b1, k[AES256_ROUNDS]), bswap));
+        _mm_storeu_si128(dst + 2, _mm_shuffle_epi8(_mm_aesenclast_si128(b2, k[AES256_ROUNDS]), bswap));
+        _mm_storeu_si128(dst + 3, _mm_shuffle_epi8(_mm_aesenclast_si128(b3, k[AES256_ROUNDS]), bswap));
+    }
+    for (; i < n; i++) {
+        __m128i b = _mm_xor_si128(_mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(in + 4 * i)), bswap), k[0]);
+        for (int r = 1; r < AES256_ROUNDS; r++) b = _mm_aesenc_si128(b, k[r]);
+        _mm_storeu_si128((__m128i*)(out + 4 * i), _mm_shuffle_epi8(_mm_aesenclast_si128(b, k[AES256_ROUNDS]), bswap));
+    }
+}
+#endif
+
+// ARMv8 crypto extension kernel =======================================
+#ifdef SOFT_AES_ARMV8
+__attribute__((target("+crypto")))
+inline void armce_encrypt(const uint8_t rkb[AES256_ROUNDS + 1][16], const uint32_t* in, uint32_t* out, size_t n) {
+    uint8x16_t k[AES256_ROUNDS + 1];
+    for (int r = 0; r <= AES256_ROUNDS; r++) k[r] = vld1q_u8(rkb[r]);
+
+    for (size_t i = 0; i < n; i++) {
+        // AESE = AddRoundKey + SubBytes + ShiftRows, AESMC = MixColumns
+        uint8x16_t s = vrev32q_u8(vld1q_u8((const uint8_t*)(in + 4 * i)));
+        for (int r = 0; r < AES256_ROUNDS - 1; r++) s = vaesmcq_u8(vaeseq_u8(s, k[r]));
+        s = veorq_u8(vaeseq_u8(s, k[AES256_ROUNDS - 1]), k[AES256_ROUNDS]);
+        vst1q_u8((uint8_t*)(out + 4 * i), vrev32q_u8(s));
+    }
+}
+#endif
+
+} // namespace soft_aes_detail
+
+// Engine =======================================
+class SoftAes256 {
+private:
+    SoftAesKernel _kernel;
+    bool          _keyed = false;
+    uint32_t      _rk[AES256_RK_WORDS];                             // TTABLE
+    uint8_t       _rkb[AES256_ROUNDS + 1][16];                      // AESNI / ARMV8_CE byte order
+    soft_aes_detail::BsWord _bs_rk[AES256_ROUNDS + 1][8];           // BITSLICE
+
+    void bitsliceBlocks(const uint32_t* pt, uint32_t* ct, size_t n) const {
+        using namespace soft_aes_detail;
+        size_t i = 0;
+        for (; i + BS_BLOCKS <= n; i += BS_BLOCKS) bs_encrypt(_bs_rk, pt + 4 * i, ct + 4 * i);
+        if (i < n) {
+            uint32_t tmp[4 * BS_BLOCKS] = {0};
+            memcpy(tmp, pt + 4 * i, (n - i) * 16);
+            bs_encrypt(_bs_rk, tmp, tmp);
+            memcpy(ct + 4 * i, tmp, (n - i) * 16);
+        }
+    }
+
+    // best of SOFT_AES_TIME_RUNS over a short buffer, T-tables on a tie; ~1 ms once
+    static SoftAesKernel timeSoftKernels() {
+        constexpr size_t blocks = 64;
+        uint32_t key[8] = {0}, buf[4 * blocks] = {0};
+        SoftAesKernel pick = SoftAesKernel::TTABLE;
+        uint64_t pick_ns = UINT64_MAX;
+        for (SoftAesKernel k : { SoftAesKernel::TTABLE, SoftAesKernel::BITSLICE }) {
+            SoftAes256 aes(k);
+            aes.setKey(key);
+            aes.encryptBlocks(buf, buf, blocks);        // tables built, caches warm
+            uint64_t best_ns = UINT64_MAX;
+            for (int r = 0; r < SOFT_AES_TIME_RUNS; r++) {
+                auto t0 = std::chrono::steady_clock::now();
+                for (int i = 0; i < 8; i++) aes.encryptBlocks(buf, buf, blocks);
+                uint64_t ns = (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count();
+                if (ns < best_ns) best_ns = ns;
+            }
+            if (best_ns < pick_ns) { pick = k; pick_ns = best_ns; }
+        }
+        return pick;
+    }
+
+public:
+    explicit SoftAes256(SoftAesKernel kernel = best()) : _kernel(available(kernel) ? kernel : SoftAesKernel::TTABLE) {}
+
+    ~SoftAes256() { wipe(); }
+
+    static bool available(SoftAesKernel k) {
+        switch (k) {
+            case SoftAesKernel::TTABLE:
+            case SoftAesKernel::BITSLICE:
+                return true;
+            case SoftAesKernel::AESNI:
+#ifdef SOFT_AES_X86
+                return __builtin_cpu_supports("aes") && __builtin_cpu_supports("ssse3");
+#else
+                return false;
+#endif
+            case SoftAesKernel::ARMV8_CE:
+#ifdef SOFT_AES_ARMV8
+                return (getauxval(AT_HWCAP) & HWCAP_AES) != 0;
+#else
+                return false;
+#endif
+        }
+        return false;
+    }
+
+    // hardware AES if present, else the faster of T-tables / bitsliced on this CPU
+    static SoftAesKernel best() {
+        if (available(SoftAesKernel::AESNI))    return SoftAesKernel::AESNI;
+        if (available(SoftAesKernel::ARMV8_CE)) return SoftAesKernel::ARMV8_CE;
+        static const SoftAesKernel fastest = timeSoftKernels();
+        return fastest;
+    }
+
+    // hardware AES if present, else bitsliced: no key / data dependent loads, whatever it costs
+    static SoftAesKernel constantTime() {
+        if (available(SoftAesKernel::AESNI))    return SoftAesKernel::AESNI;
+        if (available(SoftAesKernel::ARMV8_CE)) return SoftAesKernel::ARMV8_CE;
+        return SoftAesKernel::BITSLICE;
+    }
+
+    static const char* kernelName(SoftAesKernel k) {
+        switch (k) {
+            case SoftAesKernel::TTABLE:   return "ttable";
+            case SoftAesKernel::BITSLICE: return "bitslice";
+            case SoftAesKernel::AESNI:    return "aesni";
+            case SoftAesKernel::ARMV8_CE: return "armv8-ce";
+        }
+        return "?";
+    }
+
+    static bool parseKernel(const char* name, SoftAesKernel& out) {
+        for (SoftAesKernel k : { SoftAesKernel::TTABLE, SoftAesKernel::BITSLICE, SoftAesKernel::AESNI, SoftAesKernel::ARMV8_CE }) {
+            if (strcmp(name, kernelName(k)) == 0) { out = k; return true; }
+        }
+        return false;
+    }
+
+    SoftAesKernel kernel() const { return _kernel; }
+    const uint32_t* roundKeys() const { return _rk; }    // FIPS 197 w[0..59]
+
+    void setKey(const uint32_t key[8]) {
+        using namespace soft_aes_detail;
+        expand_key_256(key, _rk);
+        if (_kernel == SoftAesKernel::BITSLICE) bs_expand_key(_rk, _bs_rk);
+        if (_kernel == SoftAesKernel::AESNI || _kernel == SoftAesKernel::ARMV8_CE) {
+            for (int i = 0; i < AES256_RK_WORDS; i++) {
+                for (int b = 0; b < 4; b++) _rkb[i / 4][4 * (i % 4) + b] = (uint8_t)(_rk[i] >> (24 - 8 * b));
+            }
+        }
+        _keyed = true;
+    }
+
+    bool keyed() const { return _keyed; }
+
+    void wipe() {
+        volatile uint8_t* p = reinterpret_cast<volatile uint8_t*>(_rk);
+        for (size_t i = 0; i < sizeof(_rk); i++) p[i] = 0;
+        p = reinterpret_cast<volatile uint8_t*>(_rkb);
+        for (size_t i = 0; i < sizeof(_rkb); i++) p[i] = 0;
+        p = reinterpret_cast<volatile uint8_t*>(_bs_rk);
+        for (size_t i = 0; i < sizeof(_bs_rk); i++) p[i] = 0;
+        _keyed = false;
+    }
+
+    // n blocks of 4 words each; pt == ct is fine
+    void encryptBlocks(const uint32_t* pt, uint32_t* ct, size_t n) const {
+        switch (_kernel) {
+#ifdef SOFT_AES_X86
+            case SoftAesKernel::AESNI:    soft_aes_detail::aesni_encrypt(_rkb, pt, ct, n); return;
+#endif
+#ifdef SOFT_AES_ARMV8
+            case SoftAesKernel::ARMV8_CE: soft_aes_detail::armce_encrypt(_rkb, pt, ct, n); return;
+#endif
+            case SoftAesKernel::BITSLICE: bitsliceBlocks(pt, ct, n); return;
+            default:
+                for (size_t i = 0; i < n; i++) soft_aes_detail::ttable_encrypt(_rk, pt + 4 * i, ct + 4 * i);
+                return;
+        }
+    }
+
+    void encrypt(const uint32_t pt[4], uint32_t ct[4]) const { encryptBlocks(pt, ct, 1); }
+};
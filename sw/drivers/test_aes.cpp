@@ -12,178 +12,38 @@
 * 6. poll AES_status until done
 * 7. read CTEXT_R and compare to expected
 * 8. AES_CTRL to clear
+*
+* Bulk stage: BULK_BLOCKS counter blocks through AesDriver::encryptBulk(),
+* spot-checked against the single block path, every block checked against
+* the software engine (soft_aes.h), throughput vs core rate.
+* Key cache stage: KEY_PATTERN requests by key handle, reloads only on key change.
+* Dispatch stage: AesDispatcher calibrated, then DISPATCH_SIZES jobs routed CPU/HW/split,
+* all checked against the software engine. --calibrate prints the full table + crossover.
+* --sim runs everything against the behavioral model in sim_device.h instead of the FPGA.
 */
 
 #include <cstdio>
 #include <cstdint>
 #include <cstdlib>
 #include <cstring>
-#include <unistd.h>
-#include <fcntl.h>
-#include <sys/mman.h>
-
-// HW Config =======================================
-constexpr uint32_t AES_BASE_ADDR = 0x40001000;
-constexpr uint32_t AES_SIZE = 0x1000;           // 4KB
-
-// AES Reg map =======================================
-namespace AES {
-    // offsets (byte addrs) - from aes_axi_wrapper.sv
-    constexpr uint32_t CTRL       = 0x00; // control reg
-    constexpr uint32_t STATUS     = 0x04; // status reg
-    constexpr uint32_t KEY_W0     = 0x10; // key word [255:224]
-    constexpr uint32_t KEY_W1     = 0x14; // key word [223:192]
-    constexpr uint32_t KEY_W2     = 0x18; // key word [191:160]
-    constexpr uint32_t KEY_W3     = 0x1C; // key word [159:128]
-    constexpr uint32_t KEY_W4     = 0x20; // key word [127:96]
-    constexpr uint32_t KEY_W5     = 0x24; // key word [95:64]
-    constexpr uint32_t KEY_W6     = 0x28; // key word [63:32]
-    constexpr uint32_t KEY_W7     = 0x2C; // key word [31:0]
-    constexpr uint32_t PTEXT_W0   = 0x30; // plaintext word [127:96]
-    constexpr uint32_t PTEXT_W1   = 0x34; // plaintext word [95:64]
-    constexpr uint32_t PTEXT_W2   = 0x38; // plaintext word [63:32]
-    constexpr uint32_t PTEXT_W3   = 0x3C; // plaintext word [31:0]
-    constexpr uint32_t CTEXT_W0   = 0x40; // ciphertext word [127:96]
-    constexpr uint32_t CTEXT_W1   = 0x44; // ciphertext word [95:64]
-    constexpr uint32_t CTEXT_W2   = 0x48; // ciphertext word [63:32]
-    constexpr uint32_t CTEXT_W3   = 0x4C; // ciphertext word [31:0]
-
-    // control bits
-    constexpr uint32_t CTRL_KEY_LOAD = 0x1;
-    constexpr uint32_t CTRL_ENCRYPT  = 0x2;
-    constexpr uint32_t CTRL_CLEAR    = 0x4;
-
-    // status bits
-    constexpr uint32_t STATUS_READY = 0x1; 
-    constexpr uint32_t STATUS_BUSY  = 0x2;
-    constexpr uint32_t STATUS_DONE = 0x4;
-}
-
-// MMIO helper =======================================
-class MMIO {
-public:
-    volatile uint32_t* base_ptr = nullptr;
-    int fd = -1;
-    uint32_t map_size;
-
-    bool open(uint32_t base, uint32_t size) {
-        map_size = size;
-        fd = ::open("/dev/mem", O_RDWR | O_SYNC);
-        if (fd < 0) { perror("open /dev/mem"); return false; }
-        base_ptr = (volatile uint32_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, base);
-        if (base_ptr == MAP_FAILED) { perror("mmap"); ::close(fd); return false; }
-        return true;
-    }
-
-    void close() {
-        if (base_ptr && base_ptr != MAP_FAILED) munmap((void*)base_ptr, map_size);
-        if (fd >= 0) ::close(fd);
-    }
-
-    void write(uint32_t offset, uint32_t value) { base_ptr[offset / 4] = value; }
-    uint32_t read(uint32_t offset) { return base_ptr[offset / 4]; }
-};
+#include <string>
+#include <vector>
 
-// AES driver functions =======================================
+#include "aes_driver.h"
+#include "aes_vectors.h"
+#include "soft_aes.h"
+#include "aes_dispatch.h"
+#include "sim_device.h"
 
-bool poll_status(MMIO& aes, uint32_t mask, int timeout_us = 1000000) {
-    for (int i = 0; i < timeout_us; i++) {
-        uint32_t status = aes.read(AES::STATUS);
-        if ((status & mask) == mask) return true;
-        usleep(1);
-    }
-    return false;
-}
+constexpr size_t BULK_BLOCKS = 4096;
+constexpr size_t BULK_CHECK  = 16;      // blocks re-done one at a time for comparison
 
-bool aes_load_key(MMIO& aes, const uint32_t key[8]) {
-    // write 8 key words
-    aes.write(AES::KEY_W0, key[0]);
-    aes.write(AES::KEY_W1, key[1]);
-    aes.write(AES::KEY_W2, key[2]);
-    aes.write(AES::KEY_W3, key[3]);
-    aes.write(AES::KEY_W4, key[4]);
-    aes.write(AES::KEY_W5, key[5]);
-    aes.write(AES::KEY_W6, key[6]);
-    aes.write(AES::KEY_W7, key[7]);
+// dispatch stage: job sizes in blocks
+const size_t DISPATCH_SIZES[] = {1, 1, 2, 3, 16, 64, 255, 1024, 4096, 1, 8};
 
-    // strobe key load
-    aes.write(AES::CTRL, 0);
-    aes.write(AES::CTRL, AES::CTRL_KEY_LOAD);
-    aes.write(AES::CTRL, 0);
-
-    // wait for ready
-    if (!poll_status(aes, AES::STATUS_READY)) {
-        printf("    [TIMEOUT] Key expansion did not complete\n");
-        return false;
-    }
-    return true;
-}
-
-bool aes_encrypt(MMIO& aes, const uint32_t pt[4], uint32_t ct_out[4]) {
-    // write 4 plaintext words
-    aes.write(AES::PTEXT_W0, pt[0]);
-    aes.write(AES::PTEXT_W1, pt[1]);
-    aes.write(AES::PTEXT_W2, pt[2]);
-    aes.write(AES::PTEXT_W3, pt[3]);
-
-    // strobe encrypt
-    aes.write(AES::CTRL, 0);
-    aes.write(AES::CTRL, AES::CTRL_ENCRYPT);
-    aes.write(AES::CTRL, 0);
-
-    // wait for done
-    if (!poll_status(aes, AES::STATUS_DONE)) {
-        printf("    [TIMEOUT] Encryption did not complete\n");
-        return false;
-    }
-
-    // read ciphertext    ct_out[0] = aes.read(AES::CTEXT_W0);
-    ct_out[0] = aes.read(AES::CTEXT_W0);
-    ct_out[1] = aes.read(AES::CTEXT_W1);
-    ct_out[2] = aes.read(AES::CTEXT_W2);
-    ct_out[3] = aes.read(AES::CTEXT_W3);
-
-    // clear done latch
-    aes.write(AES::CTRL, AES::CTRL_CLEAR);
-    aes.write(AES::CTRL, 0);
-
-    return true;
-}
-
-// Test Vectors ================================================
-struct AESTestVector {
-    const char* name;
-    uint32_t key[8];
-    uint32_t pt[4];
-    uint32_t ct[4];
-};
-
-// words are big endian
-const AESTestVector VECTORS[] = {
-    // vector 0 from NIST FIPS 197 C.3
-    {
-        .name = "NIST FIPS 197 C.3",
-        .key = {0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f, 0x10111213, 0x14151617, 0x18191a1b, 0x1c1d1e1f},
-        .pt = {0x00112233, 0x44556677, 0x8899aabb, 0xccddeeff},
-        .ct = {0x8ea2b7ca, 0x516745bf, 0xeafc4990, 0x4b496089}
-    },
-    // vector 1 all zeros
-    {
-        .name = "All Zeros",
-        .key = {0,0,0,0,0,0,0,0},
-        .pt = {0,0,0,0},
-        .ct = {0xdc95c078, 0xa2408989, 0xad48a214, 0x92842087} // TODO: fill in correct expected ciphertext
-    },
-    // vector 2 all 1s
-    {
-        .name = "All 0xFF",
-        .key = {0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF},
-        .pt = {0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF,0xFFFFFFFF},
-        .ct = {0xd5f93d6d, 0x3311cb30, 0x9f23621b, 0x02fbd5e2} // TODO: fill in correct expected ciphertext
-    }
-};
-
-const int NUM_VECTORS = sizeof(VECTORS) / sizeof(VECTORS[0]);
+// key cache stage: vector index per request, tenant-style runs of the same key
+const int KEY_PATTERN[] = {0, 0, 0, 1, 1, 0, 2, 2, 2, 2, 1, 0, 0, 0, 0, 2, 1, 1, 1, 0};
+const int NUM_KEY_REQS = sizeof(KEY_PATTERN) / sizeof(KEY_PATTERN[0]);
 
 // helpers ================================================
 void print_128(const char* label, const uint32_t w[4]) {
@@ -195,21 +55,63 @@ bool compare_128(const uint32_t a[4], const uint32_t b[4]) {
 }
 
 // Main Test ================================================
-int main() {
+int main(int argc, char* argv[]) {
+    // --wait latency|balanced|cpu  : completion policy for key load / single block
+    // --uio /dev/uioN              : block on this UIO fd after the spin phase
+    WaitPolicy wait_policy = WaitPolicy::balanced();
+    // --calibrate                  : full HW vs CPU table + crossover job size
+    // --sim [instant|core|pynq]    : behavioral model instead of /dev/mem (default core timing)
+    const char* uio_path = nullptr;
+    bool calibrate = false;
+    bool sim = false;
+    SimTiming sim_timing;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--wait" && a + 1 < argc) {
+            if (!WaitPolicy::parse(argv[++a], wait_policy)) {
+                printf("[FATAL] Unknown wait policy '%s' (latency|balanced|cpu)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg == "--uio" && a + 1 < argc) {
+            uio_path = argv[++a];
+        } else if (arg == "--calibrate") {
+            calibrate = true;
+        } else if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                printf("[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        }
+    }
+
     printf("================================================\n");
     printf("  AES-256 Hardware Verification\n");
-    printf("  Target: PYNQ-Z2 @ 0x%08X\n", AES_BASE_ADDR);
+    if (sim) printf("  Target: behavioral model (sim_device.h)\n");
+    else     printf("  Target: PYNQ-Z2 @ 0x%08X\n", AES_BASE_ADDR);
     printf("  Vectors: %d (same as sim tb_aes_core.sv)\n", NUM_VECTORS);
     printf("================================================\n");
 
+    SimAesDevice sim_aes(sim_timing);
     MMIO aes;
-    if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+    AesDriver drv(aes);
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
         printf("[FATAL] Cannot map AES peripheral. Check:\n");
         printf("  1. Running as root (sudo)\n");
         printf("  2. Bitstream is programmed\n");
         printf("  3. AES_BASE_ADDR matches Vivado Address Editor\n");
         return EXIT_FAILURE;
     }
+    int uio_fd = -1;
+    if (uio_path) {
+        uio_fd = ::open(uio_path, O_RDWR);
+        if (uio_fd < 0) perror("open uio");
+        wait_policy.irq_fd = uio_fd;
+    }
+    drv.setWaitPolicy(wait_policy);
+
     // santiy read status before anything -------
     uint32_t status = aes.read(AES::STATUS);
     printf("[INFO] Initial AES Status: 0x%08X\n", status);
@@ -230,14 +132,14 @@ int main() {
         print_128("Plaintext", vec.pt);
 
         // 1. load key
-        if (!aes_load_key(aes, vec.key)) {
+        if (!drv.loadKey(vec.key)) {
             printf("    [FAIL] Key load failed\n");
             fail_count++;
             continue;
         }
 
         // 2. encrypt
-        if (!aes_encrypt(aes, vec.pt, ct_got)) {
+        if (!drv.encrypt(vec.pt, ct_got)) {
             printf("    [FAIL] Encryption failed\n");
             fail_count++;
             continue;
@@ -255,6 +157,120 @@ int main() {
             fail_count++;
         }
     }
+    // bulk throughput ----------------------------
+    // block 0 is the FIPS 197 vector, rest are counter blocks
+    printf("\n  --- Bulk: %zu blocks, key = %s ---\n", BULK_BLOCKS, VECTORS[0].name);
+    bool bulk_ok = drv.loadKey(VECTORS[0].key);
+    std::vector<uint32_t> bulk_pt(BULK_BLOCKS * 4), bulk_ct(BULK_BLOCKS * 4, 0);
+    memcpy(bulk_pt.data(), VECTORS[0].pt, sizeof(VECTORS[0].pt));
+    for (size_t b = 1; b < BULK_BLOCKS; b++) {
+        bulk_pt[4 * b + 0] = 0;
+        bulk_pt[4 * b + 1] = 0;
+        bulk_pt[4 * b + 2] = 0;
+        bulk_pt[4 * b + 3] = (uint32_t)b;
+    }
+
+    AesBulkStats bulk_stats;
+    if (bulk_ok) bulk_ok = drv.encryptBulk(bulk_pt.data(), bulk_ct.data(), BULK_BLOCKS, &bulk_stats);
+    if (bulk_ok && !compare_128(bulk_ct.data(), VECTORS[0].ct)) {
+        print_128("Ciphertext got", bulk_ct.data());
+        print_128("Ciphertext exp", VECTORS[0].ct);
+        bulk_ok = false;
+    }
+    for (size_t b = 0; bulk_ok && b < BULK_CHECK; b++) {
+        size_t idx = (b * (BULK_BLOCKS - 1)) / (BULK_CHECK - 1);
+        uint32_t ct_ref[4];
+        if (!drv.encrypt(&bulk_pt[4 * idx], ct_ref) || !compare_128(ct_ref, &bulk_ct[4 * idx])) {
+            printf("    Block %zu differs from single block path\n", idx);
+            bulk_ok = false;
+        }
+    }
+    // every block against the CPU engine
+    if (bulk_ok) {
+        SoftAes256 sw;
+        std::vector<uint32_t> sw_ct(BULK_BLOCKS * 4);
+        sw.setKey(VECTORS[0].key);
+        sw.encryptBlocks(bulk_pt.data(), sw_ct.data(), BULK_BLOCKS);
+        size_t mismatches = 0;
+        for (size_t b = 0; b < BULK_BLOCKS; b++) {
+            if (!compare_128(&sw_ct[4 * b], &bulk_ct[4 * b])) mismatches++;
+        }
+        printf("    Software check (%s): %zu/%zu blocks match\n",
+               SoftAes256::kernelName(sw.kernel()), BULK_BLOCKS - mismatches, BULK_BLOCKS);
+        if (mismatches) bulk_ok = false;
+    }
+    if (bulk_ok) {
+        print_bulk_stats(bulk_stats);
+        printf("    [PASS] Bulk ciphertext matches single block path\n");
+    } else {
+        printf("    [FAIL] Bulk encryption failed\n");
+        fail_count++;
+    }
+
+    // key cache ----------------------------------
+    printf("\n  --- Key cache: %d requests over %d keys ---\n", NUM_KEY_REQS, NUM_VECTORS);
+    AesKeyHandle handles[NUM_VECTORS];
+    for (int i = 0; i < NUM_VECTORS; i++) handles[i] = drv.registerKey(VECTORS[i].key);
+    drv.resetKeyCacheStats();
+
+    bool cache_ok = true;
+    uint64_t expect_hits = 0;
+    for (int r = 0; r < NUM_KEY_REQS; r++) {
+        const AESTestVector& vec = VECTORS[KEY_PATTERN[r]];
+        if (r > 0 && KEY_PATTERN[r] == KEY_PATTERN[r - 1]) expect_hits++;
+        uint32_t ct_got[4] = {0};
+        if (!drv.encrypt(handles[KEY_PATTERN[r]], vec.pt, ct_got) || !compare_128(ct_got, vec.ct)) {
+            printf("    Request %d (%s) mismatch\n", r, vec.name);
+            cache_ok = false;
+        }
+    }
+    const AesKeyCacheStats& ks = drv.keyCacheStats();
+    ks.print();
+    if (cache_ok && ks.hits == expect_hits) {
+        printf("    [PASS] All requests correct, %llu/%llu expected hits\n",
+               (unsigned long long)ks.hits, (unsigned long long)expect_hits);
+    } else {
+        printf("    [FAIL] Key cache stage (hits %llu, expected %llu)\n",
+               (unsigned long long)ks.hits, (unsigned long long)expect_hits);
+        fail_count++;
+    }
+    for (int i = 0; i < NUM_VECTORS; i++) drv.unregisterKey(handles[i]);
+
+    // hybrid dispatch ----------------------------
+    printf("\n  --- Hybrid dispatch: HW core + CPU (%s) ---\n", SoftAes256::kernelName(SoftAes256::constantTime()));
+    {
+        AesDispatcher disp(&drv);
+        disp.setKey(VECTORS[0].key);
+        disp.calibrate(calibrate ? 4096 : 256, calibrate ? 5 : 3, calibrate);
+        if (!calibrate) printf("    Crossover : %zu blocks (0 = CPU always faster)\n", disp.crossoverBlocks());
+        disp.resetStats();
+
+        SoftAes256 sw;
+        sw.setKey(VECTORS[0].key);
+        bool disp_ok = true;
+        for (size_t n : DISPATCH_SIZES) {
+            std::vector<uint32_t> got(n * 4), exp(n * 4);
+            AesDispatchPlan p = disp.plan(n);
+            disp_ok &= disp.encrypt(bulk_pt.data(), got.data(), n);
+            sw.encryptBlocks(bulk_pt.data(), exp.data(), n);
+            bool match = got == exp;
+            printf("    %5zu blocks -> %-5s (hw %zu, cpu %zu) %s\n", n,
+                   p.route == AesRoute::CPU ? "cpu" : p.route == AesRoute::HW ? "hw" : "split",
+                   p.hw_blocks, p.cpu_blocks, match ? "ok" : "MISMATCH");
+            disp_ok &= match;
+        }
+        disp.stats().print();
+        if (disp_ok) {
+            printf("    [PASS] Dispatched output matches software engine\n");
+        } else {
+            printf("    [FAIL] Dispatch stage\n");
+            fail_count++;
+        }
+    }
+
+    printf("\n  --- Completion waits ---\n");
+    drv.printWaitStats();
+
     // summary --------------------------------------
     printf("\n================================================\n");
     printf("  Test Summary: %d/%d passed, %d failed\n", pass_count, NUM_VECTORS, fail_count);
@@ -267,6 +283,7 @@ int main() {
         printf("[OVERALL FAIL] Some tests failed. Check above for details.\n");
     }
 
+    if (uio_fd >= 0) ::close(uio_fd);
     aes.close();
     return (fail_count == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -0,0 +1,338 @@
+/**
+* @file     test_async.cpp
+* @brief    HsmReactor (hsm_async.h): coroutines on an epoll loop, futures, error paths, overlap
+* @details  Behavioral model by default. Needs C++20 for the coroutine half.
+*
+* T1 - COROS coroutines on one epoll loop thread, each interleaving encrypt() under three
+*      keys with randomBytes(); every ciphertext checked against soft_aes.h
+* T2 - futures from several threads at once, same checks, no loop
+* T3 - error paths: unknown key, dead TRNG (TIMEOUT), locked TRNG (HEALTH_FAIL, buffer
+*      wiped), submit after stop()
+* T4 - one bulk stream + one random stream: blocking back to back vs both through the
+*      reactor (TRNG waits hidden behind AES blocks)
+*
+* Usage: test_async [--hw] [--sim [instant|core|pynq]]
+*   --hw  run against the FPGA (as root) instead of the behavioral model
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/epoll.h>
+
+#include "hsm_async.h"
+#include "sim_device.h"
+#include "soft_aes.h"
+
+#if !HSM_ASYNC_COROUTINES
+#error "test_async needs C++20 coroutines (-std=c++20)"
+#endif
+
+constexpr int    COROS        = 16;
+constexpr int    CORO_ROUNDS  = 24;
+constexpr int    NUM_KEYS     = 3;
+constexpr size_t RANDOM_LEN   = 61;         // not a word multiple on purpose
+constexpr int    FUT_THREADS  = 4;
+constexpr int    FUT_ROUNDS   = 64;
+constexpr size_t OVERLAP_BLOCKS = 1 << 14;
+constexpr size_t OVERLAP_BYTES  = 2048;
+
+static const uint32_t KEYS[NUM_KEYS][8] = {
+    { 0x603deb10, 0x15ca71be, 0x2b73aef0, 0x857d7781, 0x1f352c07, 0x3b6108d7, 0x2d9810a3, 0x0914dff4 },
+    { 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f, 0x10111213, 0x14151617, 0x18191a1b, 0x1c1d1e1f },
+    { 0xfeffe992, 0x8665731c, 0x6d6a8f94, 0x67308308, 0xfeffe992, 0x8665731c, 0x6d6a8f94, 0x67308308 },
+};
+
+struct Shared {
+    HsmReactor* r;
+    AesKeyHandle keys[NUM_KEYS];
+    SoftAes256   soft[NUM_KEYS];
+    int running = 0;
+    int mismatches = 0;
+    int errors = 0;
+    int random_zero = 0;
+    uint64_t ops = 0;
+};
+
+static uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    return x ^ (x >> 16);
+}
+
+// T1 body: encrypt / random interleaved, sizes and keys vary per round
+static HsmTask worker(Shared& s, int id) {
+    std::vector<uint32_t> pt, ct, ref;
+    uint8_t rnd[RANDOM_LEN];
+    for (int round = 0; round < CORO_ROUNDS; round++) {
+        uint32_t seed = mix(id * 1000 + round);
+        int k = seed % NUM_KEYS;
+        size_t blocks = 1 + (seed >> 8) % 40;
+        pt.resize(4 * blocks);
+        ct.assign(4 * blocks, 0);
+        ref.resize(4 * blocks);
+        for (size_t i = 0; i < pt.size(); i++) pt[i] = mix(seed + (uint32_t)i);
+
+        HsmAsyncStatus st = co_await s.r->encrypt(s.keys[k], pt.data(), ct.data(), blocks);
+        s.ops++;
+        if (st != HsmAsyncStatus::OK) {
+            s.errors++;
+        } else {
+            s.soft[k].encryptBlocks(pt.data(), ref.data(), blocks);
+            if (ct != ref) s.mismatches++;
+        }
+
+        if (round % 3 == 0) {
+            memset(rnd, 0, sizeof(rnd));
+            st = co_await s.r->randomBytes(rnd, sizeof(rnd));
+            s.ops++;
+            bool all_zero = true;
+            for (uint8_t b : rnd) all_zero &= b == 0;
+            if (st != HsmAsyncStatus::OK) s.errors++;
+            else if (all_zero) s.random_zero++;
+        }
+    }
+    s.running--;
+}
+
+// parameters live in the coroutine frame (a capturing lambda's closure would not outlive the call)
+static HsmTask await_encrypt(HsmReactor& r, AesKeyHandle key, const uint32_t* pt, uint32_t* ct, size_t n,
+                             HsmAsyncStatus& out, bool& done) {
+    out = co_await r.encrypt(key, pt, ct, n);
+    done = true;
+}
+
+static HsmTask await_random(HsmReactor& r, uint8_t* buf, size_t len, HsmAsyncStatus& out, bool& done) {
+    out = co_await r.randomBytes(buf, len);
+    done = true;
+}
+
+// drive a reactor's completions from a plain poll loop until flag() holds
+template <class Pred>
+static bool drain_until(HsmReactor& r, Pred flag, int timeout_ms = 10000) {
+    auto t0 = std::chrono::steady_clock::now();
+    while (!flag()) {
+        struct pollfd pfd = { r.eventFd(), POLLIN, 0 };
+        if (::poll(&pfd, 1, 50) > 0) r.dispatch();
+        if (std::chrono::steady_clock::now() - t0 > std::chrono::milliseconds(timeout_ms)) return false;
+    }
+    return true;
+}
+
+static double secs_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    SimTiming sim_timing;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO mmio;
+    if (sim) {
+        mmio.attach(&sim_aes);
+    } else if (!mmio.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral\n");
+        return EXIT_FAILURE;
+    }
+    hsm.clearHealth();
+    AesDriver drv(mmio);
+
+    printf("================================================\n");
+    printf("  Async reactor test (%s)\n", sim ? mmio.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+    auto verdict = [&](bool ok) {
+        fail_count += !ok;
+        return ok ? "[PASS]" : "[FAIL]";
+    };
+
+    HsmReactor reactor(&drv, &hsm);
+    if (!reactor.start()) {
+        fprintf(stderr, "[FATAL] Cannot start reactor\n");
+        return EXIT_FAILURE;
+    }
+    Shared s;
+    s.r = &reactor;
+    for (int k = 0; k < NUM_KEYS; k++) {
+        s.keys[k] = reactor.registerKey(KEYS[k]);
+        s.soft[k].setKey(KEYS[k]);
+    }
+
+    // T1 - coroutines on an epoll loop -------------
+    printf("\n[TEST 1] %d coroutines x %d rounds on one epoll loop\n", COROS, CORO_ROUNDS);
+    {
+        int ep = epoll_create1(EPOLL_CLOEXEC);
+        struct epoll_event ev = {};
+        ev.events = EPOLLIN;
+        ev.data.fd = reactor.eventFd();
+        epoll_ctl(ep, EPOLL_CTL_ADD, reactor.eventFd(), &ev);
+
+        auto t0 = std::chrono::steady_clock::now();
+        s.running = COROS;
+        for (int c = 0; c < COROS; c++) worker(s, c);
+        uint64_t wakeups = 0, resumed = 0;
+        bool stuck = false;
+        while (s.running > 0) {
+            struct epoll_event out[4];
+            int n = epoll_wait(ep, out, 4, 5000);
+            if (n <= 0) {
+                stuck = true;
+                break;
+            }
+            wakeups++;
+            resumed += reactor.dispatch();
+        }
+        double secs = secs_since(t0);
+        ::close(ep);
+
+        printf("    Ops         : %llu in %.3f s, %llu loop wakeups (%.1f resumes each)\n",
+               (unsigned long long)s.ops, secs, (unsigned long long)wakeups, wakeups ? (double)resumed / wakeups : 0.0);
+        printf("    Ciphertext  : %d mismatches, %d errors %s\n", s.mismatches, s.errors,
+               verdict(!stuck && s.mismatches == 0 && s.errors == 0));
+        printf("    Random      : %d all-zero buffers %s\n", s.random_zero, verdict(s.random_zero == 0));
+    }
+
+    // T2 - futures ---------------------------------
+    printf("\n[TEST 2] futures from %d threads x %d rounds\n", FUT_THREADS, FUT_ROUNDS);
+    {
+        std::vector<int> bad(FUT_THREADS, 0);
+        std::vector<std::thread> th;
+        for (int t = 0; t < FUT_THREADS; t++) {
+            th.emplace_back([&, t] {
+                uint32_t pt[4 * 8], ct[4 * 8], ref[4 * 8];
+                uint8_t rnd[32];
+                for (int i = 0; i < FUT_ROUNDS; i++) {
+                    int k = (t + i) % NUM_KEYS;
+                    for (int w = 0; w < 32; w++) pt[w] = mix(t * 7919 + i * 31 + w);
+                    auto fe = reactor.encryptFuture(s.keys[k], pt, ct, 8);
+                    auto fr = reactor.randomBytesFuture(rnd, sizeof(rnd));
+                    bool ok = fe.get() == HsmAsyncStatus::OK && fr.get() == HsmAsyncStatus::OK;
+                    s.soft[k].encryptBlocks(pt, ref, 8);
+                    if (!ok || memcmp(ct, ref, sizeof(ct)) != 0) bad[t]++;
+                }
+            });
+        }
+        for (std::thread& t : th) t.join();
+        int total = 0;
+        for (int b : bad) total += b;
+        printf("    Results     : %d bad of %d %s\n", total, FUT_THREADS * FUT_ROUNDS, verdict(total == 0));
+    }
+
+    // T3 - error paths -----------------------------
+    printf("\n[TEST 3] error paths\n");
+    {
+        uint32_t pt[4] = { 1, 2, 3, 4 }, ct[4];
+        HsmAsyncStatus st = HsmAsyncStatus::OK;
+        bool done = false;
+        await_encrypt(reactor, 0xDEAD, pt, ct, 1, st, done);
+        bool ok = drain_until(reactor, [&] { return done; }) && st == HsmAsyncStatus::BAD_KEY;
+        printf("    Unknown key : %-12s %s\n", hsm_async_status_name(st), verdict(ok));
+
+        // the good path still works after a failed op
+        ok = reactor.encryptFuture(s.keys[0], pt, ct, 1).get() == HsmAsyncStatus::OK;
+        uint32_t ref[4];
+        s.soft[0].encrypt(pt, ref);
+        printf("    Recovered   : %s\n", verdict(ok && memcmp(ct, ref, sizeof(ct)) == 0));
+
+        if (sim) {
+            HsmAsyncConfig cfg;
+            cfg.timeout_us = 2000;
+            SimHsmDevice dead_dev(sim_timing), locked_dev(sim_timing);
+            dead_dev.injectFault(TrngFault::DEAD);
+            locked_dev.injectFault(TrngFault::LOCKED);
+            PynqHSM dead(&dead_dev), locked(&locked_dev);
+            HsmReactor rd(nullptr, &dead, cfg), rl(nullptr, &locked, cfg);
+            rd.start();
+            rl.start();
+
+            uint8_t buf[64];
+            memset(buf, 0xA5, sizeof(buf));
+            st = rd.randomBytesFuture(buf, sizeof(buf)).get();
+            printf("    Dead TRNG   : %-12s %s\n", hsm_async_status_name(st), verdict(st == HsmAsyncStatus::TIMEOUT));
+
+            memset(buf, 0xA5, sizeof(buf));
+            done = false;
+            await_random(rl, buf, sizeof(buf), st, done);
+            ok = drain_until(rl, [&] { return done; });
+            bool wiped = true;
+            for (uint8_t b : buf) wiped &= b == 0;
+            printf("    Locked TRNG : %-12s wiped=%s %s\n", hsm_async_status_name(st), wiped ? "yes" : "no",
+                   verdict(ok && st == HsmAsyncStatus::HEALTH_FAIL && wiped));
+
+            st = rd.encryptFuture(s.keys[0], pt, ct, 1).get();
+            printf("    No AES      : %-12s %s\n", hsm_async_status_name(st), verdict(st == HsmAsyncStatus::NO_DEVICE));
+
+            rd.stop();
+            st = rd.randomBytesFuture(buf, 4).get();
+            printf("    After stop  : %-12s %s\n", hsm_async_status_name(st), verdict(st == HsmAsyncStatus::STOPPED));
+        }
+    }
+
+    // T4 - overlap ---------------------------------
+    printf("\n[TEST 4] %zu AES blocks + %zu TRNG bytes\n", OVERLAP_BLOCKS, OVERLAP_BYTES);
+    {
+        std::vector<uint32_t> pt(4 * OVERLAP_BLOCKS), ct(4 * OVERLAP_BLOCKS), ref(4 * OVERLAP_BLOCKS);
+        for (size_t i = 0; i < pt.size(); i++) pt[i] = mix((uint32_t)i);
+        std::vector<uint8_t> rnd(OVERLAP_BYTES);
+
+        // blocking, back to back: the drivers are the reactor's, so borrow them via post()
+        double blocking = 0;
+        reactor.post([&] {
+            auto t0 = std::chrono::steady_clock::now();
+            drv.encryptBulk(s.keys[1], pt.data(), ct.data(), OVERLAP_BLOCKS);
+            for (size_t off = 0; off < rnd.size(); off += 4) {
+                uint32_t w = hsm.getTrngRandom();
+                memcpy(rnd.data() + off, &w, 4);
+            }
+            blocking = secs_since(t0);
+        }).wait();
+
+        ct.assign(ct.size(), 0);
+        HsmAsyncStatus se = HsmAsyncStatus::STOPPED, sr = HsmAsyncStatus::STOPPED;
+        bool de = false, dr = false;
+        auto t0 = std::chrono::steady_clock::now();
+        await_encrypt(reactor, s.keys[1], pt.data(), ct.data(), OVERLAP_BLOCKS, se, de);
+        await_random(reactor, rnd.data(), rnd.size(), sr, dr);
+        bool ok = drain_until(reactor, [&] { return de && dr; });
+        double async = secs_since(t0);
+
+        s.soft[1].encryptBlocks(pt.data(), ref.data(), OVERLAP_BLOCKS);
+        ok = ok && se == HsmAsyncStatus::OK && sr == HsmAsyncStatus::OK && ct == ref;
+        printf("    Blocking    : %8.2f ms\n", blocking * 1e3);
+        printf("    Reactor     : %8.2f ms (%.2fx) %s\n", async * 1e3, async > 0 ? blocking / async : 0.0, verdict(ok));
+    }
+
+    reactor.stop();
+    reactor.stats().print();
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
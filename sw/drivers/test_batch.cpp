@@ -0,0 +1,257 @@
+/**
+* @file     test_batch.cpp
+* @brief    AesDriver::encryptBatch(): many small jobs under many keys vs the naive sequence
+* @details  Behavioral model by default (sim_device.h latches KEY_W on KEY_LOAD and PTEXT_W
+*           on ENCRYPT and holds CTEXT through a key expansion, as aes_core.sv does);
+*           test_rtl runs the same batch against the Verilated wrapper.
+*
+* T1 - every job of a mixed-tenant batch vs soft_aes.h: naive, key cache, batch in
+*      submitted order, batch grouped, batch in place; empty jobs; a bad handle fails
+*      the batch before any register access
+* T2 - key loads: grouped = distinct keys (resident key free), all but the first staged
+* T3 - jobs/s and register accesses per job for each sequence, speedup vs naive
+*
+* Naive is the per-job sequence the drivers used to issue: loadKey() (8 KEY_W, KEY_LOAD,
+* poll READY), then per block encrypt() (4 PTEXT_W, ENCRYPT, poll DONE, 4 reads, CLEAR).
+*
+* Usage: test_batch [--hw] [--sim [instant|core|pynq]] [--jobs N] [--keys N] [--blocks N]
+*   --blocks N  job sizes are 1..N blocks (default 4)
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "aes_driver.h"
+#include "sim_device.h"
+#include "soft_aes.h"
+
+static uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    return x ^ (x >> 16);
+}
+
+// Workload =======================================
+struct Tenants {
+    std::vector<std::vector<uint32_t>> keys;
+    std::vector<AesKeyHandle> handles;
+    std::vector<SoftAes256>   ref;
+};
+
+struct Workload {
+    std::vector<AesBatchJob> jobs;
+    std::vector<uint32_t>    pt, ct, want;
+    std::vector<size_t>      tenant;        // per job
+};
+
+static void make_tenants(AesDriver& drv, size_t n, Tenants& t) {
+    t.keys.assign(n, std::vector<uint32_t>(8));
+    t.handles.resize(n);
+    t.ref.resize(n);
+    for (size_t k = 0; k < n; k++) {
+        for (int i = 0; i < 8; i++) t.keys[k][i] = mix((uint32_t)(0xC0FFEE + 8 * k + i));
+        t.handles[k] = drv.registerKey(t.keys[k].data());
+        t.ref[k].setKey(t.keys[k].data());
+    }
+}
+
+// random tenant and 1..max_blocks blocks per job; a job in every 7 is empty
+static void make_jobs(const Tenants& t, size_t n_jobs, size_t max_blocks, uint32_t seed, Workload& w) {
+    std::vector<size_t> sizes(n_jobs);
+    w.tenant.resize(n_jobs);
+    size_t total = 0;
+    for (size_t j = 0; j < n_jobs; j++) {
+        uint32_t r = mix(seed ^ (uint32_t)(j * 0x9e3779b9u));
+        w.tenant[j] = r % t.keys.size();
+        sizes[j] = j % 7 == 3 ? 0 : 1 + (r >> 8) % max_blocks;
+        total += sizes[j];
+    }
+    w.pt.resize(4 * total);
+    w.ct.assign(4 * total, 0);
+    w.want.resize(4 * total);
+    for (size_t i = 0; i < w.pt.size(); i++) w.pt[i] = mix(seed + (uint32_t)i);
+    w.jobs.resize(n_jobs);
+    size_t off = 0;
+    for (size_t j = 0; j < n_jobs; j++) {
+        w.jobs[j] = { t.handles[w.tenant[j]], w.pt.data() + off, w.ct.data() + off, sizes[j] };
+        t.ref[w.tenant[j]].encryptBlocks(w.pt.data() + off, w.want.data() + off, sizes[j]);
+        off += 4 * sizes[j];
+    }
+}
+
+static size_t distinct_keys(const Workload& w) {
+    std::set<AesKeyHandle> s;
+    for (const AesBatchJob& j : w.jobs) if (j.n_blocks) s.insert(j.key);
+    return s.size();
+}
+
+// Sequences =======================================
+enum class Seq { NAIVE, CACHED, BATCH, GROUPED };
+
+static const char* seq_name(Seq s) {
+    switch (s) {
+        case Seq::NAIVE:   return "naive";
+        case Seq::CACHED:  return "key cache";
+        case Seq::BATCH:   return "batch";
+        default:           return "batch grouped";
+    }
+}
+
+static bool run_seq(Seq s, AesDriver& drv, const Tenants& t, Workload& w, AesBatchStats* st = nullptr) {
+    switch (s) {
+        case Seq::NAIVE:
+            for (size_t j = 0; j < w.jobs.size(); j++) {
+                const AesBatchJob& job = w.jobs[j];
+                if (!job.n_blocks) continue;
+                if (!drv.loadKey(t.keys[w.tenant[j]].data())) return false;
+                for (size_t b = 0; b < job.n_blocks; b++)
+                    if (!drv.encrypt(job.pt + 4 * b, job.ct + 4 * b)) return false;
+            }
+            return true;
+        case Seq::CACHED:
+            for (const AesBatchJob& job : w.jobs)
+                if (job.n_blocks && !drv.encryptBulk(job.key, job.pt, job.ct, job.n_blocks)) return false;
+            return true;
+        case Seq::BATCH:
+            return drv.encryptBatch(w.jobs.data(), w.jobs.size(), st, false);
+        default:
+            return drv.encryptBatch(w.jobs.data(), w.jobs.size(), st, true);
+    }
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    SimTiming sim_timing;
+    size_t n_jobs = 4000, n_keys = 16, max_blocks = 4;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--jobs" && a + 1 < argc)   n_jobs = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--keys" && a + 1 < argc)   n_keys = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--blocks" && a + 1 < argc) max_blocks = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--jobs N] [--keys N] [--blocks N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (n_jobs == 0) n_jobs = 1;
+    if (n_keys == 0) n_keys = 1;
+    if (max_blocks == 0) max_blocks = 1;
+
+    SimAesDevice sim_aes(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+    auto accesses = [&] { return sim ? sim_aes.reads() + sim_aes.writes() : 0; };
+
+    printf("================================================\n");
+    printf("  AES Multi-key Batch Test (%s)\n", sim ? aes.backend() : "hardware");
+    printf("  %zu jobs, %zu keys, 1..%zu blocks per job\n", n_jobs, n_keys, max_blocks);
+    printf("================================================\n");
+    int fail_count = 0;
+    auto verdict = [&](bool ok) {
+        if (!ok) fail_count++;
+        return ok ? "[PASS]" : "[FAIL]";
+    };
+
+    Tenants tenants;
+    make_tenants(drv, n_keys, tenants);
+    Workload w;
+    make_jobs(tenants, n_jobs, max_blocks, 0x5eed, w);
+
+    // T1 - correctness -----------------------------
+    printf("\n[TEST 1] Every job vs soft_aes.h\n");
+    for (Seq s : { Seq::NAIVE, Seq::CACHED, Seq::BATCH, Seq::GROUPED }) {
+        std::fill(w.ct.begin(), w.ct.end(), 0);
+        bool ok = run_seq(s, drv, tenants, w) && w.ct == w.want;
+        printf("    %-14s: %s\n", seq_name(s), verdict(ok));
+    }
+    {
+        // in place, with the first tenant's key already resident
+        Workload inplace;
+        make_jobs(tenants, n_jobs / 4 + 1, max_blocks, 0xA11A5, inplace);
+        for (AesBatchJob& j : inplace.jobs) j.ct = const_cast<uint32_t*>(j.pt);
+        drv.loadKey(tenants.keys[0].data());
+        bool ok = drv.encryptBatch(inplace.jobs.data(), inplace.jobs.size()) && inplace.pt == inplace.want;
+        printf("    %-14s: %s\n", "in place", verdict(ok));
+
+        AesBatchJob empty[2] = { { tenants.handles[0], nullptr, nullptr, 0 }, { tenants.handles[1], nullptr, nullptr, 0 } };
+        AesBatchStats st;
+        ok = drv.encryptBatch(empty, 2, &st) && st.jobs == 2 && st.blocks == 0 && st.key_loads == 0;
+        printf("    %-14s: %s\n", "empty jobs", verdict(ok));
+
+        uint32_t blk[4] = {};
+        AesBatchJob bad[2] = { { tenants.handles[0], blk, blk, 1 }, { 0xBAD, blk, blk, 1 } };
+        uint64_t before = accesses();
+        ok = !drv.encryptBatch(bad, 2) && accesses() == before;
+        printf("    %-14s: rejected, no register access %s\n", "bad handle", verdict(ok));
+    }
+
+    // T2 - key loads -------------------------------
+    printf("\n[TEST 2] Key loads\n");
+    {
+        drv.invalidateKeyCache();
+        AesBatchStats st;
+        bool ok = run_seq(Seq::GROUPED, drv, tenants, w, &st) && w.ct == w.want;
+        size_t distinct = distinct_keys(w);
+        ok = ok && st.key_loads == distinct && st.keys_staged == distinct - 1;
+        st.print();
+        printf("    Distinct    : %zu keys -> %llu loads, %llu staged %s\n", distinct,
+               (unsigned long long)st.key_loads, (unsigned long long)st.keys_staged, verdict(ok));
+
+        // the last group's key is now resident: running again costs one load fewer
+        ok = run_seq(Seq::GROUPED, drv, tenants, w, &st) && st.key_loads == distinct - 1;
+        printf("    Resident    : second run %llu loads (resident group first) %s\n",
+               (unsigned long long)st.key_loads, verdict(ok));
+    }
+
+    // T3 - throughput ------------------------------
+    printf("\n[TEST 3] Jobs/s vs the naive sequence\n");
+    {
+        printf("    %-14s %12s %10s %14s %8s\n", "sequence", "jobs/s", "blocks/s", "accesses/job", "speedup");
+        double naive_jps = 0;
+        uint64_t naive_acc = 0, grouped_acc = 0;
+        for (Seq s : { Seq::NAIVE, Seq::CACHED, Seq::BATCH, Seq::GROUPED }) {
+            drv.invalidateKeyCache();
+            uint64_t a0 = accesses();
+            auto t0 = std::chrono::steady_clock::now();
+            bool ok = run_seq(s, drv, tenants, w);
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            uint64_t acc = accesses() - a0;
+            double jps = secs > 0 ? n_jobs / secs : 0;
+            size_t blocks = w.pt.size() / 4;
+            if (s == Seq::NAIVE) { naive_jps = jps; naive_acc = acc; }
+            if (s == Seq::GROUPED) grouped_acc = acc;
+            printf("    %-14s %12.0f %10.0f %14.1f %7.2fx%s\n", seq_name(s), jps, secs > 0 ? blocks / secs : 0.0,
+                   (double)acc / n_jobs, naive_jps > 0 ? jps / naive_jps : 0.0, ok ? "" : "  [FAIL]");
+            if (!ok) fail_count++;
+        }
+        if (sim) {
+            bool ok = grouped_acc < naive_acc;
+            printf("    Grouped batch issues %.1f%% of the naive register accesses %s\n",
+                   naive_acc ? 100.0 * grouped_acc / naive_acc : 0.0, verdict(ok));
+        }
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,321 @@
+/**
+* @file     test_cluster.cpp
+* @brief    AesCluster (aes_cluster.h): discovery, sharded correctness, key affinity, scaling
+* @details  Behavioral model by default: MAX_INST SimAesDevices on one SimBus, so the scaling
+*           numbers include interconnect contention. Needs no new bitstream.
+*
+* T1 - aes_discover() on a synthetic 3-instance .hwh and on the repo's block design
+* T2 - random jobs / keys on 1..MAX_INST instances, every block checked against soft_aes.h;
+*      SP 800-38A F.5.5 CTR through AesDispatcher + AesCtr on the cluster
+* T3 - two tenants interleaving jobs on two instances: each settles on its own core
+* T4 - bulk throughput on 1, 2, 4 instances, per instance and in aggregate
+*
+* Usage: test_cluster [--hw [HWH|BD]] [--sim [instant|core|pynq]] [--instances N]
+*   --hw  every aes_bridge in the overlay description (default: the one at AES_BASE_ADDR)
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unistd.h>
+
+#include "aes_cluster.h"
+#include "aes_dispatch.h"
+#include "aes_modes.h"
+#include "sim_device.h"
+#include "soft_aes.h"
+
+constexpr size_t MAX_INST      = 4;
+constexpr int    RANDOM_JOBS   = 200;
+constexpr size_t MAX_JOB       = 700;       // blocks
+constexpr int    TENANT_ROUNDS = 40;
+constexpr size_t TENANT_JOB    = 96;
+constexpr size_t SCALE_BLOCKS  = 1 << 14;
+constexpr int    SCALE_REPS    = 4;
+constexpr uint32_t SLOW_CORE   = 32;        // core-bound profile: block_cycles multiplier
+
+const char* const BD_PATH = "hw/hsm_system_top/hsm_system_top.srcs/sources_1/bd/hsm_system_design/hsm_system_design.bd";
+
+static const uint32_t KEYS[2][8] = {
+    { 0x603deb10, 0x15ca71be, 0x2b73aef0, 0x857d7781, 0x1f352c07, 0x3b6108d7, 0x2d9810a3, 0x0914dff4 },
+    { 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f, 0x10111213, 0x14151617, 0x18191a1b, 0x1c1d1e1f },
+};
+
+// SP 800-38A F.5.5 (CTR-AES256.Encrypt)
+static const uint8_t CTR_IV[16] = { 0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff };
+static const uint8_t CTR_PT[64] = {
+    0x6b, 0xc1, 0xbe, 0xe2, 0x2e, 0x40, 0x9f, 0x96, 0xe9, 0x3d, 0x7e, 0x11, 0x73, 0x93, 0x17, 0x2a,
+    0xae, 0x2d, 0x8a, 0x57, 0x1e, 0x03, 0xac, 0x9c, 0x9e, 0xb7, 0x6f, 0xac, 0x45, 0xaf, 0x8e, 0x51,
+    0x30, 0xc8, 0x1c, 0x46, 0xa3, 0x5c, 0xe4, 0x11, 0xe5, 0xfb, 0xc1, 0x19, 0x1a, 0x0a, 0x52, 0xef,
+    0xf6, 0x9f, 0x24, 0x45, 0xdf, 0x4f, 0x9b, 0x17, 0xad, 0x2b, 0x41, 0x7b, 0xe6, 0x6c, 0x37, 0x10,
+};
+static const uint8_t CTR_CT[64] = {
+    0x60, 0x1e, 0xc3, 0x13, 0x77, 0x57, 0x89, 0xa5, 0xb7, 0xa7, 0xf5, 0x04, 0xbb, 0xf3, 0xd2, 0x28,
+    0xf4, 0x43, 0xe3, 0xca, 0x4d, 0x62, 0xb5, 0x9a, 0xca, 0x84, 0xe9, 0x90, 0xca, 0xca, 0xf5, 0xc5,
+    0x2b, 0x09, 0x30, 0xda, 0xa2, 0x3d, 0xe9, 0x4c, 0xe8, 0x70, 0x17, 0xba, 0x2d, 0x84, 0x98, 0x8d,
+    0xdf, 0xc9, 0xc5, 0x8d, 0xb6, 0x7a, 0xad, 0xa6, 0x13, 0xc2, 0xdd, 0x08, 0x45, 0x79, 0x41, 0xa6,
+};
+
+static const char HWH_3[] =
+    "<?xml version=\"1.0\"?>\n<EDKSYSTEM>\n<MODULES>\n"
+    "<MODULE FULLNAME=\"/aes_bridge_2\" INSTANCE=\"aes_bridge_2\" MODTYPE=\"aes_bridge\" VLNV=\"xilinx.com:module_ref:aes_bridge:1.0\">\n"
+    "</MODULE>\n"
+    "<MODULE FULLNAME=\"/my_hsm\" INSTANCE=\"my_hsm\" MODTYPE=\"hsm_axi_wrapper\">\n</MODULE>\n"
+    "<MODULE FULLNAME=\"/aes_bridge_0\" INSTANCE=\"aes_bridge_0\" MODTYPE=\"aes_bridge\">\n</MODULE>\n"
+    "<MODULE FULLNAME=\"/aes_bridge_1\" INSTANCE=\"aes_bridge_1\" MODTYPE=\"aes_bridge\">\n</MODULE>\n"
+    "</MODULES>\n<MEMORYMAP>\n"
+    "<MEMRANGE ADDRESSBLOCK=\"reg0\" BASENAME=\"C_BASEADDR\" BASEVALUE=\"0x40003000\" HIGHNAME=\"C_HIGHADDR\" HIGHVALUE=\"0x40003FFF\" INSTANCE=\"aes_bridge_2\" IS_DATA=\"TRUE\" MASTERBUSINTERFACE=\"M_AXI_GP0\" MEMTYPE=\"REGISTER\"/>\n"
+    "<MEMRANGE ADDRESSBLOCK=\"reg0\" BASENAME=\"C_BASEADDR\" BASEVALUE=\"0x40000000\" HIGHNAME=\"C_HIGHADDR\" HIGHVALUE=\"0x40000FFF\" INSTANCE=\"my_hsm\" MEMTYPE=\"REGISTER\"/>\n"
+    "<MEMRANGE ADDRESSBLOCK=\"reg0\" BASENAME=\"C_BASEADDR\" BASEVALUE=\"0x40001000\" HIGHNAME=\"C_HIGHADDR\" HIGHVALUE=\"0x40001FFF\" INSTANCE=\"aes_bridge_0\" MEMTYPE=\"REGISTER\"/>\n"
+    "<MEMRANGE ADDRESSBLOCK=\"reg0\" BASENAME=\"C_BASEADDR\" BASEVALUE=\"0x40002000\" HIGHNAME=\"C_HIGHADDR\" HIGHVALUE=\"0x40002FFF\" INSTANCE=\"aes_bridge_1\" MEMTYPE=\"REGISTER\"/>\n"
+    "</MEMORYMAP>\n</EDKSYSTEM>\n";
+
+static uint32_t mix(uint32_t x) {
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    return x ^ (x >> 16);
+}
+
+// a cluster of n behavioral cores on one bus
+struct SimRig {
+    SimBus bus;
+    std::vector<std::unique_ptr<SimAesDevice>> devs;
+    AesCluster cluster;
+
+    SimRig(size_t n, const SimTiming& t, const AesClusterConfig& cfg = AesClusterConfig()) : cluster(cfg) {
+        for (size_t i = 0; i < n; i++) {
+            devs.emplace_back(new SimAesDevice(t));
+            devs.back()->attachBus(&bus);
+            char name[32];
+            snprintf(name, sizeof(name), "sim_aes.%zu", i);
+            cluster.addInstance(devs.back().get(), name);
+        }
+    }
+};
+
+static bool discover_synthetic() {
+    char path[] = "/tmp/test_cluster_XXXXXX";
+    int fd = mkstemp(path);
+    if (fd < 0) {
+        perror("mkstemp");
+        return false;
+    }
+    bool ok = write(fd, HWH_3, sizeof(HWH_3) - 1) == (ssize_t)(sizeof(HWH_3) - 1);
+    close(fd);
+    std::vector<AesInstanceAddr> found = aes_discover(path);
+    unlink(path);
+    for (const AesInstanceAddr& a : found) printf("    %-14s 0x%08x  %u bytes\n", a.name.c_str(), a.base, a.size);
+    return ok && found.size() == 3 && found[0].name == "aes_bridge_0" && found[0].base == 0x40001000 &&
+           found[1].base == 0x40002000 && found[2].name == "aes_bridge_2" && found[2].size == 0x1000;
+}
+
+// random keys, sizes and offsets; every block checked
+static bool random_jobs(AesCluster& cluster, uint32_t seed) {
+    uint32_t key[3][8];
+    AesKeyHandle h[3];
+    SoftAes256 ref[3];
+    for (int k = 0; k < 3; k++) {
+        for (int i = 0; i < 8; i++) key[k][i] = mix(seed + 8 * k + i);
+        h[k] = cluster.registerKey(key[k]);
+        ref[k].setKey(key[k]);
+    }
+    std::vector<uint32_t> pt(4 * MAX_JOB), ct(4 * MAX_JOB), want(4 * MAX_JOB);
+    bool ok = true;
+    for (int j = 0; j < RANDOM_JOBS && ok; j++) {
+        uint32_t r = mix(seed ^ (j * 0x9e3779b9u));
+        int k = r % 3;
+        size_t n = 1 + (r >> 4) % MAX_JOB;
+        if (j % 5 == 0) n = 1 + n % 8;          // plenty of tiny jobs too
+        for (size_t i = 0; i < 4 * n; i++) pt[i] = mix(r + (uint32_t)i);
+        bool in_place = (r >> 20) & 1;
+        uint32_t* out = in_place ? pt.data() : ct.data();
+        ref[k].encryptBlocks(pt.data(), want.data(), n);
+        ok = cluster.encryptBulk(h[k], pt.data(), out, n) && memcmp(out, want.data(), 16 * n) == 0;
+        if (!ok) printf("    job %d: %zu blocks under key %d%s mismatched\n", j, n, k, in_place ? " (in place)" : "");
+    }
+    for (int k = 0; k < 3; k++) cluster.unregisterKey(h[k]);
+    return ok;
+}
+
+static bool ctr_vector(AesCluster& cluster) {
+    AesDispatcher disp(&cluster);
+    disp.setKey(KEYS[0]);
+    uint8_t out[64];
+    AesCtr ctr(disp);
+    ctr.init(CTR_IV);
+    bool ok = ctr.update(CTR_PT, out, sizeof(out)) && memcmp(out, CTR_CT, sizeof(out)) == 0;
+    ctr.final();
+    return ok;
+}
+
+// MB/s of SCALE_BLOCKS-block jobs, best of SCALE_REPS
+static double throughput(AesCluster& cluster, bool& correct) {
+    std::vector<uint32_t> pt(4 * SCALE_BLOCKS), ct(4 * SCALE_BLOCKS), want(4 * SCALE_BLOCKS);
+    for (size_t i = 0; i < pt.size(); i++) pt[i] = mix((uint32_t)i);
+    SoftAes256 ref;
+    ref.setKey(KEYS[1]);
+    ref.encryptBlocks(pt.data(), want.data(), SCALE_BLOCKS);
+    AesKeyHandle h = cluster.registerKey(KEYS[1]);
+    cluster.encryptBulk(h, pt.data(), ct.data(), SCALE_BLOCKS);      // warm keys + models
+    cluster.resetStats();
+    double best = 0;
+    correct = true;
+    for (int r = 0; r < SCALE_REPS; r++) {
+        auto t0 = std::chrono::steady_clock::now();
+        correct &= cluster.encryptBulk(h, pt.data(), ct.data(), SCALE_BLOCKS);
+        double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        best = std::max(best, SCALE_BLOCKS * 16 / s / 1e6);
+        correct &= ct == want;
+    }
+    cluster.unregisterKey(h);
+    return best;
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    const char* hwh = nullptr;
+    size_t instances = MAX_INST;
+    SimTiming sim_timing;
+    std::string timing_name = "core";
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") {
+            sim = false;
+            if (a + 1 < argc && argv[a + 1][0] != '-') hwh = argv[++a];
+        } else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-') {
+                timing_name = argv[++a];
+                if (!SimTiming::parse(timing_name, sim_timing)) {
+                    fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                    return EXIT_FAILURE;
+                }
+            }
+        } else if (arg == "--instances" && a + 1 < argc) {
+            instances = strtoul(argv[++a], nullptr, 0);
+            if (instances == 0) instances = 1;
+        } else {
+            printf("Usage: %s [--hw [HWH|BD]] [--sim [instant|core|pynq]] [--instances N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("================================================\n");
+    printf("  AES cluster test (%s)\n", sim ? ("sim, " + timing_name + " timing").c_str() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+    auto verdict = [&](bool ok) {
+        fail_count += !ok;
+        return ok ? "[PASS]" : "[FAIL]";
+    };
+
+    // T1 - discovery -------------
+    printf("\n[TEST 1] Discovery\n");
+    printf("  synthetic .hwh, 3 aes_bridge + 1 other module:\n");
+    printf("  %s sorted by base, my_hsm skipped\n", verdict(discover_synthetic()));
+    if (access(BD_PATH, R_OK) == 0) {
+        std::vector<AesInstanceAddr> bd = aes_discover(BD_PATH);
+        for (const AesInstanceAddr& a : bd) printf("    %-14s 0x%08x  %u bytes\n", a.name.c_str(), a.base, a.size);
+        bool ok = bd.size() == 1 && bd[0].base == AES_BASE_ADDR && bd[0].size == AES_SIZE;
+        printf("  %s hsm_system_design.bd: aes_bridge_0 at AES_BASE_ADDR\n", verdict(ok));
+    } else {
+        printf("  [SKIP] %s not found (run from the repo root)\n", BD_PATH);
+    }
+
+    if (!sim) {
+        AesCluster hw;
+        bool mapped = hwh ? hw.addDiscovered(hwh) : hw.addInstance(AES_BASE_ADDR, AES_SIZE);
+        if (!mapped) {
+            fprintf(stderr, "[FATAL] Cannot map any AES peripheral (run as root, or drop --hw)\n");
+            return EXIT_FAILURE;
+        }
+        printf("\n[TEST 2] %zu instance(s) on the board\n", hw.size());
+        printf("  %s %d random jobs vs soft_aes.h\n", verdict(random_jobs(hw, 0x5eed)), RANDOM_JOBS);
+        printf("  %s SP 800-38A CTR through AesDispatcher\n", verdict(ctr_vector(hw)));
+        bool correct;
+        double mbps = throughput(hw, correct);
+        printf("\n[TEST 4] Throughput: %.2f MB/s %s\n", mbps, verdict(correct));
+        hw.stats().print();
+    } else {
+        // T2 - correctness -------------
+        printf("\n[TEST 2] Sharded jobs vs soft_aes.h, %d random jobs (1..%zu blocks, 3 keys)\n", RANDOM_JOBS, MAX_JOB);
+        for (size_t n = 1; n <= instances; n++) {
+            AesClusterConfig cfg;
+            cfg.min_shard = 16;                 // split often
+            SimRig rig(n, SimTiming::instant(), cfg);
+            bool ok = random_jobs(rig.cluster, 0x1234 + (uint32_t)n);
+            AesClusterStats s = rig.cluster.stats();
+            size_t used = 0;
+            for (const AesInstanceStats& i : s.inst) used += i.blocks > 0;
+            printf("  %s %zu instance(s): %llu blocks, %zu instance(s) used\n", verdict(ok && used == n), n,
+                   (unsigned long long)s.blocks, used);
+        }
+        {
+            SimRig rig(instances, sim_timing);
+            printf("  %s SP 800-38A CTR through AesDispatcher on %zu instances\n", verdict(ctr_vector(rig.cluster)), instances);
+        }
+
+        // T3 - key affinity -------------
+        printf("\n[TEST 3] Key affinity: 2 tenants x %d jobs of %zu blocks on 2 instances\n", TENANT_ROUNDS, TENANT_JOB);
+        {
+            SimRig rig(2, sim_timing);
+            AesKeyHandle h[2] = { rig.cluster.registerKey(KEYS[0]), rig.cluster.registerKey(KEYS[1]) };
+            SoftAes256 ref[2];
+            ref[0].setKey(KEYS[0]);
+            ref[1].setKey(KEYS[1]);
+            std::vector<uint32_t> pt(4 * TENANT_JOB), ct(4 * TENANT_JOB), want(4 * TENANT_JOB);
+            bool correct = true;
+            for (int r = 0; r < 2 * TENANT_ROUNDS; r++) {
+                int k = r & 1;
+                for (size_t i = 0; i < pt.size(); i++) pt[i] = mix(r * 7919 + (uint32_t)i);
+                ref[k].encryptBlocks(pt.data(), want.data(), TENANT_JOB);
+                correct &= rig.cluster.encryptBulk(h[k], pt.data(), ct.data(), TENANT_JOB) && ct == want;
+            }
+            AesClusterStats s = rig.cluster.stats();
+            s.print();
+            uint64_t loads = s.inst[0].key_loads + s.inst[1].key_loads;
+            printf("  %s every block correct\n", verdict(correct));
+            printf("  %s %llu key expansions for %d jobs (a thrashing core reloads per job)\n",
+                   verdict(loads <= 4), (unsigned long long)loads, 2 * TENANT_ROUNDS);
+        }
+
+        // T4 - scaling -------------
+        // host time per block (MMIO + polling) vs core time per block decides what sharding buys:
+        // the given timing shows where this model / board stands, the core-bound one that the
+        // scheduler overlaps cores once they are the ceiling
+        SimTiming slow = SimTiming::core();
+        slow.block_cycles *= SLOW_CORE;
+        const struct { const char* name; SimTiming t; } profiles[] = {
+            { timing_name.c_str(), sim_timing },
+            { "core-bound", slow },
+        };
+        printf("\n[TEST 4] Scaling: %zu-block jobs, instances on one SimBus\n", SCALE_BLOCKS);
+        for (const auto& p : profiles) {
+            if (&p == &profiles[1]) printf("  %s timing (block_cycles x%u):\n", p.name, SLOW_CORE);
+            else printf("  %s timing:\n", p.name);
+            double base = 0, two = 0;
+            for (size_t n = 1; n <= instances; n *= 2) {
+                SimRig rig(n, p.t);
+                bool correct;
+                double mbps = throughput(rig.cluster, correct);
+                if (n == 1) base = mbps;
+                if (n == 2) two = mbps;
+                printf("  %s %zu instance(s): %8.2f MB/s  (%.2fx)  bus stall %.1f us\n", verdict(correct), n, mbps,
+                       base > 0 ? mbps / base : 0.0, rig.bus.stallNs() / 1e3);
+                rig.cluster.stats().print();
+            }
+            if (&p == &profiles[1] && instances >= 2)
+                printf("  %s core-bound: 2 instances %.2fx of one (>= 1.5x)\n", verdict(two >= 1.5 * base), base > 0 ? two / base : 0.0);
+        }
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,227 @@
+/**
+* @file     test_drbg.cpp
+* @brief    CTR_DRBG check + throughput vs raw TRNG, behavioral model by default
+* @details  Known answers come from an independent SP 800-90A implementation (AES from
+*           OpenSSL) fed the same counting entropy source, CAVP style: instantiate,
+*           generate, generate, compare the second output.
+*
+* T1 - known answers: no PR, additional input, prediction resistance; CPU engine and
+*      forced through the AES core
+* T2 - reseed interval / prediction resistance draw entropy when they should; a failed
+*      source fails generate()
+* T3 - throughput: raw TRNG words vs one DRBG vs THREADS per-thread DRBGs on one pool
+*
+* Usage: test_drbg [--hw] [--sim [instant|core|pynq]] [--threads N] [--mb N]
+*   --hw  run against the FPGA (as root) instead of the behavioral model
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "aes_driver.h"
+#include "ctr_drbg.h"
+#include "hsm_driver.h"
+#include "sim_device.h"
+#include "trng_pool.h"
+
+constexpr size_t KAT_BYTES     = 64;
+constexpr int    INTERVAL_REQS = 10;
+constexpr size_t TRNG_BYTES    = 16384;
+
+const char* const KAT_PERS = "test_drbg personalization";
+const char* const KAT_ADD  = "additional input";
+
+struct DrbgKat {
+    const char* name;
+    bool        prediction_resistance;
+    bool        additional;
+    const char* returned_hex;
+};
+
+const DrbgKat KATS[] = {
+    { "no PR        ", false, false,
+      "aff6be11a163d1d0700a047fc7a8700d8a330bcb6d815d68fdbdbc95c1d637fa"
+      "6f0e83bf9231f254ca7cdf98b727ee28fb7c1958e42d68ff6d1115b6ed6da176" },
+    { "additional   ", false, true,
+      "839ff42b6f48ef25546231588193d0c440581ec0d7c74c713e5ec86164ba1299"
+      "628667c7a826da0bcffce1917e51dfed649fc1d3dc7be50d4331b6c44ca021ed" },
+    { "PR + addl.   ", true, true,
+      "810bc1f9abf6a9086608471022b553fe0663ba17345f25e279a3fc9f10d056a8"
+      "6762d164867bbbbcd97144484b5161cd176723c50dde7ccb6268ec810326af1e" },
+};
+
+// byte i of the stream is i mod 256, across calls
+static DrbgEntropySource counting_source(uint64_t& pos) {
+    return [&pos](uint8_t* buf, size_t len) {
+        for (size_t i = 0; i < len; i++) buf[i] = (uint8_t)(pos++);
+        return true;
+    };
+}
+
+static bool run_kat(const DrbgKat& k, AesDriver* hw) {
+    uint64_t pos = 0;
+    CtrDrbgConfig cfg;
+    cfg.prediction_resistance = k.prediction_resistance;
+    CtrDrbg drbg(counting_source(pos), cfg, hw);
+    if (hw) drbg.dispatcher().cpuModel() = LatencyModel(1e12, 1e12);     // never pick the CPU
+    const char* add = k.additional ? KAT_ADD : nullptr;
+    size_t add_len = add ? strlen(add) : 0;
+    uint8_t out[KAT_BYTES];
+    if (!drbg.instantiate(KAT_PERS, strlen(KAT_PERS)) ||
+        !drbg.generate(out, sizeof(out), add, add_len) ||
+        !drbg.generate(out, sizeof(out), add, add_len)) return false;
+    char hex[2 * KAT_BYTES + 1];
+    for (size_t i = 0; i < KAT_BYTES; i++) snprintf(hex + 2 * i, 3, "%02x", out[i]);
+    return strcmp(hex, k.returned_hex) == 0 && (!hw || drbg.dispatcher().stats().blocks_cpu == 0);
+}
+
+static double secs_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    SimTiming sim_timing;
+    int threads = 4;
+    size_t mb = 64;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--threads" && a + 1 < argc) threads = atoi(argv[++a]);
+        else if (arg == "--mb" && a + 1 < argc)      mb = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--threads N] [--mb N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (threads < 1) threads = 1;
+    if (mb == 0) mb = 1;
+
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+
+    printf("================================================\n");
+    printf("  CTR_DRBG Test (%s)\n", sim ? aes.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+
+    // T1 - known answers ---------------------------
+    printf("\n[TEST 1] Known answers (AES-256, df)\n");
+    for (const DrbgKat& k : KATS) {
+        bool cpu = run_kat(k, nullptr);
+        bool core = run_kat(k, &drv);
+        printf("    %s: CPU %s  core %s\n", k.name, cpu ? "[PASS]" : "[FAIL]", core ? "[PASS]" : "[FAIL]");
+        fail_count += !cpu + !core;
+    }
+
+    // T2 - reseeds ---------------------------------
+    printf("\n[TEST 2] Reseed interval / prediction resistance / source failure\n");
+    {
+        uint64_t pos = 0;
+        CtrDrbgConfig cfg;
+        cfg.reseed_interval = 4;
+        CtrDrbg drbg(counting_source(pos), cfg);
+        uint8_t out[100];
+        bool ok = drbg.instantiate();
+        for (int i = 0; ok && i < INTERVAL_REQS; i++) ok = drbg.generate(out, sizeof(out));
+        // counter 1..4 generate, 5 reseeds: requests 5 and 9
+        ok = ok && drbg.stats().reseeds == 2 &&
+             drbg.stats().entropy_bytes == cfg.entropy_bytes * 3 + cfg.nonce_bytes;
+        printf("    Interval 4  : %llu reseeds in %d requests %s\n",
+               (unsigned long long)drbg.stats().reseeds, INTERVAL_REQS, ok ? "[PASS]" : "[FAIL]");
+        fail_count += !ok;
+
+        cfg = CtrDrbgConfig{};
+        cfg.prediction_resistance = true;
+        cfg.max_request_bytes = 4096;
+        CtrDrbg pr(counting_source(pos), cfg);
+        std::vector<uint8_t> big(10 * 4096);
+        ok = pr.instantiate() && pr.generate(big.data(), big.size()) && pr.stats().reseeds == 10;
+        printf("    PR          : %llu reseeds for %zu requests %s\n",
+               (unsigned long long)pr.stats().reseeds, big.size() / 4096, ok ? "[PASS]" : "[FAIL]");
+        fail_count += !ok;
+
+        int calls = 0;
+        CtrDrbg failing([&](uint8_t* buf, size_t len) { memset(buf, 0x5A, len); return ++calls == 1; }, cfg);
+        ok = failing.instantiate() && !failing.generate(out, sizeof(out)) && failing.stats().entropy_fails == 1;
+        CtrDrbg never([](uint8_t*, size_t) { return false; });
+        ok = ok && !never.instantiate() && !never.ready() && !never.generate(out, sizeof(out));
+        printf("    Bad source  : %s\n", ok ? "[PASS]" : "[FAIL]");
+        fail_count += !ok;
+    }
+
+    // T3 - throughput ------------------------------
+    printf("\n[TEST 3] Throughput, %zu MB per DRBG run\n", mb);
+    {
+        EntropyPool pool(hsm);
+        if (!pool.start()) return EXIT_FAILURE;
+
+        std::vector<uint8_t> buf(TRNG_BYTES);
+        auto t0 = std::chrono::steady_clock::now();
+        bool ok = pool.read(buf.data(), buf.size(), 10000000) == PoolStatus::OK;
+        double trng_mbs = TRNG_BYTES / secs_since(t0) / 1e6;
+        printf("    Raw TRNG    : %10.3f MB/s  (pool, %zu bytes)\n", trng_mbs, TRNG_BYTES);
+
+        size_t total = mb << 20;
+        buf.resize(DRBG_MAX_REQUEST);
+        {
+            CtrDrbg drbg(drbg_entropy(pool), CtrDrbgConfig{}, &drv);
+            ok = ok && drbg.instantiate();
+            t0 = std::chrono::steady_clock::now();
+            for (size_t done = 0; ok && done < total; done += buf.size()) ok = drbg.generate(buf.data(), buf.size());
+            double mbs = total / secs_since(t0) / 1e6;
+            printf("    DRBG x1     : %10.2f MB/s  (%.0fx TRNG)\n", mbs, mbs / trng_mbs);
+            drbg.stats().print();
+            drbg.dispatcher().stats().print();
+        }
+
+        std::atomic<bool> all_ok{ok};
+        std::vector<std::thread> pool_threads;
+        t0 = std::chrono::steady_clock::now();
+        for (int t = 0; t < threads; t++) {
+            pool_threads.emplace_back([&] {
+                std::vector<uint8_t> b(DRBG_MAX_REQUEST);
+                CtrDrbg& drbg = ctr_drbg_thread(pool);
+                bool good = drbg.ready();
+                for (size_t done = 0; good && done < total; done += b.size()) good = drbg.generate(b.data(), b.size());
+                if (!good) all_ok = false;
+            });
+        }
+        for (std::thread& t : pool_threads) t.join();
+        double mbs = total * threads / secs_since(t0) / 1e6;
+        printf("    DRBG x%-4d : %10.2f MB/s  (CPU engine, one instance per thread)\n", threads, mbs);
+        ok = all_ok;
+        printf("    Output      : %s\n", ok ? "[PASS]" : "[FAIL]");
+        fail_count += !ok;
+        pool.stop();
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
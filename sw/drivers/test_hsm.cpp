@@ -10,9 +10,21 @@
 #include <sys/types.h>
 #include <unistd.h>
 #include <fcntl.h>
-#include <sys/mman.h>
 #include <vector>
 #include <csignal>
+#include <string>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <random>
+#include <cstdlib>
+
+#include "hsm_driver.h"
+#include "trng_pool.h"
+#include "hsm_capture.h"
+#include "sim_device.h"
+#include "trng_health_sw.h"
+#include "ent_stats.h"
 
 // Global flag to track if user pressed Ctrl+C
 volatile sig_atomic_t stop_requested = 0; 
@@ -21,141 +33,198 @@ void signal_handler(int signum) {
     stop_requested = 1;
 }
 
-// --- CONFIG ---
-constexpr uint32_t HSM_BASE_ADDR = 0x40000000;
-constexpr uint32_t HSM_SIZE = 0x1000; // 4KB
-
-// --- REG MAP ---
-enum RegOffset : uint32_t {
-    REG_CTRL        = 0x00, 
-    REG_STATUS      = 0x04,
-    REG_DATA_IN     = 0x08, 
-    REG_DATA_OUT    = 0x0C, 
-    REG_TRNG_OSC    = 0x10, 
-    REG_TRNG_OUT    = 0x18, // TRNG Result
-    REG_SAMPLE_CNT  = 0x1C  // Sample Counter
-};
+/* ===== Health Testing (Outside Class) ===== */
+void test_trng_health(PynqHSM& hsm) {
+    std::cout << "Running TRNG Health Checks..." << std::endl;
+    uint32_t prev = hsm.getTrngRandom();
+    bool frozen = true;
 
-// --- BIT MASKS ---
-namespace Ctrl {
-    constexpr uint32_t ENABLE = 1 << 0;
-    constexpr uint32_t SAMPLE = 1 << 1;
-    constexpr uint32_t CLEAR  = 1 << 2;
-}
+    for (int i = 0; i < 10; i++) {
+        uint32_t curr = hsm.getTrngRandom();
+        if (curr != prev) frozen = false;
+        prev = curr;
+    }
 
-namespace Status {
-    constexpr uint32_t OSC_RUNNING  = 1 << 0;
-    constexpr uint32_t HEALTH_FAIL  = 1 << 8;   // combined health failure
-    constexpr uint32_t RCT_FAIL     = 1 << 9;   // repetition count test
-    constexpr uint32_t APT_FAIL     = 1 << 10; 
+    if (frozen) 
+        std::cout << "[FAIL] TRNG appears frozen! Got same value repeatedly." << std::endl;
+    else
+        std::cout << "[PASS] TRNG values changing, not frozen." << std::endl;
 }
 
-/* ===== SAFE DRIVER CLASS ===== */
-class PynqHSM {
-private:
-    int _fd;
-    volatile uint32_t* _base_ptr;
-    bool _is_mapped;
-
-public:
-    PynqHSM(uint32_t phys_addr, uint32_t size) : _fd(-1), _base_ptr(nullptr), _is_mapped(false) {
-        _fd = ::open("/dev/mem", O_RDWR | O_SYNC);
-        if (_fd < 0) {
-            perror("Failed to open /dev/mem");
-            return;
-        }
-        _base_ptr = (volatile uint32_t*)mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, phys_addr);
-        if (_base_ptr == MAP_FAILED) {
-            perror("Failed to mmap");
-            ::close(_fd);
-            _fd = -1;
-            return;
-        }
-        _is_mapped = true;
-    }
+/* ===== Entropy Pool Mode ===== */
+// N consumers pull random-length requests from the pool until Ctrl+C or POOL_SECONDS
+constexpr int    POOL_SECONDS   = 10;
+constexpr size_t POOL_MAX_REQ   = 256;
 
-    ~PynqHSM() {
-        if (_is_mapped) {
-            writeReg(REG_CTRL, 0);
-            munmap((void*)_base_ptr, HSM_SIZE);
-            if (_fd >= 0) ::close(_fd);
-        }
-    }
+struct ConsumerResult {
+    uint64_t requests = 0, bytes = 0, health_fail = 0, timeouts = 0;
+    uint64_t total_ns = 0, max_ns = 0;
+};
 
-    void writeReg(RegOffset offset, uint32_t value) {
-        if (_is_mapped) _base_ptr[offset / 4] = value;
+int run_pool(PynqHSM& hsm, int consumers) {
+    std::cout << "PYNQ HSM Entropy Pool: " << consumers << " consumer(s), "
+              << POOL_SECONDS << "s (Ctrl+C to stop early)" << std::endl;
+
+    EntropyPool pool(hsm);
+    if (!pool.start()) return 1;
+
+    std::atomic<bool> done{false};
+    std::vector<ConsumerResult> results(consumers);
+    std::vector<std::thread> threads;
+    for (int c = 0; c < consumers; c++) {
+        threads.emplace_back([&, c] {
+            std::mt19937 rng(c + 1);
+            std::uniform_int_distribution<size_t> len_dist(1, POOL_MAX_REQ);
+            uint8_t buf[POOL_MAX_REQ];
+            ConsumerResult& r = results[c];
+            while (!done.load(std::memory_order_relaxed)) {
+                size_t len = len_dist(rng);
+                auto t0 = std::chrono::steady_clock::now();
+                PoolStatus st = pool.read(buf, len);
+                uint64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - t0).count();
+                r.requests++;
+                r.total_ns += ns;
+                if (ns > r.max_ns) r.max_ns = ns;
+                if (st == PoolStatus::OK) r.bytes += len;
+                else if (st == PoolStatus::HEALTH_FAIL) r.health_fail++;
+                else r.timeouts++;
+            }
+        });
     }
 
-    uint32_t readReg(RegOffset offset) {
-        return _is_mapped ? _base_ptr[offset / 4] : 0;
+    auto t_start = std::chrono::steady_clock::now();
+    for (int s = 0; s < POOL_SECONDS * 10 && !stop_requested; s++) usleep(100000);
+    done.store(true);
+    for (auto& t : threads) t.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+    pool.stop();
+
+    ConsumerResult total;
+    for (int c = 0; c < consumers; c++) {
+        const ConsumerResult& r = results[c];
+        printf("  Consumer %-2d : %8llu req  %10llu B  avg %.1fus  max %.1fus  fail %llu  timeout %llu\n",
+               c, (unsigned long long)r.requests, (unsigned long long)r.bytes,
+               r.requests ? r.total_ns / 1e3 / r.requests : 0.0, r.max_ns / 1e3,
+               (unsigned long long)r.health_fail, (unsigned long long)r.timeouts);
+        total.requests += r.requests; total.bytes += r.bytes;
+        total.health_fail += r.health_fail; total.timeouts += r.timeouts;
+        total.total_ns += r.total_ns;
+        if (r.max_ns > total.max_ns) total.max_ns = r.max_ns;
     }
+    printf("  Total       : %.1f KB/s served, %.0f req/s, avg %.1fus, max %.1fus\n",
+           total.bytes / secs / 1024.0, total.requests / secs,
+           total.requests ? total.total_ns / 1e3 / total.requests : 0.0, total.max_ns / 1e3);
+    pool.stats().print();
+    pool.swHealth().print();
+    hsm.sampleWait().stats.print("sample");
+    return 0;
+}
 
-    // --- Health status check ---
-    bool checkHealth(bool verbose = false) {
-        uint32_t status = readReg(REG_STATUS);
-        if (verbose) {
-            bool osc_ok = status & Status::OSC_RUNNING;
-            bool rct_ok = !(status & Status::RCT_FAIL);
-            bool apt_ok = !(status & Status::APT_FAIL);
-            std::cout << "  OSC Running : " << (osc_ok  ? "[OK]" : "[FAIL]") << std::endl;
-            std::cout << "  RCT Test    : " << (rct_ok  ? "[OK]" : "[FAIL] - Oscillator may be locked") << std::endl;
-            std::cout << "  APT Test    : " << (apt_ok  ? "[OK]" : "[FAIL] - Bit distribution skewed") << std::endl;
+/* ===== Capture Mode ===== */
+// raw words -> buffered writer; bytes == 0 runs until Ctrl+C or the reader goes away.
+// Every word passes the software health tests before it is written; STATUS every
+// health_every words, cross-checked against them. Reports go to stderr so stdout can carry the data.
+// With ent_every set the same bytes also feed EntStream (rolling line every ent_every bytes, ent
+// report at the end); without an out_path nothing is written, so multi-GB runs need no file.
+int run_capture(PynqHSM& hsm, uint64_t bytes, const char* out_path, uint32_t health_every,
+                uint64_t ent_every = 0) {
+    signal(SIGPIPE, SIG_IGN);   // a closed pipe ends the capture via EPIPE instead of killing us
+
+    bool ent_mode = ent_every != 0;
+    bool sink = !ent_mode || out_path;
+    CaptureWriter writer;
+    if (sink && !writer.open(out_path)) return 1;
+
+    EntStream ent;
+    uint32_t ent_buf[1024];
+    size_t ent_fill = 0;
+    uint64_t ent_next = ent_every;
+    auto ent_flush = [&] {
+        ent.update(ent_buf, ent_fill * sizeof(uint32_t));
+        ent_fill = 0;
+        if (ent.bytes() >= ent_next) {
+            ent_next += ent_every;
+            EntResult total = ent.result();
+            ent.window().printLine(stderr, "window");
+            total.printLine(stderr, "total ");
+        }
+    };
+
+    int rc = 0;
+    uint64_t written = 0;
+    uint32_t since_check = 0;
+    SwHealth sw_health;
+    hsm.writeReg(REG_CTRL, Ctrl::ENABLE);
+    while (!stop_requested && (bytes == 0 || written < bytes)) {
+        if (health_every && ++since_check >= health_every) {
+            since_check = 0;
+            uint32_t status = hsm.readReg(REG_STATUS);
+            if (!sw_health.crossCheck(status) && sw_health.stats().hw_only + sw_health.stats().sw_only <= 8) {
+                fprintf(stderr, "[WARN] Health verdicts disagree at word %llu: STATUS 0x%03X, software: %s\n",
+                        (unsigned long long)(written / 4), status & 0x700,
+                        sw_health.describe(sw_health.failMask()).c_str());
+            }
+            if (status & Status::HEALTH_FAIL) {
+                std::cerr << "[ERROR] Health monitor failure detected mid-stream. Aborting." << std::endl;
+                rc = 1;
+                break;
+            }
+        }
+
+        uint32_t word;
+        if (!hsm.sampleWord(word)) {
+            std::cerr << "[ERROR] Hardware Timeout." << std::endl;
+            rc = 1;
+            break;
         }
-        return !(status & Status::HEALTH_FAIL);
-    }
 
-    // --- Timeout implementation ---
-    bool waitForSampleDone(uint32_t old_count) {
-        volatile int timeout = 1000000; 
-        while (timeout-- > 0) {
-            uint32_t new_count = readReg(REG_SAMPLE_CNT);
-            if (new_count > old_count) {
-                return true; 
+        if (uint32_t failed = sw_health.update(word)) {
+            fprintf(stderr, "[ERROR] Software health test failed at word %llu (%s). Aborting.\n",
+                    (unsigned long long)(written / 4), sw_health.describe(failed).c_str());
+            rc = 1;
+            break;
+        }
+
+        size_t take = (bytes && bytes - written < sizeof(word)) ? (size_t)(bytes - written) : sizeof(word);
+        if (ent_mode) {
+            if (take < sizeof(word)) {
+                ent.update(ent_buf, ent_fill * sizeof(uint32_t));
+                ent.update(&word, take);
+                ent_fill = 0;
+            } else {
+                ent_buf[ent_fill++] = word;
+                if (ent_fill == 1024) ent_flush();
             }
         }
-        return false;
+        if (sink && !writer.put(word, take)) break;
+        written += take;
     }
-    
-    // --- COMMANDS ---
-    uint32_t getTrngRandom() {
-        // 1. Read current count
-        uint32_t current_cnt = readReg(REG_SAMPLE_CNT);
-
-        // 2. PREPARE TRIGGER: Pull Sample Bit LOW (keep Enable High)
-        //    This resets the pin to 0 so we can create a rising edge.
-        writeReg(REG_CTRL, Ctrl::ENABLE); 
-
-        // 3. TRIGGER: Pull Sample Bit HIGH
-        //    This creates the 0->1 transition the hardware is waiting for!
-        writeReg(REG_CTRL, Ctrl::ENABLE | Ctrl::SAMPLE);
-
-        // 4. Wait until count increases (Hardware Handshake)
-        //    (I also increased the timeout here just to be safe)
-        if (!waitForSampleDone(current_cnt)) {
-            return 0xFFFFFFFF;
+    if (ent_mode && ent_fill) ent.update(ent_buf, ent_fill * sizeof(uint32_t));
+
+    if (sink) {
+        bool sink_ok = writer.finish();
+        if (bytes && (!sink_ok || writer.stats().bytes_written < bytes)) {
+            std::cerr << "[ERROR] Capture incomplete: " << writer.stats().bytes_written
+                      << " of " << bytes << " bytes written." << std::endl;
+            rc = 1;
         }
-
-        // 5. Read result
-        return readReg(REG_TRNG_OUT);
+    } else if (bytes && written < bytes) {
+        std::cerr << "[ERROR] Capture incomplete: " << written << " of " << bytes << " bytes analyzed." << std::endl;
+        rc = 1;
     }
-}; 
 
-/* ===== Health Testing (Outside Class) ===== */
-void test_trng_health(PynqHSM& hsm) {
-    std::cout << "Running TRNG Health Checks..." << std::endl;
-    uint32_t prev = hsm.getTrngRandom();
-    bool frozen = true;
-
-    for (int i = 0; i < 10; i++) {
-        uint32_t curr = hsm.getTrngRandom();
-        if (curr != prev) frozen = false;
-        prev = curr;
+    if (out_path || bytes || ent_mode) {
+        fprintf(stderr, "--- Capture (%s) ---\n", sink ? (out_path ? out_path : "stdout") : "analysis only");
+        if (sink) writer.stats().print();
+        hsm.sampleWait().stats.print("sample");
+        sw_health.print(stderr);
     }
-
-    if (frozen) 
-        std::cout << "[FAIL] TRNG appears frozen! Got same value repeatedly." << std::endl;
-    else
-        std::cout << "[PASS] TRNG values changing, not frozen." << std::endl;
+    if (ent_mode) {
+        fprintf(stderr, "--- ENT (%llu bytes) ---\n", (unsigned long long)ent.bytes());
+        ent.result().print(stderr);
+    }
+    return rc;
 }
 
 /* ===== MAIN ===== */
@@ -163,15 +232,88 @@ int main(int argc, char* argv[]) {
     // 1. Check mode
     bool binary_mode = false;
     bool health_mode = false;
-    if (argc > 1) {
-        std::string arg = argv[1];
+    int pool_consumers = 0;
+    uint64_t capture_bytes = 0;
+    const char* out_path = nullptr;
+    uint32_t health_every = 1000;   // words between STATUS checks while streaming (0 = off)
+    uint64_t ent_every = 0;         // --ent [bytes]: streaming ENT statistics, rolling line every N bytes
+    WaitPolicy wait_policy;
+    bool wait_set = false;
+    const char* uio_path = nullptr;
+    bool sim = false;               // --sim [instant|core|pynq]: behavioral model, no FPGA
+    SimTiming sim_timing;
+    TrngFault sim_fault = TrngFault::NONE;  // --sim-fault locked|biased|dead
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
         if (arg == "--binary") binary_mode = true;
         if (arg == "--health") health_mode = true;
+        if (arg == "--wait" && a + 1 < argc) {
+            if (!WaitPolicy::parse(argv[++a], wait_policy)) {
+                std::cerr << "Unknown wait policy '" << argv[a] << "' (latency|balanced|cpu)" << std::endl;
+                return 1;
+            }
+            wait_set = true;
+        }
+        if (arg == "--uio" && a + 1 < argc) uio_path = argv[++a];
+        if (arg == "--capture" && a + 1 < argc) capture_bytes = strtoull(argv[++a], nullptr, 0);
+        if (arg == "--out" && a + 1 < argc) out_path = argv[++a];
+        if (arg == "--health-every" && a + 1 < argc) health_every = strtoul(argv[++a], nullptr, 0);
+        if (arg == "--ent") {
+            ent_every = 64ull << 20;
+            if (a + 1 < argc && argv[a + 1][0] != '-') ent_every = strtoull(argv[++a], nullptr, 0);
+            if (!ent_every) ent_every = 64ull << 20;
+        }
+        if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                std::cerr << "Unknown sim timing '" << argv[a] << "' (instant|core|pynq)" << std::endl;
+                return 1;
+            }
+        }
+        if (arg == "--sim-fault" && a + 1 < argc) {
+            sim = true;
+            if (!SimHsmDevice::parseFault(argv[++a], sim_fault)) {
+                std::cerr << "Unknown sim fault '" << argv[a] << "' (none|locked|biased|dead)" << std::endl;
+                return 1;
+            }
+        }
+        if (arg == "--pool") {
+            pool_consumers = 4;
+            if (a + 1 < argc && argv[a + 1][0] != '-') pool_consumers = atoi(argv[++a]);
+            if (pool_consumers < 1) pool_consumers = 1;
+        }
     }
 
     signal(SIGINT, signal_handler);
 
-    PynqHSM hsm(HSM_BASE_ADDR, HSM_SIZE);
+    SimHsmDevice sim_hsm(sim_timing);
+    sim_hsm.injectFault(sim_fault);
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        std::cerr << "Cannot map HSM peripheral (run as root, or use --sim)" << std::endl;
+        return 1;
+    }
+    if (wait_set) hsm.sampleWait().policy = wait_policy;
+    int uio_fd = -1;
+    if (uio_path) {
+        uio_fd = ::open(uio_path, O_RDWR);
+        if (uio_fd < 0) perror("open uio");
+        hsm.sampleWait().policy.irq_fd = uio_fd;
+    }
+
+    // --- Entropy Pool Mode ---
+    if (pool_consumers) {
+        int rc = run_pool(hsm, pool_consumers);
+        if (uio_fd >= 0) ::close(uio_fd);
+        return rc;
+    }
+
+    // --- Capture / Binary Mode ---
+    if (capture_bytes || out_path || binary_mode || ent_every) {
+        int rc = run_capture(hsm, capture_bytes, out_path, health_every, ent_every);
+        if (uio_fd >= 0) ::close(uio_fd);
+        return rc;
+    }
 
     // --- Health Monitor Mode (Text Only) ---
     if (health_mode) {
@@ -200,7 +342,7 @@ int main(int argc, char* argv[]) {
         }
 
     // --- Normal Mode (Text Output) ---
-    if (!binary_mode) {
+    {
         std::cout << "PYNQ HSM Driver Test Starting..." << std::endl;
         std::cout << "Press Ctrl+C to stop." << std::endl;
         
@@ -217,35 +359,19 @@ int main(int argc, char* argv[]) {
     }
 
     while (!stop_requested) {
-        // check health every 1k samples in binary mode
-        if (binary_mode) {
-            static int health_check_count = 0;
-            if (++health_check_count >= 1000) {
-                health_check_count = 0;
-                if (!hsm.checkHealth(false)) {
-                    std::cerr << "[ERROR] Health monitor failure detected mid-stream. Aborting." << std::endl;
-                    break;
-                }
-            }
-        }
-
         uint32_t random_value = hsm.getTrngRandom();
 
         if (random_value == 0xFFFFFFFF) {
-            if (!binary_mode) std::cerr << "[ERROR] Hardware Timeout." << std::endl;
+            std::cerr << "[ERROR] Hardware Timeout." << std::endl;
             break;
         }
 
-        if (binary_mode) {
-            // write raw bytes for post-run analysis
-            std::cout.write(reinterpret_cast<const char*>(&random_value), sizeof(random_value));
-        } else {
-            // text mode for debug
-            std::cout << "0x" << std::hex << random_value << std::endl;
-        }
-    }
-    if (!binary_mode) {
-        std::cout << "PYNQ HSM Driver Test Ending..." << std::endl;
+        // text mode for debug
+        std::cout << "0x" << std::hex << random_value << std::endl;
     }
+    std::cout << "\n--- Sample completion waits ---" << std::endl;
+    hsm.sampleWait().stats.print("sample");
+    std::cout << "PYNQ HSM Driver Test Ending..." << std::endl;
+    if (uio_fd >= 0) ::close(uio_fd);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,416 @@
+/**
+* @file     test_hsmd.cpp
+* @brief    hsmd end to end: service + clients in one process, behavioral model by default
+* @details  Runs HsmService on a private socket in a thread and drives it with HsmClient
+*           connections, every ciphertext checked against the software engine (soft_aes.h).
+*
+* T1 - KAT vectors through one client
+* T2 - CLIENTS threads, KEYS shared keys, random request sizes + RANDOM requests;
+*      batching shown as requests per batch and key switches vs requests
+* T3 - fairness: a 1-block client keeps being served while a bulk client saturates the core
+* T4 - errors: unknown handle, dropped handle, oversized RANDOM, KEY_LOAD past
+*      max_keys_per_client (and room again after a drop)
+* T5 - shared-memory ring: in-place results vs software engine, then ring (poll and
+*      eventfd completion) vs socket throughput over the same RING_MB; a 1-block socket
+*      client keeps being served while the ring saturates the core (same DRR as T3)
+*
+* Usage: test_hsmd [--hw] [--sim [instant|core|pynq]] [--clients N] [--requests N]
+*   --hw  run against the FPGA (as root) instead of the behavioral model
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "aes_vectors.h"
+#include "hsm_client.h"
+#include "hsm_driver.h"
+#include "hsm_service.h"
+#include "hsm_shm_ring.h"
+#include "sim_device.h"
+#include "soft_aes.h"
+#include "trng_pool.h"
+
+constexpr int      KEYS          = 3;
+constexpr uint32_t MAX_REQ_BLOCKS = 300;
+constexpr int      FAIR_SMALL_REQS = 200;
+constexpr uint32_t RING_ENTRIES   = 256;
+constexpr uint32_t RING_SQE_BLOCKS = 256;          // 4 KB per descriptor
+constexpr size_t   RING_ARENA     = (size_t)RING_ENTRIES * RING_SQE_BLOCKS * 16;
+constexpr size_t   RING_MB        = 8;
+
+static void make_key(int i, uint32_t key[8]) {
+    for (int w = 0; w < 8; w++) key[w] = 0xA5A5A5A5u * (uint32_t)(i + 1) + (uint32_t)w * 0x01010101u;
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    SimTiming sim_timing;
+    int clients = 8;
+    int requests = 100;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--clients" && a + 1 < argc)  clients = atoi(argv[++a]);
+        else if (arg == "--requests" && a + 1 < argc) requests = atoi(argv[++a]);
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--clients N] [--requests N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (clients < 1) clients = 1;
+
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+    EntropyPool pool(hsm);
+    if (!pool.start()) return EXIT_FAILURE;
+
+    HsmServiceConfig cfg;
+    cfg.socket_path = "/tmp/test_hsmd." + std::to_string(getpid()) + ".sock";
+    HsmService service(drv, pool, cfg);
+    if (!service.open()) return EXIT_FAILURE;
+    std::thread server([&] { service.run(); });
+
+    printf("================================================\n");
+    printf("  hsmd Service Test (%s)\n", sim ? aes.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+
+    // T1 - KAT -------------------------------------
+    printf("\n[TEST 1] KAT vectors through the daemon\n");
+    {
+        HsmClient c;
+        bool ok = c.connect(cfg.socket_path.c_str());
+        for (int i = 0; ok && i < NUM_VECTORS; i++) {
+            AesKeyHandle h;
+            uint32_t ct[4] = {};
+            bool pass = c.loadKey(VECTORS[i].key, h) == HsmStatus::OK &&
+                        c.encrypt(h, VECTORS[i].pt, ct, 1) == HsmStatus::OK &&
+                        memcmp(ct, VECTORS[i].ct, sizeof(ct)) == 0 &&
+                        c.dropKey(h) == HsmStatus::OK;
+            printf("    %-20s %s\n", VECTORS[i].name, pass ? "[PASS]" : "[FAIL]");
+            if (!pass) fail_count++;
+        }
+        if (!ok) { printf("    connect     : [FAIL]\n"); fail_count++; }
+    }
+
+    // T2 - concurrent clients ----------------------
+    printf("\n[TEST 2] %d clients x %d requests, %d shared keys\n", clients, requests, KEYS);
+    {
+        HsmServiceStats before = service.stats();
+        std::atomic<int> bad{0}, rnd_bad{0};
+        std::atomic<uint64_t> blocks{0};
+        auto t0 = std::chrono::steady_clock::now();
+        std::vector<std::thread> threads;
+        for (int t = 0; t < clients; t++) {
+            threads.emplace_back([&, t] {
+                HsmClient c;
+                if (!c.connect(cfg.socket_path.c_str())) { bad++; return; }
+                std::mt19937 rng(1234 + t);
+                AesKeyHandle h[KEYS];
+                SoftAes256 ref[KEYS];
+                for (int k = 0; k < KEYS; k++) {
+                    uint32_t key[8];
+                    make_key(k, key);
+                    ref[k].setKey(key);
+                    if (c.loadKey(key, h[k]) != HsmStatus::OK) { bad++; return; }
+                }
+                std::vector<uint32_t> pt, ct, expect;
+                for (int r = 0; r < requests; r++) {
+                    if (rng() % 8 == 0) {
+                        uint8_t buf[1024];
+                        size_t n = 1 + rng() % sizeof(buf);
+                        if (c.random(buf, n) != HsmStatus::OK) rnd_bad++;
+                        continue;
+                    }
+                    int k = (int)(rng() % KEYS);
+                    size_t n = 1 + rng() % MAX_REQ_BLOCKS;
+                    pt.resize(n * 4);
+                    ct.assign(n * 4, 0);
+                    expect.resize(n * 4);
+                    for (uint32_t& w : pt) w = rng();
+                    ref[k].encryptBlocks(pt.data(), expect.data(), n);
+                    if (c.encrypt(h[k], pt.data(), ct.data(), n) != HsmStatus::OK || ct != expect) bad++;
+                    blocks += n;
+                }
+            });
+        }
+        for (std::thread& th : threads) th.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        const HsmServiceStats& s = service.stats();
+        uint64_t reqs = s.requests[(int)HsmOp::ENCRYPT] - before.requests[(int)HsmOp::ENCRYPT];
+        uint64_t batches = s.batches - before.batches;
+        uint64_t switches = s.key_switches - before.key_switches;
+
+        bool ok = bad == 0 && rnd_bad == 0;
+        printf("    Ciphertext  : %s (%d bad encrypts, %d bad random)\n", ok ? "[PASS]" : "[FAIL]",
+               bad.load(), rnd_bad.load());
+        if (!ok) fail_count++;
+        printf("    Throughput  : %llu blocks in %.3f s (%.2f MB/s)\n",
+               (unsigned long long)blocks.load(), secs, blocks.load() * 16 / secs / 1e6);
+        printf("    Batching    : %llu requests in %llu batches (%.2f per batch), %llu key switches\n",
+               (unsigned long long)reqs, (unsigned long long)batches,
+               batches ? (double)reqs / batches : 0.0, (unsigned long long)switches);
+        bool batched = switches < reqs;
+        printf("    Key reloads : %s (fewer key switches than requests)\n", batched ? "[PASS]" : "[FAIL]");
+        if (!batched) fail_count++;
+    }
+
+    // T3 - fairness ---------------------------------
+    printf("\n[TEST 3] 1-block client vs bulk client\n");
+    {
+        std::atomic<bool> bulk_run{true};
+        std::atomic<uint64_t> bulk_blocks{0};
+        std::thread bulk([&] {
+            HsmClient c;
+            if (!c.connect(cfg.socket_path.c_str())) return;
+            uint32_t key[8];
+            make_key(0, key);
+            AesKeyHandle h;
+            if (c.loadKey(key, h) != HsmStatus::OK) return;
+            std::vector<uint32_t> buf(4 * 4 * HSMD_MAX_BLOCKS, 0x5A5A5A5A);
+            while (bulk_run.load()) {
+                if (c.encrypt(h, buf.data(), buf.data(), 4 * HSMD_MAX_BLOCKS) != HsmStatus::OK) break;
+                bulk_blocks += 4 * HSMD_MAX_BLOCKS;
+            }
+        });
+
+        HsmClient c;
+        bool ok = c.connect(cfg.socket_path.c_str());
+        uint32_t key[8];
+        make_key(1, key);
+        SoftAes256 ref;
+        ref.setKey(key);
+        AesKeyHandle h = AES_NO_KEY;
+        ok = ok && c.loadKey(key, h) == HsmStatus::OK;
+        HsmLatency lat;
+        usleep(20000);  // let the bulk stream fill the queue
+        for (int i = 0; ok && i < FAIR_SMALL_REQS; i++) {
+            uint32_t pt[4] = { (uint32_t)i, 1, 2, 3 }, ct[4], expect[4];
+            ref.encrypt(pt, expect);
+            auto t0 = std::chrono::steady_clock::now();
+            ok = c.encrypt(h, pt, ct, 1) == HsmStatus::OK && memcmp(ct, expect, sizeof(ct)) == 0;
+            lat.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now() - t0).count());
+        }
+        bulk_run = false;
+        bulk.join();
+        printf("    Small client: %s, %d requests alongside %llu bulk blocks\n", ok ? "[PASS]" : "[FAIL]",
+               FAIR_SMALL_REQS, (unsigned long long)bulk_blocks.load());
+        lat.print(stdout, "small");
+        if (!ok) fail_count++;
+    }
+
+    // T4 - errors -----------------------------------
+    printf("\n[TEST 4] Error paths\n");
+    {
+        HsmClient c;
+        bool ok = c.connect(cfg.socket_path.c_str());
+        uint32_t pt[4] = {}, ct[4];
+        uint32_t key[8];
+        make_key(2, key);
+        AesKeyHandle h = AES_NO_KEY;
+        bool unknown = c.encrypt(0x7FFF, pt, ct, 1) == HsmStatus::BAD_KEY;
+        bool dropped = ok && c.loadKey(key, h) == HsmStatus::OK && c.dropKey(h) == HsmStatus::OK &&
+                       c.encrypt(h, pt, ct, 1) == HsmStatus::BAD_KEY;
+        HsmMsgHeader req = { HSMD_MAGIC, (uint16_t)HsmOp::RANDOM, 0, 1, 0, 4 };
+        uint32_t too_big = HSMD_MAX_RANDOM + 1;
+        // hand-built frame: HsmClient::random() never sends an oversized request
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr = {};
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, cfg.socket_path.c_str(), sizeof(addr.sun_path) - 1);
+        HsmMsgHeader resp;
+        bool oversized = ::connect(fd, (struct sockaddr*)&addr, sizeof(addr)) == 0 &&
+                         hsm_write_all(fd, &req, sizeof(req)) && hsm_write_all(fd, &too_big, 4) &&
+                         hsm_read_all(fd, &resp, sizeof(resp)) && resp.status == (uint16_t)HsmStatus::BAD_REQUEST;
+        ::close(fd);
+        // fill this connection's key table, one more is refused, a drop makes room
+        HsmClient lim;
+        bool limited = lim.connect(cfg.socket_path.c_str());
+        std::vector<AesKeyHandle> held;
+        for (uint32_t i = 0; limited && i < cfg.max_keys_per_client; i++) {
+            make_key(100 + (int)i, key);
+            limited = lim.loadKey(key, h) == HsmStatus::OK;
+            held.push_back(h);
+        }
+        make_key(99, key);
+        limited = limited && lim.loadKey(key, h) == HsmStatus::KEY_LIMIT &&
+                  lim.dropKey(held.back()) == HsmStatus::OK && lim.loadKey(key, h) == HsmStatus::OK;
+        printf("    Unknown key : %s\n", unknown ? "[PASS]" : "[FAIL]");
+        printf("    Dropped key : %s\n", dropped ? "[PASS]" : "[FAIL]");
+        printf("    Bad RANDOM  : %s\n", oversized ? "[PASS]" : "[FAIL]");
+        printf("    Key limit   : %s, %u keys per client\n", limited ? "[PASS]" : "[FAIL]", cfg.max_keys_per_client);
+        fail_count += !unknown + !dropped + !oversized + !limited;
+    }
+
+    // T5 - shared-memory ring ----------------------
+    printf("\n[TEST 5] Shared-memory ring vs socket, %zu MB each\n", RING_MB);
+    {
+        HsmClient conn;
+        HsmRingClient ring;
+        uint32_t key[8];
+        make_key(0, key);
+        SoftAes256 ref;
+        ref.setKey(key);
+        AesKeyHandle h = AES_NO_KEY;
+        bool ok = conn.connect(cfg.socket_path.c_str()) && conn.loadKey(key, h) == HsmStatus::OK &&
+                  ring.attach(conn, RING_ENTRIES, RING_ARENA);
+
+        // one pass over the whole arena, in place, checked block for block
+        std::vector<uint32_t> expect(RING_ARENA / 4);
+        uint32_t* arena = reinterpret_cast<uint32_t*>(ok ? ring.arena() : nullptr);
+        if (ok) {
+            for (size_t i = 0; i < expect.size(); i++) arena[i] = (uint32_t)(i * 0x9E3779B9u);
+            ref.encryptBlocks(arena, expect.data(), RING_ARENA / 16);
+            for (uint32_t i = 0; i < RING_ENTRIES; i++) {
+                size_t off = (size_t)i * RING_SQE_BLOCKS * 16;
+                ring.submit(i, h, off, off, RING_SQE_BLOCKS);
+            }
+            ring.flush();
+            HsmCqe cqe[RING_ENTRIES];
+            uint32_t done = 0;
+            while (ok && done < RING_ENTRIES) {
+                uint32_t n = ring.wait(cqe, RING_ENTRIES);
+                if (!n) ok = false;
+                for (uint32_t i = 0; i < n; i++) ok = ok && cqe[i].status == (uint32_t)HsmStatus::OK;
+                done += n;
+            }
+            ok = ok && memcmp(arena, expect.data(), RING_ARENA) == 0;
+        }
+        // bad descriptor: out of the arena
+        bool rejected = false;
+        if (ok) {
+            HsmCqe cqe;
+            ring.submit(7, h, RING_ARENA - 16, 0, 2);
+            ring.flush();
+            rejected = ring.wait(&cqe, 1) == 1 && cqe.user_data == 7 && cqe.status == (uint32_t)HsmStatus::BAD_REQUEST;
+        }
+        printf("    In place    : %s\n", ok ? "[PASS]" : "[FAIL]");
+        printf("    Bounds check: %s\n", rejected ? "[PASS]" : "[FAIL]");
+        fail_count += !ok + !rejected;
+
+        size_t total_sqes = RING_MB * (1u << 20) / (RING_SQE_BLOCKS * 16);
+        for (int mode = 0; ok && mode < 2; mode++) {
+            bool poll_mode = mode == 0;
+            uint64_t bells = ring.doorbells(), sleeps = ring.sleeps();
+            auto t0 = std::chrono::steady_clock::now();
+            size_t submitted = 0, completed = 0;
+            HsmCqe cqe[RING_ENTRIES];
+            while (completed < total_sqes) {
+                while (submitted < total_sqes && ring.sqSpace()) {
+                    size_t off = (submitted % RING_ENTRIES) * RING_SQE_BLOCKS * 16;
+                    ring.submit(submitted, h, off, off, RING_SQE_BLOCKS);
+                    submitted++;
+                }
+                ring.flush();
+                uint32_t n = poll_mode ? ring.reap(cqe, RING_ENTRIES) : ring.wait(cqe, RING_ENTRIES);
+                for (uint32_t i = 0; i < n; i++) if (cqe[i].status != (uint32_t)HsmStatus::OK) ok = false;
+                completed += n;
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            printf("    Ring %-7s: %7.2f MB/s  (%llu doorbells, %llu CQ sleeps)\n", poll_mode ? "poll" : "eventfd",
+                   RING_MB * 1.048576 / secs, (unsigned long long)(ring.doorbells() - bells),
+                   (unsigned long long)(ring.sleeps() - sleeps));
+        }
+        if (ok) {
+            std::vector<uint32_t> buf(RING_SQE_BLOCKS * 4, 0x3C3C3C3C);
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t i = 0; ok && i < total_sqes; i++) {
+                ok = conn.encrypt(h, buf.data(), buf.data(), RING_SQE_BLOCKS) == HsmStatus::OK;
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            printf("    Socket      : %7.2f MB/s  (one %u-block request at a time)\n",
+                   RING_MB * 1.048576 / secs, RING_SQE_BLOCKS);
+        }
+        if (!ok) { printf("    Throughput  : [FAIL] errors in timed passes\n"); fail_count++; }
+
+        // ring SQEs take DRR turns with socket requests: a small client is not starved
+        if (ok) {
+            std::atomic<bool> ring_run{true};
+            std::atomic<uint64_t> ring_blocks{0};
+            std::thread saturate([&] {
+                size_t submitted = 0, completed = 0;
+                HsmCqe cqe[RING_ENTRIES];
+                while (ring_run.load()) {
+                    while (ring.sqSpace()) {
+                        size_t off = (submitted % RING_ENTRIES) * RING_SQE_BLOCKS * 16;
+                        ring.submit(submitted, h, off, off, RING_SQE_BLOCKS);
+                        submitted++;
+                    }
+                    ring.flush();
+                    uint32_t n = ring.reap(cqe, RING_ENTRIES);
+                    completed += n;
+                    ring_blocks += (uint64_t)n * RING_SQE_BLOCKS;
+                }
+                while (completed < submitted) {
+                    uint32_t n = ring.wait(cqe, RING_ENTRIES);
+                    if (!n) break;
+                    completed += n;
+                }
+            });
+
+            HsmClient c;
+            bool small_ok = c.connect(cfg.socket_path.c_str());
+            uint32_t skey[8];
+            make_key(1, skey);
+            SoftAes256 sref;
+            sref.setKey(skey);
+            AesKeyHandle sh = AES_NO_KEY;
+            small_ok = small_ok && c.loadKey(skey, sh) == HsmStatus::OK;
+            HsmLatency lat;
+            usleep(20000);  // let the ring fill its SQ
+            for (int i = 0; small_ok && i < FAIR_SMALL_REQS; i++) {
+                uint32_t pt[4] = { (uint32_t)i, 4, 5, 6 }, ct[4], expect[4];
+                sref.encrypt(pt, expect);
+                auto t0 = std::chrono::steady_clock::now();
+                small_ok = c.encrypt(sh, pt, ct, 1) == HsmStatus::OK && memcmp(ct, expect, sizeof(ct)) == 0;
+                lat.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - t0).count());
+            }
+            ring_run = false;
+            saturate.join();
+            printf("    Small client: %s, %d requests alongside %llu ring blocks\n", small_ok ? "[PASS]" : "[FAIL]",
+                   FAIR_SMALL_REQS, (unsigned long long)ring_blocks.load());
+            lat.print(stdout, "small");
+            if (!small_ok) fail_count++;
+        }
+    }
+
+    service.requestStop();
+    server.join();
+    printf("\n%s", service.report().c_str());
+    service.close();
+    pool.stop();
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,472 @@
+/**
+* @file     test_kat.cpp
+* @brief    KAT corpus + AESAVS Monte Carlo runner over the bulk and key-cache paths
+* @details  Vector files are mmap()ed and parsed in place, any size:
+*           - .hex: gen_aes_kat.py's 4 lines per vector (key hi, key lo, pt, ct)
+*           - .rsp / .txt: NIST AESAVS response files (GFSbox, KeySbox, VarTxt, VarKey,
+*             MMT, MCT); 256-bit keys only, other lengths are counted as skipped
+*
+* KAT: vectors are grouped by key and each group goes out as one encryptBulk() under a
+* key handle, so a 20k-vector corpus over 256 keys costs 256 expansions and pipelined
+* blocks instead of 20k key loads and sleeping polls. [DECRYPT] records are checked in
+* the encrypt direction (E(K, PT) = CT either way); the core has no inverse cipher.
+*
+* MCT (AESAVS 6.4.1, ECB encrypt, 256-bit key): 100 outer rounds of 1000 chained
+* encryptions, Key ^= CT[998] || CT[999] between rounds. Every block is dependent, so it
+* runs one block per encryptBulk() call; the key stays resident for the inner loop. The
+* chain is cross-checked against soft_aes.h and, from an MCT file, against its records.
+*
+* --legacy also times the first LEGACY_SAMPLE vectors the old way (loadKey + encrypt
+* with the sleeping WaitPolicy::lowCpu() poll) for comparison.
+*
+* Usage: test_kat [--hw] [--sim [instant|core|pynq]] [--legacy] [FILE...]
+*   no FILE: vectors/aes_kat.hex, vectors/aes_kat_random.hex and every .rsp in vectors/
+*   (python3 scripts/gen_aes_kat.py --random 20000 --aesavs --mct writes all of them)
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "sim_device.h"
+#include "soft_aes.h"
+
+constexpr const char* VEC_DIR     = "vectors";
+constexpr int    MCT_OUTER        = 100;
+constexpr int    MCT_INNER        = 1000;
+constexpr size_t LEGACY_SAMPLE    = 512;
+constexpr size_t LEGACY_MIN       = 64;       // smaller files are not worth timing
+constexpr int    MAX_REPORTED     = 5;        // mismatches printed per file
+
+// Vectors =======================================
+struct KatVector {
+    uint32_t key[8];
+    uint32_t pt[4];
+    uint32_t ct[4];
+    uint32_t line;                      // where the record ends, for reports
+    bool     encrypt;                   // [ENCRYPT] section (MCT decrypt records are skipped)
+};
+
+struct KatFile {
+    std::string            path;
+    bool                   mct = false;
+    std::vector<KatVector> vec;
+    size_t                 skipped = 0;     // wrong key length, MCT decrypt
+};
+
+static bool parse_words(const char* p, const char* end, uint32_t* out, size_t words) {
+    if ((size_t)(end - p) < 8 * words) return false;
+    for (size_t w = 0; w < words; w++) {
+        uint32_t v = 0;
+        for (int i = 0; i < 8; i++) {
+            char c = *p++;
+            uint32_t d = c >= '0' && c <= '9' ? c - '0' : c >= 'a' && c <= 'f' ? c - 'a' + 10 : c >= 'A' && c <= 'F' ? c - 'A' + 10 : 16;
+            if (d == 16) return false;
+            v = v << 4 | d;
+        }
+        out[w] = v;
+    }
+    return true;
+}
+
+// hex digits in [p, end) up to the first non-hex character
+static size_t hex_len(const char* p, const char* end) {
+    const char* q = p;
+    while (q < end && isxdigit((unsigned char)*q)) q++;
+    return (size_t)(q - p);
+}
+
+static bool parse_hex_file(const char* doc, size_t len, KatFile& f) {
+    const char* p = doc;
+    const char* end = doc + len;
+    uint32_t line = 0;
+    uint32_t fields[4][8];
+    int have = 0;
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        line++;
+        const char* s = p;
+        while (s < eol && (*s == ' ' || *s == '\t')) s++;
+        size_t n = hex_len(s, eol);
+        p = eol + 1;
+        if (n == 0) continue;               // blank / comment
+        if (n != 32 || !parse_words(s, s + n, fields[have], 4)) {
+            printf("    [ERROR] %s:%u: expected 32 hex digits\n", f.path.c_str(), line);
+            return false;
+        }
+        if (++have == 4) {
+            KatVector v;
+            memcpy(v.key, fields[0], 16);
+            memcpy(v.key + 4, fields[1], 16);
+            memcpy(v.pt, fields[2], 16);
+            memcpy(v.ct, fields[3], 16);
+            v.line = line;
+            v.encrypt = true;
+            f.vec.push_back(v);
+            have = 0;
+        }
+    }
+    if (have) printf("    [WARN] %s: %d trailing line(s) ignored\n", f.path.c_str(), have);
+    return true;
+}
+
+static bool parse_rsp_file(const char* doc, size_t len, KatFile& f) {
+    const char* p = doc;
+    const char* end = doc + len;
+    uint32_t line = 0;
+    bool encrypt = true;
+    KatVector v = {};
+    bool key = false, pt = false, ct = false, bad_len = false;
+    auto flush = [&] {
+        if (bad_len || (key && pt && ct && f.mct && !encrypt)) f.skipped++;
+        else if (key && pt && ct) {
+            v.line = line;
+            v.encrypt = encrypt;
+            f.vec.push_back(v);
+        }
+        key = pt = ct = bad_len = false;
+    };
+    while (p < end) {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if (!eol) eol = end;
+        line++;
+        const char* s = p;
+        p = eol + 1;
+        while (s < eol && (*s == ' ' || *s == '\t')) s++;
+        if (s == eol || *s == '\r' || *s == '#') continue;
+        if (*s == '[') {
+            flush();
+            if (eol - s >= 9 && memcmp(s, "[ENCRYPT]", 9) == 0) encrypt = true;
+            else if (eol - s >= 9 && memcmp(s, "[DECRYPT]", 9) == 0) encrypt = false;
+            continue;
+        }
+        const char* eq = (const char*)memchr(s, '=', eol - s);
+        if (!eq) continue;
+        std::string name(s, eq - s);
+        name.erase(name.find_last_not_of(" \t") + 1);
+        const char* val = eq + 1;
+        while (val < eol && *val == ' ') val++;
+        size_t n = hex_len(val, eol);
+        if (name == "COUNT") {
+            flush();
+        } else if (name == "KEY") {
+            if (n != 64) bad_len = true;
+            else key = parse_words(val, val + n, v.key, 8);
+        } else if (name == "PLAINTEXT") {
+            pt = n == 32 && parse_words(val, val + n, v.pt, 4);
+        } else if (name == "CIPHERTEXT") {
+            ct = n == 32 && parse_words(val, val + n, v.ct, 4);
+        }
+    }
+    flush();
+    return true;
+}
+
+static bool load_file(const std::string& path, KatFile& f) {
+    f.path = path;
+    std::string base = path.substr(path.find_last_of('/') + 1);
+    f.mct = base.find("MCT") != std::string::npos;
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) { perror(path.c_str()); return false; }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        printf("    [ERROR] %s: empty or unreadable\n", path.c_str());
+        return false;
+    }
+    void* m = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (m == MAP_FAILED) { perror("mmap"); return false; }
+    madvise(m, (size_t)st.st_size, MADV_SEQUENTIAL);
+    const char* doc = (const char*)m;
+    bool is_hex = base.size() > 4 && base.compare(base.size() - 4, 4, ".hex") == 0;
+    bool ok = is_hex ? parse_hex_file(doc, (size_t)st.st_size, f) : parse_rsp_file(doc, (size_t)st.st_size, f);
+    munmap(m, (size_t)st.st_size);
+    return ok;
+}
+
+static std::vector<std::string> default_files() {
+    std::vector<std::string> out;
+    for (const char* name : { "aes_kat.hex", "aes_kat_random.hex" }) {
+        std::string p = std::string(VEC_DIR) + "/" + name;
+        if (access(p.c_str(), R_OK) == 0) out.push_back(p);
+    }
+    std::vector<std::string> rsp;
+    if (DIR* d = opendir(VEC_DIR)) {
+        while (struct dirent* e = readdir(d)) {
+            std::string n = e->d_name;
+            if (n.size() > 4 && n.compare(n.size() - 4, 4, ".rsp") == 0) rsp.push_back(std::string(VEC_DIR) + "/" + n);
+        }
+        closedir(d);
+    }
+    std::sort(rsp.begin(), rsp.end());
+    out.insert(out.end(), rsp.begin(), rsp.end());
+    return out;
+}
+
+// Runners =======================================
+struct RunResult {
+    size_t vectors  = 0;
+    size_t keys     = 0;
+    size_t failures = 0;
+    double seconds  = 0;
+};
+
+static double since_s(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+static void report_mismatch(const KatFile& f, const KatVector& v, const uint32_t got[4], size_t& reported) {
+    if (reported++ >= MAX_REPORTED) return;
+    printf("    [FAIL] %s:%u  ct %08x%08x%08x%08x, expected %08x%08x%08x%08x\n", f.path.c_str(), v.line,
+           got[0], got[1], got[2], got[3], v.ct[0], v.ct[1], v.ct[2], v.ct[3]);
+}
+
+// every vector, one encryptBulk() per distinct key
+static RunResult run_kat(AesDriver& drv, const KatFile& f) {
+    RunResult r;
+    std::vector<uint32_t> order(f.vec.size());
+    for (uint32_t i = 0; i < order.size(); i++) order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+        return memcmp(f.vec[a].key, f.vec[b].key, sizeof(f.vec[a].key)) < 0;
+    });
+
+    std::vector<uint32_t> pt, ct;
+    size_t reported = 0;
+    auto t0 = std::chrono::steady_clock::now();
+    for (size_t i = 0; i < order.size();) {
+        const uint32_t* key = f.vec[order[i]].key;
+        size_t j = i;
+        while (j < order.size() && memcmp(f.vec[order[j]].key, key, 32) == 0) j++;
+        size_t n = j - i;
+        pt.resize(4 * n);
+        ct.assign(4 * n, 0);
+        for (size_t k = 0; k < n; k++) memcpy(&pt[4 * k], f.vec[order[i + k]].pt, 16);
+
+        AesKeyHandle h = drv.registerKey(key);
+        bool ok = drv.encryptBulk(h, pt.data(), ct.data(), n);
+        drv.unregisterKey(h);
+        for (size_t k = 0; k < n; k++) {
+            const KatVector& v = f.vec[order[i + k]];
+            if (!ok || memcmp(&ct[4 * k], v.ct, 16) != 0) {
+                r.failures++;
+                report_mismatch(f, v, &ct[4 * k], reported);
+            }
+        }
+        r.keys++;
+        i = j;
+    }
+    r.seconds = since_s(t0);
+    r.vectors = f.vec.size();
+    return r;
+}
+
+// the pre-key-cache path: raw key load + one sleeping-poll encrypt per vector
+static double run_legacy(AesDriver& drv, const KatFile& f, size_t n) {
+    drv.setWaitPolicy(WaitPolicy::lowCpu());
+    auto t0 = std::chrono::steady_clock::now();
+    uint32_t ct[4];
+    for (size_t i = 0; i < n; i++) {
+        drv.loadKey(f.vec[i].key);
+        drv.encrypt(f.vec[i].pt, ct);
+    }
+    double s = since_s(t0);
+    drv.setWaitPolicy(WaitPolicy::balanced());
+    drv.invalidateKeyCache();
+    return s;
+}
+
+struct MctRecord {
+    uint32_t key[8];
+    uint32_t pt[4];
+    uint32_t ct[4];
+};
+
+// AESAVS 6.4.1 from (key, pt); the core when drv is set, else soft_aes.h
+static bool mct_chain(AesDriver* drv, const uint32_t key0[8], const uint32_t pt0[4], std::vector<MctRecord>& out) {
+    uint32_t key[8], pt[4], ct[4], prev[4];
+    memcpy(key, key0, sizeof(key));
+    memcpy(pt, pt0, sizeof(pt));
+    SoftAes256 soft;
+    out.clear();
+    for (int i = 0; i < MCT_OUTER; i++) {
+        MctRecord rec;
+        memcpy(rec.key, key, sizeof(key));
+        memcpy(rec.pt, pt, sizeof(pt));
+        memcpy(ct, pt, sizeof(ct));
+        AesKeyHandle h = AES_NO_KEY;
+        if (drv) h = drv->registerKey(key);
+        else soft.setKey(key);
+        for (int j = 0; j < MCT_INNER; j++) {
+            memcpy(prev, ct, sizeof(prev));
+            if (!drv) soft.encryptBlocks(ct, ct, 1);
+            else if (!drv->encryptBulk(h, ct, ct, 1)) {
+                drv->unregisterKey(h);
+                return false;
+            }
+        }
+        if (drv) drv->unregisterKey(h);
+        memcpy(rec.ct, ct, sizeof(ct));
+        out.push_back(rec);
+        for (int w = 0; w < 4; w++) {
+            key[w] ^= prev[w];
+            key[4 + w] ^= ct[w];
+        }
+        memcpy(pt, ct, sizeof(pt));
+    }
+    return true;
+}
+
+static size_t mct_compare(const std::vector<MctRecord>& got, const std::vector<MctRecord>& want, const char* what) {
+    size_t bad = 0;
+    for (size_t i = 0; i < std::min(got.size(), want.size()); i++) {
+        if (memcmp(&got[i], &want[i], sizeof(MctRecord)) == 0) continue;
+        if (bad++ == 0) printf("    [FAIL] MCT round %zu differs from %s\n", i, what);
+    }
+    return bad + (got.size() < want.size() ? want.size() - got.size() : 0);
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true, legacy = false;
+    SimTiming sim_timing;
+    std::vector<std::string> files;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--legacy") legacy = true;
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else if (arg[0] == '-') {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--legacy] [FILE...]\n", argv[0]);
+            return EXIT_FAILURE;
+        } else {
+            files.push_back(arg);
+        }
+    }
+    if (files.empty()) files = default_files();
+
+    SimAesDevice sim_aes(sim_timing);
+    MMIO mmio;
+    if (sim) {
+        mmio.attach(&sim_aes);
+    } else if (!mmio.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(mmio);
+
+    printf("================================================\n");
+    printf("  AES-256 KAT / AESAVS runner (%s)\n", sim ? mmio.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+    auto verdict = [&](bool ok) {
+        fail_count += !ok;
+        return ok ? "[PASS]" : "[FAIL]";
+    };
+
+    // KAT files -------------
+    std::vector<KatFile> mct_files;
+    RunResult total;
+    if (files.empty()) printf("\n  [SKIP] no vector files (python3 scripts/gen_aes_kat.py --random 20000 --aesavs --mct)\n");
+    for (const std::string& path : files) {
+        KatFile f;
+        auto t0 = std::chrono::steady_clock::now();
+        if (!load_file(path, f)) {
+            printf("  %s %s: not loaded\n", verdict(false), path.c_str());
+            continue;
+        }
+        double parse_s = since_s(t0);
+        if (f.mct) {
+            mct_files.push_back(std::move(f));
+            continue;
+        }
+        RunResult r = run_kat(drv, f);
+        printf("\n  %s %s\n", verdict(r.failures == 0 && r.vectors > 0), path.c_str());
+        printf("    %zu vectors, %zu keys, %zu skipped, %zu failed; parse %.1f ms, run %.1f ms (%.0f vectors/s)\n",
+               r.vectors, r.keys, f.skipped, r.failures, parse_s * 1e3, r.seconds * 1e3, r.seconds > 0 ? r.vectors / r.seconds : 0.0);
+        if (legacy && f.vec.size() >= LEGACY_MIN) {
+            size_t n = std::min(LEGACY_SAMPLE, f.vec.size());
+            double s = run_legacy(drv, f, n);
+            printf("    legacy loadKey + sleeping poll: %zu vectors in %.1f ms, ~%.2f s for the file (%.1fx slower)\n",
+                   n, s * 1e3, s / n * r.vectors, r.seconds > 0 ? s / n * r.vectors / r.seconds : 0.0);
+        }
+        total.vectors += r.vectors;
+        total.keys += r.keys;
+        total.failures += r.failures;
+        total.seconds += r.seconds;
+    }
+
+    // MCT -------------
+    printf("\n[MCT] AESAVS 6.4.1 ECB encrypt: %d x %d chained blocks\n", MCT_OUTER, MCT_INNER);
+    std::vector<KatFile> runs = std::move(mct_files);
+    bool builtin = runs.empty();
+    if (builtin) {
+        // built-in seed: FIPS 197 C.3 key and plaintext
+        KatFile f;
+        f.path = "FIPS 197 C.3 seed";
+        KatVector v = {};
+        const uint32_t key[8] = { 0x00010203, 0x04050607, 0x08090a0b, 0x0c0d0e0f, 0x10111213, 0x14151617, 0x18191a1b, 0x1c1d1e1f };
+        const uint32_t pt[4] = { 0x00112233, 0x44556677, 0x8899aabb, 0xccddeeff };
+        memcpy(v.key, key, sizeof(key));
+        memcpy(v.pt, pt, sizeof(pt));
+        v.encrypt = true;
+        f.vec.push_back(v);
+        runs.push_back(std::move(f));
+    }
+    for (const KatFile& f : runs) {
+        std::vector<KatVector> enc;
+        for (const KatVector& v : f.vec) if (v.encrypt) enc.push_back(v);
+        if (enc.empty()) {
+            printf("  %s %s: no [ENCRYPT] records\n", verdict(false), f.path.c_str());
+            continue;
+        }
+        std::vector<MctRecord> hw, soft;
+        auto t0 = std::chrono::steady_clock::now();
+        bool ran = mct_chain(&drv, enc[0].key, enc[0].pt, hw);
+        double s = since_s(t0);
+        mct_chain(nullptr, enc[0].key, enc[0].pt, soft);
+        size_t bad = ran ? mct_compare(hw, soft, "soft_aes.h") : MCT_OUTER;
+        if (!builtin && ran) {
+            std::vector<MctRecord> want;
+            for (const KatVector& v : enc) {
+                MctRecord rec;
+                memcpy(rec.key, v.key, sizeof(rec.key));
+                memcpy(rec.pt, v.pt, sizeof(rec.pt));
+                memcpy(rec.ct, v.ct, sizeof(rec.ct));
+                want.push_back(rec);
+            }
+            bad += mct_compare(hw, want, f.path.c_str());
+        }
+        printf("  %s %s: %d rounds, %zu mismatched; %d blocks in %.1f ms (%.0f blocks/s)%s\n", verdict(ran && bad == 0),
+               f.path.c_str(), MCT_OUTER, bad, MCT_OUTER * MCT_INNER, s * 1e3, MCT_OUTER * MCT_INNER / s,
+               builtin ? ", vs soft_aes.h only" : "");
+        if (!hw.empty()) {
+            const MctRecord& last = hw.back();
+            printf("    round %d: CT = %08x%08x%08x%08x\n", MCT_OUTER - 1, last.ct[0], last.ct[1], last.ct[2], last.ct[3]);
+        }
+    }
+
+    printf("\n  Total: %zu vectors over %zu keys in %.1f ms, %zu failed\n", total.vectors, total.keys, total.seconds * 1e3, total.failures);
+    const AesKeyCacheStats& ks = drv.keyCacheStats();
+    printf("  Key cache: %llu hits, %llu misses\n", (unsigned long long)ks.hits, (unsigned long long)ks.misses);
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,281 @@
+/**
+* @file     test_modes.cpp
+* @brief    AES-256 CTR / CBC / GCM (aes_modes.h) against NIST vectors, behavioral model by default
+* @details  Every vector runs twice: CPU engine only, and forced onto the AES core (the
+*           dispatcher's CPU model pinned to "never"), fed whole and in odd-sized pieces.
+*
+* T1 - SP 800-38A F.5.5 CTR-AES256 (encrypt and decrypt), F.2.5 CBC-AES256
+* T2 - GCM spec test cases 13-16 and 18 (AES-256; 18 has a 60-byte IV): tag, decrypt,
+*      tampered ciphertext rejected; a 12-byte truncated tag accepted, 10 bytes refused
+* T3 - throughput: GHASH alone, CTR, GCM on the CPU and on the core (GHASH overlapped)
+*
+* Usage: test_modes [--hw] [--sim [instant|core|pynq]] [--mb N]
+*   --hw  run against the FPGA (as root) instead of the behavioral model
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "aes_driver.h"
+#include "aes_modes.h"
+#include "sim_device.h"
+
+// SP 800-38A =======================================
+const char* const SP38A_KEY = "603deb1015ca71be2b73aef0857d77811f352c073b6108d72d9810a30914dff4";
+const char* const SP38A_PT  = "6bc1bee22e409f96e93d7e117393172aae2d8a571e03ac9c9eb76fac45af8e51"
+                              "30c81c46a35ce411e5fbc1191a0a52eff69f2445df4f9b17ad2b417be66c3710";
+const char* const CTR_IV    = "f0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+const char* const CTR_CT    = "601ec313775789a5b7a7f504bbf3d228f443e3ca4d62b59aca84e990cacaf5c5"
+                              "2b0930daa23de94ce87017ba2d84988ddfc9c58db67aada613c2dd08457941a6";
+const char* const CBC_IV    = "000102030405060708090a0b0c0d0e0f";
+const char* const CBC_CT    = "f58c4c04d6e5f1ba779eabfb5f7bfbd69cfc4e967edb808d679f777bc6702c7d"
+                              "39f23369a9d9bacfa530e26304231461b2eb05e2c39be9fcda6c19078c6a9d1b";
+
+// GCM spec (McGrew / Viega), AES-256 cases =======================================
+struct GcmVector {
+    const char* name;
+    const char* key;
+    const char* iv;
+    const char* pt;
+    const char* aad;
+    const char* ct;
+    const char* tag;
+};
+
+#define GCM_K15 "feffe9928665731c6d6a8f9467308308feffe9928665731c6d6a8f9467308308"
+#define GCM_P15 "d9313225f88406e5a55909c5aff5269a86a7a9531534f7da2e4c303d8a318a72" \
+                "1c3c0c95956809532fcf0e2449a6b525b16aedf5aa0de657ba637b39"
+#define GCM_A16 "feedfacedeadbeeffeedfacedeadbeefabaddad2"
+
+const GcmVector GCM_VECTORS[] = {
+    { "Case 13", "0000000000000000000000000000000000000000000000000000000000000000",
+      "000000000000000000000000", "", "", "", "530f8afbc74536b9a963b4f1c4cb738b" },
+    { "Case 14", "0000000000000000000000000000000000000000000000000000000000000000",
+      "000000000000000000000000", "00000000000000000000000000000000", "",
+      "cea7403d4d606b6e074ec5d3baf39d18", "d0d1c8a799996bf0265b98b5d48ab919" },
+    { "Case 15", GCM_K15, "cafebabefacedbaddecaf888", GCM_P15 "1aafd255", "",
+      "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+      "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662898015ad",
+      "b094dac5d93471bdec1a502270e3cc6c" },
+    { "Case 16", GCM_K15, "cafebabefacedbaddecaf888", GCM_P15, GCM_A16,
+      "522dc1f099567d07f47f37a32a84427d643a8cdcbfe5c0c97598a2bd2555d1aa"
+      "8cb08e48590dbb3da7b08b1056828838c5f61e6393ba7a0abcc9f662",
+      "76fc6ece0f4e1768cddf8853bb2d551b" },
+    { "Case 18", GCM_K15,
+      "9313225df88406e555909c5aff5269aa6a7a9538534f7da1e4c303d2a318a728"
+      "c3c0c95156809539fcf0e2429a6b525416aedbf5a0de6a57a637b39b", GCM_P15, GCM_A16,
+      "5a8def2f0c9e53f1f75d7853659e2a20eeb2b22aafde6419a058ab4f6f746bf4"
+      "0fc0c3b780f244452da3ebf1c5d82cdea2418997200ef82e44ae7e3f",
+      "a44a8266ee1c8eb0c8b5d4cf5ae9f19a" },
+};
+
+constexpr size_t PIECES[] = { 1, 15, 17, 3, 32, 7 };      // cycled through for streaming runs
+
+static std::vector<uint8_t> unhex(const char* s) {
+    std::vector<uint8_t> v(strlen(s) / 2);
+    for (size_t i = 0; i < v.size(); i++) v[i] = (uint8_t)strtoul(std::string(s + 2 * i, 2).c_str(), nullptr, 16);
+    return v;
+}
+
+static void set_key(AesDispatcher& aes, const char* hex) {
+    std::vector<uint8_t> k = unhex(hex);
+    uint32_t w[8];
+    for (int i = 0; i < 8; i++) w[i] = aes_modes_detail::load_be32(k.data() + 4 * i);
+    aes.setKey(w);
+}
+
+// feed len bytes whole (streamed = false) or in PIECES-sized runs
+template <class Fn>
+static bool feed(size_t len, bool streamed, Fn&& fn) {
+    size_t off = 0;
+    for (int i = 0; off < len; i++) {
+        size_t n = streamed ? PIECES[i % (sizeof(PIECES) / sizeof(PIECES[0]))] : len;
+        if (n > len - off) n = len - off;
+        if (!fn(off, n)) return false;
+        off += n;
+    }
+    return true;
+}
+
+static bool check_ctr(AesDispatcher& aes, bool streamed) {
+    set_key(aes, SP38A_KEY);
+    std::vector<uint8_t> pt = unhex(SP38A_PT), ct = unhex(CTR_CT), iv = unhex(CTR_IV), out(pt.size());
+    AesCtr ctr(aes);
+    ctr.init(iv.data());
+    bool ok = feed(pt.size(), streamed, [&](size_t off, size_t n) { return ctr.update(pt.data() + off, out.data() + off, n); });
+    ok = ok && out == ct;
+    ctr.init(iv.data());
+    ok = ok && ctr.update(out.data(), out.data(), out.size()) && out == pt;      // decrypt in place
+    ctr.final();
+    return ok;
+}
+
+static bool check_cbc(AesDispatcher& aes, bool streamed) {
+    set_key(aes, SP38A_KEY);
+    std::vector<uint8_t> pt = unhex(SP38A_PT), ct = unhex(CBC_CT), iv = unhex(CBC_IV), out(pt.size() + 16);
+    AesCbcEncrypt cbc(aes);
+    cbc.init(iv.data());
+    size_t total = 0, w;
+    bool ok = feed(pt.size(), streamed, [&](size_t off, size_t n) {
+        bool r = cbc.update(pt.data() + off, n, out.data() + total, w);
+        total += w;
+        return r;
+    });
+    ok = ok && cbc.final(out.data() + total, w) && total == ct.size() && memcmp(out.data(), ct.data(), total) == 0;
+    return ok;
+}
+
+static bool check_gcm(AesDispatcher& aes, const GcmVector& v, bool streamed) {
+    set_key(aes, v.key);
+    std::vector<uint8_t> iv = unhex(v.iv), pt = unhex(v.pt), aad = unhex(v.aad), ct = unhex(v.ct), tag = unhex(v.tag);
+    std::vector<uint8_t> out(pt.size());
+    uint8_t t[16];
+
+    AesGcm gcm(aes);
+    bool ok = gcm.init(iv.data(), iv.size()) &&
+              feed(aad.size(), streamed, [&](size_t off, size_t n) { return gcm.aad(aad.data() + off, n); }) &&
+              feed(pt.size(), streamed, [&](size_t off, size_t n) { return gcm.encrypt(pt.data() + off, out.data() + off, n); }) &&
+              gcm.final(t) && out == ct && memcmp(t, tag.data(), 16) == 0;
+
+    // decrypt in place, then the same with one ciphertext bit flipped
+    ok = ok && gcm.init(iv.data(), iv.size()) && gcm.aad(aad.data(), aad.size()) &&
+         feed(out.size(), streamed, [&](size_t off, size_t n) { return gcm.decrypt(out.data() + off, out.data() + off, n); }) &&
+         gcm.verify(tag.data()) && out == pt;
+    std::vector<uint8_t> bad = ct;
+    if (!bad.empty()) bad[bad.size() / 2] ^= 0x01;
+    else aad.push_back(0);                                      // nothing to flip: extend the AAD instead
+    ok = ok && gcm.init(iv.data(), iv.size()) && gcm.aad(aad.data(), aad.size()) &&
+         gcm.decrypt(bad.data(), bad.data(), bad.size()) && !gcm.verify(tag.data());
+    return ok;
+}
+
+// SP 800-38D lengths: 12 bytes is the leftmost 12 of the full tag, 10 is not a GCM tag
+static bool check_gcm_tag_len(AesDispatcher& aes, const GcmVector& v) {
+    set_key(aes, v.key);
+    std::vector<uint8_t> iv = unhex(v.iv), pt = unhex(v.pt), aad = unhex(v.aad), ct = unhex(v.ct), tag = unhex(v.tag);
+    std::vector<uint8_t> out(pt.size());
+    uint8_t t[16] = {};
+    AesGcm gcm(aes);
+    auto run = [&](bool decrypt) {
+        return gcm.init(iv.data(), iv.size()) && gcm.aad(aad.data(), aad.size()) &&
+               (decrypt ? gcm.decrypt(ct.data(), out.data(), ct.size()) : gcm.encrypt(pt.data(), out.data(), pt.size()));
+    };
+    bool ok = run(false) && gcm.final(t, 12) && memcmp(t, tag.data(), 12) == 0 &&
+              run(true) && gcm.verify(tag.data(), 12);
+    ok = ok && run(false) && !gcm.final(t, 10);
+    ok = ok && run(true) && !gcm.verify(tag.data(), 10);
+    return ok;
+}
+
+static double secs_since(std::chrono::steady_clock::time_point t0) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = true;
+    SimTiming sim_timing;
+    size_t mb = 16;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--mb" && a + 1 < argc) mb = strtoul(argv[++a], nullptr, 0);
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--mb N]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if (mb == 0) mb = 1;
+
+    SimAesDevice sim_aes(sim_timing);
+    MMIO mmio;
+    if (sim) {
+        mmio.attach(&sim_aes);
+    } else if (!mmio.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(mmio);
+    AesDispatcher cpu(nullptr);
+    AesDispatcher core(&drv);
+    core.cpuModel() = LatencyModel(1e12, 1e12);        // never pick the CPU
+
+    printf("================================================\n");
+    printf("  AES-256 Modes Test (%s)\n", sim ? mmio.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+    auto report = [&](const char* name, bool (*fn)(AesDispatcher&, bool)) {
+        bool c = fn(cpu, false) && fn(cpu, true);
+        bool h = fn(core, false) && fn(core, true);
+        printf("    %-12s: CPU %s  core %s\n", name, c ? "[PASS]" : "[FAIL]", h ? "[PASS]" : "[FAIL]");
+        fail_count += !c + !h;
+    };
+
+    // T1 - SP 800-38A ------------------------------
+    printf("\n[TEST 1] SP 800-38A CTR / CBC (AES-256)\n");
+    report("F.5.5 CTR", check_ctr);
+    report("F.2.5 CBC", check_cbc);
+
+    // T2 - GCM -------------------------------------
+    printf("\n[TEST 2] GCM (AES-256)\n");
+    for (const GcmVector& v : GCM_VECTORS) {
+        bool c = check_gcm(cpu, v, false) && check_gcm(cpu, v, true);
+        bool h = check_gcm(core, v, false) && check_gcm(core, v, true);
+        printf("    %-12s: CPU %s  core %s\n", v.name, c ? "[PASS]" : "[FAIL]", h ? "[PASS]" : "[FAIL]");
+        fail_count += !c + !h;
+    }
+    {
+        const GcmVector& v = GCM_VECTORS[2];
+        bool c = check_gcm_tag_len(cpu, v), h = check_gcm_tag_len(core, v);
+        printf("    %-12s: CPU %s  core %s\n", "Tag 12 / 10", c ? "[PASS]" : "[FAIL]", h ? "[PASS]" : "[FAIL]");
+        fail_count += !c + !h;
+    }
+
+    // T3 - throughput ------------------------------
+    printf("\n[TEST 3] Throughput, %zu MB\n", mb);
+    {
+        std::vector<uint8_t> buf(mb << 20, 0x5A);
+        uint8_t iv[16] = {}, tag[16];
+
+        aes_modes_detail::Ghash gh;
+        gh.init(iv);
+        auto t0 = std::chrono::steady_clock::now();
+        gh.update(buf.data(), buf.size());
+        double ghash_mbs = buf.size() / secs_since(t0) / 1e6;
+        printf("    GHASH       : %8.2f MB/s (CPU, 4-bit tables)\n", ghash_mbs);
+
+        set_key(cpu, SP38A_KEY);
+        set_key(core, SP38A_KEY);
+        for (AesDispatcher* d : { &cpu, &core }) {
+            const char* who = d == &cpu ? "CPU " : "core";
+            AesCtr ctr(*d);
+            ctr.init(iv);
+            t0 = std::chrono::steady_clock::now();
+            bool ok = ctr.update(buf.data(), buf.data(), buf.size());
+            double ctr_mbs = buf.size() / secs_since(t0) / 1e6;
+
+            AesGcm gcm(*d);
+            t0 = std::chrono::steady_clock::now();
+            ok = ok && gcm.init(iv, 12) && gcm.encrypt(buf.data(), buf.data(), buf.size()) && gcm.final(tag);
+            double gcm_mbs = buf.size() / secs_since(t0) / 1e6;
+            // fully serial GCM would take 1/ctr + 1/ghash per byte
+            double serial = 1.0 / (1.0 / ctr_mbs + 1.0 / ghash_mbs);
+            printf("    %s CTR    : %8.2f MB/s\n", who, ctr_mbs);
+            printf("    %s GCM    : %8.2f MB/s (serial estimate %.2f) %s\n", who, gcm_mbs, serial, ok ? "" : "[FAIL]");
+            fail_count += !ok;
+        }
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,199 @@
+/**
+* @file     test_rt.cpp
+* @brief    Low-latency runtime (hsm_rt.h): pinned SCHED_FIFO control loop over the AES core / TRNG
+* @details  Behavioral model by default. On the board, run as root with a CPU kept out of the
+*           scheduler (isolcpus=1) to get numbers that bound the control loop.
+*
+* T1 - runtime entry: pin, SCHED_FIFO, mlockall, buffer lock, register prefault; leave()
+*      restores the affinity and policy found
+* T2 - control loop: one single-block encrypt (+ one TRNG word with --trng) per period,
+*      every ciphertext checked; wake-up and response histograms, overruns vs deadline
+* T3 - overrun reporting: iterations stalled on purpose are the ones logged, and the
+*      log keeps the most recent RT_OVERRUN_LOG once it wraps
+*
+* A step the kernel refuses (no CAP_SYS_NICE, RLIMIT_MEMLOCK) and T2 overruns are
+* warnings unless --strict; with --strict they fail the run (latency bound proofs).
+*
+* Usage: test_rt [--hw] [--sim [instant|core|pynq]] [--cpu N] [--fifo PRIO] [--mlock]
+*                [--period-us P] [--deadline-us D] [--iters N] [--spin] [--trng] [--strict]
+*   --period-us 0 runs back to back; --deadline-us defaults to the period
+*/
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <sched.h>
+#include <unistd.h>
+
+#include "aes_driver.h"
+#include "aes_vectors.h"
+#include "hsm_driver.h"
+#include "hsm_rt.h"
+#include "sim_device.h"
+
+constexpr uint64_t STALL_ITERS[] = { 5, 12 };
+constexpr uint64_t STALL_US      = 3000;
+constexpr uint64_t STALL_DEADLINE_US = 1000;
+
+int main(int argc, char* argv[]) {
+    bool sim = true, spin = false, trng = false, strict = false;
+    SimTiming sim_timing;
+    RtConfig cfg;
+    uint64_t period_us = 100, deadline_us = 0, iters = 20000;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw") sim = false;
+        else if (arg == "--cpu" && a + 1 < argc)          cfg.cpu = atoi(argv[++a]);
+        else if (arg == "--fifo" && a + 1 < argc)         cfg.fifo_priority = atoi(argv[++a]);
+        else if (arg == "--mlock")                        cfg.lock_memory = true;
+        else if (arg == "--period-us" && a + 1 < argc)    period_us = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "--deadline-us" && a + 1 < argc)  deadline_us = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "--iters" && a + 1 < argc)        iters = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "--spin")                         spin = true;
+        else if (arg == "--trng")                         trng = true;
+        else if (arg == "--strict")                       strict = true;
+        else if (arg == "--sim") {
+            if (a + 1 < argc && argv[a + 1][0] != '-' && !SimTiming::parse(argv[++a], sim_timing)) {
+                fprintf(stderr, "[FATAL] Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+        } else {
+            printf("Usage: %s [--hw] [--sim [instant|core|pynq]] [--cpu N] [--fifo PRIO] [--mlock]\n"
+                   "       %*s [--period-us P] [--deadline-us D] [--iters N] [--spin] [--trng] [--strict]\n",
+                   argv[0], (int)strlen(argv[0]), "");
+            return EXIT_FAILURE;
+        }
+    }
+    if (!deadline_us) deadline_us = period_us;
+    cfg.deadline_ns = deadline_us * 1000;
+
+    SimAesDevice sim_aes(sim_timing);
+    SimHsmDevice sim_hsm(sim_timing);
+    MMIO aes;
+    if (sim) {
+        aes.attach(&sim_aes);
+    } else if (!aes.open(AES_BASE_ADDR, AES_SIZE)) {
+        fprintf(stderr, "[FATAL] Cannot map AES peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    PynqHSM hsm = sim ? PynqHSM(&sim_hsm) : PynqHSM(HSM_BASE_ADDR, HSM_SIZE);
+    if (!hsm.isOpen()) {
+        fprintf(stderr, "[FATAL] Cannot map HSM peripheral (run as root, or drop --hw)\n");
+        return EXIT_FAILURE;
+    }
+    AesDriver drv(aes);
+    drv.setWaitPolicy(WaitPolicy::lowLatency());   // never yield the pinned core
+    hsm.sampleWait().policy = WaitPolicy::lowLatency();
+    hsm.clearHealth();
+
+    printf("================================================\n");
+    printf("  Low-latency Runtime Test (%s)\n", sim ? aes.backend() : "hardware");
+    printf("================================================\n");
+    int fail_count = 0;
+    auto verdict = [&](bool ok, bool warn_only) {
+        if (!ok && !warn_only) fail_count++;
+        return ok ? "[PASS]" : warn_only ? "[WARN]" : "[FAIL]";
+    };
+
+    // T1 - runtime entry ---------------------------
+    printf("\n[TEST 1] Runtime entry\n");
+    RtRuntime rt;
+    std::vector<uint32_t> work(4096);           // the loop's working buffer
+    cpu_set_t before;
+    sched_getaffinity(0, sizeof(before), &before);
+    int policy_before = sched_getscheduler(0);
+    {
+        bool entered = rt.enter(cfg);
+        rt.print(cfg);
+        printf("    Requested   : %s\n", verdict(entered, !strict));
+        if (cfg.cpu >= 0 && rt.pinned()) {
+            bool on_cpu = sched_getcpu() == cfg.cpu;
+            printf("    Running on  : CPU %d %s\n", sched_getcpu(), verdict(on_cpu, false));
+        }
+        if (!rt.locked()) {
+            bool locked = RtRuntime::lock(work.data(), work.size() * sizeof(work[0]));
+            printf("    Buffer lock : %zu bytes %s\n", work.size() * sizeof(work[0]), verdict(locked, !strict));
+        }
+        RtRuntime::prefault(aes, AES::STATUS);
+        (void)hsm.readReg(REG_COUNTER);         // same for the TRNG page (COUNTER has no side effects)
+
+        // leave() must hand back the mask it found, then re-enter for the loop
+        rt.leave();
+        cpu_set_t after;
+        sched_getaffinity(0, sizeof(after), &after);
+        bool restored = CPU_EQUAL(&before, &after) && sched_getscheduler(0) == policy_before;
+        printf("    leave()     : affinity / policy restored %s\n", verdict(restored, false));
+        rt.enter(cfg);
+    }
+
+    // T2 - control loop ----------------------------
+    printf("\n[TEST 2] Control loop: %llu iterations, period %lluus, deadline %lluus%s%s\n",
+           (unsigned long long)iters, (unsigned long long)period_us, (unsigned long long)deadline_us,
+           spin ? ", spin release" : "", trng ? ", + TRNG word" : "");
+    {
+        const AESTestVector& v = VECTORS[0];
+        AesKeyHandle h = drv.registerKey(v.key);
+        uint64_t bad = 0, failed = 0;
+        drv.encrypt(h, v.pt, work.data());     // key expansion + cold caches outside the loop
+        if (trng) hsm.sampleWord(work[3]);
+        RtLoop loop(period_us * 1000, cfg.deadline_ns, spin);
+        loop.start();
+        for (uint64_t i = 0; i < iters; i++) {
+            loop.next();
+            uint32_t* ct = &work[(i * 4) % work.size()];
+            if (!drv.encrypt(h, v.pt, ct)) failed++;
+            else if (memcmp(ct, v.ct, sizeof(v.ct)) != 0) bad++;
+            if (trng) {
+                uint32_t w = 0;
+                if (!hsm.sampleWord(w)) failed++;
+                work[(i * 4 + 3) % work.size()] ^= w;
+            }
+            loop.done();
+        }
+        drv.unregisterKey(h);
+        loop.print();
+        bool ok = !bad && !failed;
+        printf("    Results     : %llu wrong, %llu timed out %s\n", (unsigned long long)bad,
+               (unsigned long long)failed, verdict(ok, false));
+        bool met = loop.response.overruns() == 0;
+        printf("    Deadline    : %llu / %llu overran %s\n", (unsigned long long)loop.response.overruns(),
+               (unsigned long long)loop.iterations(), verdict(met, !strict));
+    }
+    rt.leave();
+
+    // T3 - overrun reporting -----------------------
+    printf("\n[TEST 3] Overrun reporting\n");
+    {
+        RtLoop loop(0, STALL_DEADLINE_US * 1000);
+        loop.start();
+        for (uint64_t i = 0; i < 20; i++) {
+            loop.next();
+            for (uint64_t s : STALL_ITERS)
+                if (i == s) usleep(STALL_US);
+            loop.done();
+        }
+        // the stalled ones must be there; a preempted neighbour may add to them
+        bool found = true;
+        for (uint64_t s : STALL_ITERS) {
+            bool hit = false;
+            for (int i = 0; i < loop.response.logged(); i++) hit |= loop.response.overrun(i).iter == s;
+            found &= hit;
+        }
+        printf("    Stalls      : %llu overrun(s) logged, iterations 5 and 12 among them %s\n",
+               (unsigned long long)loop.response.overruns(), verdict(found, false));
+
+        RtJitter j(100);
+        for (uint64_t i = 0; i < 100; i++) j.record(i, 200);
+        bool wrapped = j.overruns() == 100 && j.logged() == RT_OVERRUN_LOG &&
+                       j.overrun(0).iter == 100 - RT_OVERRUN_LOG && j.overrun(RT_OVERRUN_LOG - 1).iter == 99;
+        printf("    Log wrap    : %d kept of %llu, oldest iter %llu %s\n", j.logged(),
+               (unsigned long long)j.overruns(), (unsigned long long)j.overrun(0).iter, verdict(wrapped, false));
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
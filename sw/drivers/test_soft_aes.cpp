@@ -0,0 +1,172 @@
+/**
+* @file     test_soft_aes.cpp
+* @brief    Software AES-256 engine check + per-kernel throughput (runs on board or host)
+* @details  No hardware access; every kernel the CPU supports is exercised.
+*
+* T1 - key expansion words (as in tb_aes_core.sv) and the shared KAT vectors, per kernel
+* T2 - pseudo-random keys / blocks cross-checked against the T-table kernel (odd block counts, in place)
+* T3 - throughput per kernel vs the FPGA core's block rate
+*
+* Usage: test_soft_aes [--kernel ttable|bitslice|aesni|armv8-ce] [--mb N]
+*/
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include "aes_driver.h"
+#include "aes_vectors.h"
+#include "soft_aes.h"
+
+constexpr size_t CROSS_BLOCKS = 1027;   // not a multiple of 4 or 8: exercises the tail paths
+constexpr int    CROSS_KEYS   = 8;
+
+const SoftAesKernel ALL_KERNELS[] = { SoftAesKernel::TTABLE, SoftAesKernel::BITSLICE,
+                                      SoftAesKernel::AESNI, SoftAesKernel::ARMV8_CE };
+
+// xorshift, enough for test data
+static uint32_t next_rand(uint64_t& s) {
+    s ^= s << 13; s ^= s >> 7; s ^= s << 17;
+    return (uint32_t)(s >> 32);
+}
+
+static bool same_blocks(const uint32_t* a, const uint32_t* b, size_t n) {
+    return memcmp(a, b, n * 16) == 0;
+}
+
+int main(int argc, char* argv[]) {
+    bool only_set = false;
+    SoftAesKernel only = SoftAesKernel::TTABLE;
+    size_t bench_mb = 16;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--kernel" && a + 1 < argc) {
+            if (!SoftAes256::parseKernel(argv[++a], only)) {
+                printf("[FATAL] Unknown kernel '%s' (ttable|bitslice|aesni|armv8-ce)\n", argv[a]);
+                return EXIT_FAILURE;
+            }
+            only_set = true;
+        } else if (arg == "--mb" && a + 1 < argc) {
+            bench_mb = strtoul(argv[++a], nullptr, 0);
+            if (bench_mb == 0) bench_mb = 1;
+        }
+    }
+
+    std::vector<SoftAesKernel> kernels;
+    for (SoftAesKernel k : ALL_KERNELS) {
+        if (only_set && k != only) continue;
+        if (SoftAes256::available(k)) kernels.push_back(k);
+    }
+
+    printf("================================================\n");
+    printf("  Software AES-256 Engine Test\n");
+    printf("  Kernels:");
+    for (SoftAesKernel k : ALL_KERNELS) {
+        printf(" %s%s", SoftAes256::kernelName(k), SoftAes256::available(k) ? "" : "(n/a)");
+    }
+    printf("\n  Default: %s\n", SoftAes256::kernelName(SoftAes256::best()));
+    printf("================================================\n");
+    if (kernels.empty()) {
+        printf("[FATAL] Requested kernel not available on this CPU\n");
+        return EXIT_FAILURE;
+    }
+
+    int fail_count = 0;
+
+    // T1 - known answers ----------------------------
+    printf("\n[TEST 1] Key expansion + KAT vectors\n");
+    {
+        // w[8..11] for the C.3 key, same check as tb_aes_core.sv / aes_key_exp.hex
+        const uint32_t W8_11[4] = { 0xa573c29f, 0xa176c498, 0xa97fce93, 0xa572c09c };
+        SoftAes256 ref(SoftAesKernel::TTABLE);
+        ref.setKey(VECTORS[0].key);
+        bool ok = memcmp(ref.roundKeys() + 8, W8_11, sizeof(W8_11)) == 0;
+        printf("    %-10s key expansion w[8..11] %s\n", "", ok ? "[PASS]" : "[FAIL]");
+        if (!ok) fail_count++;
+    }
+    for (SoftAesKernel k : kernels) {
+        SoftAes256 aes(k);
+        int pass = 0;
+        for (int i = 0; i < NUM_VECTORS; i++) {
+            uint32_t ct[4];
+            aes.setKey(VECTORS[i].key);
+            aes.encrypt(VECTORS[i].pt, ct);
+            if (memcmp(ct, VECTORS[i].ct, sizeof(ct)) == 0) pass++;
+            else printf("    %-10s %s: got %08x_%08x_%08x_%08x\n", SoftAes256::kernelName(k),
+                        VECTORS[i].name, ct[0], ct[1], ct[2], ct[3]);
+        }
+        printf("    %-10s %d/%d vectors %s\n", SoftAes256::kernelName(k), pass, NUM_VECTORS,
+               pass == NUM_VECTORS ? "[PASS]" : "[FAIL]");
+        if (pass != NUM_VECTORS) fail_count++;
+    }
+
+    // T2 - cross-check ------------------------------
+    printf("\n[TEST 2] Cross-check vs ttable: %d keys x %zu blocks\n", CROSS_KEYS, CROSS_BLOCKS);
+    {
+        std::vector<uint32_t> pt(CROSS_BLOCKS * 4), ref_ct(CROSS_BLOCKS * 4), ct(CROSS_BLOCKS * 4);
+        SoftAes256 ref(SoftAesKernel::TTABLE);
+        for (SoftAesKernel k : kernels) {
+            if (k == SoftAesKernel::TTABLE) continue;
+            SoftAes256 aes(k);
+            uint64_t seed = 0x9E3779B97F4A7C15ull;
+            bool ok = true;
+            for (int key_i = 0; key_i < CROSS_KEYS && ok; key_i++) {
+                uint32_t key[8];
+                for (uint32_t& w : key) w = next_rand(seed);
+                for (uint32_t& w : pt) w = next_rand(seed);
+                ref.setKey(key);
+                aes.setKey(key);
+                ref.encryptBlocks(pt.data(), ref_ct.data(), CROSS_BLOCKS);
+
+                // every length 1..9 from the start, then the full odd-length run, then in place
+                for (size_t n = 1; n <= 9 && ok; n++) {
+                    aes.encryptBlocks(pt.data(), ct.data(), n);
+                    ok = same_blocks(ct.data(), ref_ct.data(), n);
+                }
+                aes.encryptBlocks(pt.data(), ct.data(), CROSS_BLOCKS);
+                ok = ok && same_blocks(ct.data(), ref_ct.data(), CROSS_BLOCKS);
+                ct = pt;
+                aes.encryptBlocks(ct.data(), ct.data(), CROSS_BLOCKS);
+                ok = ok && same_blocks(ct.data(), ref_ct.data(), CROSS_BLOCKS);
+            }
+            printf("    %-10s %s\n", SoftAes256::kernelName(k), ok ? "[PASS]" : "[FAIL]");
+            if (!ok) fail_count++;
+        }
+    }
+
+    // T3 - throughput -------------------------------
+    double core_mbs = AesBulkStats::core_blocks_per_sec() * 16 / 1e6;
+    printf("\n[TEST 3] Throughput, %zu MB per kernel (FPGA core: %.1f MB/s at %.0f MHz)\n",
+           bench_mb, core_mbs, AES_CLK_HZ / 1e6);
+    {
+        const size_t chunk_blocks = 4096;   // 64KB working set, stays in L2
+        const size_t total_blocks = bench_mb * (1 << 20) / 16;
+        std::vector<uint32_t> buf(chunk_blocks * 4);
+        uint64_t seed = 1;
+        for (uint32_t& w : buf) w = next_rand(seed);
+
+        for (SoftAesKernel k : kernels) {
+            SoftAes256 aes(k);
+            aes.setKey(VECTORS[0].key);
+            aes.encryptBlocks(buf.data(), buf.data(), chunk_blocks);     // warm tables / caches
+
+            auto t0 = std::chrono::steady_clock::now();
+            for (size_t done = 0; done < total_blocks; done += chunk_blocks) {
+                aes.encryptBlocks(buf.data(), buf.data(), chunk_blocks);
+            }
+            double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+            double mbs = total_blocks * 16 / secs / 1e6;
+            printf("    %-10s %8.1f MB/s  %7.2f Mblocks/s  %5.2fx core\n", SoftAes256::kernelName(k),
+                   mbs, total_blocks / secs / 1e6, mbs / core_mbs);
+        }
+        printf("    (checksum %08x)\n", buf[0] ^ buf[buf.size() - 1]);
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,130 @@
+/**
+* @file     test_wait.cpp
+* @brief    Off-board check of the completion wait policies in hsm_wait.h
+* @details  A device thread raises a done flag DEVICE_DELAY_US after each request
+*           (and fires a SoftIrq), standing in for the AES core / TRNG sampler.
+*
+* T1 - each policy completes every wait, reports latency and waiter CPU time
+* T2 - SoftIrq policy completes through the interrupt path
+* T3 - timeout returns false within bounds
+*/
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <thread>
+
+#include "hsm_wait.h"
+
+constexpr int      NUM_WAITS       = 200;
+constexpr uint32_t DEVICE_DELAY_US = 50;
+
+static double thread_cpu_us() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e6 + ts.tv_nsec / 1e3;
+}
+
+// fake peripheral ===============================
+struct FakeDevice {
+    std::atomic<uint32_t> request{0};
+    std::atomic<uint32_t> done{0};
+    std::atomic<bool>     quit{false};
+    SoftIrq*              irq = nullptr;
+
+    void run() {
+        uint32_t seen = 0;
+        while (!quit.load()) {
+            uint32_t req = request.load();
+            if (req == seen) { std::this_thread::yield(); continue; }
+            seen = req;
+            auto t_end = std::chrono::steady_clock::now() + std::chrono::microseconds(DEVICE_DELAY_US);
+            while (std::chrono::steady_clock::now() < t_end) {}
+            done.store(req);
+            if (irq) irq->fire();
+        }
+    }
+};
+
+struct PolicyResult {
+    bool   ok;
+    double avg_us;
+    double cpu_us;
+};
+
+static PolicyResult run_policy(const char* name, const WaitPolicy& policy, SoftIrq* irq, Completion& c) {
+    FakeDevice dev;
+    dev.irq = irq;
+    std::thread t(&FakeDevice::run, &dev);
+
+    c.policy = policy;
+    c.stats.reset();
+    bool ok = true;
+    double cpu0 = thread_cpu_us();
+    auto t0 = std::chrono::steady_clock::now();
+    for (int i = 1; i <= NUM_WAITS; i++) {
+        dev.request.store(i);
+        if (!c.wait([&] { return dev.done.load() == (uint32_t)i; })) ok = false;
+    }
+    double wall_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    double cpu_us = thread_cpu_us() - cpu0;
+
+    dev.quit.store(true);
+    t.join();
+
+    PolicyResult r = { ok && c.stats.timeouts == 0, wall_us / NUM_WAITS, cpu_us / NUM_WAITS };
+    printf("  %-10s %s  wall %.1fus/op  waiter cpu %.1fus/op\n", name, r.ok ? "[PASS]" : "[FAIL]", r.avg_us, r.cpu_us);
+    c.stats.print(name);
+    return r;
+}
+
+int main() {
+    printf("================================================\n");
+    printf("  Completion Wait Policy Test (off-board)\n");
+    printf("  %d waits/policy, device latency %uus\n", NUM_WAITS, DEVICE_DELAY_US);
+    printf("================================================\n");
+
+    int fail_count = 0;
+    Completion c;
+
+    // T1 - polling policies ----------------------
+    printf("\n[TEST 1] Polling policies\n");
+    if (!run_policy("latency",  WaitPolicy::lowLatency(), nullptr, c).ok) fail_count++;
+    if (!run_policy("balanced", WaitPolicy::balanced(),   nullptr, c).ok) fail_count++;
+    if (!run_policy("cpu",      WaitPolicy::lowCpu(),     nullptr, c).ok) fail_count++;
+
+    // T2 - interrupt path ------------------------
+    printf("\n[TEST 2] SoftIrq interrupt policy\n");
+    SoftIrq irq;
+    if (!irq.open()) return EXIT_FAILURE;
+    PolicyResult r = run_policy("irq", WaitPolicy::lowCpu(irq.fd()), &irq, c);
+    if (!r.ok || c.stats.irq_done == 0) {
+        printf("    [FAIL] No waits completed through the interrupt path\n");
+        fail_count++;
+    } else {
+        printf("    Interrupts fired: %u, unmask writes seen: %llu\n", irq.count(), (unsigned long long)irq.unmasks());
+    }
+
+    // T3 - timeout -------------------------------
+    printf("\n[TEST 3] Timeout\n");
+    c.policy = WaitPolicy::balanced();
+    c.policy.timeout_us = 2000;
+    c.stats.reset();
+    auto t0 = std::chrono::steady_clock::now();
+    bool got = c.wait([] { return false; });
+    double waited_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - t0).count();
+    printf("    Returned %s after %.0fus (timeout %uus)\n", got ? "true" : "false", waited_us, c.policy.timeout_us);
+    if (got || c.stats.timeouts != 1 || waited_us < c.policy.timeout_us || waited_us > 10 * c.policy.timeout_us) {
+        printf("    [FAIL] Timeout not honoured\n");
+        fail_count++;
+    } else {
+        printf("    [PASS] Timeout honoured\n");
+    }
+
+    printf("\n================================================\n");
+    printf("  %s: %d failure(s)\n", fail_count ? "[OVERALL FAIL]" : "[OVERALL PASS]", fail_count);
+    printf("================================================\n");
+    return fail_count ? EXIT_FAILURE : EXIT_SUCCESS;
+}
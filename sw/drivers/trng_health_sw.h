@@ -0,0 +1,275 @@
+/**
+* @file     trng_health_sw.h
+* @brief    Software SP 800-90B continuous health tests over every harvested TRNG word
+* @details  The fabric only tests the VN bit stream with one RCT and one APT and the
+*           drivers only see the sticky STATUS bits now and then. SwHealth runs the same
+*           family of tests on every 32-bit word that leaves the driver, word at a time:
+*
+* RCT - transitions t = w ^ (w >> 1 | prev << 31); runs crossing word boundaries are
+*       carried with clz/ctz, runs inside a word found by AND-shifting ~t (log2(C) ops)
+* APT - binary adaptive proportion on tumbling windows (multiples of 32 bits): per-word
+*       popcounts (NEON vcnt on ARM, popcnt elsewhere) summed per window, fail when
+*       either symbol reaches the cutoff
+*
+* Cutoffs follow SP 800-90B 4.4 from the claimed min-entropy h_min and alpha = 2^-alpha_log2.
+* The hardware-equivalent pair (RCT run of 34 = trng_health.sv RCT_CUTOFF 32, APT 512 bits
+* outside [166,346]) also runs so verdicts can be cross-checked against REG_STATUS.
+* The software sees only the bits that land in words; the fabric also tests VN bits
+* produced while no sample is pending, so an occasional disagreement is expected and is
+* counted rather than treated as an error.
+*
+* Bit order: RAND_OUT shifts new bits in at bit 0, so bit 31 is the oldest bit of a word.
+*/
+
+#pragma once
+
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+#include "hsm_driver.h"
+
+// software verdict flag carried next to the REG_STATUS bits (not a hardware bit)
+constexpr uint32_t SW_HEALTH_FAIL = 1u << 31;
+
+// Config =======================================
+struct SwHealthConfig {
+    double   h_min      = 1.0;          // claimed min-entropy per bit (post-VN)
+    uint32_t alpha_log2 = 40;           // false positive rate; 90B allows 2^-20..2^-40, 2^-40 keeps
+                                        // false alarms out of multi-GB captures
+    std::vector<uint32_t> apt_windows = { 1024, 4096 };     // bits, rounded up to 32
+    bool     hw_tests   = true;         // also run the trng_health.sv-equivalent RCT / APT
+};
+
+// Cutoffs =======================================
+// SP 800-90B 4.4.1: C = 1 + ceil(-log2(alpha) / H)
+inline uint32_t rct_cutoff(double h_min, uint32_t alpha_log2) {
+    return 1 + (uint32_t)std::ceil(alpha_log2 / h_min);
+}
+
+// SP 800-90B 4.4.2: C = 1 + CRITBINOM(W, 2^-H, 1 - alpha)
+inline uint32_t apt_cutoff(uint32_t window, double h_min, uint32_t alpha_log2) {
+    double p = std::pow(2.0, -h_min);
+    double tail = std::ldexp(1.0, -(int)alpha_log2);
+    double lp = std::log(p), lq = std::log1p(-p);
+    double cdf = 0.0;
+    for (uint32_t k = 0; k <= window; k++) {
+        double lpmf = std::lgamma(window + 1.0) - std::lgamma(k + 1.0) - std::lgamma(window - k + 1.0)
+                    + k * lp + (window - k) * (p < 1.0 ? lq : 0.0);
+        cdf += std::exp(lpmf);
+        if (cdf >= 1.0 - tail) return k + 1;
+    }
+    return window + 1;
+}
+
+// per-word popcounts, the hot loop of every APT
+inline void popcount_words(const uint32_t* w, size_t n, uint8_t* out) {
+    size_t i = 0;
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    for (; i + 4 <= n; i += 4) {
+        // Cortex-A9 has no scalar popcount: vcnt per byte, pairwise-add to words, narrow to bytes
+        uint8x16_t c8 = vcntq_u8(vreinterpretq_u8_u32(vld1q_u32(w + i)));
+        uint16x4_t c16 = vmovn_u32(vpaddlq_u16(vpaddlq_u8(c8)));
+        uint8x8_t  packed = vmovn_u16(vcombine_u16(c16, c16));
+        uint32_t four = vget_lane_u32(vreinterpret_u32_u8(packed), 0);
+        memcpy(out + i, &four, sizeof(four));
+    }
+#endif
+    for (; i < n; i++) out[i] = (uint8_t)__builtin_popcount(w[i]);
+}
+
+// Tests =======================================
+struct SwHealthTest {
+    std::string name;
+    bool     rct      = false;
+    bool     hw_equiv = false;      // compared against STATUS in crossCheck()
+    uint32_t window   = 0;          // APT bits
+    uint32_t cutoff   = 0;
+    uint64_t fails    = 0;          // windows / runs that hit the cutoff
+    uint64_t windows  = 0;          // APT windows completed
+    uint32_t worst    = 0;          // APT: largest symbol count seen in a window
+
+    // APT state
+    uint32_t ones     = 0;
+    uint32_t fill     = 0;
+};
+
+struct SwHealthStats {
+    uint64_t words        = 0;
+    uint64_t cross_checks = 0;
+    uint64_t hw_only      = 0;      // STATUS failed, software passed
+    uint64_t sw_only      = 0;      // software failed, STATUS passed
+};
+
+// Monitor =======================================
+class SwHealth {
+private:
+    std::vector<SwHealthTest> _tests;
+    uint32_t _fail_mask = 0;        // sticky, one bit per test
+    uint32_t _run = 0;              // RCT run carried into the next word
+    bool     _prev = false;
+    bool     _started = false;
+    SwHealthStats _stats;
+    std::vector<uint8_t> _counts;
+
+    void addApt(const std::string& name, uint32_t window, uint32_t cutoff, bool hw_equiv) {
+        SwHealthTest t;
+        t.name = name;
+        t.window = (window + 31) & ~31u;
+        t.cutoff = cutoff;
+        t.hw_equiv = hw_equiv;
+        _tests.push_back(t);
+    }
+
+    // RCT over one word for every cutoff; returns the mask of tests that failed
+    uint32_t rctWord(uint32_t w) {
+        uint32_t failed = 0;
+        if (!_started) { _prev = w >> 31; _started = true; }
+        uint32_t t = w ^ ((w >> 1) | ((uint32_t)_prev << 31));
+        uint32_t lead = t ? __builtin_clz(t) : 32;
+        uint32_t head_run = _run + lead;
+        uint32_t same = ~t & (t ? (0xFFFFFFFFu >> (lead + 1)) : 0);   // no-transition positions after the first transition
+
+        for (size_t i = 0; i < _tests.size(); i++) {
+            SwHealthTest& T = _tests[i];
+            if (!T.rct) continue;
+            bool fail = head_run >= T.cutoff;
+            // an interior run of length >= C is C-1 consecutive no-transition positions
+            uint32_t need = T.cutoff - 1;
+            if (!fail && t && need <= 31) {
+                uint32_t z = same;
+                for (uint32_t k = 1; k < need && z; ) {
+                    uint32_t s = (need - k) < k ? (need - k) : k;
+                    z &= z << s;
+                    k += s;
+                }
+                fail = z != 0;
+            }
+            if (fail) { T.fails++; failed |= 1u << i; }
+        }
+
+        _run = t ? __builtin_ctz(t) + 1 : head_run;
+        _prev = w & 1;
+        return failed;
+    }
+
+public:
+    explicit SwHealth(const SwHealthConfig& cfg = SwHealthConfig()) {
+        SwHealthTest rct;
+        rct.rct = true;
+        rct.cutoff = rct_cutoff(cfg.h_min, cfg.alpha_log2);
+        rct.name = "rct C=" + std::to_string(rct.cutoff);
+        _tests.push_back(rct);
+        for (uint32_t w : cfg.apt_windows) {
+            uint32_t win = (w + 31) & ~31u;
+            uint32_t c = apt_cutoff(win, cfg.h_min, cfg.alpha_log2);
+            addApt("apt W=" + std::to_string(win) + " C=" + std::to_string(c), win, c, false);
+        }
+        if (cfg.hw_tests) {
+            // trng_health.sv: count >= 32 on a repeat fails, count restarts at 0 -> run of 34
+            SwHealthTest hw_rct;
+            hw_rct.rct = true;
+            hw_rct.hw_equiv = true;
+            hw_rct.cutoff = 34;
+            hw_rct.name = "hw rct run=34";
+            _tests.push_back(hw_rct);
+            // ones outside [166, 346] of 512 <=> either symbol >= 347
+            addApt("hw apt W=512 [166,346]", 512, 347, true);
+        }
+    }
+
+    const std::vector<SwHealthTest>& tests() const { return _tests; }
+    const SwHealthStats& stats() const { return _stats; }
+    uint32_t failMask() const { return _fail_mask; }
+    bool failed() const { return _fail_mask != 0; }
+
+    /**
+    * @brief Run every test over n words (stream order)
+    * @return mask of tests that failed within these words (failMask() stays sticky)
+    */
+    uint32_t update(const uint32_t* words, size_t n) {
+        uint32_t failed = 0;
+        if (_counts.size() < n) _counts.resize(n);
+        popcount_words(words, n, _counts.data());
+
+        for (size_t j = 0; j < n; j++) failed |= rctWord(words[j]);
+
+        for (size_t i = 0; i < _tests.size(); i++) {
+            SwHealthTest& T = _tests[i];
+            if (T.rct) continue;
+            for (size_t j = 0; j < n; j++) {
+                T.ones += _counts[j];
+                T.fill += 32;
+                if (T.fill < T.window) continue;
+                uint32_t major = T.ones > T.window - T.ones ? T.ones : T.window - T.ones;
+                if (major > T.worst) T.worst = major;
+                if (major >= T.cutoff) { T.fails++; failed |= 1u << i; }
+                T.windows++;
+                T.ones = 0;
+                T.fill = 0;
+            }
+        }
+        _stats.words += n;
+        _fail_mask |= failed;
+        return failed;
+    }
+
+    uint32_t update(uint32_t word) { return update(&word, 1); }
+
+    // forget verdicts and window state (pair with PynqHSM::clearHealth)
+    void clear() {
+        _fail_mask = 0;
+        _run = 0;
+        _started = false;
+        for (SwHealthTest& t : _tests) { t.ones = 0; t.fill = 0; }
+    }
+
+    /**
+    * @brief Compare sticky verdicts with a REG_STATUS read taken at the same point
+    * @return true when the hardware-equivalent tests agree with the RCT/APT bits
+    */
+    bool crossCheck(uint32_t hw_status) {
+        bool sw_rct = false, sw_apt = false;
+        for (size_t i = 0; i < _tests.size(); i++) {
+            if (!_tests[i].hw_equiv || !(_fail_mask & (1u << i))) continue;
+            if (_tests[i].rct) sw_rct = true;
+            else sw_apt = true;
+        }
+        bool hw_rct = hw_status & Status::RCT_FAIL;
+        bool hw_apt = hw_status & Status::APT_FAIL;
+        _stats.cross_checks++;
+        if ((hw_rct && !sw_rct) || (hw_apt && !sw_apt)) _stats.hw_only++;
+        if ((sw_rct && !hw_rct) || (sw_apt && !hw_apt)) _stats.sw_only++;
+        return hw_rct == sw_rct && hw_apt == sw_apt;
+    }
+
+    // names of the failed tests in mask, for log lines
+    std::string describe(uint32_t mask) const {
+        std::string s;
+        for (size_t i = 0; i < _tests.size(); i++) {
+            if (!(mask & (1u << i))) continue;
+            if (!s.empty()) s += ", ";
+            s += _tests[i].name;
+        }
+        return s.empty() ? "none" : s;
+    }
+
+    void print(FILE* out = stdout) const {
+        fprintf(out, "    SW health   : %llu words (%.1f MB), %llu cross-checks, %llu hw-only / %llu sw-only disagreements\n",
+                (unsigned long long)_stats.words, _stats.words * 4 / 1e6,
+                (unsigned long long)_stats.cross_checks, (unsigned long long)_stats.hw_only,
+                (unsigned long long)_stats.sw_only);
+        for (const SwHealthTest& t : _tests) {
+            if (t.rct) fprintf(out, "      %-24s fails=%llu\n", t.name.c_str(), (unsigned long long)t.fails);
+            else       fprintf(out, "      %-24s fails=%-6llu windows=%llu max count=%u\n", t.name.c_str(),
+                               (unsigned long long)t.fails, (unsigned long long)t.windows, t.worst);
+        }
+    }
+};
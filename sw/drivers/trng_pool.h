@@ -0,0 +1,319 @@
+/**
+* @file     trng_pool.h
+* @brief    Entropy pool: background TRNG harvester + lock-free multi-consumer ring
+* @details  One harvester thread owns the PynqHSM and runs the sample handshake
+*           back to back; any number of consumer threads pull byte requests
+*           without locks.
+*
+* Harvester:
+* 1. sleeps while fill >= low watermark, wakes (eventfd) when a consumer drops below it
+* 2. harvests batch_words words, then reads STATUS once; RCT/APT bits are sticky so
+*    a clean STATUS after the batch vouches for every word in it. Every word also goes
+*    through the software tests (trng_health_sw.h), cross-checked against that STATUS
+* 3. clean batch -> words go in tagged with STATUS; failed batch (either verdict) -> words
+*    are dropped and one marker record carrying the STATUS bits goes in their place, in
+*    stream order (SW_HEALTH_FAIL set when the software tests failed it)
+* 4. stops at the high watermark
+*
+* Consumers: claim a run of records with one CAS on the head, copy, release the slots.
+* A request that meets a HEALTH_FAIL record fails as a whole and gets no bytes.
+*/
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <memory>
+#include <thread>
+#include <poll.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include "hsm_driver.h"
+#include "trng_health_sw.h"
+
+// Config =======================================
+struct EntropyPoolConfig {
+    uint32_t capacity_words = 16384;    // ring size, power of 2
+    uint32_t low_watermark  = 4096;     // harvester wakes below this fill
+    uint32_t high_watermark = 12288;    // harvester sleeps at this fill
+    uint32_t batch_words    = 64;       // words per STATUS check
+    bool     clear_on_fail  = true;     // CLEAR latched fails and keep harvesting
+    bool     sw_health      = true;     // software continuous tests on every word
+    SwHealthConfig sw_health_cfg;
+};
+
+enum class PoolStatus : uint8_t { OK, HEALTH_FAIL, TIMEOUT, STOPPED };
+
+inline const char* pool_status_str(PoolStatus s) {
+    switch (s) {
+        case PoolStatus::OK:          return "OK";
+        case PoolStatus::HEALTH_FAIL: return "HEALTH_FAIL";
+        case PoolStatus::TIMEOUT:     return "TIMEOUT";
+        default:                      return "STOPPED";
+    }
+}
+
+struct EntropyPoolStats {
+    uint64_t words_harvested = 0;
+    uint64_t batches_failed  = 0;   // batches dropped on a HEALTH_FAIL status
+    uint64_t sw_batches_failed = 0; // of those, failed by the software tests
+    uint64_t health_disagreements = 0;  // software vs STATUS verdicts differed
+    uint64_t sample_timeouts = 0;
+    uint64_t wakeups         = 0;   // harvester woken by a consumer
+    uint64_t requests_ok     = 0;
+    uint64_t requests_failed = 0;   // hit a HEALTH_FAIL record
+    uint64_t requests_timeout = 0;
+    uint64_t bytes_served    = 0;
+
+    void print() const {
+        printf("    Harvested   : %llu words, %llu failed batches, %llu sample timeouts, %llu wakeups\n",
+               (unsigned long long)words_harvested, (unsigned long long)batches_failed,
+               (unsigned long long)sample_timeouts, (unsigned long long)wakeups);
+        printf("    Health      : %llu batches failed by software tests, %llu software/STATUS disagreements\n",
+               (unsigned long long)sw_batches_failed, (unsigned long long)health_disagreements);
+        printf("    Requests    : %llu ok, %llu health fail, %llu timeout, %llu bytes served\n",
+               (unsigned long long)requests_ok, (unsigned long long)requests_failed,
+               (unsigned long long)requests_timeout, (unsigned long long)bytes_served);
+    }
+};
+
+// Pool =======================================
+class EntropyPool {
+private:
+    // one ring record; seq is the Vyukov sequence number for the slot
+    struct Slot {
+        std::atomic<uint64_t> seq;
+        uint32_t word;
+        uint32_t status;    // REG_STATUS health bits at harvest time
+    };
+
+    static constexpr uint32_t HEALTH_BITS = Status::HEALTH_FAIL | Status::RCT_FAIL | Status::APT_FAIL;
+
+    PynqHSM&                _hsm;
+    EntropyPoolConfig       _cfg;
+    std::unique_ptr<Slot[]> _ring;
+    uint64_t                _mask;
+    SwHealth                _sw;        // harvester thread only
+
+    alignas(64) std::atomic<uint64_t> _head{0};    // consumers
+    alignas(64) std::atomic<uint64_t> _tail{0};    // harvester
+    alignas(64) std::atomic<bool>     _sleeping{false};
+    std::atomic<bool> _running{false};
+    int               _wake_fd = -1;
+    std::thread       _thread;
+
+    // stats - harvester side written by one thread, consumer side shared
+    std::atomic<uint64_t> _words{0}, _batches_failed{0}, _sample_timeouts{0}, _wakeups{0};
+    std::atomic<uint64_t> _sw_failed{0}, _disagree{0};
+    std::atomic<uint64_t> _req_ok{0}, _req_failed{0}, _req_timeout{0}, _bytes{0};
+
+    // harvester ------------------------------------
+    bool push(uint32_t word, uint32_t status) {
+        uint64_t pos = _tail.load(std::memory_order_relaxed);
+        Slot& s = _ring[pos & _mask];
+        if (s.seq.load(std::memory_order_acquire) != pos) return false;   // not yet released
+        s.word = word;
+        s.status = status;
+        s.seq.store(pos + 1, std::memory_order_release);
+        _tail.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    void harvestBatch(uint32_t* batch) {
+        uint32_t n = 0;
+        for (; n < _cfg.batch_words && _running.load(std::memory_order_relaxed); n++) {
+            if (!_hsm.sampleWord(batch[n])) { _sample_timeouts.fetch_add(1, std::memory_order_relaxed); break; }
+        }
+        uint32_t status = _hsm.readReg(REG_STATUS) & HEALTH_BITS;
+        if (_cfg.sw_health) {
+            if (n && _sw.update(batch, n)) {
+                status |= Status::HEALTH_FAIL | SW_HEALTH_FAIL;
+                _sw_failed.fetch_add(1, std::memory_order_relaxed);
+            }
+            if (!_sw.crossCheck(status)) _disagree.fetch_add(1, std::memory_order_relaxed);
+        }
+
+        if (status & Status::HEALTH_FAIL) {
+            _batches_failed.fetch_add(1, std::memory_order_relaxed);
+            hsm_tel_count(HsmCounter::HEALTH_FAILS);
+            while (!push(0, status) && _running.load(std::memory_order_relaxed)) sched_yield();
+            if (_cfg.clear_on_fail) {
+                _hsm.clearHealth();
+                _sw.clear();
+            }
+            return;
+        }
+        for (uint32_t i = 0; i < n; i++) {
+            while (!push(batch[i], status)) {
+                if (!_running.load(std::memory_order_relaxed)) return;
+                sched_yield();
+            }
+        }
+        _words.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    void harvestLoop() {
+        std::unique_ptr<uint32_t[]> batch(new uint32_t[_cfg.batch_words]);
+        _hsm.writeReg(REG_CTRL, Ctrl::ENABLE);
+
+        while (_running.load(std::memory_order_relaxed)) {
+            if (fill() < _cfg.high_watermark) {
+                harvestBatch(batch.get());
+                continue;
+            }
+            // full: sleep until a consumer takes us below the low watermark
+            _sleeping.store(true, std::memory_order_seq_cst);
+            while (_running.load(std::memory_order_relaxed) && fill() >= _cfg.low_watermark) {
+                struct pollfd pfd = { _wake_fd, POLLIN, 0 };
+                if (poll(&pfd, 1, 100) > 0) {
+                    uint64_t v;
+                    if (::read(_wake_fd, &v, sizeof(v)) == sizeof(v)) _wakeups.fetch_add(1, std::memory_order_relaxed);
+                }
+            }
+            _sleeping.store(false, std::memory_order_seq_cst);
+        }
+        volatile uint32_t* wipe = batch.get();
+        for (uint32_t i = 0; i < _cfg.batch_words; i++) wipe[i] = 0;
+    }
+
+    void wakeHarvester() {
+        if (_sleeping.load(std::memory_order_seq_cst) && fill() < _cfg.low_watermark) {
+            uint64_t one = 1;
+            if (::write(_wake_fd, &one, sizeof(one)) < 0) perror("EntropyPool wake");
+        }
+    }
+
+    // consumer ------------------------------------
+    // claim up to max_words published records; returns count, first position in pos
+    uint32_t claim(uint32_t max_words, uint64_t& pos) {
+        while (true) {
+            pos = _head.load(std::memory_order_acquire);     // head first, as in fill()
+            uint64_t tail = _tail.load(std::memory_order_acquire);
+            if (tail <= pos || tail - pos > _cfg.capacity_words) return 0;
+            uint64_t avail = tail - pos;
+            uint32_t n = avail < max_words ? (uint32_t)avail : max_words;
+            if (_head.compare_exchange_weak(pos, pos + n, std::memory_order_acq_rel, std::memory_order_acquire)) return n;
+        }
+    }
+
+public:
+    EntropyPool(PynqHSM& hsm, const EntropyPoolConfig& cfg = EntropyPoolConfig{})
+        : _hsm(hsm), _cfg(cfg), _sw(cfg.sw_health_cfg) {
+        uint32_t cap = 1;
+        while (cap < _cfg.capacity_words) cap <<= 1;
+        _cfg.capacity_words = cap;
+        if (_cfg.high_watermark > cap) _cfg.high_watermark = cap;
+        if (_cfg.low_watermark > _cfg.high_watermark) _cfg.low_watermark = _cfg.high_watermark;
+        if (_cfg.batch_words == 0) _cfg.batch_words = 1;
+        _mask = cap - 1;
+        _ring.reset(new Slot[cap]);
+        for (uint32_t i = 0; i < cap; i++) _ring[i].seq.store(i, std::memory_order_relaxed);
+        _wake_fd = eventfd(0, EFD_NONBLOCK);
+    }
+
+    ~EntropyPool() {
+        stop();
+        if (_wake_fd >= 0) ::close(_wake_fd);
+        for (uint64_t i = 0; i <= _mask; i++) _ring[i].word = 0;
+    }
+
+    bool start() {
+        if (_wake_fd < 0) { perror("eventfd"); return false; }
+        if (_running.exchange(true)) return true;
+        _thread = std::thread(&EntropyPool::harvestLoop, this);
+        return true;
+    }
+
+    void stop() {
+        if (!_running.exchange(false)) return;
+        uint64_t one = 1;
+        if (::write(_wake_fd, &one, sizeof(one)) < 0) perror("EntropyPool wake");
+        _thread.join();
+    }
+
+    bool running() const { return _running.load(std::memory_order_relaxed); }
+
+    uint32_t fill() const {
+        uint64_t head = _head.load(std::memory_order_acquire);    // head first: never passes a later tail
+        return (uint32_t)(_tail.load(std::memory_order_acquire) - head);
+    }
+
+    const EntropyPoolConfig& config() const { return _cfg; }
+
+    // per-test detail; harvester-owned, read it after stop()
+    const SwHealth& swHealth() const { return _sw; }
+
+    /**
+    * @brief Fill buf with len random bytes, all or nothing
+    * @details Never blocks on a lock; spins, then yields, then sleeps for data until
+    *          timeout_us. On anything but OK the buffer is zeroed.
+    */
+    PoolStatus read(void* buf, size_t len, uint32_t timeout_us = 100000) {
+        uint8_t* out = static_cast<uint8_t*>(buf);
+        size_t got = 0;
+        PoolStatus result = PoolStatus::OK;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::microseconds(timeout_us);
+        uint32_t idle = 0;
+
+        while (got < len) {
+            uint64_t pos;
+            uint32_t want = (uint32_t)((len - got + 3) / 4);
+            uint32_t n = claim(want, pos);
+            if (n == 0) {
+                wakeHarvester();
+                if (!running()) { result = PoolStatus::STOPPED; break; }
+                if (std::chrono::steady_clock::now() >= deadline) { result = PoolStatus::TIMEOUT; break; }
+                if (++idle < 64) continue;
+                if (idle < 128) { sched_yield(); continue; }
+                struct timespec ts = { 0, 20000 };
+                nanosleep(&ts, nullptr);
+                continue;
+            }
+            idle = 0;
+            for (uint32_t i = 0; i < n; i++) {
+                Slot& s = _ring[(pos + i) & _mask];
+                uint32_t word = s.word;
+                uint32_t status = s.status;
+                s.word = 0;
+                s.seq.store(pos + i + _cfg.capacity_words, std::memory_order_release);
+                if (status & Status::HEALTH_FAIL) { result = PoolStatus::HEALTH_FAIL; continue; }
+                if (result != PoolStatus::OK) continue;
+                size_t take = (len - got) < 4 ? (len - got) : 4;
+                memcpy(out + got, &word, take);
+                got += take;
+            }
+            wakeHarvester();
+            if (result != PoolStatus::OK) break;
+        }
+
+        switch (result) {
+            case PoolStatus::OK:          _req_ok.fetch_add(1, std::memory_order_relaxed);
+                                          _bytes.fetch_add(len, std::memory_order_relaxed); break;
+            case PoolStatus::HEALTH_FAIL: _req_failed.fetch_add(1, std::memory_order_relaxed); break;
+            default:                      _req_timeout.fetch_add(1, std::memory_order_relaxed); break;
+        }
+        if (result != PoolStatus::OK) memset(buf, 0, len);
+        return result;
+    }
+
+    EntropyPoolStats stats() const {
+        EntropyPoolStats s;
+        s.words_harvested  = _words.load(std::memory_order_relaxed);
+        s.batches_failed   = _batches_failed.load(std::memory_order_relaxed);
+        s.sample_timeouts  = _sample_timeouts.load(std::memory_order_relaxed);
+        s.wakeups          = _wakeups.load(std::memory_order_relaxed);
+        s.sw_batches_failed = _sw_failed.load(std::memory_order_relaxed);
+        s.health_disagreements = _disagree.load(std::memory_order_relaxed);
+        s.requests_ok      = _req_ok.load(std::memory_order_relaxed);
+        s.requests_failed  = _req_failed.load(std::memory_order_relaxed);
+        s.requests_timeout = _req_timeout.load(std::memory_order_relaxed);
+        s.bytes_served     = _bytes.load(std::memory_order_relaxed);
+        return s;
+    }
+};
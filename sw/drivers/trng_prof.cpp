@@ -0,0 +1,197 @@
+/**
+* @file     trng_prof.cpp
+* @brief    trng-prof: TRNG handshake latency / throughput profile in fabric cycles (trng_profile.h)
+* @details  Live: samples words back to back, each handshake stamped with COUNTER, and prints
+*           the trigger -> ready distribution, host gap, sustained and ceiling bits/s and the
+*           VN acceptance they imply. -o keeps every sample as a compact binary trace.
+*
+* --read summarises traces instead of a device, one block each plus a table keyed by
+* trace label, so runs of different bitstreams line up as rows. --baseline compares this
+* run (or each --read trace) against an earlier trace and exits non-zero if the sampler
+* got slower by more than --tolerance percent, or timed out more often.
+*
+* Usage: trng_prof [--hw | --sim [instant|core|pynq]] [-n WORDS | -t SEC] [-o TRACE]
+*                  [--label NAME] [--clk-mhz F] [--hist] [--baseline TRACE [--tolerance PCT]]
+*        trng_prof --read TRACE... [--hist] [--baseline TRACE [--tolerance PCT]]
+*/
+
+#include <chrono>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "hsm_driver.h"
+#include "sim_device.h"
+#include "trng_profile.h"
+
+constexpr uint64_t PROF_WORDS     = 100000;
+constexpr double   PROF_TOLERANCE = 10.0;   // percent
+constexpr int      HIST_BAR       = 50;
+constexpr const char* RTL_LABEL   = "ro13/17/19/23 dec3-4";  // trng_sampler.sv as shipped
+
+static volatile sig_atomic_t g_stop = 0;
+static void on_stop(int) { g_stop = 1; }
+
+// Reporting =======================================
+static void print_hist(const TrngCycleHist& h, FILE* out = stdout) {
+    uint64_t peak = 0;
+    for (uint64_t b : h.buckets) peak = std::max(peak, b);
+    if (!peak) return;
+    fprintf(out, "    Latency histogram (cycles <=, count):\n");
+    for (int i = 0; i < TRNG_PROF_BUCKETS; i++) {
+        if (!h.buckets[i]) continue;
+        int bar = (int)(h.buckets[i] * HIST_BAR / peak);
+        fprintf(out, "      %8llu %10llu %5.1f%% %.*s\n", (unsigned long long)HsmHist::upper(i),
+                (unsigned long long)h.buckets[i], 100.0 * h.buckets[i] / h.count, bar ? bar : 1,
+                "##################################################");
+    }
+}
+
+static bool load_trace(const char* path, TrngProfile& prof, std::string& label) {
+    TrngTraceReader rd;
+    if (!rd.open(path)) return false;
+    prof = TrngProfile(rd.clkHz());
+    label = rd.label();
+    TrngSample s;
+    while (rd.next(s)) prof.add(s);
+    return true;
+}
+
+static int usage(const char* argv0) {
+    fprintf(stderr, "Usage: %s [--hw | --sim [instant|core|pynq]] [-n WORDS | -t SEC] [-o TRACE]\n"
+                    "       %*s [--label NAME] [--clk-mhz F] [--hist] [--baseline TRACE [--tolerance PCT]]\n"
+                    "       %s --read TRACE... [--hist] [--baseline TRACE [--tolerance PCT]]\n",
+            argv0, (int)strlen(argv0), "", argv0);
+    return EXIT_FAILURE;
+}
+
+int main(int argc, char* argv[]) {
+    bool sim = false, hist = false;
+    SimTiming sim_timing;
+    std::string timing_name = "core";
+    uint64_t words = PROF_WORDS;
+    double seconds = 0, clk_mhz = TRNG_CLK_HZ / 1e6, tolerance = PROF_TOLERANCE;
+    const char* trace_path = nullptr;
+    const char* baseline_path = nullptr;
+    std::string label;
+    std::vector<const char*> reads;
+    for (int a = 1; a < argc; a++) {
+        std::string arg = argv[a];
+        if (arg == "--hw")                                  sim = false;
+        else if (arg == "-n" && a + 1 < argc)               words = strtoull(argv[++a], nullptr, 0);
+        else if (arg == "-t" && a + 1 < argc)               seconds = atof(argv[++a]);
+        else if (arg == "-o" && a + 1 < argc)               trace_path = argv[++a];
+        else if (arg == "--label" && a + 1 < argc)          label = argv[++a];
+        else if (arg == "--clk-mhz" && a + 1 < argc)        clk_mhz = atof(argv[++a]);
+        else if (arg == "--baseline" && a + 1 < argc)       baseline_path = argv[++a];
+        else if (arg == "--tolerance" && a + 1 < argc)      tolerance = atof(argv[++a]);
+        else if (arg == "--hist")                           hist = true;
+        else if (arg == "--read") {
+            while (a + 1 < argc && argv[a + 1][0] != '-') reads.push_back(argv[++a]);
+            if (reads.empty()) return usage(argv[0]);
+        } else if (arg == "--sim") {
+            sim = true;
+            if (a + 1 < argc && argv[a + 1][0] != '-') {
+                timing_name = argv[++a];
+                if (!SimTiming::parse(timing_name, sim_timing)) {
+                    printf("Unknown sim timing '%s' (instant|core|pynq)\n", argv[a]);
+                    return EXIT_FAILURE;
+                }
+            }
+        } else {
+            return usage(argv[0]);
+        }
+    }
+    if (clk_mhz <= 0 || (!reads.empty() && (sim || trace_path))) return usage(argv[0]);
+
+    TrngProfile base;
+    std::string base_label;
+    if (baseline_path && !load_trace(baseline_path, base, base_label)) return EXIT_FAILURE;
+    bool ok = true;
+    auto against_baseline = [&](const TrngProfile& p) {
+        if (!baseline_path) return;
+        printf("    Baseline    : %s (%s), tolerance %.1f%%\n", baseline_path, base_label.c_str(), tolerance);
+        bool same = p.compare(base, tolerance / 100.0);
+        printf("    %s\n", same ? "[PASS] no regression" : "[FAIL] sampler slower than baseline");
+        ok = ok && same;
+    };
+
+    // Traces -------------------------------------
+    if (!reads.empty()) {
+        std::vector<std::pair<std::string, TrngProfile>> rows;
+        for (const char* path : reads) {
+            TrngProfile p;
+            std::string lbl;
+            if (!load_trace(path, p, lbl)) return EXIT_FAILURE;
+            printf("\n%s\n", path);
+            p.print(lbl.c_str());
+            if (hist) print_hist(p.latency);
+            against_baseline(p);
+            rows.emplace_back(lbl, p);
+        }
+        printf("\n");
+        TrngProfile::printHeader();
+        for (const auto& r : rows) r.second.printRow(r.first.c_str());
+        return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    // Live -------------------------------------
+    double clk_hz = sim ? sim_timing.clk_hz : clk_mhz * 1e6;
+    if (label.empty()) label = sim ? "sim-" + timing_name : RTL_LABEL;
+
+    SimHsmDevice sim_hsm(sim_timing);
+    std::unique_ptr<PynqHSM> dev(sim ? new PynqHSM(&sim_hsm) : new PynqHSM(HSM_BASE_ADDR, HSM_SIZE));
+    PynqHSM& hsm = *dev;
+    if (!hsm.isOpen()) {
+        printf("[FATAL] Cannot map HSM peripheral (run as root, or use --sim)\n");
+        return EXIT_FAILURE;
+    }
+    hsm.clearHealth();
+
+    TrngTraceWriter trace;
+    if (trace_path && !trace.open(trace_path, label.c_str(), clk_hz)) return EXIT_FAILURE;
+
+    signal(SIGINT, on_stop);
+    signal(SIGTERM, on_stop);
+    printf("TRNG profile: %s, backend %s, ", label.c_str(), hsm.backend());
+    if (seconds > 0) printf("%.1fs", seconds);
+    else printf("%llu words", (unsigned long long)words);
+    printf("%s%s\n", trace_path ? ", trace " : "", trace_path ? trace_path : "");
+
+    TrngProfiler prof(hsm, clk_hz);
+    TrngProfile profile(clk_hz);
+    auto t_end = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+    for (uint64_t n = 0; !g_stop; n++) {
+        if (seconds > 0 ? (n % 1024 == 0 && std::chrono::steady_clock::now() >= t_end) : n >= words) break;
+        TrngSample s;
+        uint32_t word;
+        prof.sample(s, word);
+        profile.add(s);
+        if (trace_path && !trace.add(s)) {
+            printf("[ERROR] Trace write failed\n");
+            ok = false;
+            break;
+        }
+    }
+    if (trace_path) {
+        ok = trace.finish() && ok;
+        const CaptureStats& ws = trace.stats();
+        printf("  Trace: %llu samples, %llu bytes (%.2f bytes/sample)\n", (unsigned long long)trace.records(),
+               (unsigned long long)ws.bytes_written,
+               trace.records() ? (double)ws.bytes_written / trace.records() : 0.0);
+    }
+
+    printf("\n");
+    profile.print(label.c_str());
+    if (hist) print_hist(profile.latency);
+    bool healthy = hsm.checkHealth();
+    printf("    Health      : %s\n", healthy ? "[OK]" : "[FAIL] RCT/APT latched during the run");
+    if (profile.timeouts()) printf("    [FAIL] %llu handshakes timed out\n", (unsigned long long)profile.timeouts());
+    against_baseline(profile);
+    ok = ok && healthy && !profile.timeouts() && profile.words();
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,373 @@
+/**
+* @file     trng_profile.h
+* @brief    TRNG handshake profiler: every sample timestamped with the fabric's free-running COUNTER
+* @details  COUNTER (0x14) counts S_AXI_ACLK, so trigger -> ready is measured in fabric cycles
+*           rather than in host time, and the same numbers come out whether the ARM side was
+*           busy, descheduled or running a different kernel.
+*
+* 1. TrngProfiler::sample() runs one PynqHSM split-phase handshake: startSample(), a
+*    COUNTER read (the trigger stamp), SAMP_CNT polled without backoff, a COUNTER read
+*    as soon as the count moves (the ready stamp), takeSample()
+* 2. TrngProfile folds samples into log-linear cycle histograms (HsmHist buckets) plus
+*    the figures used to size entropy buffers: bits/s the sampler can deliver back to
+*    back, bits/s this host actually sustained, and the VN pair acceptance they imply
+* 3. TrngTraceWriter / TrngTraceReader store every sample as three LEB128 varints
+*    (trigger delta, latency, polls << 1 | timeout), ~5 bytes a word, through
+*    CaptureWriter so long runs never stall on the disk
+*
+* Resolution: a stamp is taken one AXI read after the event, and ready is only seen at
+* the next SAMP_CNT poll, so every latency carries one poll interval of slack (mean poll
+* interval is printed next to it). The 32-bit COUNTER is unwrapped between stamps; runs
+* only have to sample more often than once per 2^32 cycles (43s at 100 MHz).
+*
+* The oscillator set (13/17/19/23 stages) and the decimator are fixed in trng_sampler.sv,
+* not selectable from software, so a "configuration" is a bitstream: each trace carries
+* a label naming it, and comparing traces across builds is how configurations are ranked.
+*/
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "hsm_capture.h"
+#include "hsm_driver.h"
+#include "hsm_telemetry.h"
+
+constexpr double   TRNG_CLK_HZ = 100e6;     // S_AXI_ACLK, shared with the AES core
+
+// RTL model =======================================
+// what trng_sampler.sv should deliver from an unbiased source
+namespace TrngModel {
+    constexpr uint32_t WORD_BITS    = 32;
+    // dec_threshold = {3'd6, raw_bit} + 4'd6 truncates to 2 or 3: a pulse every 3 or 4 cycles
+    constexpr double   PULSE_CYCLES = 3.5;
+    // a VN pair is two pulses and is kept only as 01 / 10
+    constexpr double   PAIR_CYCLES  = 2 * PULSE_CYCLES;
+    constexpr double   VN_ACCEPT    = 0.5;
+
+    constexpr double wordCycles() { return WORD_BITS * PAIR_CYCLES / VN_ACCEPT; }   // 448
+}
+
+// Samples =======================================
+struct TrngSample {
+    uint64_t trigger = 0;       // COUNTER right after the SAMPLE edge (unwrapped)
+    uint32_t latency = 0;       // trigger -> COUNTER at the poll that saw SAMP_CNT move
+    uint32_t polls   = 0;       // SAMP_CNT reads it took
+    bool     timeout = false;   // gave up; latency is how long it waited
+};
+
+// Statistics =======================================
+constexpr int TRNG_PROF_BUCKETS = 30 * HsmHist::SUB;    // every uint32_t cycle count
+
+using TrngCycleHist = HsmHistogram<TRNG_PROF_BUCKETS>;
+
+class TrngProfile {
+private:
+    double   _clk_hz;
+    uint64_t _first = 0;        // first trigger
+    uint64_t _end = 0;          // last ready (or give-up)
+    uint64_t _prev_end = 0;
+    uint64_t _words = 0;
+    uint64_t _timeouts = 0;
+    uint64_t _polls = 0;        // SAMP_CNT reads behind the words in latency (not timeouts)
+
+public:
+    TrngCycleHist latency;      // trigger -> ready
+    TrngCycleHist gap;          // ready -> next trigger: host cost of taking a word and asking again
+
+    explicit TrngProfile(double clk_hz = TRNG_CLK_HZ) : _clk_hz(clk_hz) {}
+
+    void add(const TrngSample& s) {
+        if (_words + _timeouts == 0) _first = s.trigger;
+        else if (s.trigger >= _prev_end) gap.record(s.trigger - _prev_end);
+        _prev_end = _end = s.trigger + s.latency;
+        if (s.timeout) { _timeouts++; return; }
+        _words++;
+        _polls += s.polls;
+        latency.record(s.latency);
+    }
+
+    double   clkHz() const { return _clk_hz; }
+    uint64_t words() const { return _words; }
+    uint64_t timeouts() const { return _timeouts; }
+    uint64_t cycles() const { return _end - _first; }
+    double   seconds() const { return cycles() / _clk_hz; }
+
+    // what this host got: every word between the first trigger and the last ready
+    double sustainedBps() const {
+        return cycles() ? TrngModel::WORD_BITS * _words * _clk_hz / cycles() : 0;
+    }
+    // what the sampler gives a reader with no overhead: one word per mean latency
+    double ceilingBps() const {
+        return latency.mean() > 0 ? TrngModel::WORD_BITS * _clk_hz / latency.mean() : 0;
+    }
+    // VN pairs kept, if every latency cycle went to pulses (an upper bound on the loss)
+    double vnAccept() const {
+        return latency.mean() > 0 ? TrngModel::WORD_BITS * TrngModel::PAIR_CYCLES / latency.mean() : 0;
+    }
+    // same samples on both sides: latency holds no timed-out waits, so neither may the polls
+    double pollCycles() const {
+        return _polls ? (double)latency.sum / _polls : 0;
+    }
+
+    void print(const char* label, FILE* out = stdout) const {
+        double us = 1e6 / _clk_hz;
+        fprintf(out, "  %s: %llu words in %.3fs (%llu cycles @ %.0f MHz), %llu timeouts\n",
+                label, (unsigned long long)_words, seconds(), (unsigned long long)cycles(),
+                _clk_hz / 1e6, (unsigned long long)_timeouts);
+        fprintf(out, "    Latency     : mean %.1f  p50 %llu  p90 %llu  p99 %llu  p99.9 %llu  max %llu cycles\n",
+                latency.mean(), (unsigned long long)latency.percentile(0.50),
+                (unsigned long long)latency.percentile(0.90), (unsigned long long)latency.percentile(0.99),
+                (unsigned long long)latency.percentile(0.999), (unsigned long long)latency.max);
+        fprintf(out, "                  mean %.2f us, RTL model %.0f cycles (%.2f us)\n",
+                latency.mean() * us, TrngModel::wordCycles(), TrngModel::wordCycles() * us);
+        fprintf(out, "    Host gap    : mean %.1f  p50 %llu  p99 %llu cycles (take word + re-trigger)\n",
+                gap.mean(), (unsigned long long)gap.percentile(0.50), (unsigned long long)gap.percentile(0.99));
+        fprintf(out, "    Polling     : %.2f SAMP_CNT reads/word, %.1f cycles/read (latency resolution)\n",
+                _words ? (double)_polls / _words : 0, pollCycles());
+        fprintf(out, "    Throughput  : %.3f Mbit/s sustained, %.3f Mbit/s sampler ceiling\n",
+                sustainedBps() / 1e6, ceilingBps() / 1e6);
+        if (vnAccept() <= 1.0)
+            fprintf(out, "    VN accept   : <= %.3f of pairs (unbiased source: %.3f)\n",
+                    vnAccept(), TrngModel::VN_ACCEPT);
+        else    // faster than one pulse pair per bit: not a sampler-bound word (instant sim)
+            fprintf(out, "    VN accept   : n/a, latency below the %.0f-cycle floor of 32 VN pairs\n",
+                    TrngModel::WORD_BITS * TrngModel::PAIR_CYCLES);
+    }
+
+    // one row of the per-configuration table
+    void printRow(const char* label, FILE* out = stdout) const {
+        fprintf(out, "  %-24s %10llu %8.1f %6llu %6llu %9.3f %9.3f %6llu\n", label,
+                (unsigned long long)_words, latency.mean(), (unsigned long long)latency.percentile(0.50),
+                (unsigned long long)latency.percentile(0.99), ceilingBps() / 1e6, sustainedBps() / 1e6,
+                (unsigned long long)_timeouts);
+    }
+
+    static void printHeader(FILE* out = stdout) {
+        fprintf(out, "  %-24s %10s %8s %6s %6s %9s %9s %6s\n", "config", "words", "mean",
+                "p50", "p99", "ceil Mb/s", "sust Mb/s", "t/o");
+    }
+
+    /**
+    * @brief Compare against an earlier run (same label, older bitstream / driver)
+    * @param tol  allowed fractional loss, e.g. 0.10
+    * @return false if the sampler got slower (mean / p99 latency up, or ceiling down, by
+    *         more than tol) or timed out; sustained bits/s depends on the host and only warns
+    */
+    bool compare(const TrngProfile& base, double tol, FILE* out = stdout) const {
+        bool ok = true;
+        auto check = [&](const char* what, double now, double was, bool higher_is_worse, bool fatal) {
+            double change = was > 0 ? (now - was) / was : 0;
+            bool worse = higher_is_worse ? change > tol : change < -tol;
+            fprintf(out, "    %-12s: %10.3f vs %10.3f  (%+6.1f%%)%s\n", what, now, was, change * 100,
+                    worse ? (fatal ? "  [REGRESSION]" : "  [WARN]") : "");
+            if (worse && fatal) ok = false;
+        };
+        check("mean cycles", latency.mean(), base.latency.mean(), true, true);
+        check("p99 cycles", (double)latency.percentile(0.99), (double)base.latency.percentile(0.99), true, true);
+        check("ceil Mbit/s", ceilingBps() / 1e6, base.ceilingBps() / 1e6, false, true);
+        check("sust Mbit/s", sustainedBps() / 1e6, base.sustainedBps() / 1e6, false, false);
+        if (_timeouts > base._timeouts) {
+            fprintf(out, "    timeouts    : %llu vs %llu  [REGRESSION]\n",
+                    (unsigned long long)_timeouts, (unsigned long long)base._timeouts);
+            ok = false;
+        }
+        return ok;
+    }
+};
+
+// Profiler =======================================
+class TrngProfiler {
+private:
+    PynqHSM& _hsm;
+    uint64_t _timeout_cycles;
+    uint64_t _high = 0;         // COUNTER wraps, folded in here
+    uint32_t _last = 0;
+
+    uint64_t stamp() {
+        uint32_t c = _hsm.readReg(REG_COUNTER);
+        if (c < _last) _high += 1ull << 32;
+        _last = c;
+        return _high | c;
+    }
+
+public:
+    // timeout matches PynqHSM's sample wait (100ms)
+    explicit TrngProfiler(PynqHSM& hsm, double clk_hz = TRNG_CLK_HZ, double timeout_s = 0.1)
+        : _hsm(hsm), _timeout_cycles((uint64_t)(clk_hz * timeout_s)) {
+        _last = _hsm.readReg(REG_COUNTER);
+    }
+
+    // one timestamped handshake; false on timeout (s.timeout set, `word` untouched)
+    bool sample(TrngSample& s, uint32_t& word) {
+        uint32_t base = _hsm.startSample();
+        s.trigger = stamp();
+        s.polls = 0;
+        s.timeout = false;
+        uint64_t ready;
+        for (;;) {
+            s.polls++;
+            if (_hsm.sampleReady(base)) { ready = stamp(); break; }
+            if ((s.polls & 63) == 0 && (ready = stamp()) - s.trigger > _timeout_cycles) {
+                s.timeout = true;
+                break;
+            }
+        }
+        uint64_t lat = ready - s.trigger;
+        s.latency = lat > UINT32_MAX ? UINT32_MAX : (uint32_t)lat;
+        if (s.timeout) {
+            _hsm.sampleFailed();
+            return false;
+        }
+        word = _hsm.takeSample();
+        return true;
+    }
+};
+
+// Trace format =======================================
+// header, then per sample: varint(trigger - previous trigger), varint(latency),
+// varint(polls << 1 | timeout); the first delta is the absolute trigger
+constexpr char     TRNG_TRACE_MAGIC[8] = { 'T', 'R', 'N', 'G', 'P', 'R', 'O', 'F' };
+constexpr uint32_t TRNG_TRACE_VERSION  = 1;
+constexpr size_t   TRNG_TRACE_LABEL    = 48;
+
+struct TrngTraceHeader {
+    char     magic[8];
+    uint32_t version;
+    uint32_t clk_hz;
+    char     label[TRNG_TRACE_LABEL];   // bitstream / oscillator configuration, NUL padded
+};
+static_assert(sizeof(TrngTraceHeader) == 64, "trace header layout");
+
+class TrngTraceWriter {
+private:
+    CaptureWriter _out;
+    uint64_t _prev = 0;
+    uint64_t _records = 0;
+
+    static size_t varint(uint8_t* p, uint64_t v) {
+        size_t n = 0;
+        do {
+            p[n++] = (uint8_t)((v & 0x7F) | (v >= 0x80 ? 0x80 : 0));
+            v >>= 7;
+        } while (v);
+        return n;
+    }
+
+    bool put(const uint8_t* src, size_t len) {
+        while (len) {
+            size_t room;
+            uint8_t* dst = _out.space(room);
+            size_t n = std::min(room, len);
+            memcpy(dst, src, n);
+            if (!_out.commit(n)) return false;
+            src += n;
+            len -= n;
+        }
+        return true;
+    }
+
+public:
+    bool open(const char* path, const char* label, double clk_hz) {
+        CaptureConfig cfg;
+        cfg.buffer_bytes = 256 << 10;
+        if (!_out.open(path, cfg)) return false;
+        TrngTraceHeader h = {};
+        memcpy(h.magic, TRNG_TRACE_MAGIC, sizeof(h.magic));
+        h.version = TRNG_TRACE_VERSION;
+        h.clk_hz = (uint32_t)clk_hz;
+        strncpy(h.label, label, TRNG_TRACE_LABEL - 1);
+        return put(reinterpret_cast<const uint8_t*>(&h), sizeof(h));
+    }
+
+    bool add(const TrngSample& s) {
+        uint8_t rec[30];
+        size_t n = varint(rec, s.trigger - _prev);
+        n += varint(rec + n, s.latency);
+        n += varint(rec + n, ((uint64_t)s.polls << 1) | s.timeout);
+        _prev = s.trigger;
+        _records++;
+        return put(rec, n);
+    }
+
+    bool finish() { return _out.finish(); }
+    uint64_t records() const { return _records; }
+    const CaptureStats& stats() const { return _out.stats(); }
+};
+
+class TrngTraceReader {
+private:
+    int            _fd = -1;
+    const uint8_t* _map = nullptr;
+    size_t         _len = 0;
+    size_t         _pos = 0;
+    uint64_t       _prev = 0;
+    TrngTraceHeader _hdr = {};
+
+    bool varint(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64 && _pos < _len; shift += 7) {
+            uint8_t b = _map[_pos++];
+            v |= (uint64_t)(b & 0x7F) << shift;
+            if (!(b & 0x80)) return true;
+        }
+        return false;
+    }
+
+public:
+    TrngTraceReader() = default;
+    TrngTraceReader(const TrngTraceReader&) = delete;
+    TrngTraceReader& operator=(const TrngTraceReader&) = delete;
+
+    ~TrngTraceReader() {
+        if (_map) munmap(const_cast<uint8_t*>(_map), _len);
+        if (_fd >= 0) ::close(_fd);
+    }
+
+    bool open(const char* path) {
+        _fd = ::open(path, O_RDONLY);
+        if (_fd < 0) { perror(path); return false; }
+        struct stat st;
+        if (fstat(_fd, &st) != 0) { perror("fstat"); return false; }
+        _len = (size_t)st.st_size;
+        if (_len < sizeof(TrngTraceHeader)) {
+            printf("%s: too short for a trace\n", path);
+            return false;
+        }
+        void* p = mmap(nullptr, _len, PROT_READ, MAP_PRIVATE, _fd, 0);
+        if (p == MAP_FAILED) { perror("mmap"); return false; }
+        _map = static_cast<const uint8_t*>(p);
+        madvise(p, _len, MADV_SEQUENTIAL);
+
+        memcpy(&_hdr, _map, sizeof(_hdr));
+        if (memcmp(_hdr.magic, TRNG_TRACE_MAGIC, sizeof(_hdr.magic)) != 0 || _hdr.version != TRNG_TRACE_VERSION) {
+            printf("%s: not a v%u TRNG trace\n", path, TRNG_TRACE_VERSION);
+            return false;
+        }
+        _hdr.label[TRNG_TRACE_LABEL - 1] = '\0';
+        _pos = sizeof(_hdr);
+        return true;
+    }
+
+    const char* label() const { return _hdr.label; }
+    double clkHz() const { return _hdr.clk_hz; }
+
+    // false at the end (a record cut short by a killed writer is dropped)
+    bool next(TrngSample& s) {
+        uint64_t delta, lat, polls;
+        if (!varint(delta) || !varint(lat) || !varint(polls)) return false;
+        _prev += delta;
+        s.trigger = _prev;
+        s.latency = (uint32_t)lat;
+        s.polls = (uint32_t)(polls >> 1);
+        s.timeout = polls & 1;
+        return true;
+    }
+};